@@ -137,6 +137,11 @@ cd src/server
 replace_makefile
 make $1 $2
 
+cd tests || exit
+replace_makefile
+make $1 $2
+cd ..
+
 cd ../client
 replace_makefile
 make $1 $2
@@ -0,0 +1,1069 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <poll.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/sockopt.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/sched_thread.h"
+#include "client_proto.h"
+#include "async_client.h"
+
+#define ASYNC_CLIENT_THREAD_STACK_SIZE  (256 * 1024)
+#define ASYNC_CLIENT_ERROR_INFO_SIZE     512
+
+typedef struct fs_async_client_chunk {
+    FSAsyncClientRequest *request;
+    int offset;   //the offset within the slice
+    int length;
+    struct fs_async_client_chunk *next;
+} FSAsyncClientChunk;
+
+typedef struct fs_async_client_chunk_queue {
+    FSAsyncClientChunk *head;
+    FSAsyncClientChunk *tail;
+    int count;
+} FSAsyncClientChunkQueue;
+
+typedef struct fs_async_client_connection {
+    ConnectionInfo conn;
+    int data_group_index;
+    bool is_master;
+    bool connecting;  //in the connector thread
+    int buffer_size;
+    time_t last_active_time;
+    FSAsyncClientChunkQueue waitings;   //not sent
+    FSAsyncClientChunkQueue inflights;  //sent and wait for the response
+
+    struct {
+        FSAsyncClientRequest *head;
+        FSAsyncClientRequest *tail;
+    } pendings;  //the requests wait for the connection
+
+    struct {
+        ConnectionInfo conn;  //written by the connector thread
+        int buffer_size;
+        int result;
+    } connect;
+    struct fs_async_client_connection *next;  //for the connector
+
+    struct {
+        FSAsyncClientChunk *chunk;  //the chunk in sending
+        char header[sizeof(FSProtoHeader) + sizeof(FSProtoBlockSlice)];
+        int header_len;
+        int offset;  //the sent bytes of the header and the data
+        int total;
+    } send;
+
+    struct {
+        char header[sizeof(FSProtoHeader)];
+        int header_offset;
+        int body_len;
+        int body_offset;
+        int status;
+        char *dest;
+
+        /* the update response or the error info */
+        char body[ASYNC_CLIENT_ERROR_INFO_SIZE];
+    } recv;
+} FSAsyncClientConnection;
+
+static inline void chunk_queue_push(FSAsyncClientChunkQueue *queue,
+        FSAsyncClientChunk *chunk)
+{
+    chunk->next = NULL;
+    if (queue->tail == NULL) {
+        queue->head = chunk;
+    } else {
+        queue->tail->next = chunk;
+    }
+    queue->tail = chunk;
+    queue->count++;
+}
+
+static inline FSAsyncClientChunk *chunk_queue_pop(
+        FSAsyncClientChunkQueue *queue)
+{
+    FSAsyncClientChunk *chunk;
+
+    if ((chunk=queue->head) != NULL) {
+        queue->head = chunk->next;
+        if (queue->head == NULL) {
+            queue->tail = NULL;
+        }
+        queue->count--;
+    }
+    return chunk;
+}
+
+static void complete_request(FSAsyncClientRequest *request)
+{
+    if (request->result == 0 && request->req_cmd ==
+            FS_SERVICE_PROTO_SLICE_READ_REQ && request->done_bytes == 0)
+    {
+        request->result = ENODATA;
+    }
+    request->callback(request);
+}
+
+static void finish_chunk(FSAsyncClientContext *async_ctx,
+        FSAsyncClientChunk *chunk, const int result)
+{
+    FSAsyncClientRequest *request;
+
+    request = chunk->request;
+    if (result != 0 && request->result == 0) {
+        request->result = result;
+    }
+    fast_mblock_free_object(&async_ctx->chunk_allocator, chunk);
+
+    if (--request->pending == 0) {
+        complete_request(request);
+    }
+}
+
+static void fail_chunk_queue(FSAsyncClientContext *async_ctx,
+        FSAsyncClientChunkQueue *queue, const int result)
+{
+    FSAsyncClientChunk *chunk;
+
+    while ((chunk=chunk_queue_pop(queue)) != NULL) {
+        finish_chunk(async_ctx, chunk, result);
+    }
+}
+
+static void close_connection(FSAsyncClientContext *async_ctx,
+        FSAsyncClientConnection *aconn, const int result)
+{
+    int count;
+
+    count = aconn->waitings.count + aconn->inflights.count +
+        (aconn->send.chunk != NULL ? 1 : 0);
+    if (count > 0) {
+        logError("file: "__FILE__", line: %d, "
+                "data group id: %d, server %s:%u, %d requests fail, "
+                "errno: %d, error info: %s", __LINE__,
+                aconn->data_group_index + 1, aconn->conn.ip_addr,
+                aconn->conn.port, count, result, STRERROR(result));
+    }
+
+    conn_pool_disconnect_server(&aconn->conn);
+    aconn->recv.header_offset = 0;
+    aconn->recv.body_offset = 0;
+    aconn->recv.body_len = 0;
+
+    fail_chunk_queue(async_ctx, &aconn->inflights, result);
+    if (aconn->send.chunk != NULL) {
+        finish_chunk(async_ctx, aconn->send.chunk, result);
+        aconn->send.chunk = NULL;
+    }
+    fail_chunk_queue(async_ctx, &aconn->waitings, result);
+}
+
+/* called by the connector thread, the blocking calls of the
+ * master query, connect and join are kept out of the event loop */
+static int make_connection(FSAsyncClientContext *async_ctx,
+        FSAsyncClientConnection *aconn)
+{
+    FSClientServerEntry server;
+    FSConnectionParameters conn_params;
+    ConnectionInfo *conn;
+    int result;
+
+    if (aconn->is_master) {
+        result = fs_client_proto_get_master(async_ctx->client_ctx,
+                aconn->data_group_index, &server);
+    } else {
+        result = fs_client_proto_get_readable_server(async_ctx->client_ctx,
+                aconn->data_group_index, &server);
+    }
+    if (result != 0) {
+        return result;
+    }
+
+    conn = &aconn->connect.conn;
+    conn_pool_set_server_info(conn, server.conn.ip_addr, server.conn.port);
+    if ((result=conn_pool_connect_server(conn, async_ctx->
+                    client_ctx->connect_timeout)) != 0)
+    {
+        return result;
+    }
+
+    /* the async connection does NOT use the idempotency channel */
+    memset(&conn_params, 0, sizeof(conn_params));
+    if ((result=fs_client_proto_join_server(async_ctx->client_ctx,
+                    conn, &conn_params)) != 0)
+    {
+        conn_pool_disconnect_server(conn);
+        return result;
+    }
+
+    if ((result=tcpsetnonblockopt(conn->sock)) != 0) {
+        conn_pool_disconnect_server(conn);
+        return result;
+    }
+
+    aconn->connect.buffer_size = conn_params.buffer_size;
+    return 0;
+}
+
+static inline void notify_event_loop(FSAsyncClientContext *async_ctx)
+{
+    if (write(async_ctx->pipe_fds[1], "", 1) < 0) {
+        /* EAGAIN means the event loop has been notified */
+    }
+}
+
+static void *async_connector_thread_func(void *arg)
+{
+    FSAsyncClientContext *async_ctx;
+    FSAsyncClientConnection *aconn;
+
+    async_ctx = (FSAsyncClientContext *)arg;
+    while (1) {
+        PTHREAD_MUTEX_LOCK(&async_ctx->connector.lc_pair.lock);
+        while ((aconn=async_ctx->connector.head) == NULL &&
+                async_ctx->connector.running)
+        {
+            pthread_cond_wait(&async_ctx->connector.lc_pair.cond,
+                    &async_ctx->connector.lc_pair.lock);
+        }
+        if (aconn != NULL) {
+            async_ctx->connector.head = aconn->next;
+            if (async_ctx->connector.head == NULL) {
+                async_ctx->connector.tail = NULL;
+            }
+        }
+        PTHREAD_MUTEX_UNLOCK(&async_ctx->connector.lc_pair.lock);
+
+        if (aconn == NULL) {  //stopped
+            break;
+        }
+
+        aconn->connect.result = make_connection(async_ctx, aconn);
+
+        /* hand the connection back to the event loop */
+        PTHREAD_MUTEX_LOCK(&async_ctx->queue.lock);
+        aconn->next = NULL;
+        if (async_ctx->connected.tail == NULL) {
+            async_ctx->connected.head = aconn;
+        } else {
+            async_ctx->connected.tail->next = aconn;
+        }
+        async_ctx->connected.tail = aconn;
+        PTHREAD_MUTEX_UNLOCK(&async_ctx->queue.lock);
+        notify_event_loop(async_ctx);
+    }
+
+    return NULL;
+}
+
+static void start_connect(FSAsyncClientContext *async_ctx,
+        FSAsyncClientConnection *aconn)
+{
+    aconn->connecting = true;
+    aconn->next = NULL;
+    PTHREAD_MUTEX_LOCK(&async_ctx->connector.lc_pair.lock);
+    if (async_ctx->connector.tail == NULL) {
+        async_ctx->connector.head = aconn;
+        pthread_cond_signal(&async_ctx->connector.lc_pair.cond);
+    } else {
+        async_ctx->connector.tail->next = aconn;
+    }
+    async_ctx->connector.tail = aconn;
+    PTHREAD_MUTEX_UNLOCK(&async_ctx->connector.lc_pair.lock);
+}
+
+static int split_request(FSAsyncClientContext *async_ctx,
+        FSAsyncClientConnection *aconn, FSAsyncClientRequest *request)
+{
+    FSAsyncClientChunk *chunk;
+    int chunk_size;
+    int offset;
+    int remain;
+
+    if (request->req_cmd == FS_SERVICE_PROTO_SLICE_WRITE_REQ ||
+            request->req_cmd == FS_SERVICE_PROTO_SLICE_READ_REQ)
+    {
+        chunk_size = aconn->buffer_size;
+    } else {
+        chunk_size = request->bs_key.slice.length;
+    }
+    if (chunk_size <= 0) {
+        chunk_size = 1;
+    }
+
+    offset = 0;
+    if (request->req_cmd == FS_SERVICE_PROTO_BLOCK_DELETE_REQ) {
+        remain = 0;
+    } else {
+        remain = request->bs_key.slice.length;
+    }
+    do {
+        chunk = (FSAsyncClientChunk *)fast_mblock_alloc_object(
+                &async_ctx->chunk_allocator);
+        if (chunk == NULL) {
+            return ENOMEM;
+        }
+
+        chunk->request = request;
+        chunk->offset = offset;
+        chunk->length = (remain < chunk_size) ? remain : chunk_size;
+        request->pending++;
+        chunk_queue_push(&aconn->waitings, chunk);
+
+        offset += chunk->length;
+        remain -= chunk->length;
+    } while (remain > 0);
+
+    return 0;
+}
+
+static void queue_request(FSAsyncClientContext *async_ctx,
+        FSAsyncClientConnection *aconn, FSAsyncClientRequest *request)
+{
+    int result;
+
+    /* hold the request until all chunks are queued */
+    request->pending = 1;
+    if ((result=split_request(async_ctx, aconn, request)) != 0) {
+        request->result = result;
+    }
+    if (--request->pending == 0) {
+        complete_request(request);
+    }
+}
+
+static inline void pending_push(FSAsyncClientConnection *aconn,
+        FSAsyncClientRequest *request)
+{
+    request->next = NULL;
+    if (aconn->pendings.tail == NULL) {
+        aconn->pendings.head = request;
+    } else {
+        aconn->pendings.tail->next = request;
+    }
+    aconn->pendings.tail = request;
+}
+
+/* queue or fail the requests which wait for the connection */
+static void deal_pendings(FSAsyncClientContext *async_ctx,
+        FSAsyncClientConnection *aconn, const int result)
+{
+    FSAsyncClientRequest *head;
+    FSAsyncClientRequest *request;
+
+    head = aconn->pendings.head;
+    aconn->pendings.head = aconn->pendings.tail = NULL;
+    while (head != NULL) {
+        request = head;
+        head = head->next;
+        if (result == 0) {
+            queue_request(async_ctx, aconn, request);
+        } else {
+            request->result = result;
+            complete_request(request);
+        }
+    }
+}
+
+static void dispatch_request(FSAsyncClientContext *async_ctx,
+        FSAsyncClientRequest *request)
+{
+    FSAsyncClientConnection *aconn;
+    int data_group_index;
+
+    data_group_index = FS_CLIENT_DATA_GROUP_INDEX(async_ctx->client_ctx,
+            request->bs_key.block.hash_code);
+    if (request->req_cmd == FS_SERVICE_PROTO_SLICE_READ_REQ) {
+        aconn = async_ctx->connections.readers + data_group_index;
+    } else {
+        aconn = async_ctx->connections.masters + data_group_index;
+    }
+
+    if (aconn->connecting) {
+        pending_push(aconn, request);
+    } else if (aconn->conn.sock < 0) {
+        pending_push(aconn, request);
+        start_connect(async_ctx, aconn);
+    } else {
+        queue_request(async_ctx, aconn, request);
+    }
+}
+
+static void deal_connected(FSAsyncClientContext *async_ctx)
+{
+    FSAsyncClientConnection *head;
+    FSAsyncClientConnection *aconn;
+    int result;
+
+    PTHREAD_MUTEX_LOCK(&async_ctx->queue.lock);
+    head = async_ctx->connected.head;
+    async_ctx->connected.head = async_ctx->connected.tail = NULL;
+    PTHREAD_MUTEX_UNLOCK(&async_ctx->queue.lock);
+
+    while (head != NULL) {
+        aconn = head;
+        head = head->next;
+
+        aconn->connecting = false;
+        if ((result=aconn->connect.result) == 0) {
+            aconn->conn = aconn->connect.conn;
+            aconn->buffer_size = aconn->connect.buffer_size;
+            aconn->last_active_time = get_current_time();
+        } else {
+            logError("file: "__FILE__", line: %d, "
+                    "data group id: %d, make connection fail, "
+                    "errno: %d, error info: %s", __LINE__,
+                    aconn->data_group_index + 1, result, STRERROR(result));
+        }
+        deal_pendings(async_ctx, aconn, result);
+    }
+}
+
+static void pack_request(FSAsyncClientConnection *aconn,
+        FSAsyncClientChunk *chunk)
+{
+    FSAsyncClientRequest *request;
+    FSProtoHeader *proto_header;
+    FSProtoBlockSlice *proto_bs;
+    FSProtoBlockDeleteReq *dreq;
+    int body_len;
+    int data_len;
+
+    request = chunk->request;
+    proto_header = (FSProtoHeader *)aconn->send.header;
+    data_len = 0;
+    if (request->req_cmd == FS_SERVICE_PROTO_BLOCK_DELETE_REQ) {
+        dreq = (FSProtoBlockDeleteReq *)(proto_header + 1);
+        long2buff(request->bs_key.block.oid, dreq->bkey.oid);
+        long2buff(request->bs_key.block.offset, dreq->bkey.offset);
+        body_len = sizeof(FSProtoBlockDeleteReq);
+    } else {
+        /* the requests of slice write, read, allocate and delete
+         * start with the block slice */
+        proto_bs = (FSProtoBlockSlice *)(proto_header + 1);
+        long2buff(request->bs_key.block.oid, proto_bs->bkey.oid);
+        long2buff(request->bs_key.block.offset, proto_bs->bkey.offset);
+        int2buff(request->bs_key.slice.offset + chunk->offset,
+                proto_bs->slice_size.offset);
+        int2buff(chunk->length, proto_bs->slice_size.length);
+        body_len = sizeof(FSProtoBlockSlice);
+        if (request->req_cmd == FS_SERVICE_PROTO_SLICE_WRITE_REQ) {
+            data_len = chunk->length;
+        }
+    }
+
+    SF_PROTO_SET_HEADER(proto_header, request->req_cmd, body_len + data_len);
+    aconn->send.header_len = sizeof(FSProtoHeader) + body_len;
+    aconn->send.total = aconn->send.header_len + data_len;
+    aconn->send.offset = 0;
+}
+
+static inline bool can_send(FSAsyncClientContext *async_ctx,
+        FSAsyncClientConnection *aconn)
+{
+    return (aconn->send.chunk != NULL) || (aconn->waitings.head != NULL &&
+            aconn->inflights.count < async_ctx->max_inflight);
+}
+
+static int deal_send(FSAsyncClientContext *async_ctx,
+        FSAsyncClientConnection *aconn)
+{
+    FSAsyncClientChunk *chunk;
+    struct iovec iov[2];
+    struct msghdr msg;
+    const char *data;
+    ssize_t bytes;
+
+    while (can_send(async_ctx, aconn)) {
+        if (aconn->send.chunk == NULL) {
+            aconn->send.chunk = chunk_queue_pop(&aconn->waitings);
+            pack_request(aconn, aconn->send.chunk);
+        }
+
+        chunk = aconn->send.chunk;
+        data = chunk->request->data + chunk->offset;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        if (aconn->send.offset < aconn->send.header_len) {
+            iov[0].iov_base = aconn->send.header + aconn->send.offset;
+            iov[0].iov_len = aconn->send.header_len - aconn->send.offset;
+            iov[1].iov_base = (char *)data;
+            iov[1].iov_len = aconn->send.total - aconn->send.header_len;
+            msg.msg_iovlen = (iov[1].iov_len > 0) ? 2 : 1;
+        } else {
+            iov[0].iov_base = (char *)data + (aconn->send.offset -
+                    aconn->send.header_len);
+            iov[0].iov_len = aconn->send.total - aconn->send.offset;
+            msg.msg_iovlen = 1;
+        }
+
+        bytes = sendmsg(aconn->conn.sock, &msg, MSG_NOSIGNAL);
+        if (bytes < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            } else if (errno == EINTR) {
+                continue;
+            }
+            return errno != 0 ? errno : EIO;
+        }
+
+        aconn->send.offset += bytes;
+        if (aconn->inflights.count == 0) {
+            aconn->last_active_time = get_current_time();
+        }
+        if (aconn->send.offset == aconn->send.total) {
+            chunk_queue_push(&aconn->inflights, chunk);
+            aconn->send.chunk = NULL;
+        }
+    }
+
+    return 0;
+}
+
+static int check_response_header(FSAsyncClientConnection *aconn)
+{
+    FSProtoHeader *proto_header;
+    FSAsyncClientChunk *chunk;
+    FSAsyncClientRequest *request;
+    int cmd;
+
+    if ((chunk=aconn->inflights.head) == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "server %s:%u, unexpected response without request",
+                __LINE__, aconn->conn.ip_addr, aconn->conn.port);
+        return EINVAL;
+    }
+
+    request = chunk->request;
+    proto_header = (FSProtoHeader *)aconn->recv.header;
+    aconn->recv.body_len = buff2int(proto_header->body_len);
+    aconn->recv.status = buff2short(proto_header->status);
+    aconn->recv.body_offset = 0;
+    cmd = proto_header->cmd;
+
+    if (aconn->recv.status != 0) {
+        if (aconn->recv.body_len < 0 || aconn->recv.body_len >=
+                sizeof(aconn->recv.body))
+        {
+            logError("file: "__FILE__", line: %d, "
+                    "server %s:%u, request id: %"PRId64", invalid error "
+                    "info length: %d", __LINE__, aconn->conn.ip_addr,
+                    aconn->conn.port, request->req_id, aconn->recv.body_len);
+            return EINVAL;
+        }
+        aconn->recv.dest = aconn->recv.body;
+        return 0;
+    }
+
+    if (cmd != request->resp_cmd) {
+        logError("file: "__FILE__", line: %d, "
+                "server %s:%u, request id: %"PRId64", response cmd: %d "
+                "!= expected: %d", __LINE__, aconn->conn.ip_addr,
+                aconn->conn.port, request->req_id, cmd, request->resp_cmd);
+        return EINVAL;
+    }
+
+    if (request->req_cmd == FS_SERVICE_PROTO_SLICE_READ_REQ) {
+        if (aconn->recv.body_len < 0 || aconn->recv.body_len >
+                chunk->length)
+        {
+            logError("file: "__FILE__", line: %d, "
+                    "server %s:%u, request id: %"PRId64", response body "
+                    "length: %d > slice length: %d", __LINE__,
+                    aconn->conn.ip_addr, aconn->conn.port, request->req_id,
+                    aconn->recv.body_len, chunk->length);
+            return EINVAL;
+        }
+        aconn->recv.dest = request->buff + chunk->offset;
+    } else {
+        if (aconn->recv.body_len != sizeof(FSProtoSliceUpdateResp)) {
+            logError("file: "__FILE__", line: %d, "
+                    "server %s:%u, request id: %"PRId64", response body "
+                    "length: %d != %d", __LINE__, aconn->conn.ip_addr,
+                    aconn->conn.port, request->req_id, aconn->recv.body_len,
+                    (int)sizeof(FSProtoSliceUpdateResp));
+            return EINVAL;
+        }
+        aconn->recv.dest = aconn->recv.body;
+    }
+
+    return 0;
+}
+
+static void deal_response(FSAsyncClientContext *async_ctx,
+        FSAsyncClientConnection *aconn)
+{
+    FSAsyncClientChunk *chunk;
+    FSAsyncClientRequest *request;
+    int result;
+    int end;
+
+    chunk = chunk_queue_pop(&aconn->inflights);
+    request = chunk->request;
+    result = aconn->recv.status;
+    if (result == 0) {
+        if (request->req_cmd == FS_SERVICE_PROTO_SLICE_READ_REQ) {
+            if (aconn->recv.body_len < chunk->length) {  //fill the hole
+                memset(request->buff + chunk->offset + aconn->recv.body_len,
+                        0, chunk->length - aconn->recv.body_len);
+            }
+            end = chunk->offset + aconn->recv.body_len;
+            if (aconn->recv.body_len > 0 && end > request->done_bytes) {
+                request->done_bytes = end;
+            }
+        } else {
+            request->inc_alloc += buff2int(((FSProtoSliceUpdateResp *)
+                        aconn->recv.body)->inc_alloc);
+            if (request->req_cmd == FS_SERVICE_PROTO_SLICE_WRITE_REQ) {
+                request->done_bytes += chunk->length;
+            }
+        }
+    } else if (result == ENOENT && request->req_cmd ==
+            FS_SERVICE_PROTO_SLICE_READ_REQ)
+    {
+        memset(request->buff + chunk->offset, 0, chunk->length);
+        result = 0;
+    } else if (result != ENOENT) {
+        aconn->recv.body[aconn->recv.body_len] = '\0';
+        logError("file: "__FILE__", line: %d, "
+                "server %s:%u, request id: %"PRId64", cmd: %d, "
+                "response status: %d, error info: %s", __LINE__,
+                aconn->conn.ip_addr, aconn->conn.port, request->req_id,
+                request->req_cmd, result, aconn->recv.body);
+    }
+
+    aconn->recv.header_offset = 0;
+    aconn->last_active_time = get_current_time();
+    finish_chunk(async_ctx, chunk, result);
+}
+
+static int deal_recv(FSAsyncClientContext *async_ctx,
+        FSAsyncClientConnection *aconn)
+{
+    ssize_t bytes;
+    int result;
+
+    while (1) {
+        if (aconn->recv.header_offset < sizeof(FSProtoHeader)) {
+            bytes = recv(aconn->conn.sock, aconn->recv.header +
+                    aconn->recv.header_offset, sizeof(FSProtoHeader) -
+                    aconn->recv.header_offset, 0);
+        } else {
+            bytes = recv(aconn->conn.sock, aconn->recv.dest +
+                    aconn->recv.body_offset, aconn->recv.body_len -
+                    aconn->recv.body_offset, 0);
+        }
+
+        if (bytes == 0) {
+            return ECONNRESET;
+        } else if (bytes < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            } else if (errno == EINTR) {
+                continue;
+            }
+            return errno != 0 ? errno : EIO;
+        }
+
+        if (aconn->recv.header_offset < sizeof(FSProtoHeader)) {
+            aconn->recv.header_offset += bytes;
+            if (aconn->recv.header_offset < sizeof(FSProtoHeader)) {
+                continue;
+            }
+            if ((result=check_response_header(aconn)) != 0) {
+                return result;
+            }
+        } else {
+            aconn->recv.body_offset += bytes;
+        }
+
+        if (aconn->recv.body_offset == aconn->recv.body_len) {
+            deal_response(async_ctx, aconn);
+
+            /* the requests in the window can be sent now */
+            if ((result=deal_send(async_ctx, aconn)) != 0) {
+                return result;
+            }
+        }
+    }
+}
+
+static void deal_submitted_requests(FSAsyncClientContext *async_ctx)
+{
+    char buff[256];
+    FSAsyncClientRequest *head;
+    FSAsyncClientRequest *request;
+
+    while (read(async_ctx->pipe_fds[0], buff, sizeof(buff)) > 0) {
+    }
+
+    /* the requests wait for the connection are earlier */
+    deal_connected(async_ctx);
+
+    PTHREAD_MUTEX_LOCK(&async_ctx->queue.lock);
+    head = async_ctx->queue.head;
+    async_ctx->queue.head = async_ctx->queue.tail = NULL;
+    PTHREAD_MUTEX_UNLOCK(&async_ctx->queue.lock);
+
+    while (head != NULL) {
+        request = head;
+        head = head->next;
+        dispatch_request(async_ctx, request);
+    }
+}
+
+static int build_poll_fds(FSAsyncClientContext *async_ctx)
+{
+    FSAsyncClientConnection *aconn;
+    FSAsyncClientConnection *end;
+    struct pollfd *pfd;
+    int count;
+
+    pfd = async_ctx->poll.fds;
+    pfd->fd = async_ctx->pipe_fds[0];
+    pfd->events = POLLIN;
+    pfd->revents = 0;
+    count = 1;
+
+    end = async_ctx->connections.masters + 2 * async_ctx->connections.count;
+    for (aconn=async_ctx->connections.masters; aconn<end; aconn++) {
+        if (aconn->conn.sock < 0) {
+            continue;
+        }
+
+        pfd = async_ctx->poll.fds + count;
+        pfd->fd = aconn->conn.sock;
+        pfd->events = POLLIN;
+        if (can_send(async_ctx, aconn)) {
+            pfd->events |= POLLOUT;
+        }
+        pfd->revents = 0;
+        async_ctx->poll.conns[count++] = aconn;
+    }
+
+    return count;
+}
+
+static void check_timeouts(FSAsyncClientContext *async_ctx)
+{
+    FSAsyncClientConnection *aconn;
+    FSAsyncClientConnection *end;
+    time_t current_time;
+
+    current_time = get_current_time();
+    end = async_ctx->connections.masters + 2 * async_ctx->connections.count;
+    for (aconn=async_ctx->connections.masters; aconn<end; aconn++) {
+        if (aconn->conn.sock >= 0 && (aconn->inflights.count > 0 ||
+                    aconn->send.chunk != NULL) && current_time -
+                aconn->last_active_time > async_ctx->client_ctx->
+                network_timeout)
+        {
+            close_connection(async_ctx, aconn, ETIMEDOUT);
+        }
+    }
+}
+
+static void *async_client_thread_func(void *arg)
+{
+    FSAsyncClientContext *async_ctx;
+    FSAsyncClientConnection *aconn;
+    FSAsyncClientConnection *end;
+    struct pollfd *pfd;
+    int count;
+    int result;
+    int i;
+
+    async_ctx = (FSAsyncClientContext *)arg;
+    while (async_ctx->running) {
+        count = build_poll_fds(async_ctx);
+        if (poll(async_ctx->poll.fds, count, 1000) < 0) {
+            if (errno != EINTR) {
+                logError("file: "__FILE__", line: %d, "
+                        "poll fail, errno: %d, error info: %s",
+                        __LINE__, errno, STRERROR(errno));
+                sleep(1);
+            }
+            continue;
+        }
+
+        for (i=1; i<count; i++) {
+            pfd = async_ctx->poll.fds + i;
+            aconn = async_ctx->poll.conns[i];
+            if (pfd->revents == 0 || aconn->conn.sock != pfd->fd) {
+                continue;
+            }
+
+            result = 0;
+            if ((pfd->revents & POLLOUT) != 0) {
+                result = deal_send(async_ctx, aconn);
+            }
+            if (result == 0 && (pfd->revents & (POLLIN |
+                            POLLERR | POLLHUP)) != 0)
+            {
+                result = deal_recv(async_ctx, aconn);
+            }
+            if (result == 0 && (pfd->revents & POLLNVAL) != 0) {
+                result = EBADF;
+            }
+            if (result != 0) {
+                close_connection(async_ctx, aconn, result);
+            }
+        }
+
+        if ((async_ctx->poll.fds->revents & POLLIN) != 0) {
+            deal_submitted_requests(async_ctx);
+
+            /* send the new requests without waiting for POLLOUT */
+            end = async_ctx->connections.masters +
+                2 * async_ctx->connections.count;
+            for (aconn=async_ctx->connections.masters; aconn<end; aconn++) {
+                if (aconn->conn.sock >= 0 && aconn->send.chunk == NULL &&
+                        can_send(async_ctx, aconn))
+                {
+                    if ((result=deal_send(async_ctx, aconn)) != 0) {
+                        close_connection(async_ctx, aconn, result);
+                    }
+                }
+            }
+        }
+
+        check_timeouts(async_ctx);
+    }
+
+    /* cancel the requests not done, the connector thread is stopped */
+    deal_submitted_requests(async_ctx);
+    end = async_ctx->connections.masters + 2 * async_ctx->connections.count;
+    for (aconn=async_ctx->connections.masters; aconn<end; aconn++) {
+        if (aconn->connecting) {
+            aconn->connecting = false;
+            deal_pendings(async_ctx, aconn, ECANCELED);
+        } else if (aconn->conn.sock >= 0) {
+            close_connection(async_ctx, aconn, ECANCELED);
+        }
+    }
+
+    return NULL;
+}
+
+static int set_nonblock(const int fd)
+{
+    int flags;
+
+    if ((flags=fcntl(fd, F_GETFL, 0)) < 0 ||
+            fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        return errno != 0 ? errno : EIO;
+    }
+    return 0;
+}
+
+int fs_async_client_init_ex(FSAsyncClientContext *async_ctx,
+        FSClientContext *client_ctx, const int max_inflight)
+{
+    FSAsyncClientConnection *aconn;
+    FSAsyncClientConnection *end;
+    int count;
+    int bytes;
+    int result;
+
+    memset(async_ctx, 0, sizeof(FSAsyncClientContext));
+    async_ctx->client_ctx = client_ctx;
+    async_ctx->max_inflight = (max_inflight > 0) ? max_inflight :
+        FS_ASYNC_CLIENT_DEFAULT_MAX_INFLIGHT;
+    async_ctx->pipe_fds[0] = async_ctx->pipe_fds[1] = -1;
+
+    if ((result=init_pthread_lock(&async_ctx->queue.lock)) != 0) {
+        return result;
+    }
+    if ((result=init_pthread_lock_cond_pair(&async_ctx->
+                    connector.lc_pair)) != 0)
+    {
+        pthread_mutex_destroy(&async_ctx->queue.lock);
+        return result;
+    }
+    if ((result=fast_mblock_init_ex1(&async_ctx->chunk_allocator,
+                    "async_chunk", sizeof(FSAsyncClientChunk),
+                    4 * 1024, 0, NULL, NULL, false)) != 0)
+    {
+        destroy_pthread_lock_cond_pair(&async_ctx->connector.lc_pair);
+        pthread_mutex_destroy(&async_ctx->queue.lock);
+        return result;
+    }
+
+    /* the resources from here are released by the destroy */
+    count = FS_DATA_GROUP_COUNT(*client_ctx->cluster_cfg.ptr);
+    bytes = sizeof(FSAsyncClientConnection) * 2 * count;
+    async_ctx->connections.masters = (FSAsyncClientConnection *)
+        fc_malloc(bytes);
+    if (async_ctx->connections.masters == NULL) {
+        fs_async_client_destroy(async_ctx);
+        return ENOMEM;
+    }
+    memset(async_ctx->connections.masters, 0, bytes);
+    async_ctx->connections.readers = async_ctx->connections.masters + count;
+    async_ctx->connections.count = count;
+
+    end = async_ctx->connections.masters + 2 * count;
+    for (aconn=async_ctx->connections.masters; aconn<end; aconn++) {
+        aconn->conn.sock = -1;
+        aconn->connect.conn.sock = -1;
+        aconn->is_master = (aconn < async_ctx->connections.readers);
+        aconn->data_group_index = (aconn - async_ctx->
+                connections.masters) % count;
+    }
+
+    bytes = (sizeof(struct pollfd) + sizeof(FSAsyncClientConnection *)) *
+        (2 * count + 1);
+    async_ctx->poll.fds = (struct pollfd *)fc_malloc(bytes);
+    if (async_ctx->poll.fds == NULL) {
+        fs_async_client_destroy(async_ctx);
+        return ENOMEM;
+    }
+    async_ctx->poll.conns = (FSAsyncClientConnection **)
+        (async_ctx->poll.fds + 2 * count + 1);
+
+    if (pipe(async_ctx->pipe_fds) != 0) {
+        result = errno != 0 ? errno : EMFILE;
+        logError("file: "__FILE__", line: %d, "
+                "create pipe fail, errno: %d, error info: %s",
+                __LINE__, result, STRERROR(result));
+        async_ctx->pipe_fds[0] = async_ctx->pipe_fds[1] = -1;
+        fs_async_client_destroy(async_ctx);
+        return result;
+    }
+    if ((result=set_nonblock(async_ctx->pipe_fds[0])) != 0 ||
+            (result=set_nonblock(async_ctx->pipe_fds[1])) != 0)
+    {
+        fs_async_client_destroy(async_ctx);
+        return result;
+    }
+
+    async_ctx->connector.running = true;
+    if ((result=fc_create_thread(&async_ctx->connector.tid,
+                    async_connector_thread_func, async_ctx,
+                    ASYNC_CLIENT_THREAD_STACK_SIZE)) != 0)
+    {
+        async_ctx->connector.running = false;
+        fs_async_client_destroy(async_ctx);
+        return result;
+    }
+
+    async_ctx->running = true;
+    if ((result=fc_create_thread(&async_ctx->tid, async_client_thread_func,
+                    async_ctx, ASYNC_CLIENT_THREAD_STACK_SIZE)) != 0)
+    {
+        async_ctx->running = false;
+        fs_async_client_destroy(async_ctx);
+        return result;
+    }
+    return 0;
+}
+
+void fs_async_client_destroy(FSAsyncClientContext *async_ctx)
+{
+    /* stop the connector first, the event loop takes its last
+     * connections and cancels the requests which wait for connecting */
+    if (async_ctx->connector.running) {
+        PTHREAD_MUTEX_LOCK(&async_ctx->connector.lc_pair.lock);
+        async_ctx->connector.running = false;
+        pthread_cond_signal(&async_ctx->connector.lc_pair.cond);
+        PTHREAD_MUTEX_UNLOCK(&async_ctx->connector.lc_pair.lock);
+        pthread_join(async_ctx->connector.tid, NULL);
+    }
+
+    if (async_ctx->running) {
+        PTHREAD_MUTEX_LOCK(&async_ctx->queue.lock);
+        async_ctx->running = false;
+        PTHREAD_MUTEX_UNLOCK(&async_ctx->queue.lock);
+        notify_event_loop(async_ctx);
+        pthread_join(async_ctx->tid, NULL);
+    }
+
+    if (async_ctx->pipe_fds[0] >= 0) {
+        close(async_ctx->pipe_fds[0]);
+        close(async_ctx->pipe_fds[1]);
+        async_ctx->pipe_fds[0] = async_ctx->pipe_fds[1] = -1;
+    }
+    destroy_pthread_lock_cond_pair(&async_ctx->connector.lc_pair);
+    pthread_mutex_destroy(&async_ctx->queue.lock);
+    fast_mblock_destroy(&async_ctx->chunk_allocator);
+    if (async_ctx->poll.fds != NULL) {
+        free(async_ctx->poll.fds);
+        async_ctx->poll.fds = NULL;
+    }
+    if (async_ctx->connections.masters != NULL) {
+        free(async_ctx->connections.masters);
+        async_ctx->connections.masters = NULL;
+    }
+}
+
+int fs_async_client_submit(FSAsyncClientContext *async_ctx,
+        const int req_cmd, const int resp_cmd,
+        FSAsyncClientRequest *request)
+{
+    bool notify;
+
+    if (request->callback == NULL || (req_cmd ==
+                FS_SERVICE_PROTO_SLICE_WRITE_REQ && request->data == NULL) ||
+            (req_cmd == FS_SERVICE_PROTO_SLICE_READ_REQ &&
+             request->buff == NULL))
+    {
+        return EINVAL;
+    }
+    if (req_cmd != FS_SERVICE_PROTO_BLOCK_DELETE_REQ &&
+            request->bs_key.slice.length <= 0)
+    {
+        return EINVAL;
+    }
+
+    request->req_cmd = req_cmd;
+    request->resp_cmd = resp_cmd;
+    request->result = 0;
+    request->done_bytes = 0;
+    request->inc_alloc = 0;
+    request->pending = 0;
+    request->next = NULL;
+
+    PTHREAD_MUTEX_LOCK(&async_ctx->queue.lock);
+    if (async_ctx->running) {
+        request->req_id = ++async_ctx->current_req_id;
+        notify = (async_ctx->queue.head == NULL);
+        if (async_ctx->queue.tail == NULL) {
+            async_ctx->queue.head = request;
+        } else {
+            async_ctx->queue.tail->next = request;
+        }
+        async_ctx->queue.tail = request;
+    } else {
+        notify = false;
+        request->req_id = 0;
+    }
+    PTHREAD_MUTEX_UNLOCK(&async_ctx->queue.lock);
+
+    if (request->req_id == 0) {
+        return ECANCELED;
+    }
+    if (notify) {
+        notify_event_loop(async_ctx);
+    }
+    return 0;
+}
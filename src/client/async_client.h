@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//async_client.h
+
+/* the asynchronous client of the slice operations.
+ *
+ * the submitted requests are sent by the event loop thread over its own
+ * non-blocking connections, one to the master of each data group for
+ * the updates and one to a readable server for the reads. many requests
+ * are in flight per connection. the server handles the requests of
+ * a connection in order, so the response is matched with the earliest
+ * request in flight of the connection.
+ *
+ * the master query, connect and join of a connection are done by the
+ * connector thread, the requests wait for the connection meanwhile.
+ *
+ * the callback is called in the event loop thread, it should NOT block.
+ * the request is NOT retried on network error.
+ */
+
+#ifndef _FS_ASYNC_CLIENT_H
+#define _FS_ASYNC_CLIENT_H
+
+#include <pthread.h>
+#include "fastcommon/fast_mblock.h"
+#include "fs_proto.h"
+#include "client_types.h"
+
+#define FS_ASYNC_CLIENT_DEFAULT_MAX_INFLIGHT  64
+
+struct fs_async_client_request;
+struct fs_async_client_connection;
+struct pollfd;
+
+typedef void (*fs_async_client_callback)(
+        struct fs_async_client_request *request);
+
+typedef struct fs_async_client_request {
+    /* input, the hash code of the block key is required */
+    FSBlockSliceKeyInfo bs_key;
+    const char *data;   //the data to write
+    char *buff;         //the buffer to read
+    fs_async_client_callback callback;
+    void *arg;          //for the caller
+
+    /* output */
+    int result;         //0 for success, != 0 for errno
+    int done_bytes;     //the written or read bytes
+    int inc_alloc;      //increase or decrease alloc space in bytes
+
+    /* internal */
+    uint64_t req_id;
+    int req_cmd;
+    int resp_cmd;
+    int pending;        //the chunks not done
+    struct fs_async_client_request *next;
+} FSAsyncClientRequest;
+
+typedef struct fs_async_client_context {
+    FSClientContext *client_ctx;
+    int max_inflight;   //the max requests in flight per connection
+    volatile bool running;
+    pthread_t tid;
+    int pipe_fds[2];    //for notify the event loop
+    uint64_t current_req_id;
+
+    struct {
+        FSAsyncClientRequest *head;
+        FSAsyncClientRequest *tail;
+        pthread_mutex_t lock;  //also for the connected list
+    } queue;  //the submitted requests
+
+    struct {
+        struct fs_async_client_connection *head;
+        struct fs_async_client_connection *tail;
+    } connected;  //handed back by the connector thread
+
+    struct {
+        struct fs_async_client_connection *head;
+        struct fs_async_client_connection *tail;
+        pthread_lock_cond_pair_t lc_pair;
+        volatile bool running;
+        pthread_t tid;
+    } connector;  //for the blocking connect
+
+    struct {
+        struct fs_async_client_connection *masters;  //for update
+        struct fs_async_client_connection *readers;  //for read
+        int count;   //the data group count
+    } connections;
+
+    struct {
+        struct pollfd *fds;
+        struct fs_async_client_connection **conns;
+    } poll;
+
+    struct fast_mblock_man chunk_allocator;
+} FSAsyncClientContext;
+
+#define fs_async_client_init(async_ctx, client_ctx) \
+    fs_async_client_init_ex(async_ctx, client_ctx,  \
+            FS_ASYNC_CLIENT_DEFAULT_MAX_INFLIGHT)
+
+#define fs_async_client_slice_write(async_ctx, request) \
+    fs_async_client_submit(async_ctx, FS_SERVICE_PROTO_SLICE_WRITE_REQ, \
+            FS_SERVICE_PROTO_SLICE_WRITE_RESP, request)
+
+#define fs_async_client_slice_read(async_ctx, request) \
+    fs_async_client_submit(async_ctx, FS_SERVICE_PROTO_SLICE_READ_REQ, \
+            FS_SERVICE_PROTO_SLICE_READ_RESP, request)
+
+#define fs_async_client_slice_allocate(async_ctx, request) \
+    fs_async_client_submit(async_ctx, FS_SERVICE_PROTO_SLICE_ALLOCATE_REQ, \
+            FS_SERVICE_PROTO_SLICE_ALLOCATE_RESP, request)
+
+#define fs_async_client_slice_delete(async_ctx, request) \
+    fs_async_client_submit(async_ctx, FS_SERVICE_PROTO_SLICE_DELETE_REQ, \
+            FS_SERVICE_PROTO_SLICE_DELETE_RESP, request)
+
+#define fs_async_client_block_delete(async_ctx, request) \
+    fs_async_client_submit(async_ctx, FS_SERVICE_PROTO_BLOCK_DELETE_REQ, \
+            FS_SERVICE_PROTO_BLOCK_DELETE_RESP, request)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    int fs_async_client_init_ex(FSAsyncClientContext *async_ctx,
+            FSClientContext *client_ctx, const int max_inflight);
+
+    /* stop the event loop thread, the requests not done
+     * are called back with errno ECANCELED */
+    void fs_async_client_destroy(FSAsyncClientContext *async_ctx);
+
+    /* submit the request to the event loop thread, the request
+     * should be kept until called back */
+    int fs_async_client_submit(FSAsyncClientContext *async_ctx,
+            const int req_cmd, const int resp_cmd,
+            FSAsyncClientRequest *request);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
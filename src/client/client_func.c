@@ -22,12 +22,16 @@
 #include "fs_cluster_cfg.h"
 #include "client_global.h"
 #include "simple_connection_manager.h"
+#include "pooled_connection_manager.h"
+#include "server_selector.h"
+#include "hedged_read.h"
 #include "client_func.h"
 
 static int fs_client_do_init_ex(FSClientContext *client_ctx,
         IniFullContext *ini_ctx)
 {
     char *pBasePath;
+    char *read_policy;
     int result;
 
     pBasePath = iniGetStrValue(NULL, "base_path", ini_ctx->context);
@@ -67,8 +71,69 @@ static int fs_client_do_init_ex(FSClientContext *client_ctx,
         client_ctx->network_timeout = DEFAULT_NETWORK_TIMEOUT;
     }
 
+    client_ctx->pipeline_window = iniGetIntValueEx(
+            ini_ctx->section_name, "pipeline_window",
+            ini_ctx->context, FS_CLIENT_DEFAULT_PIPELINE_WINDOW, true);
+    if (client_ctx->pipeline_window <= 0) {
+        client_ctx->pipeline_window = 1;
+    } else if (client_ctx->pipeline_window > FS_CLIENT_MAX_PIPELINE_WINDOW) {
+        client_ctx->pipeline_window = FS_CLIENT_MAX_PIPELINE_WINDOW;
+    }
+
+    client_ctx->conn_pool.connections_per_server = iniGetIntValueEx(
+            ini_ctx->section_name, "connections_per_server",
+            ini_ctx->context, 0, true);
+    if (client_ctx->conn_pool.connections_per_server < 0) {
+        client_ctx->conn_pool.connections_per_server = 0;
+    }
+
+    client_ctx->conn_pool.check_interval = iniGetIntValueEx(
+            ini_ctx->section_name, "connection_check_interval",
+            ini_ctx->context, FS_CLIENT_DEFAULT_CONNECTION_CHECK_INTERVAL,
+            true);
+    if (client_ctx->conn_pool.check_interval <= 0) {
+        client_ctx->conn_pool.check_interval =
+            FS_CLIENT_DEFAULT_CONNECTION_CHECK_INTERVAL;
+    }
+
     sf_load_read_rule_config(&client_ctx->read_rule, ini_ctx);
 
+    read_policy = iniGetStrValue(ini_ctx->section_name,
+            "read_policy", ini_ctx->context);
+    if (read_policy == NULL || *read_policy == '\0' ||
+            strcasecmp(read_policy, "random") == 0)
+    {
+        client_ctx->read_policy = FS_CLIENT_READ_POLICY_RANDOM;
+    } else if (strcasecmp(read_policy, "latency") == 0) {
+        client_ctx->read_policy = FS_CLIENT_READ_POLICY_LATENCY;
+    } else {
+        logError("file: "__FILE__", line: %d, "
+                "config file: %s, invalid read_policy: %s",
+                __LINE__, ini_ctx->filename, read_policy);
+        return EINVAL;
+    }
+
+    client_ctx->hedged_read.enabled = iniGetBoolValue(ini_ctx->
+            section_name, "hedged_read", ini_ctx->context, false);
+    client_ctx->hedged_read.percentile = iniGetIntValueEx(
+            ini_ctx->section_name, "hedged_read_percentile",
+            ini_ctx->context, FS_CLIENT_DEFAULT_HEDGED_READ_PERCENTILE,
+            true);
+    if (client_ctx->hedged_read.percentile <= 0 ||
+            client_ctx->hedged_read.percentile >= 100)
+    {
+        client_ctx->hedged_read.percentile =
+            FS_CLIENT_DEFAULT_HEDGED_READ_PERCENTILE;
+    }
+    client_ctx->hedged_read.budget = iniGetIntValueEx(
+            ini_ctx->section_name, "hedged_read_budget",
+            ini_ctx->context, FS_CLIENT_DEFAULT_HEDGED_READ_BUDGET, true);
+    if (client_ctx->hedged_read.budget <= 0) {
+        client_ctx->hedged_read.budget = FS_CLIENT_DEFAULT_HEDGED_READ_BUDGET;
+    } else if (client_ctx->hedged_read.budget > 100) {
+        client_ctx->hedged_read.budget = 100;
+    }
+
     if ((result=fs_cluster_cfg_load_from_ini_ex1(client_ctx->
                     cluster_cfg.ptr, ini_ctx)) != 0)
     {
@@ -95,7 +160,12 @@ void fs_client_log_config_ex(FSClientContext *client_ctx,
             "base_path: %s, "
             "connect_timeout: %d, "
             "network_timeout: %d, "
-            "read_rule: %s, %s, "
+            "pipeline_window: %d, "
+            "connections_per_server: %d, "
+            "connection_check_interval: %d, "
+            "read_rule: %s, read_policy: %s, "
+            "hedged_read: %d, hedged_read_percentile: %d, "
+            "hedged_read_budget: %d%%, %s, "
             "server group count: %d, "
             "data group count: %d%s%s",
             g_fs_global_vars.version.major,
@@ -103,7 +173,15 @@ void fs_client_log_config_ex(FSClientContext *client_ctx,
             g_fs_client_vars.base_path,
             client_ctx->connect_timeout,
             client_ctx->network_timeout,
+            client_ctx->pipeline_window,
+            client_ctx->conn_pool.connections_per_server,
+            client_ctx->conn_pool.check_interval,
             sf_get_read_rule_caption(client_ctx->read_rule),
+            client_ctx->read_policy == FS_CLIENT_READ_POLICY_LATENCY ?
+            "latency" : "random",
+            client_ctx->hedged_read.enabled,
+            client_ctx->hedged_read.percentile,
+            client_ctx->hedged_read.budget,
             net_retry_output,
             FS_SERVER_GROUP_COUNT(*client_ctx->cluster_cfg.ptr),
             FS_DATA_GROUP_COUNT(*client_ctx->cluster_cfg.ptr),
@@ -155,9 +233,16 @@ int fs_client_init_ex1(FSClientContext *client_ctx, IniFullContext *ini_ctx,
     }
 
     if (conn_manager == NULL) {
-        if ((result=fs_simple_connection_manager_init(client_ctx,
-                        &client_ctx->conn_manager)) != 0)
-        {
+        if (client_ctx->conn_pool.connections_per_server > 0) {
+            result = fs_pooled_connection_manager_init(client_ctx,
+                    &client_ctx->conn_manager, client_ctx->conn_pool.
+                    connections_per_server, client_ctx->conn_pool.
+                    check_interval);
+        } else {
+            result = fs_simple_connection_manager_init(client_ctx,
+                    &client_ctx->conn_manager);
+        }
+        if (result != 0) {
             return result;
         }
         client_ctx->is_simple_conn_mananger = true;
@@ -168,6 +253,22 @@ int fs_client_init_ex1(FSClientContext *client_ctx, IniFullContext *ini_ctx,
         client_ctx->is_simple_conn_mananger = false;
     }
 
+    if (client_ctx->read_policy == FS_CLIENT_READ_POLICY_LATENCY &&
+            client_ctx->read_rule != sf_data_read_rule_master_only)
+    {
+        if ((result=fs_server_selector_init(client_ctx)) != 0) {
+            return result;
+        }
+    }
+
+    /* the other server of the hedged read is selected
+     * from the cached servers of the server selector */
+    if (client_ctx->hedged_read.enabled && client_ctx->selector != NULL) {
+        if ((result=fs_hedged_read_init(client_ctx)) != 0) {
+            return result;
+        }
+    }
+
     srand(time(NULL));
     return 0;
 }
@@ -178,8 +279,14 @@ void fs_client_destroy_ex(FSClientContext *client_ctx)
         return;
     }
 
+    fs_hedged_read_destroy(client_ctx);
+    fs_server_selector_destroy(client_ctx);
     if (client_ctx->is_simple_conn_mananger) {
-        fs_simple_connection_manager_destroy(&client_ctx->conn_manager);
+        if (client_ctx->conn_pool.connections_per_server > 0) {
+            fs_pooled_connection_manager_destroy(&client_ctx->conn_manager);
+        } else {
+            fs_simple_connection_manager_destroy(&client_ctx->conn_manager);
+        }
     }
     memset(client_ctx, 0, sizeof(FSClientContext));
 }
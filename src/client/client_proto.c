@@ -31,18 +31,15 @@ static inline void proto_pack_block_key(const FSBlockKey *
     long2buff(bkey->offset, proto_bkey->offset);
 }
 
-int fs_client_proto_slice_write(FSClientContext *client_ctx,
+static int slice_write_send(FSClientContext *client_ctx,
         ConnectionInfo *conn, const uint64_t req_id,
-        const FSBlockSliceKeyInfo *bs_key, const char *data,
-        int *inc_alloc)
+        const FSBlockSliceKeyInfo *bs_key, const char *data)
 {
     char out_buff[sizeof(FSProtoHeader) +
         sizeof(SFProtoIdempotencyAdditionalHeader) +
         sizeof(FSProtoSliceWriteReqHeader)];
     FSProtoHeader *proto_header;
     FSProtoSliceWriteReqHeader *req_header;
-    SFResponseInfo response;
-    FSProtoSliceUpdateResp resp;
     int result;
     int body_front_len;
 
@@ -59,39 +56,120 @@ int fs_client_proto_slice_write(FSClientContext *client_ctx,
     }
     proto_pack_block_key(&bs_key->block, &req_header->bs.bkey);
 
+    SF_PROTO_SET_HEADER(proto_header, FS_SERVICE_PROTO_SLICE_WRITE_REQ,
+            body_front_len + bs_key->slice.length);
+    int2buff(bs_key->slice.offset, req_header->bs.slice_size.offset);
+    int2buff(bs_key->slice.length, req_header->bs.slice_size.length);
+
+    if ((result=tcpsenddata_nb(conn->sock, out_buff,
+                    sizeof(FSProtoHeader) + body_front_len,
+                    client_ctx->network_timeout)) != 0)
+    {
+        return result;
+    }
+
+    return tcpsenddata_nb(conn->sock, (char *)data, bs_key->
+            slice.length, client_ctx->network_timeout);
+}
+
+static inline int slice_write_recv(FSClientContext *client_ctx,
+        ConnectionInfo *conn, SFResponseInfo *response, int *inc_alloc)
+{
+    FSProtoSliceUpdateResp resp;
+    int result;
+
+    if ((result=sf_recv_response(conn, response, client_ctx->
+                    network_timeout, FS_SERVICE_PROTO_SLICE_WRITE_RESP,
+                    (char *)&resp, sizeof(FSProtoSliceUpdateResp))) == 0)
+    {
+        *inc_alloc = buff2int(resp.inc_alloc);
+    }
+
+    return result;
+}
+
+int fs_client_proto_slice_write(FSClientContext *client_ctx,
+        ConnectionInfo *conn, const uint64_t req_id,
+        const FSBlockSliceKeyInfo *bs_key, const char *data,
+        int *inc_alloc)
+{
+    SFResponseInfo response;
+    int result;
+
     response.error.length = 0;
-    do {
-        SF_PROTO_SET_HEADER(proto_header, FS_SERVICE_PROTO_SLICE_WRITE_REQ,
-                body_front_len + bs_key->slice.length);
-        int2buff(bs_key->slice.offset, req_header->bs.slice_size.offset);
-        int2buff(bs_key->slice.length, req_header->bs.slice_size.length);
+    if ((result=slice_write_send(client_ctx, conn,
+                    req_id, bs_key, data)) == 0)
+    {
+        result = slice_write_recv(client_ctx, conn, &response, inc_alloc);
+    }
 
-        if ((result=tcpsenddata_nb(conn->sock, out_buff,
-                        sizeof(FSProtoHeader) + body_front_len,
-                        client_ctx->network_timeout)) != 0)
-        {
-            break;
+    if (result != 0) {
+        *inc_alloc = 0;
+        sf_log_network_error_for_update(&response, conn, result);
+    }
+
+    return result;
+}
+
+int fs_client_proto_slice_write_pipelined(FSClientContext *client_ctx,
+        ConnectionInfo *conn, const uint64_t *req_ids,
+        const FSBlockSliceKeyInfo *bs_key, const char *data,
+        const int chunk_size, int *done_count, int *inc_alloc)
+{
+    FSBlockSliceKeyInfo chunk_key;
+    SFResponseInfo response;
+    int result;
+    int sub_result;
+    int current_alloc;
+    int offset;
+    int sent_count;
+    int i;
+
+    *done_count = 0;
+    *inc_alloc = 0;
+    response.error.length = 0;
+    chunk_key = *bs_key;
+    result = 0;
+    sent_count = 0;
+    for (offset=0; offset<bs_key->slice.length; offset+=chunk_size) {
+        chunk_key.slice.offset = bs_key->slice.offset + offset;
+        if (bs_key->slice.length - offset < chunk_size) {
+            chunk_key.slice.length = bs_key->slice.length - offset;
+        } else {
+            chunk_key.slice.length = chunk_size;
         }
 
-        if ((result=tcpsenddata_nb(conn->sock, (char *)data, bs_key->
-                        slice.length, client_ctx->network_timeout)) != 0)
+        if ((result=slice_write_send(client_ctx, conn, req_ids[sent_count],
+                        &chunk_key, data + offset)) != 0)
         {
-            break;
+            sf_log_network_error_for_update(&response, conn, result);
+            return result;
         }
+        sent_count++;
+    }
 
-        if ((result=sf_recv_response(conn, &response, client_ctx->
-                        network_timeout, FS_SERVICE_PROTO_SLICE_WRITE_RESP,
-                        (char *)&resp, sizeof(FSProtoSliceUpdateResp))) != 0)
+    /* the responses are in the order of the requests, receive all of
+     * them to keep the connection usable after the server's error */
+    for (i=0; i<sent_count; i++) {
+        response.error.length = 0;
+        response.header.status = 0;
+        if ((sub_result=slice_write_recv(client_ctx, conn,
+                        &response, &current_alloc)) == 0)
         {
-            break;
+            if (result == 0) {
+                (*done_count)++;
+                *inc_alloc += current_alloc;
+            }
+            continue;
         }
 
-        *inc_alloc = buff2int(resp.inc_alloc);
-    } while (0);
-
-    if (result != 0) {
-        *inc_alloc = 0;
-        sf_log_network_error_for_update(&response, conn, result);
+        sf_log_network_error_for_update(&response, conn, sub_result);
+        if (result == 0) {
+            result = sub_result;
+        }
+        if (response.header.status == 0) {  //network error
+            break;
+        }
     }
 
     return result;
@@ -102,110 +180,161 @@ int fs_client_proto_slice_read_ex(FSClientContext *client_ctx,
         const int resp_cmd, const FSBlockSliceKeyInfo *bs_key,
         char *buff, int *read_bytes)
 {
+#define SLICE_READ_REQ_SIZE  (sizeof(FSProtoHeader) + \
+        sizeof(FSProtoReplicaSliceReadReq))
+
     const FSConnectionParameters *connection_params;
-    char out_buff[sizeof(FSProtoHeader) + sizeof(FSProtoServiceSliceReadReq)
-        + sizeof(FSProtoReplicaSliceReadReq)];
+    char out_buff[SLICE_READ_REQ_SIZE * FS_CLIENT_MAX_PIPELINE_WINDOW];
     FSProtoHeader *proto_header;
     SFResponseInfo response;
     FSProtoServiceSliceReadReq *sreq;
     FSProtoReplicaSliceReadReq *rreq;
     FSProtoBlockSlice *proto_bs;
+    char *p;
     int body_len;
     int hole_start;
     int hole_len;
     int buff_offet;
+    int send_offset;
     int remain;
     int curr_len;
+    int window;
+    int count;
     int bytes;
     int result;
-
-    proto_header = (FSProtoHeader *)out_buff;
-    if (req_cmd == FS_SERVICE_PROTO_SLICE_READ_REQ) {
-        body_len = sizeof(FSProtoServiceSliceReadReq);
-        sreq = (FSProtoServiceSliceReadReq *)(proto_header + 1);
-        proto_bs = &sreq->bs;
-    } else {
-        body_len = sizeof(FSProtoReplicaSliceReadReq);
-        rreq = (FSProtoReplicaSliceReadReq *)(proto_header + 1);
-        int2buff(slave_id, rreq->slave_id);
-        proto_bs = &rreq->bs;
-    }
-    SF_PROTO_SET_HEADER(proto_header, req_cmd, body_len);
-    proto_pack_block_key(&bs_key->block, &proto_bs->bkey);
+    int sub_result;
+    int i;
+    bool net_error;
 
     connection_params = client_ctx->conn_manager.get_connection_params(
             client_ctx, conn);
+    window = FS_CLIENT_PIPELINE_WINDOW(client_ctx);
 
     result = 0;
+    net_error = false;
+    response.error.length = 0;
     hole_start = buff_offet = 0;
     remain = bs_key->slice.length;
-    while (remain > 0) {
-        if (remain <= connection_params->buffer_size) {
-            curr_len = remain;
-        } else {
-            curr_len = connection_params->buffer_size;
-        }
+    while (remain > 0 && result == 0) {
+        /* send the requests of the window back to back */
+        p = out_buff;
+        send_offset = buff_offet;
+        for (count=0; count<window && send_offset <
+                bs_key->slice.length; count++)
+        {
+            if (bs_key->slice.length - send_offset <=
+                    connection_params->buffer_size)
+            {
+                curr_len = bs_key->slice.length - send_offset;
+            } else {
+                curr_len = connection_params->buffer_size;
+            }
 
-        int2buff(bs_key->slice.offset + buff_offet,
-                proto_bs->slice_size.offset);
-        int2buff(curr_len, proto_bs->slice_size.length);
+            proto_header = (FSProtoHeader *)p;
+            if (req_cmd == FS_SERVICE_PROTO_SLICE_READ_REQ) {
+                body_len = sizeof(FSProtoServiceSliceReadReq);
+                sreq = (FSProtoServiceSliceReadReq *)(proto_header + 1);
+                proto_bs = &sreq->bs;
+            } else {
+                body_len = sizeof(FSProtoReplicaSliceReadReq);
+                rreq = (FSProtoReplicaSliceReadReq *)(proto_header + 1);
+                int2buff(slave_id, rreq->slave_id);
+                proto_bs = &rreq->bs;
+            }
+            SF_PROTO_SET_HEADER(proto_header, req_cmd, body_len);
+            proto_pack_block_key(&bs_key->block, &proto_bs->bkey);
+            int2buff(bs_key->slice.offset + send_offset,
+                    proto_bs->slice_size.offset);
+            int2buff(curr_len, proto_bs->slice_size.length);
+
+            p += sizeof(FSProtoHeader) + body_len;
+            send_offset += curr_len;
+        }
 
-        response.error.length = 0;
-        if ((result=sf_send_and_recv_response_header(conn,
-                        out_buff, sizeof(FSProtoHeader) + body_len,
-                        &response, client_ctx->network_timeout)) != 0)
+        if ((result=tcpsenddata_nb(conn->sock, out_buff, p - out_buff,
+                        client_ctx->network_timeout)) != 0)
         {
+            response.error.length = snprintf(response.error.message,
+                    sizeof(response.error.message),
+                    "send data fail, errno: %d, error info: %s",
+                    result, STRERROR(result));
+            net_error = true;
             break;
         }
 
-        if ((result=sf_check_response(conn, &response, client_ctx->
-                        network_timeout, resp_cmd)) != 0)
-        {
-            if (result == ENOENT) {  //ignore errno ENOENT
-                bytes = 0;
-                result = 0;
+        /* the responses are in the order of the requests */
+        for (i=0; i<count; i++) {
+            if (remain <= connection_params->buffer_size) {
+                curr_len = remain;
             } else {
-                break;
-            }
-        } else {
-            if (response.header.body_len > curr_len) {
-                response.error.length = sprintf(response.error.message,
-                        "response body length: %d > slice length: %d",
-                        response.header.body_len, curr_len);
-                result = EINVAL;
-                break;
+                curr_len = connection_params->buffer_size;
             }
 
-            if ((result=tcprecvdata_nb_ex(conn->sock, buff + buff_offet,
-                            response.header.body_len, client_ctx->
-                            network_timeout, &bytes)) != 0)
+            response.error.length = 0;
+            if ((sub_result=sf_recv_response_header(conn, &response,
+                            client_ctx->network_timeout)) != 0)
             {
-                response.error.length = snprintf(response.error.message,
-                        sizeof(response.error.message),
-                        "recv data fail, errno: %d, error info: %s",
-                        result, STRERROR(result));
+                result = sub_result;
+                net_error = true;
                 break;
             }
 
-            hole_len = buff_offet - hole_start;
-            if (hole_len > 0) {
-                memset(buff + hole_start, 0, hole_len);
+            bytes = 0;
+            if ((sub_result=sf_check_response(conn, &response, client_ctx->
+                            network_timeout, resp_cmd)) != 0)
+            {
+                if (sub_result != ENOENT) {  //ignore errno ENOENT
+                    sf_log_network_error(&response, conn, sub_result);
+                    if (result == 0) {
+                        result = sub_result;
+                    }
+                }
+            } else {
+                if (response.header.body_len > curr_len) {
+                    response.error.length = sprintf(response.error.message,
+                            "response body length: %d > slice length: %d",
+                            response.header.body_len, curr_len);
+                    result = EINVAL;
+                    net_error = true;
+                    break;
+                }
+
+                if ((sub_result=tcprecvdata_nb_ex(conn->sock, buff +
+                                buff_offet, response.header.body_len,
+                                client_ctx->network_timeout, &bytes)) != 0)
+                {
+                    response.error.length = snprintf(response.error.message,
+                            sizeof(response.error.message),
+                            "recv data fail, errno: %d, error info: %s",
+                            sub_result, STRERROR(sub_result));
+                    result = sub_result;
+                    net_error = true;
+                    break;
+                }
+
+                /* the data after the error is received but NOT used */
+                if (result == 0) {
+                    hole_len = buff_offet - hole_start;
+                    if (hole_len > 0) {
+                        memset(buff + hole_start, 0, hole_len);
+                    }
+                    hole_start = buff_offet + bytes;
+                }
             }
-            hole_start = buff_offet + bytes;
-        }
 
-        /*
-        logInfo("total recv: %d, current offset: %d, "
-                "current length: %d, current read: %d, remain: %d, result: %d",
-                hole_start, bs_key->slice.offset + buff_offet,
-                curr_len, bytes, remain, result);
-                */
+            /*
+            logInfo("total recv: %d, current offset: %d, "
+                    "current length: %d, current read: %d, remain: %d, "
+                    "result: %d", hole_start, bs_key->slice.offset +
+                    buff_offet, curr_len, bytes, remain, result);
+                    */
 
-        buff_offet += curr_len;
-        remain -= curr_len;
+            buff_offet += curr_len;
+            remain -= curr_len;
+        }
     }
 
-    if (result != 0) {
+    if (net_error) {
         sf_log_network_error(&response, conn, result);
     }
 
@@ -217,6 +346,87 @@ int fs_client_proto_slice_read_ex(FSClientContext *client_ctx,
     }
 }
 
+int fs_client_proto_slice_read_send(FSClientContext *client_ctx,
+        ConnectionInfo *conn, const FSBlockSliceKeyInfo *bs_key)
+{
+    char out_buff[sizeof(FSProtoHeader) + sizeof(FSProtoServiceSliceReadReq)];
+    FSProtoHeader *proto_header;
+    FSProtoServiceSliceReadReq *req;
+    int result;
+
+    proto_header = (FSProtoHeader *)out_buff;
+    req = (FSProtoServiceSliceReadReq *)(proto_header + 1);
+    SF_PROTO_SET_HEADER(proto_header, FS_SERVICE_PROTO_SLICE_READ_REQ,
+            sizeof(FSProtoServiceSliceReadReq));
+    proto_pack_block_key(&bs_key->block, &req->bs.bkey);
+    int2buff(bs_key->slice.offset, req->bs.slice_size.offset);
+    int2buff(bs_key->slice.length, req->bs.slice_size.length);
+
+    if ((result=tcpsenddata_nb(conn->sock, out_buff, sizeof(out_buff),
+                    client_ctx->network_timeout)) != 0)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "send data to server %s:%u fail, "
+                "errno: %d, error info: %s", __LINE__,
+                conn->ip_addr, conn->port, result, STRERROR(result));
+    }
+
+    return result;
+}
+
+int fs_client_proto_slice_read_recv(FSClientContext *client_ctx,
+        ConnectionInfo *conn, const FSBlockSliceKeyInfo *bs_key,
+        char *buff, int *read_bytes)
+{
+    SFResponseInfo response;
+    int result;
+
+    *read_bytes = 0;
+    response.error.length = 0;
+    do {
+        if ((result=sf_recv_response_header(conn, &response,
+                        client_ctx->network_timeout)) != 0)
+        {
+            break;
+        }
+
+        if ((result=sf_check_response(conn, &response, client_ctx->
+                        network_timeout, FS_SERVICE_PROTO_SLICE_READ_RESP)) != 0)
+        {
+            if (result == ENOENT) {  //the hole
+                result = 0;
+            }
+            break;
+        }
+
+        if (response.header.body_len > bs_key->slice.length) {
+            response.error.length = sprintf(response.error.message,
+                    "response body length: %d > slice length: %d",
+                    response.header.body_len, bs_key->slice.length);
+            result = EINVAL;
+            break;
+        }
+
+        if ((result=tcprecvdata_nb(conn->sock, buff, response.header.
+                        body_len, client_ctx->network_timeout)) != 0)
+        {
+            response.error.length = snprintf(response.error.message,
+                    sizeof(response.error.message),
+                    "recv data fail, errno: %d, error info: %s",
+                    result, STRERROR(result));
+            break;
+        }
+        *read_bytes = response.header.body_len;
+    } while (0);
+
+    if (result != 0) {
+        sf_log_network_error(&response, conn, result);
+        return result;
+    }
+
+    return *read_bytes > 0 ? 0 : ENODATA;
+}
+
 int fs_client_proto_bs_operate(FSClientContext *client_ctx,
         ConnectionInfo *conn, const uint64_t req_id, const void *key,
         const int req_cmd, const int resp_cmd,
@@ -334,7 +544,7 @@ int fs_client_proto_join_server(FSClientContext *client_ctx,
     proto_header = (FSProtoHeader *)out_buff;
     req = (FSProtoClientJoinReq *)(proto_header + 1);
 
-    if (client_ctx->idempotency_enabled) {
+    if (client_ctx->idempotency_enabled && conn_params->channel != NULL) {
         flags = FS_CLIENT_JOIN_FLAGS_IDEMPOTENCY_REQUEST;
 
         int2buff(__sync_add_and_fetch(&conn_params->channel->id, 0),
@@ -575,6 +785,327 @@ int fs_client_proto_cluster_stat(FSClientContext *client_ctx,
     return result;
 }
 
+int fs_client_proto_slice_bulk_read_send(FSClientContext *client_ctx,
+        ConnectionInfo *conn, const int slave_id,
+        const FSClientBulkReadEntry *entries, const int count)
+{
+    char out_buff[sizeof(FSProtoHeader) + sizeof(
+            FSProtoReplicaSliceBulkReadReqHeader) +
+        sizeof(FSProtoBlockSlice) * FS_REPLICA_BULK_READ_MAX_SLICES];
+    FSProtoReplicaSliceBulkReadReqHeader *req_header;
+    FSProtoBlockSlice *bs;
+    const FSClientBulkReadEntry *entry;
+    const FSClientBulkReadEntry *end;
+    int body_len;
+    int result;
+
+    if (count <= 0 || count > FS_REPLICA_BULK_READ_MAX_SLICES) {
+        logError("file: "__FILE__", line: %d, "
+                "invalid slice count: %d", __LINE__, count);
+        return EINVAL;
+    }
+
+    req_header = (FSProtoReplicaSliceBulkReadReqHeader *)
+        (out_buff + sizeof(FSProtoHeader));
+    int2buff(slave_id, req_header->slave_id);
+    int2buff(count, req_header->count);
+    bs = (FSProtoBlockSlice *)(req_header + 1);
+    end = entries + count;
+    for (entry=entries; entry<end; entry++, bs++) {
+        proto_pack_block_key(&entry->bs_key->block, &bs->bkey);
+        int2buff(entry->bs_key->slice.offset, bs->slice_size.offset);
+        int2buff(entry->bs_key->slice.length, bs->slice_size.length);
+    }
+
+    body_len = (char *)bs - (char *)req_header;
+    SF_PROTO_SET_HEADER((FSProtoHeader *)out_buff,
+            FS_REPLICA_PROTO_SLICE_BULK_READ_REQ, body_len);
+    if ((result=tcpsenddata_nb(conn->sock, out_buff, sizeof(FSProtoHeader)
+                    + body_len, client_ctx->network_timeout)) != 0)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "send data to server %s:%u fail, "
+                "errno: %d, error info: %s", __LINE__,
+                conn->ip_addr, conn->port, result, STRERROR(result));
+    }
+
+    return result;
+}
+
+int fs_client_proto_slice_bulk_read_recv(FSClientContext *client_ctx,
+        ConnectionInfo *conn, char *buff, const int size,
+        FSClientBulkReadEntry *entries, const int count)
+{
+    SFResponseInfo response;
+    FSProtoReplicaSliceBulkReadRespPart *part;
+    FSClientBulkReadEntry *entry;
+    FSClientBulkReadEntry *end;
+    char *p;
+    char *body_end;
+    int result;
+
+    response.error.length = 0;
+    do {
+        if ((result=sf_recv_response_header(conn, &response,
+                        client_ctx->network_timeout)) != 0)
+        {
+            break;
+        }
+
+        if ((result=sf_check_response(conn, &response, client_ctx->
+                        network_timeout, FS_REPLICA_PROTO_SLICE_BULK_READ_RESP)) != 0)
+        {
+            break;
+        }
+
+        if (response.header.body_len > size) {
+            response.error.length = sprintf(response.error.message,
+                    "response body length: %d > buffer size: %d",
+                    response.header.body_len, size);
+            result = EOVERFLOW;
+            break;
+        }
+
+        if ((result=tcprecvdata_nb(conn->sock, buff, response.header.
+                        body_len, client_ctx->network_timeout)) != 0)
+        {
+            break;
+        }
+
+        p = buff;
+        body_end = buff + response.header.body_len;
+        end = entries + count;
+        for (entry=entries; entry<end; entry++) {
+            part = (FSProtoReplicaSliceBulkReadRespPart *)p;
+            if (p + sizeof(*part) > body_end) {
+                break;
+            }
+            entry->read_bytes = buff2int(part->read_bytes);
+            entry->err_no = buff2short(part->err_no);
+            entry->data = p + sizeof(*part);
+            p = entry->data + entry->read_bytes;
+            if (entry->read_bytes < 0 || entry->read_bytes >
+                    entry->bs_key->slice.length || p > body_end)
+            {
+                break;
+            }
+        }
+
+        if (entry != end || p != body_end) {
+            response.error.length = sprintf(response.error.message,
+                    "invalid response body length: %d, slice count: %d",
+                    response.header.body_len, count);
+            result = EINVAL;
+        }
+    } while (0);
+
+    if (result != 0) {
+        sf_log_network_error(&response, conn, result);
+    }
+
+    return result;
+}
+
+int fs_client_proto_replica_stat(FSClientContext *client_ctx,
+        const int data_group_id, FSClientReplicaStatEntry *stats,
+        const int size, int *count)
+{
+    FSProtoHeader *header;
+    FSProtoReplicaStatReq *req;
+    FSProtoReplicaStatRespBodyHeader *body_header;
+    FSProtoReplicaStatRespBodyPart *body_part;
+    FSProtoReplicaStatRespBodyPart *body_end;
+    FSClientReplicaStatEntry *stat;
+    ConnectionInfo *conn;
+    char out_buff[sizeof(FSProtoHeader) + sizeof(FSProtoReplicaStatReq)];
+    char in_buff[8 * 1024];
+    SFResponseInfo response;
+    int64_t master_version;
+    int result;
+    int calc_size;
+    int i;
+
+    if ((conn=client_ctx->conn_manager.get_master_connection(client_ctx,
+                    data_group_id - 1, &result)) == NULL)
+    {
+        return result;
+    }
+
+    header = (FSProtoHeader *)out_buff;
+    req = (FSProtoReplicaStatReq *)(header + 1);
+    memset(req, 0, sizeof(FSProtoReplicaStatReq));
+    int2buff(data_group_id, req->data_group_id);
+    SF_PROTO_SET_HEADER(header, FS_SERVICE_PROTO_REPLICA_STAT_REQ,
+            sizeof(FSProtoReplicaStatReq));
+
+    if ((result=sf_send_and_check_response_header(conn, out_buff,
+                    sizeof(out_buff), &response, client_ctx->
+                    network_timeout, FS_SERVICE_PROTO_REPLICA_STAT_RESP)) == 0)
+    {
+        if (response.header.body_len > sizeof(in_buff)) {
+            response.error.length = sprintf(response.error.message,
+                    "response body length: %d is too large",
+                    response.header.body_len);
+            result = EOVERFLOW;
+        } else {
+            result = tcprecvdata_nb(conn->sock, in_buff, response.header.
+                    body_len, client_ctx->network_timeout);
+        }
+    }
+
+    body_header = (FSProtoReplicaStatRespBodyHeader *)in_buff;
+    body_part = (FSProtoReplicaStatRespBodyPart *)(in_buff +
+            sizeof(FSProtoReplicaStatRespBodyHeader));
+    if (result == 0) {
+        *count = buff2int(body_header->count);
+
+        calc_size = sizeof(FSProtoReplicaStatRespBodyHeader) +
+            (*count) * sizeof(FSProtoReplicaStatRespBodyPart);
+        if (calc_size != response.header.body_len) {
+            response.error.length = sprintf(response.error.message,
+                    "response body length: %d != calculate size: %d, "
+                    "server count: %d", response.header.body_len,
+                    calc_size, *count);
+            result = EINVAL;
+        } else if (size < *count) {
+            response.error.length = sprintf(response.error.message,
+                    "entry size %d too small < %d", size, *count);
+            *count = 0;
+            result = ENOSPC;
+        }
+    } else {
+        *count = 0;
+    }
+
+    if (result != 0) {
+        sf_log_network_error(&response, conn, result);
+    } else {
+        master_version = buff2long(body_header->master_data_version);
+        body_end = body_part + (*count);
+        for (stat=stats; body_part<body_end; body_part++, stat++) {
+            stat->data_group_id = data_group_id;
+            stat->server_id = buff2int(body_part->server_id);
+            stat->status = body_part->status;
+            stat->parked_rpcs = buff2int(body_part->parked_rpcs);
+            stat->master_version = master_version;
+            stat->data_version = buff2long(body_part->data_version);
+            stat->lag_versions = buff2long(body_part->lag_versions);
+            stat->queued_rpcs = buff2int(body_part->queued_rpcs);
+            stat->inflight_rpcs = buff2int(body_part->inflight_rpcs);
+            stat->last_lag_ms = buff2int(body_part->last_lag_ms);
+            stat->queued_bytes = buff2long(body_part->queued_bytes);
+            stat->inflight_bytes = buff2long(body_part->inflight_bytes);
+            stat->timeouts = buff2long(body_part->timeouts);
+            stat->overflows = buff2long(body_part->overflows);
+            for (i=0; i<FS_REPLICA_RTT_HISTOGRAM_SIZE; i++) {
+                stat->rtt_counts[i] = buff2long(body_part->rtt_counts[i]);
+            }
+        }
+    }
+
+    SF_CLIENT_RELEASE_CONNECTION(client_ctx, conn, result);
+    return result;
+}
+
+int fs_client_proto_io_stat(FSClientContext *client_ctx,
+        ConnectionInfo *conn, FSClientIOStat *stat,
+        FSClientPathIOStat *paths, const int size, int *count)
+{
+    char out_buff[sizeof(FSProtoHeader)];
+    char in_buff[16 * 1024];
+    FSProtoHeader *proto_header;
+    FSProtoIOStatRespBodyHeader *body_header;
+    FSProtoIOStatRespBodyPart *body_part;
+    FSClientPathIOStat *path;
+    FSClientPathIOStat *end;
+    SFResponseInfo response;
+    int body_len;
+    int expect_len;
+    int result;
+    int i;
+
+    proto_header = (FSProtoHeader *)out_buff;
+    SF_PROTO_SET_HEADER(proto_header, FS_SERVICE_PROTO_IO_STAT_REQ, 0);
+    response.error.length = 0;
+    do {
+        if ((result=sf_send_and_recv_response_ex1(conn, out_buff,
+                        sizeof(out_buff), &response, client_ctx->network_timeout,
+                        FS_SERVICE_PROTO_IO_STAT_RESP, in_buff,
+                        sizeof(in_buff), &body_len)) != 0)
+        {
+            break;
+        }
+
+        if (body_len < sizeof(FSProtoIOStatRespBodyHeader)) {
+            response.error.length = snprintf(response.error.message,
+                    sizeof(response.error.message), "invalid response "
+                    "body length: %d < min length: %d", body_len,
+                    (int)sizeof(FSProtoIOStatRespBodyHeader));
+            result = EINVAL;
+            break;
+        }
+
+        body_header = (FSProtoIOStatRespBodyHeader *)in_buff;
+        *count = buff2int(body_header->path_count);
+        expect_len = sizeof(*body_header) + sizeof(*body_part) * (*count);
+        if (body_len != expect_len) {
+            response.error.length = snprintf(response.error.message,
+                    sizeof(response.error.message), "invalid response "
+                    "body length: %d != expect length: %d",
+                    body_len, expect_len);
+            result = EINVAL;
+            break;
+        }
+
+        if (*count > size) {
+            response.error.length = snprintf(response.error.message,
+                    sizeof(response.error.message), "response path "
+                    "count: %d exceeds entry size: %d", *count, size);
+            result = ENOSPC;
+            break;
+        }
+
+        for (i=0; i<FS_ALLOC_STREAM_COUNT; i++) {
+            stat->streams[i].written_bytes = buff2long(
+                    body_header->streams[i].written_bytes);
+            stat->streams[i].migrated_bytes = buff2long(
+                    body_header->streams[i].migrated_bytes);
+        }
+        for (i=0; i<FS_REPLICA_BATCH_HISTOGRAM_SIZE; i++) {
+            stat->replica_batch.sizes[i] = buff2long(
+                    body_header->replica_batch.sizes[i]);
+            stat->replica_batch.delays[i] = buff2long(
+                    body_header->replica_batch.delays[i]);
+        }
+        stat->replica_compress.raw_bytes = buff2long(
+                body_header->replica_compress.raw_bytes);
+        stat->replica_compress.compressed_bytes = buff2long(
+                body_header->replica_compress.compressed_bytes);
+        stat->replica_compress.incompressible = buff2long(
+                body_header->replica_compress.incompressible);
+        stat->replica_compress.skipped_bytes = buff2long(
+                body_header->replica_compress.skipped_bytes);
+
+        body_part = (FSProtoIOStatRespBodyPart *)(body_header + 1);
+        end = paths + *count;
+        for (path=paths; path<end; path++, body_part++) {
+            path->path_index = buff2int(body_part->path_index);
+            path->select_weight = buff2int(body_part->select_weight);
+            path->queue_depth = buff2int(body_part->queue_depth);
+            path->latency_us = buff2long(body_part->latency_us);
+            path->lock_waits = buff2long(body_part->lock_waits);
+            path->lock_wait_us = buff2long(body_part->lock_wait_us);
+        }
+    } while (0);
+
+    if (result != 0) {
+        *count = 0;
+        sf_log_network_error(&response, conn, result);
+    }
+
+    return result;
+}
+
 int fs_client_proto_server_group_space_stat(FSClientContext *client_ctx,
         ConnectionInfo *conn, FSClientServerSpaceStat *stats,
         const int size, int *count)
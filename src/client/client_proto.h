@@ -37,11 +37,30 @@ extern "C" {
             const FSBlockSliceKeyInfo *bs_key, const char *data,
             int *inc_alloc);
 
+    /* send the chunks of the slice back to back and receive the
+     * responses in order, the req_ids is the request id of each chunk.
+     * done_count returns the leading chunks written successfully */
+    int fs_client_proto_slice_write_pipelined(FSClientContext *client_ctx,
+            ConnectionInfo *conn, const uint64_t *req_ids,
+            const FSBlockSliceKeyInfo *bs_key, const char *data,
+            const int chunk_size, int *done_count, int *inc_alloc);
+
     int fs_client_proto_slice_read_ex(FSClientContext *client_ctx,
             ConnectionInfo *conn, const int slave_id, const int req_cmd,
             const int resp_cmd, const FSBlockSliceKeyInfo *bs_key,
             char *buff, int *read_bytes);
 
+    /* send the slice read request without waiting for the response,
+     * the slice length should NOT exceed the buffer size */
+    int fs_client_proto_slice_read_send(FSClientContext *client_ctx,
+            ConnectionInfo *conn, const FSBlockSliceKeyInfo *bs_key);
+
+    /* receive the response of the slice read request,
+     * return ENODATA for the hole */
+    int fs_client_proto_slice_read_recv(FSClientContext *client_ctx,
+            ConnectionInfo *conn, const FSBlockSliceKeyInfo *bs_key,
+            char *buff, int *read_bytes);
+
     int fs_client_proto_bs_operate(FSClientContext *client_ctx,
             ConnectionInfo *conn, const uint64_t req_id, const void *key,
             const int req_cmd, const int resp_cmd,
@@ -68,6 +87,26 @@ extern "C" {
             const ConnectionInfo *spec_conn, const int data_group_id,
             FSClientClusterStatEntry *stats, const int size, int *count);
 
+    /* send the bulk read request without waiting for the response,
+     * so the caller can keep several requests in flight */
+    int fs_client_proto_slice_bulk_read_send(FSClientContext *client_ctx,
+            ConnectionInfo *conn, const int slave_id,
+            const FSClientBulkReadEntry *entries, const int count);
+
+    /* receive the response of the earliest request in flight,
+     * the data of the entries point to the buff */
+    int fs_client_proto_slice_bulk_read_recv(FSClientContext *client_ctx,
+            ConnectionInfo *conn, char *buff, const int size,
+            FSClientBulkReadEntry *entries, const int count);
+
+    int fs_client_proto_replica_stat(FSClientContext *client_ctx,
+            const int data_group_id, FSClientReplicaStatEntry *stats,
+            const int size, int *count);
+
+    int fs_client_proto_io_stat(FSClientContext *client_ctx,
+            ConnectionInfo *conn, FSClientIOStat *stat,
+            FSClientPathIOStat *paths, const int size, int *count);
+
     int fs_client_proto_server_group_space_stat(FSClientContext *client_ctx,
             ConnectionInfo *conn, FSClientServerSpaceStat *stats,
             const int size, int *count);
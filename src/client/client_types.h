@@ -23,9 +23,22 @@
 #include "fs_types.h"
 #include "fs_cluster_cfg.h"
 
+#define FS_CLIENT_DEFAULT_PIPELINE_WINDOW   8
+#define FS_CLIENT_MAX_PIPELINE_WINDOW      32
+
+#define FS_CLIENT_DEFAULT_CONNECTION_CHECK_INTERVAL  30
+
+#define FS_CLIENT_READ_POLICY_RANDOM    0  //selected by the server
+#define FS_CLIENT_READ_POLICY_LATENCY   1  //EWMA latency and two choices
+
+#define FS_CLIENT_DEFAULT_HEDGED_READ_PERCENTILE  95
+#define FS_CLIENT_DEFAULT_HEDGED_READ_BUDGET       5  //in percent
+
 struct idempotency_client_channel;
 struct fs_connection_parameters;
 struct fs_client_context;
+struct fs_server_selector;
+struct fs_hedged_read_context;
 
 typedef ConnectionInfo *(*fs_get_connection_func)(
         struct fs_client_context *client_ctx,
@@ -84,6 +97,62 @@ typedef struct fs_client_cluster_stat_entry {
     int64_t data_version;
 } FSClientClusterStatEntry;
 
+typedef struct fs_client_bulk_read_entry {
+    const FSBlockSliceKeyInfo *bs_key;
+    char *data;      //point to the response buffer
+    int read_bytes;
+    int err_no;
+} FSClientBulkReadEntry;
+
+typedef struct fs_client_replica_stat_entry {
+    int data_group_id;
+    int server_id;   //the slave server id
+    char status;
+    int parked_rpcs;
+    int64_t master_version;
+    int64_t data_version;
+    int64_t lag_versions;
+
+    /* the replica link from the master to the slave */
+    int queued_rpcs;
+    int inflight_rpcs;
+    int last_lag_ms;
+    int64_t queued_bytes;
+    int64_t inflight_bytes;
+    int64_t timeouts;
+    int64_t overflows;
+    int64_t rtt_counts[FS_REPLICA_RTT_HISTOGRAM_SIZE];
+} FSClientReplicaStatEntry;
+
+typedef struct fs_client_path_io_stat {
+    int path_index;
+    int select_weight;   //for the store path selection
+    int queue_depth;     //the pending requests of the IO threads
+    int64_t latency_us;  //EWMA of the IO service time
+    int64_t lock_waits;  //contention count of the alloc cursor lock
+    int64_t lock_wait_us;
+} FSClientPathIOStat;
+
+/* the totals of the server since startup */
+typedef struct fs_client_io_stat {
+    struct {
+        int64_t written_bytes;   //the space allocated by the stream
+        int64_t migrated_bytes;  //moved out of its trunks by reclaim
+    } streams[FS_ALLOC_STREAM_COUNT];
+
+    struct {
+        int64_t sizes[FS_REPLICA_BATCH_HISTOGRAM_SIZE];
+        int64_t delays[FS_REPLICA_BATCH_HISTOGRAM_SIZE];
+    } replica_batch;
+
+    struct {
+        int64_t raw_bytes;
+        int64_t compressed_bytes;
+        int64_t incompressible;
+        int64_t skipped_bytes;
+    } replica_compress;
+} FSClientIOStat;
+
 typedef struct fs_client_server_space_stat {
     int server_id;
     FSClusterSpaceStat stat;
@@ -132,8 +201,21 @@ typedef struct fs_client_context {
     bool is_simple_conn_mananger;
     bool idempotency_enabled;
     SFDataReadRule read_rule;  //the rule for read
+    int read_policy;  //the policy to select the readable server
+    struct fs_server_selector *selector;  //for latency policy
+    struct {
+        bool enabled;
+        int percentile;  //the percentile of the read latency as the delay
+        int budget;      //the max hedged reads in percent of the reads
+        struct fs_hedged_read_context *ctx;
+    } hedged_read;
     int connect_timeout;
     int network_timeout;
+    int pipeline_window;  //the max chunks in flight of a large slice
+    struct {
+        int connections_per_server;  //0 for the simple connection manager
+        int check_interval;  //the interval in seconds to check connections
+    } conn_pool;
     SFNetRetryConfig net_retry_cfg;
 } FSClientContext;
 
@@ -147,4 +229,9 @@ typedef struct fs_client_context {
 #define FS_CLIENT_DATA_GROUP_INDEX(client_ctx, hash_code) \
     (hash_code % FS_DATA_GROUP_COUNT(*client_ctx->cluster_cfg.ptr))
 
+#define FS_CLIENT_PIPELINE_WINDOW(client_ctx) \
+    ((client_ctx)->pipeline_window <= 0 ? 1 : \
+     ((client_ctx)->pipeline_window > FS_CLIENT_MAX_PIPELINE_WINDOW ? \
+      FS_CLIENT_MAX_PIPELINE_WINDOW : (client_ctx)->pipeline_window))
+
 #endif
@@ -181,6 +181,66 @@ int fs_cluster_stat(FSClientContext *client_ctx, const int data_group_id,
     return result;
 }
 
+int fs_replica_stat(FSClientContext *client_ctx, const int data_group_id,
+        FSClientReplicaStatEntry *stats, const int size, int *count)
+{
+    int data_group_count;
+    int start_id;
+    int end_id;
+    int id;
+    int n;
+    int result;
+
+    if (data_group_id > 0) {
+        start_id = end_id = data_group_id;
+    } else {
+        data_group_count = FS_DATA_GROUP_COUNT(*client_ctx->cluster_cfg.ptr);
+        start_id = 1;
+        end_id = data_group_count;
+    }
+
+    result = 0;
+    *count = 0;
+    for (id=start_id; id<=end_id; id++) {
+        if ((result=fs_client_proto_replica_stat(client_ctx, id,
+                        stats + *count, size - *count, &n)) != 0)
+        {
+            break;
+        }
+        *count += n;
+    }
+
+    return result;
+}
+
+int fs_io_stat(FSClientContext *client_ctx, const int server_id,
+        FSClientIOStat *stat, FSClientPathIOStat *paths,
+        const int size, int *count)
+{
+    FCServerInfo *server;
+    ConnectionInfo *conn;
+    int result;
+
+    if ((server=fc_server_get_by_id(&client_ctx->cluster_cfg.ptr->
+                    server_cfg, server_id)) == NULL)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "server id: %d not exist", __LINE__, server_id);
+        return ENOENT;
+    }
+
+    if ((conn=client_ctx->conn_manager.get_server_connection(
+                    client_ctx, server, &result)) == NULL)
+    {
+        return result;
+    }
+
+    result = fs_client_proto_io_stat(client_ctx, conn,
+            stat, paths, size, count);
+    SF_CLIENT_RELEASE_CONNECTION(client_ctx, conn, result);
+    return result;
+}
+
 int fs_client_slice_write(FSClientContext *client_ctx,
         const FSBlockSliceKeyInfo *bs_key, const char *data,
         int *write_bytes, int *inc_alloc)
@@ -189,13 +249,21 @@ int fs_client_slice_write(FSClientContext *client_ctx,
     ConnectionInfo *conn;
     IdempotencyClientChannel *old_channel;
     FSBlockSliceKeyInfo new_key;
+    FSBlockSliceKeyInfo chunk_key;
     int result;
     int conn_result;
     int remain;
     int bytes;
+    int chunk_size;
+    int chunk_count;
+    int done_count;
+    int done_bytes;
+    int current_count;
     int current_alloc;
+    int window;
     int i;
-    uint64_t req_id;
+    int k;
+    uint64_t req_ids[FS_CLIENT_MAX_PIPELINE_WINDOW];
     SFNetRetryIntervalContext net_retry_ctx;
 
     /*
@@ -226,24 +294,31 @@ int fs_client_slice_write(FSClientContext *client_ctx,
     *inc_alloc = *write_bytes = 0;
     new_key = *bs_key;
     remain = bs_key->slice.length;
+    window = FS_CLIENT_PIPELINE_WINDOW(client_ctx);
 
-
+    /* the chunks of the window are sent back to back, each chunk
+     * has its own request id in order */
     while (remain > 0) {
-        if (remain <= connection_params->buffer_size) {
+        chunk_size = connection_params->buffer_size;
+        if (remain <= chunk_size * window) {
             bytes = remain;
         } else {
-            bytes = connection_params->buffer_size;
+            bytes = chunk_size * window;
         }
         new_key.slice.length = bytes;
+        chunk_count = (bytes + chunk_size - 1) / chunk_size;
 
-        if (client_ctx->idempotency_enabled) {
-            req_id = idempotency_client_channel_next_seq_id(
-                    connection_params->channel);
-        } else {
-            req_id = 0;
+        for (k=0; k<chunk_count; k++) {
+            if (client_ctx->idempotency_enabled) {
+                req_ids[k] = idempotency_client_channel_next_seq_id(
+                        connection_params->channel);
+            } else {
+                req_ids[k] = 0;
+            }
         }
 
         old_channel = connection_params->channel;
+        done_count = 0;
         i = 0;
         while (1) {
             if (client_ctx->idempotency_enabled) {
@@ -254,10 +329,34 @@ int fs_client_slice_write(FSClientContext *client_ctx,
             }
 
             if (result == 0) {
-                if ((result=fs_client_proto_slice_write(client_ctx, conn,
-                                req_id, &new_key, data + *write_bytes,
-                                &current_alloc)) == 0)
-                {
+                chunk_key = new_key;
+                chunk_key.slice.offset += done_count * chunk_size;
+                chunk_key.slice.length -= done_count * chunk_size;
+                if (chunk_count - done_count == 1) {
+                    result = fs_client_proto_slice_write(client_ctx, conn,
+                            req_ids[done_count], &chunk_key, data +
+                            *write_bytes + done_count * chunk_size,
+                            &current_alloc);
+                    current_count = (result == 0) ? 1 : 0;
+                } else {
+                    result = fs_client_proto_slice_write_pipelined(
+                            client_ctx, conn, req_ids + done_count,
+                            &chunk_key, data + *write_bytes + done_count *
+                            chunk_size, chunk_size, &current_count,
+                            &current_alloc);
+                }
+
+                /* the chunks done are never resent */
+                if (client_ctx->idempotency_enabled) {
+                    for (k=done_count; k<done_count+current_count; k++) {
+                        idempotency_client_channel_push(
+                                connection_params->channel, req_ids[k]);
+                    }
+                }
+                *inc_alloc += current_alloc;
+                done_count += current_count;
+
+                if (result == 0) {
                     break;
                 }
             }
@@ -311,29 +410,34 @@ int fs_client_slice_write(FSClientContext *client_ctx,
                 new_key.slice.length, result, current_alloc);
                 */
 
+        done_bytes = done_count * chunk_size;
+        if (done_bytes > bytes) {
+            done_bytes = bytes;
+        }
+        *write_bytes += done_bytes;
+        remain -= done_bytes;
+        new_key.slice.offset += done_bytes;
+
         if (connection_params->channel != old_channel) { //master changed
             sf_reset_net_retry_interval(&net_retry_ctx);
             continue;
         }
 
         if (client_ctx->idempotency_enabled) {
-            idempotency_client_channel_push(
-                    connection_params->channel, req_id);
+            for (k=done_count; k<chunk_count; k++) {
+                idempotency_client_channel_push(
+                        connection_params->channel, req_ids[k]);
+            }
         }
 
         if (result != 0) {
             break;
         }
 
-        *inc_alloc += current_alloc;
-        *write_bytes += bytes;
-        remain -= bytes;
-
         if (remain == 0) {
             break;
         }
 
-        new_key.slice.offset += bytes;
         sf_reset_net_retry_interval(&net_retry_ctx);
     }
 
@@ -357,19 +461,45 @@ int fs_client_slice_read_ex(FSClientContext *client_ctx,
 {
     ConnectionInfo *conn;
     FSBlockSliceKeyInfo new_key;
+    FSServerLoad *load;
+    int64_t start_time;
+    int data_group_index;
     int result;
     int remain;
     int bytes;
     int i;
     SFNetRetryIntervalContext net_retry_ctx;
 
+    data_group_index = FS_CLIENT_DATA_GROUP_INDEX(client_ctx,
+            bs_key->block.hash_code);
     if ((conn=client_ctx->conn_manager.get_readable_connection(client_ctx,
-                    FS_CLIENT_DATA_GROUP_INDEX(client_ctx, bs_key->block.
-                        hash_code), &result)) == NULL)
+                    data_group_index, &result)) == NULL)
     {
         return SF_UNIX_ERRNO(result, EIO);
     }
 
+    if (client_ctx->hedged_read.ctx != NULL && req_cmd ==
+            FS_SERVICE_PROTO_SLICE_READ_REQ && bs_key->slice.length <=
+            client_ctx->conn_manager.get_connection_params(
+                client_ctx, conn)->buffer_size)
+    {
+        if ((result=fs_hedged_slice_read(client_ctx, data_group_index,
+                        conn, bs_key, buff, read_bytes)) == 0 ||
+                result == ENODATA)
+        {
+            return result;
+        } else if (!SF_IS_RETRIABLE_ERROR(result)) {
+            return SF_UNIX_ERRNO(result, EIO);
+        }
+
+        /* read again with the retries for the network error */
+        if ((conn=client_ctx->conn_manager.get_readable_connection(
+                        client_ctx, data_group_index, &result)) == NULL)
+        {
+            return SF_UNIX_ERRNO(result, EIO);
+        }
+    }
+
     sf_init_net_retry_interval_context(&net_retry_ctx,
             &client_ctx->net_retry_cfg.interval_mm,
             &client_ctx->net_retry_cfg.network);
@@ -379,10 +509,22 @@ int fs_client_slice_read_ex(FSClientContext *client_ctx,
     remain = bs_key->slice.length;
     i = 0;
     while (remain > 0) {
-        if ((result=fs_client_proto_slice_read_ex(client_ctx, conn,
-                        slave_id, req_cmd, resp_cmd, &new_key,
-                        buff + *read_bytes, &bytes)) == 0)
-        {
+        if (client_ctx->selector != NULL) {
+            load = fs_server_selector_begin(client_ctx,
+                    data_group_index, conn);
+            start_time = get_current_time_us();
+        } else {
+            load = NULL;
+            start_time = 0;
+        }
+
+        result = fs_client_proto_slice_read_ex(client_ctx, conn, slave_id,
+                req_cmd, resp_cmd, &new_key, buff + *read_bytes, &bytes);
+        if (load != NULL) {
+            fs_server_selector_end(client_ctx, data_group_index, load,
+                    get_current_time_us() - start_time, result);
+        }
+        if (result == 0) {
             *read_bytes += bytes;
             break;
         }
@@ -397,9 +539,8 @@ int fs_client_slice_read_ex(FSClientContext *client_ctx,
                 */
 
         SF_CLIENT_RELEASE_CONNECTION(client_ctx, conn, result);
-        if ((conn=client_ctx->conn_manager.get_readable_connection(client_ctx,
-                        FS_CLIENT_DATA_GROUP_INDEX(client_ctx, bs_key->block.
-                            hash_code), &result)) == NULL)
+        if ((conn=client_ctx->conn_manager.get_readable_connection(
+                        client_ctx, data_group_index, &result)) == NULL)
         {
             break;
         }
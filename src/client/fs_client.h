@@ -25,6 +25,10 @@
 #include "client_global.h"
 #include "client_proto.h"
 #include "simple_connection_manager.h"
+#include "pooled_connection_manager.h"
+#include "server_selector.h"
+#include "hedged_read.h"
+#include "async_client.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -81,6 +85,17 @@ int fs_unlink_file(FSClientContext *client_ctx, const int64_t oid,
 int fs_cluster_stat(FSClientContext *client_ctx, const int data_group_id,
         FSClientClusterStatEntry *stats, const int size, int *count);
 
+/* the replica stats of the slaves from the masters,
+ * data_group_id 0 for all data groups */
+int fs_replica_stat(FSClientContext *client_ctx, const int data_group_id,
+        FSClientReplicaStatEntry *stats, const int size, int *count);
+
+/* the IO stats of the server: the allocation streams, the store paths,
+ * the replica packages and the replica compression */
+int fs_io_stat(FSClientContext *client_ctx, const int server_id,
+        FSClientIOStat *stat, FSClientPathIOStat *paths,
+        const int size, int *count);
+
 int fs_client_slice_write(FSClientContext *client_ctx,
         const FSBlockSliceKeyInfo *bs_key, const char *data,
         int *write_bytes, int *inc_alloc);
@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <sys/stat.h>
+#include <poll.h>
+#include <limits.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/sched_thread.h"
+#include "sf/sf_proto.h"
+#include "client_proto.h"
+#include "server_selector.h"
+#include "hedged_read.h"
+
+#define HEDGED_READ_CTX(client_ctx) \
+    ((FSHedgedReadContext *)(client_ctx)->hedged_read.ctx)
+
+typedef struct hedged_read_entry {
+    ConnectionInfo *conn;
+    FSServerLoad *load;
+    int64_t start_time_us;
+} HedgedReadEntry;
+
+int64_t fs_hedged_read_calc_percentile(const FSHedgedReadContext *hctx,
+        const int percentile)
+{
+    int64_t target;
+    int64_t count;
+    int index;
+
+    target = (hctx->histogram.total * percentile + 99) / 100;
+    count = 0;
+    for (index=0; index<FS_HEDGED_READ_BUCKET_COUNT - 1; index++) {
+        count += hctx->histogram.counts[index];
+        if (count >= target) {
+            break;
+        }
+    }
+
+    return fs_hedged_read_bucket_upper(index);
+}
+
+static void add_latency_sample(FSClientContext *client_ctx,
+        FSHedgedReadContext *hctx, const int64_t time_used_us)
+{
+    int64_t delay_us;
+    int index;
+
+    PTHREAD_MUTEX_LOCK(&hctx->lock);
+    hctx->histogram.counts[fs_hedged_read_bucket_index(time_used_us)]++;
+    if (++hctx->histogram.total >= FS_HEDGED_READ_DECAY_SAMPLES) {
+        /* the old samples fade out for the delay to follow the load */
+        hctx->histogram.total = 0;
+        for (index=0; index<FS_HEDGED_READ_BUCKET_COUNT; index++) {
+            hctx->histogram.counts[index] /= 2;
+            hctx->histogram.total += hctx->histogram.counts[index];
+        }
+    }
+
+    if (++hctx->histogram.samples >= FS_HEDGED_READ_UPDATE_SAMPLES &&
+            hctx->histogram.total >= FS_HEDGED_READ_MIN_SAMPLES)
+    {
+        delay_us = fs_hedged_read_calc_percentile(hctx,
+                client_ctx->hedged_read.percentile);
+        hctx->delay_us = (delay_us > FS_HEDGED_READ_MIN_DELAY_US ?
+                delay_us : FS_HEDGED_READ_MIN_DELAY_US);
+        hctx->histogram.samples = 0;
+    }
+    PTHREAD_MUTEX_UNLOCK(&hctx->lock);
+}
+
+static int64_t get_hedge_delay(FSClientContext *client_ctx,
+        FSHedgedReadContext *hctx)
+{
+    int64_t delay_us;
+
+    PTHREAD_MUTEX_LOCK(&hctx->lock);
+    hctx->stat.reads++;
+    hctx->tokens += client_ctx->hedged_read.budget;
+    if (hctx->tokens > FS_HEDGED_READ_MAX_TOKENS) {
+        hctx->tokens = FS_HEDGED_READ_MAX_TOKENS;
+    }
+    delay_us = hctx->delay_us;
+    PTHREAD_MUTEX_UNLOCK(&hctx->lock);
+
+    return delay_us;
+}
+
+static bool acquire_hedge_token(FSHedgedReadContext *hctx)
+{
+    bool acquired;
+
+    PTHREAD_MUTEX_LOCK(&hctx->lock);
+    if (hctx->tokens >= FS_HEDGED_READ_TOKEN_UNIT) {
+        hctx->tokens -= FS_HEDGED_READ_TOKEN_UNIT;
+        acquired = true;
+    } else {
+        acquired = false;
+    }
+    PTHREAD_MUTEX_UNLOCK(&hctx->lock);
+
+    return acquired;
+}
+
+static int wait_readable(struct pollfd *fds, const int count,
+        const int timeout_ms, int *index)
+{
+    int result;
+    int i;
+
+    result = poll(fds, count, timeout_ms);
+    if (result < 0) {
+        return errno != 0 ? errno : EIO;
+    } else if (result == 0) {
+        return ETIMEDOUT;
+    }
+
+    /* the first server is preferred when both are readable */
+    for (i=0; i<count; i++) {
+        if (fds[i].revents != 0) {
+            *index = i;
+            return 0;
+        }
+    }
+
+    return EAGAIN;
+}
+
+static inline int get_remain_timeout_ms(const int64_t deadline_us)
+{
+    int64_t remain_us;
+
+    remain_us = deadline_us - get_current_time_us();
+    return remain_us > 0 ? (remain_us + 999) / 1000 : 0;
+}
+
+/* the other server is selected from the cached servers
+ * without the RPC to query the readable server */
+static ConnectionInfo *get_another_readable_connection(
+        FSClientContext *client_ctx, const int data_group_index,
+        const ConnectionInfo *first)
+{
+    FSClientServerEntry server;
+    int result;
+
+    if (fs_server_selector_get_another(client_ctx, data_group_index,
+                first, &server) != 0)
+    {
+        return NULL;
+    }
+
+    return client_ctx->conn_manager.get_spec_connection(
+            client_ctx, &server.conn, &result);
+}
+
+static inline void begin_read(FSClientContext *client_ctx,
+        const int data_group_index, HedgedReadEntry *entry)
+{
+    if (client_ctx->selector != NULL) {
+        entry->load = fs_server_selector_begin(client_ctx,
+                data_group_index, entry->conn);
+    } else {
+        entry->load = NULL;
+    }
+    entry->start_time_us = get_current_time_us();
+}
+
+static inline void finish_read(FSClientContext *client_ctx,
+        const int data_group_index, HedgedReadEntry *entry,
+        const int result)
+{
+    if (entry->load != NULL) {
+        fs_server_selector_end(client_ctx, data_group_index, entry->load,
+                get_current_time_us() - entry->start_time_us, result);
+    }
+    SF_CLIENT_RELEASE_CONNECTION(client_ctx, entry->conn, result);
+}
+
+static inline void abandon_read(FSClientContext *client_ctx,
+        const int data_group_index, HedgedReadEntry *entry)
+{
+    /* the time waited is the lower bound of the latency */
+    if (entry->load != NULL) {
+        fs_server_selector_end(client_ctx, data_group_index, entry->load,
+                get_current_time_us() - entry->start_time_us, 0);
+    }
+
+    /* the response is pending, the connection can't be reused */
+    client_ctx->conn_manager.close_connection(client_ctx, entry->conn);
+}
+
+int fs_hedged_slice_read(FSClientContext *client_ctx,
+        const int data_group_index, ConnectionInfo *conn,
+        const FSBlockSliceKeyInfo *bs_key, char *buff,
+        int *read_bytes)
+{
+    FSHedgedReadContext *hctx;
+    HedgedReadEntry entries[2];
+    struct pollfd fds[2];
+    int64_t delay_us;
+    int64_t deadline_us;
+    int count;
+    int index;
+    int readable;
+    int result;
+
+    hctx = HEDGED_READ_CTX(client_ctx);
+    *read_bytes = 0;
+    delay_us = get_hedge_delay(client_ctx, hctx);
+
+    entries[0].conn = conn;
+    begin_read(client_ctx, data_group_index, entries + 0);
+    if ((result=fs_client_proto_slice_read_send(client_ctx,
+                    conn, bs_key)) != 0)
+    {
+        finish_read(client_ctx, data_group_index, entries + 0, result);
+        return result;
+    }
+
+    /* the total wait of the servers is bounded by the network timeout */
+    deadline_us = entries[0].start_time_us +
+        client_ctx->network_timeout * 1000LL * 1000LL;
+    count = 1;
+    index = 0;
+    fds[0].fd = conn->sock;
+    fds[0].events = POLLIN;
+    if (delay_us > 0 && wait_readable(fds, 1, (delay_us + 999) / 1000,
+                &index) == ETIMEDOUT && acquire_hedge_token(hctx))
+    {
+        if ((entries[1].conn=get_another_readable_connection(client_ctx,
+                        data_group_index, conn)) != NULL)
+        {
+            begin_read(client_ctx, data_group_index, entries + 1);
+            if ((result=fs_client_proto_slice_read_send(client_ctx,
+                            entries[1].conn, bs_key)) == 0)
+            {
+                __sync_add_and_fetch(&hctx->stat.issued, 1);
+                count = 2;
+                fds[1].fd = entries[1].conn->sock;
+                fds[1].events = POLLIN;
+            } else {
+                finish_read(client_ctx, data_group_index,
+                        entries + 1, result);
+            }
+        }
+    }
+
+    if ((result=wait_readable(fds, count, get_remain_timeout_ms(
+                        deadline_us), &index)) != 0)
+    {
+        /* no server answered within the network timeout */
+        finish_read(client_ctx, data_group_index, entries + 0, result);
+        if (count == 2) {
+            finish_read(client_ctx, data_group_index, entries + 1, result);
+        }
+        return result;
+    }
+
+    result = fs_client_proto_slice_read_recv(client_ctx,
+            entries[index].conn, bs_key, buff, read_bytes);
+    if (count == 2) {
+        if (result != 0 && result != ENODATA) {
+            /* take the response of the other server in the remain time */
+            finish_read(client_ctx, data_group_index,
+                    entries + index, result);
+            index = 1 - index;
+            if ((result=wait_readable(fds + index, 1, get_remain_timeout_ms(
+                                deadline_us), &readable)) == 0)
+            {
+                result = fs_client_proto_slice_read_recv(client_ctx,
+                        entries[index].conn, bs_key, buff, read_bytes);
+            }
+        } else {
+            abandon_read(client_ctx, data_group_index,
+                    entries + (1 - index));
+        }
+
+        if (index == 1 && (result == 0 || result == ENODATA)) {
+            __sync_add_and_fetch(&hctx->stat.won, 1);
+        }
+    }
+
+    if (result == 0 || result == ENODATA) {
+        /* the latency seen by the caller */
+        add_latency_sample(client_ctx, hctx, get_current_time_us() -
+                entries[0].start_time_us);
+    }
+    finish_read(client_ctx, data_group_index, entries + index, result);
+    return result;
+}
+
+void fs_hedged_read_get_stat(FSClientContext *client_ctx,
+        FSHedgedReadStat *stat)
+{
+    FSHedgedReadContext *hctx;
+
+    if ((hctx=HEDGED_READ_CTX(client_ctx)) == NULL) {
+        memset(stat, 0, sizeof(FSHedgedReadStat));
+        return;
+    }
+
+    PTHREAD_MUTEX_LOCK(&hctx->lock);
+    stat->reads = hctx->stat.reads;
+    PTHREAD_MUTEX_UNLOCK(&hctx->lock);
+    stat->issued = __sync_add_and_fetch(&hctx->stat.issued, 0);
+    stat->won = __sync_add_and_fetch(&hctx->stat.won, 0);
+}
+
+int fs_hedged_read_init(FSClientContext *client_ctx)
+{
+    FSHedgedReadContext *hctx;
+    int result;
+
+    hctx = (FSHedgedReadContext *)fc_malloc(sizeof(FSHedgedReadContext));
+    if (hctx == NULL) {
+        return ENOMEM;
+    }
+    memset(hctx, 0, sizeof(FSHedgedReadContext));
+
+    if ((result=init_pthread_lock(&hctx->lock)) != 0) {
+        free(hctx);
+        return result;
+    }
+
+    client_ctx->hedged_read.ctx = hctx;
+    return 0;
+}
+
+void fs_hedged_read_destroy(FSClientContext *client_ctx)
+{
+    FSHedgedReadContext *hctx;
+
+    if ((hctx=HEDGED_READ_CTX(client_ctx)) == NULL) {
+        return;
+    }
+
+    pthread_mutex_destroy(&hctx->lock);
+    free(hctx);
+    client_ctx->hedged_read.ctx = NULL;
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//hedged_read.h
+
+/* the hedged read of the slice.
+ *
+ * the read request is sent to the first server, when the server has not
+ * answered within the delay, the same request is sent to another ACTIVE
+ * server cached by the server selector and the response which arrives
+ * first is taken. the total wait is bounded by the network timeout.
+ * the delay is the configured percentile of the recent read latency.
+ * the hedged reads are limited by the budget: each read earns a share
+ * of a hedged read and a hedged read costs one, so the extra load is
+ * at most the budget.
+ */
+
+#ifndef _FS_HEDGED_READ_H
+#define _FS_HEDGED_READ_H
+
+#include "client_types.h"
+
+#define FS_HEDGED_READ_BUCKET_COUNT      128
+#define FS_HEDGED_READ_MIN_SAMPLES       100  //no hedged read before
+#define FS_HEDGED_READ_UPDATE_SAMPLES     64  //update the delay interval
+#define FS_HEDGED_READ_DECAY_SAMPLES    4096  //halve the histogram
+#define FS_HEDGED_READ_MIN_DELAY_US     1000
+#define FS_HEDGED_READ_TOKEN_UNIT        100  //the cost of a hedged read
+#define FS_HEDGED_READ_MAX_TOKENS  (10 * FS_HEDGED_READ_TOKEN_UNIT)
+
+typedef struct fs_hedged_read_stat {
+    int64_t reads;   //the reads which can be hedged
+    int64_t issued;  //the hedged reads sent
+    int64_t won;     //the hedged reads answered first
+} FSHedgedReadStat;
+
+typedef struct fs_hedged_read_context {
+    struct {
+        int64_t counts[FS_HEDGED_READ_BUCKET_COUNT];  //log-linear buckets
+        int64_t total;
+        int samples;  //since the last update of the delay
+    } histogram;
+    volatile int64_t delay_us;  //0 for not enough samples
+    int tokens;  //in 1 / FS_HEDGED_READ_TOKEN_UNIT hedged read
+    FSHedgedReadStat stat;
+    pthread_mutex_t lock;
+} FSHedgedReadContext;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /* 4 buckets for each power of 2 */
+    static inline int fs_hedged_read_bucket_index(const int64_t time_used_us)
+    {
+        int msb;
+        int index;
+
+        if (time_used_us < 4) {
+            return time_used_us > 0 ? time_used_us : 0;
+        }
+
+        msb = 63 - __builtin_clzll(time_used_us);
+        index = (msb - 1) * 4 + ((time_used_us >> (msb - 2)) & 3);
+        return index < FS_HEDGED_READ_BUCKET_COUNT ? index :
+            FS_HEDGED_READ_BUCKET_COUNT - 1;
+    }
+
+    /* the exclusive upper bound of the bucket in microseconds */
+    static inline int64_t fs_hedged_read_bucket_upper(const int index)
+    {
+        int shift;
+
+        if (index < 4) {
+            return index + 1;
+        }
+
+        shift = index / 4 - 1;
+        return (int64_t)(5 + index % 4) << shift;
+    }
+
+    /* the upper bound of the bucket where the percentile falls */
+    int64_t fs_hedged_read_calc_percentile(const FSHedgedReadContext *hctx,
+            const int percentile);
+
+    int fs_hedged_read_init(FSClientContext *client_ctx);
+    void fs_hedged_read_destroy(FSClientContext *client_ctx);
+
+    /* read the slice which does NOT exceed the buffer size,
+     * the connection is released or closed by this function */
+    int fs_hedged_slice_read(FSClientContext *client_ctx,
+            const int data_group_index, ConnectionInfo *conn,
+            const FSBlockSliceKeyInfo *bs_key, char *buff,
+            int *read_bytes);
+
+    void fs_hedged_read_get_stat(FSClientContext *client_ctx,
+            FSHedgedReadStat *stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
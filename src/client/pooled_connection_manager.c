@@ -0,0 +1,521 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <sys/stat.h>
+#include <limits.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/hash.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/sched_thread.h"
+#include "client_global.h"
+#include "client_proto.h"
+#include "simple_connection_manager.h"
+#include "pooled_connection_manager.h"
+
+#define POOLED_CM_HTABLE_CAPACITY   1361
+#define POOLED_CM_THREAD_STACK_SIZE (256 * 1024)
+
+struct fs_pooled_server;
+
+typedef struct fs_pooled_connection {
+    ConnectionInfo conn;   //must be the first
+    FSConnectionParameters params;
+    struct fs_pooled_server *server;
+    time_t last_used_time;
+    bool in_use;
+} FSPooledConnection;
+
+typedef struct fs_pooled_server {
+    char ip_addr[IP_ADDRESS_SIZE];
+    uint16_t port;
+    int in_use_count;
+    int waiting_count;
+    pthread_lock_cond_pair_t lcp;
+    FSPooledConnection *connections;
+    struct fs_pooled_server *next;  //for hashtable
+} FSPooledServer;
+
+typedef struct fs_pooled_connection_manager {
+    FSClientContext *client_ctx;
+    int connections_per_server;
+    int check_interval;
+    struct {
+        FSPooledServer **buckets;
+        pthread_mutex_t lock;
+    } htable;
+    volatile bool running;
+    pthread_t tid;
+} FSPooledConnectionManager;
+
+#define POOLED_CM(client_ctx) \
+    ((FSPooledConnectionManager *)client_ctx->conn_manager.args)
+
+static FSPooledServer *create_server(FSPooledConnectionManager *pcm,
+        const char *ip_addr, const uint16_t port)
+{
+    FSPooledServer *server;
+    FSPooledConnection *pc;
+    FSPooledConnection *end;
+    int bytes;
+
+    bytes = sizeof(FSPooledServer) + sizeof(FSPooledConnection) *
+        pcm->connections_per_server;
+    if ((server=(FSPooledServer *)fc_malloc(bytes)) == NULL) {
+        return NULL;
+    }
+    memset(server, 0, bytes);
+    if (init_pthread_lock_cond_pair(&server->lcp) != 0) {
+        free(server);
+        return NULL;
+    }
+
+    snprintf(server->ip_addr, sizeof(server->ip_addr), "%s", ip_addr);
+    server->port = port;
+    server->connections = (FSPooledConnection *)(server + 1);
+    end = server->connections + pcm->connections_per_server;
+    for (pc=server->connections; pc<end; pc++) {
+        conn_pool_set_server_info(&pc->conn, ip_addr, port);
+        pc->conn.sock = -1;
+        pc->conn.args = &pc->params;
+        pc->server = server;
+    }
+
+    return server;
+}
+
+static FSPooledServer *get_server(FSPooledConnectionManager *pcm,
+        const char *ip_addr, const uint16_t port)
+{
+    FSPooledServer **bucket;
+    FSPooledServer *server;
+    unsigned int hash_code;
+
+    hash_code = simple_hash(ip_addr, strlen(ip_addr)) + port;
+    bucket = pcm->htable.buckets + hash_code % POOLED_CM_HTABLE_CAPACITY;
+
+    PTHREAD_MUTEX_LOCK(&pcm->htable.lock);
+    server = *bucket;
+    while (server != NULL) {
+        if (server->port == port && strcmp(server->ip_addr, ip_addr) == 0) {
+            break;
+        }
+        server = server->next;
+    }
+
+    if (server == NULL) {
+        if ((server=create_server(pcm, ip_addr, port)) != NULL) {
+            server->next = *bucket;
+            *bucket = server;
+        }
+    }
+    PTHREAD_MUTEX_UNLOCK(&pcm->htable.lock);
+
+    return server;
+}
+
+static FSPooledConnection *get_idle_connection(
+        FSPooledConnectionManager *pcm, FSPooledServer *server)
+{
+    FSPooledConnection *pc;
+    FSPooledConnection *end;
+    FSPooledConnection *unconnected;
+
+    unconnected = NULL;
+    end = server->connections + pcm->connections_per_server;
+    for (pc=server->connections; pc<end; pc++) {
+        if (pc->in_use) {
+            continue;
+        }
+        if (pc->conn.sock >= 0) {
+            return pc;
+        }
+        if (unconnected == NULL) {
+            unconnected = pc;
+        }
+    }
+
+    return unconnected;
+}
+
+static FSPooledConnection *checkout_connection(
+        FSPooledConnectionManager *pcm, FSPooledServer *server,
+        int *err_no)
+{
+    FSPooledConnection *pc;
+    struct timespec ts;
+
+    ts.tv_sec = get_current_time() + pcm->client_ctx->network_timeout;
+    ts.tv_nsec = 0;
+    *err_no = 0;
+
+    PTHREAD_MUTEX_LOCK(&server->lcp.lock);
+    while ((pc=get_idle_connection(pcm, server)) == NULL) {
+        server->waiting_count++;
+        *err_no = pthread_cond_timedwait(&server->lcp.cond,
+                &server->lcp.lock, &ts);
+        server->waiting_count--;
+        if (*err_no == ETIMEDOUT) {
+            break;
+        }
+    }
+
+    if (pc != NULL) {
+        pc->in_use = true;
+        server->in_use_count++;
+        *err_no = 0;
+    }
+    PTHREAD_MUTEX_UNLOCK(&server->lcp.lock);
+
+    if (pc == NULL) {
+        logError("file: "__FILE__", line: %d, "
+                "server %s:%u, wait for idle connection timeout, "
+                "connections per server: %d", __LINE__, server->ip_addr,
+                server->port, pcm->connections_per_server);
+    }
+    return pc;
+}
+
+static void checkin_connection(FSPooledConnection *pc, const bool forced)
+{
+    FSPooledServer *server;
+
+    if (forced && pc->conn.sock >= 0) {
+        conn_pool_disconnect_server(&pc->conn);
+    }
+
+    server = pc->server;
+    PTHREAD_MUTEX_LOCK(&server->lcp.lock);
+    pc->in_use = false;
+    pc->last_used_time = get_current_time();
+    server->in_use_count--;
+    if (server->waiting_count > 0) {
+        pthread_cond_signal(&server->lcp.cond);
+    }
+    PTHREAD_MUTEX_UNLOCK(&server->lcp.lock);
+}
+
+static int connect_server(FSPooledConnectionManager *pcm,
+        FSPooledConnection *pc)
+{
+    int result;
+
+    if ((result=conn_pool_connect_server(&pc->conn, pcm->
+                    client_ctx->connect_timeout)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=fs_connection_manager_join_server(pcm->client_ctx,
+                    &pc->conn)) != 0)
+    {
+        conn_pool_disconnect_server(&pc->conn);
+        return result;
+    }
+
+    pc->last_used_time = get_current_time();
+    return 0;
+}
+
+static ConnectionInfo *get_spec_connection(FSClientContext *client_ctx,
+        const ConnectionInfo *target, int *err_no)
+{
+    FSPooledConnectionManager *pcm;
+    FSPooledServer *server;
+    FSPooledConnection *pc;
+
+    pcm = POOLED_CM(client_ctx);
+    if ((server=get_server(pcm, target->ip_addr, target->port)) == NULL) {
+        *err_no = ENOMEM;
+        return NULL;
+    }
+
+    if ((pc=checkout_connection(pcm, server, err_no)) == NULL) {
+        return NULL;
+    }
+
+    if (pc->conn.sock < 0) {
+        if ((*err_no=connect_server(pcm, pc)) != 0) {
+            checkin_connection(pc, true);
+            return NULL;
+        }
+    }
+
+    return &pc->conn;
+}
+
+static inline int get_in_use_count(FSPooledConnectionManager *pcm,
+        FSClientContext *client_ctx, FCServerInfo *server)
+{
+    FCAddressPtrArray *addr_array;
+    FCAddressInfo *addr;
+    FSPooledServer *pserver;
+
+    addr_array = &FS_CFG_SERVICE_ADDRESS_ARRAY(client_ctx, server);
+    if (addr_array->count <= 0) {
+        return INT_MAX;
+    }
+
+    addr = addr_array->addrs[addr_array->index];
+    if ((pserver=get_server(pcm, addr->conn.ip_addr,
+                    addr->conn.port)) == NULL)
+    {
+        return INT_MAX;
+    }
+    return __sync_add_and_fetch(&pserver->in_use_count, 0);
+}
+
+/* get the connection of the server with the fewest connections in use */
+static ConnectionInfo *get_connection(FSClientContext *client_ctx,
+        const int data_group_index, int *err_no)
+{
+    FSPooledConnectionManager *pcm;
+    FCServerInfoPtrArray *server_ptr_array;
+    FCServerInfo *server;
+    ConnectionInfo *conn;
+    int start;
+    int selected;
+    int in_use_count;
+    int min_count;
+    int index;
+    int i;
+
+    pcm = POOLED_CM(client_ctx);
+    server_ptr_array = &client_ctx->cluster_cfg.ptr->data_groups.mappings
+        [data_group_index].server_group->server_array;
+
+    start = rand() % server_ptr_array->count;
+    selected = start;
+    min_count = INT_MAX;
+    for (i=0; i<server_ptr_array->count; i++) {
+        index = (start + i) % server_ptr_array->count;
+        in_use_count = get_in_use_count(pcm, client_ctx,
+                server_ptr_array->servers[index]);
+        if (in_use_count < min_count) {
+            min_count = in_use_count;
+            selected = index;
+        }
+    }
+
+    server = server_ptr_array->servers[selected];
+    if ((conn=client_ctx->conn_manager.get_server_connection(
+                    client_ctx, server, err_no)) != NULL)
+    {
+        return conn;
+    }
+
+    for (i=0; i<server_ptr_array->count; i++) {
+        if (i == selected) {
+            continue;
+        }
+
+        if ((conn=client_ctx->conn_manager.get_server_connection(client_ctx,
+                        server_ptr_array->servers[i], err_no)) != NULL)
+        {
+            return conn;
+        }
+    }
+
+    logError("file: "__FILE__", line: %d, "
+            "data group index: %d, get_connection fail, "
+            "configured server count: %d", __LINE__,
+            data_group_index, server_ptr_array->count);
+    return NULL;
+}
+
+static void release_connection(FSClientContext *client_ctx,
+        ConnectionInfo *conn)
+{
+    fs_connection_manager_reset_master_cache(client_ctx, conn, false);
+    checkin_connection((FSPooledConnection *)conn, false);
+}
+
+static void close_connection(FSClientContext *client_ctx,
+        ConnectionInfo *conn)
+{
+    fs_connection_manager_reset_master_cache(client_ctx, conn, true);
+    checkin_connection((FSPooledConnection *)conn, true);
+}
+
+static void check_connection(FSPooledConnectionManager *pcm,
+        FSPooledConnection *pc)
+{
+    SFResponseInfo response;
+    int result;
+
+    if (pc->conn.sock < 0) {
+        result = connect_server(pcm, pc);
+    } else if ((result=sf_active_test(&pc->conn, &response,
+                    pcm->client_ctx->network_timeout)) != 0)
+    {
+        sf_log_network_error(&response, &pc->conn, result);
+    }
+
+    checkin_connection(pc, result != 0);
+}
+
+static void check_server(FSPooledConnectionManager *pcm,
+        FSPooledServer *server)
+{
+    FSPooledConnection *pc;
+    FSPooledConnection *end;
+    time_t current_time;
+    bool need_check;
+
+    current_time = get_current_time();
+    end = server->connections + pcm->connections_per_server;
+    for (pc=server->connections; pc<end; pc++) {
+        PTHREAD_MUTEX_LOCK(&server->lcp.lock);
+        need_check = !pc->in_use && (pc->conn.sock < 0 || current_time -
+                pc->last_used_time >= pcm->check_interval);
+        if (need_check) {
+            pc->in_use = true;
+            server->in_use_count++;
+        }
+        PTHREAD_MUTEX_UNLOCK(&server->lcp.lock);
+
+        if (need_check) {
+            check_connection(pcm, pc);
+        }
+    }
+}
+
+static void *pooled_cm_thread_func(void *arg)
+{
+    FSPooledConnectionManager *pcm;
+    FSPooledServer **bucket;
+    FSPooledServer **end;
+    FSPooledServer *server;
+    int i;
+
+    pcm = (FSPooledConnectionManager *)arg;
+    while (pcm->running) {
+        for (i=0; i<pcm->check_interval && pcm->running; i++) {
+            sleep(1);
+        }
+        if (!pcm->running) {
+            break;
+        }
+
+        /* the servers are never removed until destroy */
+        end = pcm->htable.buckets + POOLED_CM_HTABLE_CAPACITY;
+        for (bucket=pcm->htable.buckets; bucket<end; bucket++) {
+            PTHREAD_MUTEX_LOCK(&pcm->htable.lock);
+            server = *bucket;
+            PTHREAD_MUTEX_UNLOCK(&pcm->htable.lock);
+
+            while (server != NULL && pcm->running) {
+                check_server(pcm, server);
+                server = server->next;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+int fs_pooled_connection_manager_init(FSClientContext *client_ctx,
+        FSConnectionManager *conn_manager, const int connections_per_server,
+        const int check_interval)
+{
+    FSPooledConnectionManager *pcm;
+    int bytes;
+    int result;
+
+    if ((result=fs_connection_manager_init_common(client_ctx,
+                    conn_manager)) != 0)
+    {
+        return result;
+    }
+
+    pcm = (FSPooledConnectionManager *)fc_malloc(
+            sizeof(FSPooledConnectionManager));
+    if (pcm == NULL) {
+        return ENOMEM;
+    }
+    memset(pcm, 0, sizeof(FSPooledConnectionManager));
+
+    bytes = sizeof(FSPooledServer *) * POOLED_CM_HTABLE_CAPACITY;
+    pcm->htable.buckets = (FSPooledServer **)fc_malloc(bytes);
+    if (pcm->htable.buckets == NULL) {
+        return ENOMEM;
+    }
+    memset(pcm->htable.buckets, 0, bytes);
+    if ((result=init_pthread_lock(&pcm->htable.lock)) != 0) {
+        return result;
+    }
+
+    pcm->client_ctx = client_ctx;
+    pcm->connections_per_server = connections_per_server > 0 ?
+        connections_per_server : 1;
+    pcm->check_interval = check_interval > 0 ? check_interval : 30;
+
+    conn_manager->args = pcm;
+    conn_manager->get_connection = get_connection;
+    conn_manager->get_spec_connection = get_spec_connection;
+    conn_manager->release_connection = release_connection;
+    conn_manager->close_connection = close_connection;
+
+    pcm->running = true;
+    if ((result=fc_create_thread(&pcm->tid, pooled_cm_thread_func,
+                    pcm, POOLED_CM_THREAD_STACK_SIZE)) != 0)
+    {
+        pcm->running = false;
+    }
+    return result;
+}
+
+void fs_pooled_connection_manager_destroy(FSConnectionManager *conn_manager)
+{
+    FSPooledConnectionManager *pcm;
+    FSPooledServer **bucket;
+    FSPooledServer **end;
+    FSPooledServer *server;
+    FSPooledServer *deleted;
+    FSPooledConnection *pc;
+    FSPooledConnection *pc_end;
+
+    if ((pcm=(FSPooledConnectionManager *)conn_manager->args) == NULL) {
+        return;
+    }
+
+    if (pcm->running) {
+        pcm->running = false;
+        pthread_join(pcm->tid, NULL);
+    }
+
+    end = pcm->htable.buckets + POOLED_CM_HTABLE_CAPACITY;
+    for (bucket=pcm->htable.buckets; bucket<end; bucket++) {
+        server = *bucket;
+        while (server != NULL) {
+            pc_end = server->connections + pcm->connections_per_server;
+            for (pc=server->connections; pc<pc_end; pc++) {
+                if (pc->conn.sock >= 0) {
+                    conn_pool_disconnect_server(&pc->conn);
+                }
+            }
+
+            deleted = server;
+            server = server->next;
+            destroy_pthread_lock_cond_pair(&deleted->lcp);
+            free(deleted);
+        }
+    }
+
+    pthread_mutex_destroy(&pcm->htable.lock);
+    free(pcm->htable.buckets);
+    free(pcm);
+    conn_manager->args = NULL;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//pooled_connection_manager.h
+
+/* the connection manager with a fixed count of persistent connections
+ * per server. the caller waits for an idle connection when all of the
+ * connections of the server are in use. the connections of any server
+ * of the data group are taken from the server with the fewest
+ * connections in use. the idle connections are checked and the broken
+ * ones are reconnected by a background thread.
+ */
+
+#ifndef _FS_POOLED_CONNECTION_MANAGER_H
+#define _FS_POOLED_CONNECTION_MANAGER_H
+
+#include "client_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int fs_pooled_connection_manager_init(FSClientContext *client_ctx,
+        FSConnectionManager *conn_manager, const int connections_per_server,
+        const int check_interval);
+
+void fs_pooled_connection_manager_destroy(FSConnectionManager *conn_manager);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,390 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <sys/stat.h>
+#include <limits.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/sched_thread.h"
+#include "client_proto.h"
+#include "server_selector.h"
+
+#define SERVER_SELECTOR(client_ctx) \
+    ((FSServerSelector *)(client_ctx)->selector)
+
+static FSServerLoad *get_server_load(FSServerSelector *selector,
+        const int server_id)
+{
+    FSServerLoad *load;
+    FSServerLoad *end;
+
+    PTHREAD_MUTEX_LOCK(&selector->loads.lock);
+    end = selector->loads.entries + selector->loads.count;
+    for (load=selector->loads.entries; load<end; load++) {
+        if (load->server_id == server_id) {
+            break;
+        }
+    }
+
+    if (load == end) {
+        if (selector->loads.count < selector->loads.alloc) {
+            load->server_id = server_id;
+            selector->loads.count++;
+        } else {
+            load = NULL;
+        }
+    }
+    PTHREAD_MUTEX_UNLOCK(&selector->loads.lock);
+
+    return load;
+}
+
+static int fetch_readable_servers(FSClientContext *client_ctx,
+        const int data_group_index, FSClientClusterStatEntry *stats,
+        const int size, int *count)
+{
+    FCServerInfoPtrArray *server_ptr_array;
+    FCAddressPtrArray *addr_array;
+    int result;
+    int i;
+
+    /* any server of the data group knows the status of the group */
+    server_ptr_array = &client_ctx->cluster_cfg.ptr->data_groups.mappings
+        [data_group_index].server_group->server_array;
+    result = ENOENT;
+    for (i=0; i<server_ptr_array->count; i++) {
+        addr_array = &FS_CFG_SERVICE_ADDRESS_ARRAY(client_ctx,
+                server_ptr_array->servers[i]);
+        if (addr_array->count <= 0) {
+            continue;
+        }
+
+        if ((result=fs_client_proto_cluster_stat(client_ctx,
+                        &addr_array->addrs[addr_array->index]->conn,
+                        data_group_index + 1, stats, size, count)) == 0)
+        {
+            break;
+        }
+    }
+
+    return result;
+}
+
+static int refresh_readable_servers(FSClientContext *client_ctx,
+        const int data_group_index)
+{
+    FSServerSelector *selector;
+    FSReadableServerGroup *group;
+    FSClientClusterStatEntry stats[FS_MAX_GROUP_SERVERS];
+    FSClientClusterStatEntry *stat;
+    FSClientClusterStatEntry *end;
+    FSReadableServer *server;
+    int count;
+    int slave_count;
+    int result;
+    bool use_master;
+
+    if ((result=fetch_readable_servers(client_ctx, data_group_index,
+                    stats, FS_MAX_GROUP_SERVERS, &count)) != 0)
+    {
+        return result;
+    }
+
+    slave_count = 0;
+    end = stats + count;
+    for (stat=stats; stat<end; stat++) {
+        if (stat->status == FS_SERVER_STATUS_ACTIVE && !stat->is_master) {
+            slave_count++;
+        }
+    }
+
+    /* the master is readable when no slave for rule slave first */
+    use_master = !(client_ctx->read_rule == sf_data_read_rule_slave_first
+            && slave_count > 0);
+
+    selector = SERVER_SELECTOR(client_ctx);
+    group = selector->groups + data_group_index;
+    PTHREAD_MUTEX_LOCK(&group->lock);
+    server = group->servers;
+    for (stat=stats; stat<end; stat++) {
+        if (stat->status != FS_SERVER_STATUS_ACTIVE ||
+                (stat->is_master && !use_master))
+        {
+            continue;
+        }
+
+        server->entry.server_id = stat->server_id;
+        server->entry.status = stat->status;
+        conn_pool_set_server_info(&server->entry.conn,
+                stat->ip_addr, stat->port);
+        server->is_master = stat->is_master;
+        server->load = get_server_load(selector, stat->server_id);
+        server++;
+    }
+    group->count = server - group->servers;
+    group->last_refresh_time = get_current_time();
+    PTHREAD_MUTEX_UNLOCK(&group->lock);
+
+    return 0;
+}
+
+static inline int64_t get_server_score(FSReadableServer *server,
+        const int64_t current_time_us)
+{
+    int64_t latency;
+
+    if (server->load == NULL) {
+        return 1;
+    }
+
+    /* the stale latency is ignored for the server to be tried again */
+    if (current_time_us - server->load->last_sample_time_us >
+            FS_SERVER_SELECTOR_STALE_TIME_US)
+    {
+        latency = 0;
+    } else {
+        latency = server->load->ewma_latency_us;
+    }
+
+    return (latency + 1) * (__sync_add_and_fetch(&server->load->
+                inflight, 0) + 1);
+}
+
+int fs_server_selector_get_readable(FSClientContext *client_ctx,
+        const int data_group_index, FSClientServerEntry *server)
+{
+    FSReadableServerGroup *group;
+    FSReadableServer *selected;
+    int64_t current_time_us;
+    int refresh_result;
+    int result;
+    int i;
+    int j;
+
+    group = SERVER_SELECTOR(client_ctx)->groups + data_group_index;
+    refresh_result = 0;
+    if (get_current_time() - group->last_refresh_time >=
+            FS_SERVER_SELECTOR_REFRESH_INTERVAL &&
+            __sync_bool_compare_and_swap(&group->refreshing, 0, 1))
+    {
+        /* the other callers select from the cached servers meanwhile */
+        if ((refresh_result=refresh_readable_servers(client_ctx,
+                        data_group_index)) != 0)
+        {
+            /* retry in one second with the cached servers */
+            group->last_refresh_time = get_current_time() -
+                FS_SERVER_SELECTOR_REFRESH_INTERVAL + 1;
+        }
+        __sync_bool_compare_and_swap(&group->refreshing, 1, 0);
+    }
+
+    PTHREAD_MUTEX_LOCK(&group->lock);
+    if (group->count == 0) {
+        result = (refresh_result != 0 ? refresh_result : ENOENT);
+    } else {
+        if (group->count == 1) {
+            selected = group->servers;
+        } else {
+            i = rand() % group->count;
+            j = rand() % (group->count - 1);
+            if (j >= i) {
+                j++;
+            }
+
+            current_time_us = get_current_time_us();
+            if (get_server_score(group->servers + i, current_time_us) <=
+                    get_server_score(group->servers + j, current_time_us))
+            {
+                selected = group->servers + i;
+            } else {
+                selected = group->servers + j;
+            }
+        }
+
+        *server = selected->entry;
+        result = 0;
+    }
+    PTHREAD_MUTEX_UNLOCK(&group->lock);
+
+    return result;
+}
+
+int fs_server_selector_get_another(FSClientContext *client_ctx,
+        const int data_group_index, const ConnectionInfo *exclude,
+        FSClientServerEntry *server)
+{
+    FSReadableServerGroup *group;
+    FSReadableServer *current;
+    FSReadableServer *end;
+    FSReadableServer *selected;
+    int64_t current_time_us;
+    int64_t score;
+    int64_t lowest;
+    int result;
+
+    group = SERVER_SELECTOR(client_ctx)->groups + data_group_index;
+    selected = NULL;
+    lowest = 0;
+    current_time_us = get_current_time_us();
+    PTHREAD_MUTEX_LOCK(&group->lock);
+    end = group->servers + group->count;
+    for (current=group->servers; current<end; current++) {
+        if (FC_CONNECTION_SERVER_EQUAL1(current->entry.conn, *exclude)) {
+            continue;
+        }
+
+        score = get_server_score(current, current_time_us);
+        if (selected == NULL || score < lowest) {
+            selected = current;
+            lowest = score;
+        }
+    }
+
+    if (selected != NULL) {
+        *server = selected->entry;
+        result = 0;
+    } else {
+        result = ENOENT;
+    }
+    PTHREAD_MUTEX_UNLOCK(&group->lock);
+
+    return result;
+}
+
+FSServerLoad *fs_server_selector_begin(FSClientContext *client_ctx,
+        const int data_group_index, const ConnectionInfo *conn)
+{
+    FSReadableServerGroup *group;
+    FSReadableServer *server;
+    FSReadableServer *end;
+    FSServerLoad *load;
+
+    load = NULL;
+    group = SERVER_SELECTOR(client_ctx)->groups + data_group_index;
+    PTHREAD_MUTEX_LOCK(&group->lock);
+    end = group->servers + group->count;
+    for (server=group->servers; server<end; server++) {
+        if (FC_CONNECTION_SERVER_EQUAL1(*conn, server->entry.conn)) {
+            load = server->load;
+            break;
+        }
+    }
+    PTHREAD_MUTEX_UNLOCK(&group->lock);
+
+    if (load != NULL) {
+        __sync_add_and_fetch(&load->inflight, 1);
+    }
+    return load;
+}
+
+void fs_server_selector_end(FSClientContext *client_ctx,
+        const int data_group_index, FSServerLoad *load,
+        const int64_t time_used_us, const int result)
+{
+    FSServerSelector *selector;
+    int64_t sample;
+
+    if (load == NULL) {
+        return;
+    }
+
+    selector = SERVER_SELECTOR(client_ctx);
+    sample = time_used_us;
+    if (result != 0 && result != ENODATA && result != ENOENT) {
+        if (sample < FS_SERVER_SELECTOR_FAIL_PENALTY_US) {
+            sample = FS_SERVER_SELECTOR_FAIL_PENALTY_US;
+        }
+
+        /* the status of the servers may be changed, the next
+         * selection refreshes the servers by one caller */
+        selector->groups[data_group_index].last_refresh_time = 0;
+    }
+
+    PTHREAD_MUTEX_LOCK(&selector->loads.lock);
+    if (load->ewma_latency_us == 0) {
+        load->ewma_latency_us = sample;
+    } else {
+        load->ewma_latency_us += (sample - load->ewma_latency_us) >>
+            FS_SERVER_SELECTOR_EWMA_SHIFT;
+    }
+    load->last_sample_time_us = get_current_time_us();
+    PTHREAD_MUTEX_UNLOCK(&selector->loads.lock);
+
+    __sync_sub_and_fetch(&load->inflight, 1);
+}
+
+int fs_server_selector_init(FSClientContext *client_ctx)
+{
+    FSServerSelector *selector;
+    FSReadableServerGroup *group;
+    FSReadableServerGroup *end;
+    int bytes;
+    int result;
+
+    selector = (FSServerSelector *)fc_malloc(sizeof(FSServerSelector));
+    if (selector == NULL) {
+        return ENOMEM;
+    }
+    memset(selector, 0, sizeof(FSServerSelector));
+
+    selector->loads.alloc = FC_SID_SERVER_COUNT(client_ctx->
+            cluster_cfg.ptr->server_cfg);
+    bytes = sizeof(FSServerLoad) * selector->loads.alloc;
+    if ((selector->loads.entries=(FSServerLoad *)fc_malloc(bytes)) == NULL) {
+        return ENOMEM;
+    }
+    memset(selector->loads.entries, 0, bytes);
+    if ((result=init_pthread_lock(&selector->loads.lock)) != 0) {
+        return result;
+    }
+
+    selector->group_count = FS_DATA_GROUP_COUNT(*client_ctx->cluster_cfg.ptr);
+    bytes = sizeof(FSReadableServerGroup) * selector->group_count;
+    if ((selector->groups=(FSReadableServerGroup *)fc_malloc(bytes)) == NULL) {
+        return ENOMEM;
+    }
+    memset(selector->groups, 0, bytes);
+    end = selector->groups + selector->group_count;
+    for (group=selector->groups; group<end; group++) {
+        if ((result=init_pthread_lock(&group->lock)) != 0) {
+            return result;
+        }
+    }
+
+    client_ctx->selector = selector;
+    return 0;
+}
+
+void fs_server_selector_destroy(FSClientContext *client_ctx)
+{
+    FSServerSelector *selector;
+    FSReadableServerGroup *group;
+    FSReadableServerGroup *end;
+
+    if ((selector=SERVER_SELECTOR(client_ctx)) == NULL) {
+        return;
+    }
+
+    end = selector->groups + selector->group_count;
+    for (group=selector->groups; group<end; group++) {
+        pthread_mutex_destroy(&group->lock);
+    }
+    pthread_mutex_destroy(&selector->loads.lock);
+    free(selector->groups);
+    free(selector->loads.entries);
+    free(selector);
+    client_ctx->selector = NULL;
+}
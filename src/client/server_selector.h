@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//server_selector.h
+
+/* the latency-aware selection of the readable server.
+ *
+ * the ACTIVE servers of the data group are fetched from the cluster and
+ * cached for a while, only one caller refreshes the expired servers while
+ * the others select from the cached servers. the client keeps the EWMA
+ * of the read latency and the reads in flight of each server, the server
+ * is selected by the power of two choices: pick two servers at random and
+ * take the one with the lower score, the score is the latency multiplied
+ * by the load.
+ */
+
+#ifndef _FS_SERVER_SELECTOR_H
+#define _FS_SERVER_SELECTOR_H
+
+#include "client_types.h"
+
+#define FS_SERVER_SELECTOR_REFRESH_INTERVAL   10  //in seconds
+#define FS_SERVER_SELECTOR_STALE_TIME_US  (10 * 1000 * 1000LL)
+#define FS_SERVER_SELECTOR_FAIL_PENALTY_US  (1000 * 1000LL)
+#define FS_SERVER_SELECTOR_EWMA_SHIFT          3  //alpha is 1/8
+
+typedef struct fs_server_load {
+    int server_id;
+    volatile int inflight;
+    int64_t ewma_latency_us;  //0 for no sample
+    int64_t last_sample_time_us;
+} FSServerLoad;
+
+typedef struct fs_readable_server {
+    FSClientServerEntry entry;
+    bool is_master;
+    FSServerLoad *load;
+} FSReadableServer;
+
+typedef struct fs_readable_server_group {
+    FSReadableServer servers[FS_MAX_GROUP_SERVERS];
+    int count;
+    volatile time_t last_refresh_time;
+    volatile char refreshing;  //only one caller refreshes
+    pthread_mutex_t lock;
+} FSReadableServerGroup;
+
+typedef struct fs_server_selector {
+    struct {
+        FSServerLoad *entries;
+        int count;
+        int alloc;
+        pthread_mutex_t lock;
+    } loads;
+
+    FSReadableServerGroup *groups;  //indexed by data group index
+    int group_count;
+} FSServerSelector;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    int fs_server_selector_init(FSClientContext *client_ctx);
+    void fs_server_selector_destroy(FSClientContext *client_ctx);
+
+    /* select a readable server of the data group */
+    int fs_server_selector_get_readable(FSClientContext *client_ctx,
+            const int data_group_index, FSClientServerEntry *server);
+
+    /* select the readable server with the lowest score except the
+     * excluded one from the cached servers, without refreshing.
+     * return ENOENT when no other server */
+    int fs_server_selector_get_another(FSClientContext *client_ctx,
+            const int data_group_index, const ConnectionInfo *exclude,
+            FSClientServerEntry *server);
+
+    /* called before the read request, return the load of the server */
+    FSServerLoad *fs_server_selector_begin(FSClientContext *client_ctx,
+            const int data_group_index, const ConnectionInfo *conn);
+
+    /* called after the read request with the time used */
+    void fs_server_selector_end(FSClientContext *client_ctx,
+            const int data_group_index, FSServerLoad *load,
+            const int64_t time_used_us, const int result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
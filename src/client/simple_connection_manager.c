@@ -22,6 +22,7 @@
 #include "client_func.h"
 #include "client_proto.h"
 #include "simple_connection_manager.h"
+#include "server_selector.h"
 
 static ConnectionInfo *get_spec_connection(FSClientContext *client_ctx,
         const ConnectionInfo *target, int *err_no)
@@ -30,6 +31,17 @@ static ConnectionInfo *get_spec_connection(FSClientContext *client_ctx,
             conn_manager.args, target, err_no);
 }
 
+/* the connections are got and put back through the connection manager,
+ * so these functions are shared with the pooled connection manager */
+#define CM_GET_SPEC_CONNECTION(client_ctx, target, err_no) \
+    client_ctx->conn_manager.get_spec_connection(client_ctx, target, err_no)
+
+#define CM_RELEASE_CONNECTION(client_ctx, conn) \
+    client_ctx->conn_manager.release_connection(client_ctx, conn)
+
+#define CM_CLOSE_CONNECTION(client_ctx, conn) \
+    client_ctx->conn_manager.close_connection(client_ctx, conn)
+
 static ConnectionInfo *make_connection(FSClientContext *client_ctx,
         FCAddressPtrArray *addr_array, int *err_no)
 {
@@ -44,7 +56,7 @@ static ConnectionInfo *make_connection(FSClientContext *client_ctx,
     }
 
     current = addr_array->addrs + addr_array->index;
-    if ((conn=get_spec_connection(client_ctx, &(*current)->conn,
+    if ((conn=CM_GET_SPEC_CONNECTION(client_ctx, &(*current)->conn,
                     err_no)) != NULL)
     {
         return conn;
@@ -60,7 +72,7 @@ static ConnectionInfo *make_connection(FSClientContext *client_ctx,
             continue;
         }
 
-        if ((conn=get_spec_connection(client_ctx, &(*addr)->conn,
+        if ((conn=CM_GET_SPEC_CONNECTION(client_ctx, &(*addr)->conn,
                         err_no)) != NULL)
         {
             addr_array->index = addr - addr_array->addrs;
@@ -160,7 +172,9 @@ static ConnectionInfo *get_master_connection(FSClientContext *client_ctx,
     mconn = *CM_MASTER_CACHE_CONN(client_ctx, data_group_index);
     CM_MASTER_CACHE_MUTEX_UNLOCK(client_ctx, data_group_index);
     if (mconn.port > 0) {
-        if ((conn=get_spec_connection(client_ctx, &mconn, err_no)) != NULL) {
+        if ((conn=CM_GET_SPEC_CONNECTION(client_ctx,
+                        &mconn, err_no)) != NULL)
+        {
             ((FSConnectionParameters *)conn->args)->data_group_id =
                 data_group_index + 1;
             return conn;
@@ -179,7 +193,7 @@ static ConnectionInfo *get_master_connection(FSClientContext *client_ctx,
                 break;
             }
 
-            if ((conn=get_spec_connection(client_ctx, &master.conn,
+            if ((conn=CM_GET_SPEC_CONNECTION(client_ctx, &master.conn,
                             err_no)) == NULL)
             {
                 break;
@@ -219,13 +233,23 @@ static ConnectionInfo *get_readable_connection(FSClientContext *client_ctx,
     i = 0;
     while (1) {
         do {
-            if ((*err_no=fs_client_proto_get_readable_server(client_ctx,
-                            data_group_index, &server)) != 0)
-            {
+            if (client_ctx->selector != NULL) {
+                if ((*err_no=fs_server_selector_get_readable(client_ctx,
+                                data_group_index, &server)) != 0)
+                {
+                    /* let the server select */
+                    *err_no = fs_client_proto_get_readable_server(
+                            client_ctx, data_group_index, &server);
+                }
+            } else {
+                *err_no = fs_client_proto_get_readable_server(client_ctx,
+                        data_group_index, &server);
+            }
+            if (*err_no != 0) {
                 break;
             }
 
-            if ((conn=get_spec_connection(client_ctx, &server.conn,
+            if ((conn=CM_GET_SPEC_CONNECTION(client_ctx, &server.conn,
                             err_no)) == NULL)
             {
                 break;
@@ -245,13 +269,27 @@ static ConnectionInfo *get_readable_connection(FSClientContext *client_ctx,
     return NULL;
 }
 
-static void release_connection(FSClientContext *client_ctx,
-        ConnectionInfo *conn)
+void fs_connection_manager_reset_master_cache(FSClientContext *client_ctx,
+        ConnectionInfo *conn, const bool invalidate)
 {
+    int data_group_index;
+
     if (((FSConnectionParameters *)conn->args)->data_group_id > 0) {
+        if (invalidate) {
+            data_group_index = ((FSConnectionParameters *)conn->args)->
+                data_group_id - 1;
+            CM_MASTER_CACHE_MUTEX_LOCK(client_ctx, data_group_index);
+            CM_MASTER_CACHE_CONN(client_ctx, data_group_index)->port = 0;
+            CM_MASTER_CACHE_MUTEX_UNLOCK(client_ctx, data_group_index);
+        }
         ((FSConnectionParameters *)conn->args)->data_group_id = 0;
     }
+}
 
+static void release_connection(FSClientContext *client_ctx,
+        ConnectionInfo *conn)
+{
+    fs_connection_manager_reset_master_cache(client_ctx, conn, false);
     conn_pool_close_connection_ex((ConnectionPool *)client_ctx->
             conn_manager.args, conn, false);
 }
@@ -259,16 +297,7 @@ static void release_connection(FSClientContext *client_ctx,
 static void close_connection(FSClientContext *client_ctx,
         ConnectionInfo *conn)
 {
-    if (((FSConnectionParameters *)conn->args)->data_group_id > 0) {
-        int data_group_index;
-        data_group_index = ((FSConnectionParameters *)conn->args)->
-            data_group_id - 1;
-        CM_MASTER_CACHE_MUTEX_LOCK(client_ctx, data_group_index);
-        CM_MASTER_CACHE_CONN(client_ctx, data_group_index)->port = 0;
-        CM_MASTER_CACHE_MUTEX_UNLOCK(client_ctx, data_group_index);
-        ((FSConnectionParameters *)conn->args)->data_group_id = 0;
-    }
-
+    fs_connection_manager_reset_master_cache(client_ctx, conn, true);
     conn_pool_close_connection_ex((ConnectionPool *)client_ctx->
             conn_manager.args, conn, true);
 }
@@ -298,15 +327,15 @@ static ConnectionInfo *get_leader_connection(FSClientContext *client_ctx,
             if ((*err_no=fs_client_proto_get_leader(client_ctx,
                             conn, &leader)) != 0)
             {
-                close_connection(client_ctx, conn);
+                CM_CLOSE_CONNECTION(client_ctx, conn);
                 break;
             }
 
             if (FC_CONNECTION_SERVER_EQUAL1(*conn, leader.conn)) {
                 return conn;
             }
-            release_connection(client_ctx, conn);
-            if ((conn=get_spec_connection(client_ctx,
+            CM_RELEASE_CONNECTION(client_ctx, conn);
+            if ((conn=CM_GET_SPEC_CONNECTION(client_ctx,
                             &leader.conn, err_no)) == NULL)
             {
                 break;
@@ -339,16 +368,16 @@ static const struct fs_connection_parameters *get_connection_params(
     return (FSConnectionParameters *)conn->args;
 }
 
-static int connect_done_callback(ConnectionInfo *conn, void *args)
+int fs_connection_manager_join_server(FSClientContext *client_ctx,
+        ConnectionInfo *conn)
 {
     FSConnectionParameters *params;
     int result;
 
     params = (FSConnectionParameters *)conn->args;
-    if (((FSClientContext *)args)->idempotency_enabled) {
+    if (client_ctx->idempotency_enabled) {
         params->channel = idempotency_client_channel_get(conn->ip_addr,
-                conn->port, ((FSClientContext *)args)->connect_timeout,
-                &result);
+                conn->port, client_ctx->connect_timeout, &result);
         if (params->channel == NULL) {
             logError("file: "__FILE__", line: %d, "
                     "server %s:%u, idempotency channel get fail, "
@@ -360,13 +389,18 @@ static int connect_done_callback(ConnectionInfo *conn, void *args)
         params->channel = NULL;
     }
 
-    result = fs_client_proto_join_server((FSClientContext *)args, conn, params);
+    result = fs_client_proto_join_server(client_ctx, conn, params);
     if (result == SF_RETRIABLE_ERROR_NO_CHANNEL && params->channel != NULL) {
         idempotency_client_channel_check_reconnect(params->channel);
     }
     return result;
 }
 
+static int connect_done_callback(ConnectionInfo *conn, void *args)
+{
+    return fs_connection_manager_join_server((FSClientContext *)args, conn);
+}
+
 static int validate_connection_callback(ConnectionInfo *conn, void *args)
 {
     SFResponseInfo response;
@@ -407,6 +441,29 @@ static int init_data_group_array(FSClientContext *client_ctx,
     return 0;
 }
 
+int fs_connection_manager_init_common(FSClientContext *client_ctx,
+        FSConnectionManager *conn_manager)
+{
+    int result;
+
+    if ((result=init_data_group_array(client_ctx, &conn_manager->
+                    data_group_array)) != 0)
+    {
+        return result;
+    }
+
+    conn_manager->get_connection = get_connection;
+    conn_manager->get_server_connection = get_server_connection;
+    conn_manager->get_spec_connection = get_spec_connection;
+    conn_manager->get_master_connection = get_master_connection;
+    conn_manager->get_readable_connection = get_readable_connection;
+    conn_manager->get_leader_connection = get_leader_connection;
+    conn_manager->release_connection = release_connection;
+    conn_manager->close_connection = close_connection;
+    conn_manager->get_connection_params = get_connection_params;
+    return 0;
+}
+
 int fs_simple_connection_manager_init_ex(FSClientContext *client_ctx,
         FSConnectionManager *conn_manager, const int max_count_per_entry,
         const int max_idle_time)
@@ -416,8 +473,8 @@ int fs_simple_connection_manager_init_ex(FSClientContext *client_ctx,
     ConnectionPool *cp;
     int result;
 
-    if ((result=init_data_group_array(client_ctx, &conn_manager->
-                    data_group_array)) != 0)
+    if ((result=fs_connection_manager_init_common(client_ctx,
+                    conn_manager)) != 0)
     {
         return result;
     }
@@ -442,15 +499,6 @@ int fs_simple_connection_manager_init_ex(FSClientContext *client_ctx,
     }
 
     conn_manager->args = cp;
-    conn_manager->get_connection = get_connection;
-    conn_manager->get_server_connection = get_server_connection;
-    conn_manager->get_spec_connection = get_spec_connection;
-    conn_manager->get_master_connection = get_master_connection;
-    conn_manager->get_readable_connection = get_readable_connection;
-    conn_manager->get_leader_connection = get_leader_connection;
-    conn_manager->release_connection = release_connection;
-    conn_manager->close_connection = close_connection;
-    conn_manager->get_connection_params = get_connection_params;
     return 0;
 }
 
@@ -22,6 +22,20 @@
 extern "C" {
 #endif
 
+/* init the data group array and the callbacks of the simple
+ * connection manager, the caller can override the callbacks */
+int fs_connection_manager_init_common(FSClientContext *client_ctx,
+        FSConnectionManager *conn_manager);
+
+/* the callback after the connection established */
+int fs_connection_manager_join_server(FSClientContext *client_ctx,
+        ConnectionInfo *conn);
+
+/* reset the data group of the connection, and clear the master cache
+ * of the data group when invalidate is true */
+void fs_connection_manager_reset_master_cache(FSClientContext *client_ctx,
+        ConnectionInfo *conn, const bool invalidate);
+
 int fs_simple_connection_manager_init_ex(FSClientContext *client_ctx,
         FSConnectionManager *conn_manager, const int max_count_per_entry,
         const int max_idle_time);
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "fastcommon/logger.h"
+#include "fastcommon/shared_func.h"
+#include "fastcommon/pthread_func.h"
+#include "faststore/client/fs_client.h"
+
+#define TEST_REQUEST_COUNT  64
+#define TEST_SLICE_LENGTH   (4 * 1024)
+
+typedef struct {
+    int done_count;
+    int order[TEST_REQUEST_COUNT];  //the request index by the done order
+    pthread_lock_cond_pair_t lc_pair;
+} TestContext;
+
+static TestContext test_ctx;
+
+static void usage(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [-c config_filename] [-i oid=1] "
+            "[-O block_offset=0]\n", argv[0]);
+}
+
+static void request_done_callback(FSAsyncClientRequest *request)
+{
+    PTHREAD_MUTEX_LOCK(&test_ctx.lc_pair.lock);
+    test_ctx.order[test_ctx.done_count++] = (long)request->arg;
+    pthread_cond_signal(&test_ctx.lc_pair.cond);
+    PTHREAD_MUTEX_UNLOCK(&test_ctx.lc_pair.lock);
+}
+
+static void wait_requests_done(const int count)
+{
+    PTHREAD_MUTEX_LOCK(&test_ctx.lc_pair.lock);
+    while (test_ctx.done_count < count) {
+        pthread_cond_wait(&test_ctx.lc_pair.cond, &test_ctx.lc_pair.lock);
+    }
+    PTHREAD_MUTEX_UNLOCK(&test_ctx.lc_pair.lock);
+}
+
+static int check_done_order(FSAsyncClientRequest *requests, const int count)
+{
+    int i;
+
+    for (i=0; i<count; i++) {
+        if (requests[i].result != 0) {
+            logError("file: "__FILE__", line: %d, "
+                    "request #%d fail, errno: %d, error info: %s",
+                    __LINE__, i, requests[i].result,
+                    STRERROR(requests[i].result));
+            return requests[i].result;
+        }
+        if (test_ctx.order[i] != i) {
+            logError("file: "__FILE__", line: %d, "
+                    "the #%d done request: %d != submit order: %d",
+                    __LINE__, i, test_ctx.order[i], i);
+            return EINVAL;
+        }
+    }
+
+    return 0;
+}
+
+/* the writes of the same slice are submitted in order, the callbacks
+ * should be called in the submit order and the last write wins */
+static int test_write_order(FSAsyncClientContext *async_ctx,
+        const FSBlockSliceKeyInfo *bs_key, char *out_buffs)
+{
+    FSAsyncClientRequest requests[TEST_REQUEST_COUNT];
+    int result;
+    int i;
+
+    test_ctx.done_count = 0;
+    memset(requests, 0, sizeof(requests));
+    for (i=0; i<TEST_REQUEST_COUNT; i++) {
+        memset(out_buffs + i * TEST_SLICE_LENGTH, 'a' + i % 26,
+                TEST_SLICE_LENGTH);
+        requests[i].bs_key = *bs_key;
+        requests[i].data = out_buffs + i * TEST_SLICE_LENGTH;
+        requests[i].callback = request_done_callback;
+        requests[i].arg = (void *)(long)i;
+        if ((result=fs_async_client_slice_write(async_ctx,
+                        requests + i)) != 0)
+        {
+            wait_requests_done(i);
+            return result;
+        }
+    }
+
+    wait_requests_done(TEST_REQUEST_COUNT);
+    if ((result=check_done_order(requests, TEST_REQUEST_COUNT)) != 0) {
+        return result;
+    }
+
+    for (i=0; i<TEST_REQUEST_COUNT; i++) {
+        if (requests[i].done_bytes != bs_key->slice.length) {
+            logError("file: "__FILE__", line: %d, "
+                    "request #%d, write bytes: %d != slice length: %d",
+                    __LINE__, i, requests[i].done_bytes,
+                    bs_key->slice.length);
+            return EINVAL;
+        }
+    }
+
+    return 0;
+}
+
+static int test_read_back(FSAsyncClientContext *async_ctx,
+        const FSBlockSliceKeyInfo *bs_key, const char *expect)
+{
+    FSAsyncClientRequest request;
+    char in_buff[TEST_SLICE_LENGTH];
+    int result;
+
+    test_ctx.done_count = 0;
+    memset(&request, 0, sizeof(request));
+    memset(in_buff, 0, sizeof(in_buff));
+    request.bs_key = *bs_key;
+    request.buff = in_buff;
+    request.callback = request_done_callback;
+    if ((result=fs_async_client_slice_read(async_ctx, &request)) != 0) {
+        return result;
+    }
+
+    wait_requests_done(1);
+    if (request.result != 0) {
+        return request.result;
+    }
+    if (request.done_bytes != bs_key->slice.length) {
+        logError("file: "__FILE__", line: %d, "
+                "read bytes: %d != slice length: %d",
+                __LINE__, request.done_bytes, bs_key->slice.length);
+        return EINVAL;
+    }
+
+    result = memcmp(in_buff, expect, bs_key->slice.length);
+    if (result != 0) {
+        printf("read buffer and the last write compare result: "
+                "%d != 0\n", result);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *config_filename = "/etc/fstore/client.conf";
+    FSAsyncClientContext async_ctx;
+    FSBlockSliceKeyInfo bs_key;
+    char *endptr;
+    char *out_buffs;
+    int ch;
+    int result;
+
+    bs_key.block.oid = 1;
+    bs_key.block.offset = 0;
+    while ((ch=getopt(argc, argv, "hc:i:O:")) != -1) {
+        switch (ch) {
+            case 'h':
+                usage(argv);
+                return 0;
+            case 'c':
+                config_filename = optarg;
+                break;
+            case 'i':
+                bs_key.block.oid = strtol(optarg, &endptr, 10);
+                break;
+            case 'O':
+                bs_key.block.offset = strtol(optarg, &endptr, 10);
+                break;
+            default:
+                usage(argv);
+                return 1;
+        }
+    }
+
+    log_init();
+    bs_key.block.offset -= bs_key.block.offset % FS_FILE_BLOCK_SIZE;
+    bs_key.slice.offset = 0;
+    bs_key.slice.length = TEST_SLICE_LENGTH;
+    fs_calc_block_hashcode(&bs_key.block);
+
+    if ((result=init_pthread_lock_cond_pair(&test_ctx.lc_pair)) != 0) {
+        return result;
+    }
+
+    out_buffs = (char *)fc_malloc(TEST_REQUEST_COUNT * TEST_SLICE_LENGTH);
+    if (out_buffs == NULL) {
+        return ENOMEM;
+    }
+
+    if ((result=fs_client_init(config_filename)) != 0) {
+        return result;
+    }
+    if ((result=fs_async_client_init(&async_ctx, &g_fs_client_vars.
+                    client_ctx)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=test_write_order(&async_ctx, &bs_key, out_buffs)) == 0) {
+        result = test_read_back(&async_ctx, &bs_key, out_buffs +
+                (TEST_REQUEST_COUNT - 1) * TEST_SLICE_LENGTH);
+    }
+
+    fs_async_client_destroy(&async_ctx);
+    free(out_buffs);
+    if (result == 0) {
+        printf("test async client order OK\n");
+    }
+    return result;
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include "fastcommon/logger.h"
+#include "faststore/client/fs_client.h"
+
+static int check_bucket_bounds()
+{
+    int64_t time_used_us;
+    int64_t max_time_us;
+    int index;
+
+    /* the time is in its bucket: lower <= time < upper */
+    max_time_us = fs_hedged_read_bucket_upper(
+            FS_HEDGED_READ_BUCKET_COUNT - 2);
+    for (time_used_us=0; time_used_us<max_time_us;
+            time_used_us += (time_used_us < 64 * 1024 ?
+                1 : time_used_us / 4096))
+    {
+        index = fs_hedged_read_bucket_index(time_used_us);
+        if (time_used_us >= fs_hedged_read_bucket_upper(index)) {
+            printf("time: %"PRId64" >= the upper: %"PRId64" of "
+                    "bucket: %d\n", time_used_us,
+                    fs_hedged_read_bucket_upper(index), index);
+            return EINVAL;
+        }
+        if (index > 0 && time_used_us <
+                fs_hedged_read_bucket_upper(index - 1))
+        {
+            printf("time: %"PRId64" < the lower: %"PRId64" of "
+                    "bucket: %d\n", time_used_us,
+                    fs_hedged_read_bucket_upper(index - 1), index);
+            return EINVAL;
+        }
+    }
+
+    /* the bucket bounds are increasing */
+    for (index=1; index<FS_HEDGED_READ_BUCKET_COUNT; index++) {
+        if (fs_hedged_read_bucket_upper(index) <=
+                fs_hedged_read_bucket_upper(index - 1))
+        {
+            printf("the upper of bucket: %d is NOT increasing\n", index);
+            return EINVAL;
+        }
+    }
+
+    /* the huge time falls in the last bucket */
+    index = fs_hedged_read_bucket_index(INT64_MAX / 2);
+    if (index != FS_HEDGED_READ_BUCKET_COUNT - 1) {
+        printf("bucket of the huge time: %d != %d\n",
+                index, FS_HEDGED_READ_BUCKET_COUNT - 1);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+static int check_percentile(FSHedgedReadContext *hctx,
+        const int percentile, const int64_t expect)
+{
+    int64_t latency;
+
+    latency = fs_hedged_read_calc_percentile(hctx, percentile);
+    if (latency != expect) {
+        printf("percentile: %d, latency: %"PRId64" != expect: %"PRId64"\n",
+                percentile, latency, expect);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+static int check_percentiles()
+{
+    FSHedgedReadContext *hctx;
+    int64_t time_used_us;
+    int index;
+    int result;
+
+    hctx = (FSHedgedReadContext *)calloc(1, sizeof(FSHedgedReadContext));
+    if (hctx == NULL) {
+        return ENOMEM;
+    }
+
+    /* 100 samples: 1ms to 100ms */
+    for (time_used_us=1000; time_used_us<=100 * 1000;
+            time_used_us += 1000)
+    {
+        index = fs_hedged_read_bucket_index(time_used_us);
+        hctx->histogram.counts[index]++;
+        hctx->histogram.total++;
+    }
+
+    do {
+        /* the percentile is the upper of the bucket of the N-th sample */
+        if ((result=check_percentile(hctx, 50, fs_hedged_read_bucket_upper(
+                            fs_hedged_read_bucket_index(50 * 1000)))) != 0)
+        {
+            break;
+        }
+        if ((result=check_percentile(hctx, 95, fs_hedged_read_bucket_upper(
+                            fs_hedged_read_bucket_index(95 * 1000)))) != 0)
+        {
+            break;
+        }
+        if ((result=check_percentile(hctx, 100, fs_hedged_read_bucket_upper(
+                            fs_hedged_read_bucket_index(100 * 1000)))) != 0)
+        {
+            break;
+        }
+
+        /* the percentile rounds up to the next sample */
+        if ((result=check_percentile(hctx, 1, fs_hedged_read_bucket_upper(
+                            fs_hedged_read_bucket_index(1000)))) != 0)
+        {
+            break;
+        }
+    } while (0);
+
+    free(hctx);
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    int result;
+
+    log_init();
+    if ((result=check_bucket_bounds()) != 0) {
+        return result;
+    }
+    if ((result=check_percentiles()) != 0) {
+        return result;
+    }
+
+    printf("test hedged read histogram OK\n");
+    return 0;
+}
@@ -27,7 +27,163 @@
 static void usage(char *argv[])
 {
     fprintf(stderr, "Usage: %s [-c config_filename=/etc/fstore/client.conf] "
-            "[-g data_group_id=0]\n", argv[0]);
+            "[-g data_group_id=0] [-r for replica stat] "
+            "[-s server_id for IO stat]\n", argv[0]);
+}
+
+static void output_replica_stats(FSClientReplicaStatEntry *stats,
+        const int count)
+{
+    const char *rtt_captions[FS_REPLICA_RTT_HISTOGRAM_SIZE] = {
+        "<1ms", "<2ms", "<5ms", "<10ms", "<20ms",
+        "<50ms", "<100ms", ">=100ms"
+    };
+    FSClientReplicaStatEntry *stat;
+    FSClientReplicaStatEntry *end;
+    int prev_data_group_id;
+    int i;
+
+    prev_data_group_id = 0;
+    end = stats + count;
+    for (stat=stats; stat<end; stat++) {
+        if (stat->data_group_id != prev_data_group_id) {
+            printf("\ndata_group_id: %d, master data_version: %"PRId64"\n",
+                    stat->data_group_id, stat->master_version);
+            prev_data_group_id = stat->data_group_id;
+        }
+        printf( "\tslave server_id: %d, "
+                "status: %d (%s), "
+                "data_version: %"PRId64", "
+                "lag versions: %"PRId64", "
+                "parked RPCs: %d\n"
+                "\t\tlink queued RPCs: %d, queued bytes: %"PRId64", "
+                "in-flight RPCs: %d, in-flight bytes: %"PRId64", "
+                "last lag: %d ms, timeouts: %"PRId64", "
+                "overflows: %"PRId64"\n"
+                "\t\tRTT histogram:",
+                stat->server_id, stat->status,
+                fs_get_server_status_caption(stat->status),
+                stat->data_version, stat->lag_versions,
+                stat->parked_rpcs, stat->queued_rpcs,
+                stat->queued_bytes, stat->inflight_rpcs,
+                stat->inflight_bytes, stat->last_lag_ms,
+                stat->timeouts, stat->overflows
+              );
+        for (i=0; i<FS_REPLICA_RTT_HISTOGRAM_SIZE; i++) {
+            printf(" %s: %"PRId64, rtt_captions[i], stat->rtt_counts[i]);
+        }
+        printf("\n");
+    }
+    printf("\nslave count: %d\n\n", count);
+}
+
+static int replica_stat(const int data_group_id, const int alloc_size)
+{
+    int count;
+    int bytes;
+    FSClientReplicaStatEntry *stats;
+    int result;
+
+    bytes = sizeof(FSClientReplicaStatEntry) * alloc_size;
+    stats = (FSClientReplicaStatEntry *)fc_malloc(bytes);
+    if (stats == NULL) {
+        return ENOMEM;
+    }
+
+    if ((result=fs_replica_stat(&g_fs_client_vars.client_ctx,
+                    data_group_id, stats, alloc_size, &count)) != 0)
+    {
+        fprintf(stderr, "fs_replica_stat fail, "
+                "errno: %d, error info: %s\n", result, STRERROR(result));
+    } else {
+        output_replica_stats(stats, count);
+    }
+
+    free(stats);
+    return result;
+}
+
+static void output_io_stat(const int server_id, FSClientIOStat *stat,
+        FSClientPathIOStat *paths, const int count)
+{
+    const char *stream_captions[FS_ALLOC_STREAM_COUNT] = {
+        "normal", "reclaim", "recovery"
+    };
+    const char *size_captions[FS_REPLICA_BATCH_HISTOGRAM_SIZE] = {
+        "1", "2+", "4+", "8+", "16+", "32+", "64+", "128+"
+    };
+    const char *delay_captions[FS_REPLICA_BATCH_HISTOGRAM_SIZE] = {
+        "<50us", "<100us", "<200us", "<500us", "<1ms",
+        "<2ms", "<5ms", ">=5ms"
+    };
+    FSClientPathIOStat *path;
+    FSClientPathIOStat *end;
+    int64_t written_bytes;
+    int i;
+
+    printf("\nserver_id: %d\n", server_id);
+    for (i=0; i<FS_ALLOC_STREAM_COUNT; i++) {
+        written_bytes = stat->streams[i].written_bytes;
+        printf("\talloc stream: %s, written: %"PRId64" MB, "
+                "migrated by reclaim: %"PRId64" MB, "
+                "write amplification: %.3f\n", stream_captions[i],
+                written_bytes / (1024 * 1024),
+                stat->streams[i].migrated_bytes / (1024 * 1024),
+                written_bytes > 0 ? (double)(written_bytes + stat->
+                    streams[i].migrated_bytes) / (double)written_bytes : 0.00);
+    }
+
+    end = paths + count;
+    for (path=paths; path<end; path++) {
+        printf("\tpath index: %d, select weight: %d, "
+                "IO queue depth: %d, IO latency: %"PRId64" us, "
+                "alloc cursor lock waits: %"PRId64", "
+                "lock wait time: %"PRId64" ms\n", path->path_index,
+                path->select_weight, path->queue_depth, path->latency_us,
+                path->lock_waits, path->lock_wait_us / 1000);
+    }
+
+    printf("\treplica package RPC count histogram:");
+    for (i=0; i<FS_REPLICA_BATCH_HISTOGRAM_SIZE; i++) {
+        printf(" %s: %"PRId64, size_captions[i],
+                stat->replica_batch.sizes[i]);
+    }
+    printf("\n\treplica package delay histogram:");
+    for (i=0; i<FS_REPLICA_BATCH_HISTOGRAM_SIZE; i++) {
+        printf(" %s: %"PRId64, delay_captions[i],
+                stat->replica_batch.delays[i]);
+    }
+
+    printf("\n\treplica compression raw: %"PRId64" KB, "
+            "compressed: %"PRId64" KB, ratio: %.2f%%, "
+            "incompressible samples: %"PRId64", skipped: %"PRId64" KB\n\n",
+            stat->replica_compress.raw_bytes / 1024,
+            stat->replica_compress.compressed_bytes / 1024,
+            stat->replica_compress.raw_bytes > 0 ? 100.00 * (double)
+            stat->replica_compress.compressed_bytes / (double)
+            stat->replica_compress.raw_bytes : 100.00,
+            stat->replica_compress.incompressible,
+            stat->replica_compress.skipped_bytes / 1024);
+}
+
+static int io_stat(const int server_id)
+{
+#define IO_STAT_MAX_PATH_COUNT  256
+    FSClientIOStat stat;
+    FSClientPathIOStat paths[IO_STAT_MAX_PATH_COUNT];
+    int count;
+    int result;
+
+    if ((result=fs_io_stat(&g_fs_client_vars.client_ctx, server_id,
+                    &stat, paths, IO_STAT_MAX_PATH_COUNT, &count)) != 0)
+    {
+        fprintf(stderr, "fs_io_stat fail, "
+                "errno: %d, error info: %s\n", result, STRERROR(result));
+    } else {
+        output_io_stat(server_id, &stat, paths, count);
+    }
+
+    return result;
 }
 
 static void output(FSClientClusterStatEntry *stats, const int count)
@@ -70,6 +226,8 @@ int main(int argc, char *argv[])
 	int ch;
     const char *config_filename = "/etc/fstore/client.conf";
     int data_group_id;
+    int server_id;
+    bool show_replica;
     int alloc_size;
     int count;
     int bytes;
@@ -85,7 +243,9 @@ int main(int argc, char *argv[])
     */
 
     data_group_id = 0;
-    while ((ch=getopt(argc, argv, "hc:g:")) != -1) {
+    server_id = 0;
+    show_replica = false;
+    while ((ch=getopt(argc, argv, "hc:g:rs:")) != -1) {
         switch (ch) {
             case 'h':
                 usage(argv);
@@ -96,6 +256,12 @@ int main(int argc, char *argv[])
             case 'g':
                 data_group_id = strtol(optarg, NULL, 10);
                 break;
+            case 'r':
+                show_replica = true;
+                break;
+            case 's':
+                server_id = strtol(optarg, NULL, 10);
+                break;
             default:
                 usage(argv);
                 return 1;
@@ -110,8 +276,16 @@ int main(int argc, char *argv[])
         return result;
     }
 
+    if (server_id > 0) {
+        return io_stat(server_id);
+    }
+
     alloc_size = FS_DATA_GROUP_COUNT(*g_fs_client_vars.
             client_ctx.cluster_cfg.ptr) * 5;
+    if (show_replica) {
+        return replica_stat(data_group_id, alloc_size);
+    }
+
     if (alloc_size < CLUSTER_MAX_STAT_COUNT) {
         alloc_size = CLUSTER_MAX_STAT_COUNT;
         stats = fixed_stats;
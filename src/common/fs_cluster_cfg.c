@@ -658,6 +658,7 @@ static int load_one_server_group(FSClusterConfig *cluster_cfg,
         FSIdArray *server_ids)
 {
     char section_name[32];
+    char *replication_mode;
     int result;
 
     server_group->server_group_id = server_group_id;
@@ -693,6 +694,39 @@ static int load_one_server_group(FSClusterConfig *cluster_cfg,
         return result;
     }
 
+    server_group->write_quorum = iniGetIntValue(section_name,
+            "write_quorum", ini_context, 0);
+    if (server_group->write_quorum < 0) {
+        server_group->write_quorum = 0;
+    } else if (server_group->write_quorum >
+            server_group->server_array.count)
+    {
+        logWarning("file: "__FILE__", line: %d, "
+                "config file: %s, server group id: %d, "
+                "write_quorum: %d > server count: %d, set to 0 (all)",
+                __LINE__, cluster_filename, server_group_id,
+                server_group->write_quorum,
+                server_group->server_array.count);
+        server_group->write_quorum = 0;
+    }
+
+    replication_mode = iniGetStrValue(section_name,
+            "replication_mode", ini_context);
+    if (replication_mode == NULL || *replication_mode == '\0' ||
+            strcasecmp(replication_mode, "fanout") == 0)
+    {
+        server_group->chain_replication = false;
+    } else if (strcasecmp(replication_mode, "chain") == 0) {
+        server_group->chain_replication = true;
+    } else {
+        logError("file: "__FILE__", line: %d, "
+                "config file: %s, server group id: %d, "
+                "invalid replication_mode: %s, expect fanout or chain",
+                __LINE__, cluster_filename, server_group_id,
+                replication_mode);
+        return EINVAL;
+    }
+
     if ((result=set_data_group(cluster_cfg, cluster_filename,
                     server_group_id, server_group)) != 0)
     {
@@ -902,6 +936,12 @@ void fs_cluster_cfg_to_log(FSClusterConfig *cluster_cfg)
         logInfo("[server-group-%d]", sgroup->server_group_id);
         logInfo("server_ids = %s", server_id_buff);
         logInfo("data_group_ids = %s", group_id_buff);
+        if (sgroup->write_quorum > 0) {
+            logInfo("write_quorum = %d", sgroup->write_quorum);
+        }
+        if (sgroup->chain_replication) {
+            logInfo("replication_mode = chain");
+        }
     }
 }
 
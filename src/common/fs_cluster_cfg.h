@@ -29,6 +29,8 @@ typedef struct {
 
 typedef struct {
     int server_group_id;
+    int write_quorum;   //the servers to persist a write, 0 for all
+    bool chain_replication;  //replicate along the chain of the slaves
     FCServerInfoPtrArray server_array;
     FSIdArray data_group;
 } FSServerGroup;
@@ -65,6 +65,14 @@ const char *fs_get_cmd_caption(const int cmd)
             return "DISK_SPACE_STAT_REQ";
         case FS_SERVICE_PROTO_DISK_SPACE_STAT_RESP:
             return "DISK_SPACE_STAT_RESP";
+        case FS_SERVICE_PROTO_REPLICA_STAT_REQ:
+            return "REPLICA_STAT_REQ";
+        case FS_SERVICE_PROTO_REPLICA_STAT_RESP:
+            return "REPLICA_STAT_RESP";
+        case FS_SERVICE_PROTO_IO_STAT_REQ:
+            return "IO_STAT_REQ";
+        case FS_SERVICE_PROTO_IO_STAT_RESP:
+            return "IO_STAT_RESP";
         case FS_SERVICE_PROTO_SLICE_WRITE_REQ:
             return "SLICE_WRITE_REQ";
         case FS_SERVICE_PROTO_SLICE_WRITE_RESP:
@@ -149,6 +157,22 @@ const char *fs_get_cmd_caption(const int cmd)
             return "REPLICA_SLICE_READ_REQ";
         case FS_REPLICA_PROTO_SLICE_READ_RESP:
             return "REPLICA_SLICE_READ_RESP";
+        case FS_REPLICA_PROTO_SLICE_BULK_READ_REQ:
+            return "REPLICA_SLICE_BULK_READ_REQ";
+        case FS_REPLICA_PROTO_SLICE_BULK_READ_RESP:
+            return "REPLICA_SLICE_BULK_READ_RESP";
+        case FS_REPLICA_PROTO_CHECKSUM_NODES_REQ:
+            return "REPLICA_CHECKSUM_NODES_REQ";
+        case FS_REPLICA_PROTO_CHECKSUM_NODES_RESP:
+            return "REPLICA_CHECKSUM_NODES_RESP";
+        case FS_REPLICA_PROTO_CHECKSUM_BLOCKS_REQ:
+            return "REPLICA_CHECKSUM_BLOCKS_REQ";
+        case FS_REPLICA_PROTO_CHECKSUM_BLOCKS_RESP:
+            return "REPLICA_CHECKSUM_BLOCKS_RESP";
+        case FS_REPLICA_PROTO_BLOCK_SLICES_REQ:
+            return "REPLICA_BLOCK_SLICES_REQ";
+        case FS_REPLICA_PROTO_BLOCK_SLICES_RESP:
+            return "REPLICA_BLOCK_SLICES_RESP";
         default:
             return sf_get_cmd_caption(cmd);
     }
@@ -49,6 +49,10 @@
 #define FS_SERVICE_PROTO_CLUSTER_STAT_RESP       44
 #define FS_SERVICE_PROTO_DISK_SPACE_STAT_REQ     45
 #define FS_SERVICE_PROTO_DISK_SPACE_STAT_RESP    46
+#define FS_SERVICE_PROTO_REPLICA_STAT_REQ        47
+#define FS_SERVICE_PROTO_REPLICA_STAT_RESP       48
+#define FS_SERVICE_PROTO_IO_STAT_REQ             49
+#define FS_SERVICE_PROTO_IO_STAT_RESP            50
 
 #define FS_SERVICE_PROTO_GET_MASTER_REQ           51
 #define FS_SERVICE_PROTO_GET_MASTER_RESP          52
@@ -84,6 +88,21 @@
 #define FS_REPLICA_PROTO_ACTIVE_CONFIRM_RESP     88
 #define FS_REPLICA_PROTO_SLICE_READ_REQ          89
 #define FS_REPLICA_PROTO_SLICE_READ_RESP         90
+#define FS_REPLICA_PROTO_SLICE_BULK_READ_REQ     91
+#define FS_REPLICA_PROTO_SLICE_BULK_READ_RESP    92
+
+#define FS_REPLICA_PROTO_CHECKSUM_NODES_REQ      93
+#define FS_REPLICA_PROTO_CHECKSUM_NODES_RESP     94
+#define FS_REPLICA_PROTO_CHECKSUM_BLOCKS_REQ     95
+#define FS_REPLICA_PROTO_CHECKSUM_BLOCKS_RESP    96
+#define FS_REPLICA_PROTO_BLOCK_SLICES_REQ        97
+#define FS_REPLICA_PROTO_BLOCK_SLICES_RESP       98
+
+#define FS_REPLICA_BULK_READ_MAX_SLICES         256
+#define FS_REPLICA_CHECKSUM_MAX_NODES          4096
+
+#define FS_REPLICA_SLICE_TYPE_FILE   'F'  //the slice with data
+#define FS_REPLICA_SLICE_TYPE_ALLOC  'A'  //the allocated space only
 
 // master -> slave RPC
 #define FS_REPLICA_PROTO_RPC_REQ                 99
@@ -153,6 +172,70 @@ typedef struct fs_proto_replica_slice_read_req {
     FSProtoBlockSlice bs;
 } FSProtoReplicaSliceReadReq;
 
+/* followed by count FSProtoBlockSlice */
+typedef struct fs_proto_replica_slice_bulk_read_req_header {
+    char slave_id[4];
+    char count[4];
+} FSProtoReplicaSliceBulkReadReqHeader;
+
+/* the response is count parts in the request order,
+ * each part is followed by read_bytes data */
+typedef struct fs_proto_replica_slice_bulk_read_resp_part {
+    char read_bytes[4];
+    char err_no[2];
+    char padding[2];
+} FSProtoReplicaSliceBulkReadRespPart;
+
+/* followed by count node indexes (4 bytes each) of the level */
+typedef struct fs_proto_replica_checksum_nodes_req_header {
+    char data_group_id[4];
+    char count[4];
+    char level;
+    char padding[7];
+} FSProtoReplicaChecksumNodesReqHeader;
+
+/* followed by count node values (8 bytes each) in the request order */
+typedef struct fs_proto_replica_checksum_nodes_resp_header {
+    char data_version[8];  //the master's data version when got the nodes
+    char ready;            //if the checksum tree of the master is ready
+    char padding[7];
+} FSProtoReplicaChecksumNodesRespHeader;
+
+typedef struct fs_proto_replica_checksum_blocks_req {
+    char data_group_id[4];
+    char leaf_index[4];
+} FSProtoReplicaChecksumBlocksReq;
+
+/* followed by count FSProtoReplicaChecksumBlock sorted by block key */
+typedef struct fs_proto_replica_checksum_blocks_resp_header {
+    char count[4];
+    char padding[4];
+} FSProtoReplicaChecksumBlocksRespHeader;
+
+typedef struct fs_proto_replica_checksum_block {
+    FSProtoBlockKey bkey;
+    char data_version[8];
+} FSProtoReplicaChecksumBlock;
+
+typedef struct fs_proto_replica_block_slices_req {
+    char data_group_id[4];
+    char padding[4];
+    FSProtoBlockKey bkey;
+} FSProtoReplicaBlockSlicesReq;
+
+/* followed by count FSProtoReplicaBlockSlice sorted by slice offset */
+typedef struct fs_proto_replica_block_slices_resp_header {
+    char count[4];
+    char padding[4];
+} FSProtoReplicaBlockSlicesRespHeader;
+
+typedef struct fs_proto_replica_block_slice {
+    char type;  //FS_REPLICA_SLICE_TYPE_FILE or FS_REPLICA_SLICE_TYPE_ALLOC
+    char padding[3];
+    char offset[4];
+    char length[4];
+} FSProtoReplicaBlockSlice;
+
 typedef struct {
     unsigned char servers[16];
     unsigned char cluster[16];
@@ -209,6 +292,69 @@ typedef struct fs_proto_cluster_stat_resp_body_part {
     char padding[4];
 } FSProtoClusterStatRespBodyPart;
 
+typedef struct fs_proto_replica_stat_req {
+    char data_group_id[4];
+    char padding[4];
+} FSProtoReplicaStatReq;
+
+typedef struct fs_proto_replica_stat_resp_body_header {
+    char count[4];
+    char master_data_version[8];
+    char padding[4];
+} FSProtoReplicaStatRespBodyHeader;
+
+typedef struct fs_proto_replica_stat_resp_body_part {
+    char server_id[4];       //the slave server id
+    char status;
+    char padding[3];
+    char data_version[8];
+    char lag_versions[8];    //the data versions behind the master
+    char parked_rpcs[4];     //the RPCs parked for the ONLINE slave
+
+    /* the replica link to the slave, shared by the data groups */
+    char queued_rpcs[4];     //NOT sent yet
+    char queued_bytes[8];
+    char inflight_rpcs[4];   //sent and waiting for the response
+    char last_lag_ms[4];     //from the push to the response of the last RPC
+    char inflight_bytes[8];
+    char timeouts[8];
+    char overflows[8];       //the RPCs out of the result ring
+    char rtt_counts[FS_REPLICA_RTT_HISTOGRAM_SIZE][8];
+} FSProtoReplicaStatRespBodyPart;
+
+/* the IO stats of the server, the counters are totals since startup */
+typedef struct fs_proto_io_stat_resp_body_header {
+    char path_count[4];
+    char padding[4];
+
+    struct {
+        char written_bytes[8];   //the space allocated by the stream
+        char migrated_bytes[8];  //moved out of its trunks by reclaim
+    } streams[FS_ALLOC_STREAM_COUNT];
+
+    struct {
+        char sizes[FS_REPLICA_BATCH_HISTOGRAM_SIZE][8];
+        char delays[FS_REPLICA_BATCH_HISTOGRAM_SIZE][8];
+    } replica_batch;
+
+    struct {
+        char raw_bytes[8];
+        char compressed_bytes[8];
+        char incompressible[8];  //the samples NOT compressed
+        char skipped_bytes[8];   //sent raw without trying
+    } replica_compress;
+} FSProtoIOStatRespBodyHeader;
+
+typedef struct fs_proto_io_stat_resp_body_part {
+    char path_index[4];
+    char select_weight[4];   //for the store path selection
+    char queue_depth[4];     //the pending requests of the IO threads
+    char padding[4];
+    char latency_us[8];      //EWMA of the IO service time
+    char lock_waits[8];      //contention count of the alloc cursor lock
+    char lock_wait_us[8];
+} FSProtoIOStatRespBodyPart;
+
 typedef struct fs_proto_disk_space_stat_resp_body_header {
     char count[4];
     char padding[4];
@@ -263,7 +409,18 @@ typedef struct fs_proto_join_server_req {
     FSProtoConfigSigns config_signs;
 } FSProtoJoinServerReq;
 
+/* appended to the join request only when the compression is configured,
+ * the older servers send the join request without it */
+typedef struct fs_proto_join_server_req_ext {
+    char compression;    //the compression supported by me
+    char padding[7];
+} FSProtoJoinServerReqExt;
+
+/* the body of the join response is empty for the join request
+ * without the extension */
 typedef struct fs_proto_join_server_resp {
+    char compression;    //the compression of the link
+    char padding[7];
 } FSProtoJoinServerResp;
 
 typedef struct fs_proto_push_data_server_status_header  {
@@ -305,26 +462,28 @@ typedef struct fs_proto_replia_fetch_binlog_first_req_header {
     char server_id[4];
     char binlog_length[4]; //last N rows for consistency check
     char catch_up;         //tell master to ONLINE me
-    char padding[3];
+    char compression;      //the compression supported by me
+    char padding[2];
     char binlog[0];
 } FSProtoReplicaFetchBinlogFirstReqHeader;
 
 typedef struct fs_proto_replia_fetch_binlog_resp_body_header {
-    char binlog_length[4]; //current binlog length
+    char binlog_length[4]; //current binlog length (before compressed)
     char is_last;          //is the last package
+    char compression;      //the compression of the binlog
 } FSProtoReplicaFetchBinlogRespBodyHeader;
 
 typedef struct fs_proto_replia_fetch_binlog_first_resp_body_header {
     FSProtoReplicaFetchBinlogRespBodyHeader common;
     char is_online;        //tell slave to ONLINE
-    char padding[2];
+    char padding[1];
     char until_version[8];  // for catch up master (including)
     char binlog[0];
 } FSProtoReplicaFetchBinlogFirstRespBodyHeader;
 
 typedef struct fs_proto_replia_fetch_binlog_next_resp_body_header {
     FSProtoReplicaFetchBinlogRespBodyHeader common;
-    char padding[3];
+    char padding[2];
     char binlog[0];
 } FSProtoReplicaFetchBinlogNextRespBodyHeader;
 
@@ -335,14 +494,16 @@ typedef struct fs_proto_replia_active_confirm_req {
 
 typedef struct fs_proto_replica_rpc_req_body_header {
     char count[4];
-    char padding[4];
+    char raw_length[4];  //the length of the parts before compressed,
+                         //0 for not compressed
 } FSProtoReplicaRPCReqBodyHeader;
 
 typedef struct fs_proto_replica_rpc_req_body_part {
     char data_version[8];
     char body_len[4];
     unsigned char cmd;
-    char padding[3];
+    unsigned char chain_count;  //the server ids (4 bytes each) after body
+    char padding[2];
     char body[0];
 } FSProtoReplicaRPCReqBodyPart;
 
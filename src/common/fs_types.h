@@ -31,6 +31,18 @@
 #define FS_MAX_DATA_GROUPS_PER_SERVER   1024
 #define FS_MAX_GROUP_SERVERS             128
 
+/* the RTT of the replica RPCs in ms: < 1, < 2, < 5, < 10, < 20,
+ * < 50, < 100 and 100+ */
+#define FS_REPLICA_RTT_HISTOGRAM_SIZE      8
+
+/* the RPC count of the replica packages: 1, 2+, 4+, ..., 128+ and
+ * the delay of the oldest RPC in us: < 50, < 100, < 200, < 500, < 1000,
+ * < 2000, < 5000 and 5000+ */
+#define FS_REPLICA_BATCH_HISTOGRAM_SIZE    8
+
+//the trunk allocation streams: normal, reclaim and recovery
+#define FS_ALLOC_STREAM_COUNT              3
+
 //random seed to generate hash code for master election
 #define FS_DATA_GROUP_MASTER_HC_SEED0   2020
 #define FS_DATA_GROUP_MASTER_HC_SEED1   6024
@@ -23,6 +23,7 @@
 #include <pthread.h>
 #include "fastcommon/fast_buffer.h"
 #include "fastcommon/common_blocked_queue.h"
+#include "fastcommon/fc_queue.h"
 #include "../server_types.h"
 
 #define BINLOG_COMMON_FIELD_INDEX_TIMESTAMP      0
@@ -66,6 +67,26 @@ typedef struct binlog_common_fields {
     int64_t data_version;
 } BinlogCommonFields;
 
+/* the binlog records of a batch are pushed to the writer threads at once
+ * for group commit, the queue elements are SFBinlogWriterBuffer */
+typedef struct fs_binlog_write_batch {
+    struct fc_queue_info slice;    //for the slice binlog
+    struct fc_queue_info replica;  //for the replica binlog
+    int count;
+} FSBinlogWriteBatch;
+
+#define FS_BINLOG_WRITE_BATCH_APPEND(batch, qinfo, wbuffer) \
+    do { \
+        (wbuffer)->next = NULL;  \
+        if ((qinfo)->head == NULL) { \
+            (qinfo)->head = wbuffer; \
+        } else { \
+            ((SFBinlogWriterBuffer *)(qinfo)->tail)->next = wbuffer; \
+        } \
+        (qinfo)->tail = wbuffer; \
+        (batch)->count++;  \
+    } while (0)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -25,6 +25,7 @@
 #include "../dio/trunk_io_thread.h"
 #include "../storage/storage_allocator.h"
 #include "../storage/trunk_id_info.h"
+#include "../replication/checksum_tree.h"
 #include "binlog_func.h"
 #include "binlog_reader.h"
 #include "binlog_loader.h"
@@ -423,10 +424,40 @@ static SFBinlogWriterBuffer *alloc_binlog_buffer(const int data_group_id,
     return sf_binlog_writer_alloc_one_version_buffer(*writer, data_version);
 }
 
+static inline void push_to_binlog_thread_queue(SFBinlogWriterInfo *writer,
+        SFBinlogWriterBuffer *wbuffer, FSBinlogWriteBatch *batch)
+{
+    if (batch != NULL) {
+        /* the reused buffer may keep a stale type */
+        wbuffer->type = SF_BINLOG_BUFFER_TYPE_WRITE_TO_FILE;
+        FS_BINLOG_WRITE_BATCH_APPEND(batch, &batch->replica, wbuffer);
+    } else {
+        sf_push_to_binlog_thread_queue(writer->thread, wbuffer);
+    }
+}
+
+void replica_binlog_push_batch(struct fc_queue_info *qinfo)
+{
+    bool notify;
+
+    if (qinfo->head == NULL) {
+        return;
+    }
+
+    /* all data groups share one writer thread, the whole batch
+     * is pushed under one lock with one wakeup */
+    fc_queue_push_queue_to_tail_ex(&binlog_writer_thread.queue,
+            qinfo, &notify);
+    if (notify) {
+        pthread_cond_signal(&binlog_writer_thread.queue.lc_pair.cond);
+    }
+    qinfo->head = qinfo->tail = NULL;
+}
+
 int replica_binlog_log_slice(const time_t current_time,
         const int data_group_id, const int64_t data_version,
         const FSBlockSliceKeyInfo *bs_key, const int source,
-        const int op_type)
+        const int op_type, FSBinlogWriteBatch *batch)
 {
     SFBinlogWriterInfo *writer;
     SFBinlogWriterBuffer *wbuffer;
@@ -442,13 +473,20 @@ int replica_binlog_log_slice(const time_t current_time,
             (int64_t)current_time, data_version, source,
             op_type, bs_key->block.oid, bs_key->block.offset,
             bs_key->slice.offset, bs_key->slice.length);
-    sf_push_to_binlog_thread_queue(writer->thread, wbuffer);
+
+    /* update the checksum tree before the record written, so the records
+     * in the binlog file are always in the checksum tree */
+    if (CHECKSUM_TREE_ENABLED) {
+        checksum_tree_update(data_group_id, &bs_key->block, data_version);
+    }
+    push_to_binlog_thread_queue(writer, wbuffer, batch);
     return 0;
 }
 
 int replica_binlog_log_block(const time_t current_time,
         const int data_group_id, const int64_t data_version,
-        const FSBlockKey *bkey, const int source, const int op_type)
+        const FSBlockKey *bkey, const int source, const int op_type,
+        FSBinlogWriteBatch *batch)
 {
     SFBinlogWriterInfo *writer;
     SFBinlogWriterBuffer *wbuffer;
@@ -463,7 +501,12 @@ int replica_binlog_log_block(const time_t current_time,
             "%"PRId64" %"PRId64" %c %c %"PRId64" %"PRId64"\n",
             (int64_t)current_time, data_version,
             source, op_type, bkey->oid, bkey->offset);
-    sf_push_to_binlog_thread_queue(writer->thread, wbuffer);
+
+    /* the no-op records only fill the gaps of the data versions */
+    if (CHECKSUM_TREE_ENABLED && op_type != REPLICA_BINLOG_OP_TYPE_NO_OP) {
+        checksum_tree_update(data_group_id, bkey, data_version);
+    }
+    push_to_binlog_thread_queue(writer, wbuffer, batch);
     return 0;
 }
 
@@ -131,19 +131,24 @@ extern "C" {
     int replica_binlog_log_slice(const time_t current_time,
             const int data_group_id, const int64_t data_version,
             const FSBlockSliceKeyInfo *bs_key, const int source,
-            const int op_type);
+            const int op_type, FSBinlogWriteBatch *batch);
 
     int replica_binlog_log_block(const time_t current_time,
             const int data_group_id, const int64_t data_version,
-            const FSBlockKey *bkey, const int source, const int op_type);
+            const FSBlockKey *bkey, const int source, const int op_type,
+            FSBinlogWriteBatch *batch);
+
+    /* push the replica binlog records of the batch to the writer thread */
+    void replica_binlog_push_batch(struct fc_queue_info *qinfo);
 
     static inline int replica_binlog_log_del_block(const time_t current_time,
             const int data_group_id, const int64_t data_version,
-            const FSBlockKey *bkey, const int source)
+            const FSBlockKey *bkey, const int source,
+            FSBinlogWriteBatch *batch)
     {
         return replica_binlog_log_block(current_time, data_group_id,
                 data_version, bkey, source,
-                REPLICA_BINLOG_OP_TYPE_DEL_BLOCK);
+                REPLICA_BINLOG_OP_TYPE_DEL_BLOCK, batch);
     }
 
     static inline int replica_binlog_log_no_op(const int data_group_id,
@@ -151,34 +156,37 @@ extern "C" {
     {
         return replica_binlog_log_block(g_current_time, data_group_id,
                 data_version, bkey, BINLOG_SOURCE_REPLAY,
-                REPLICA_BINLOG_OP_TYPE_NO_OP);
+                REPLICA_BINLOG_OP_TYPE_NO_OP, NULL);
     }
 
     static inline int replica_binlog_log_write_slice(const time_t current_time,
             const int data_group_id, const int64_t data_version,
-            const FSBlockSliceKeyInfo *bs_key, const int source)
+            const FSBlockSliceKeyInfo *bs_key, const int source,
+            FSBinlogWriteBatch *batch)
     {
         return replica_binlog_log_slice(current_time, data_group_id,
                 data_version, bs_key, source,
-                REPLICA_BINLOG_OP_TYPE_WRITE_SLICE);
+                REPLICA_BINLOG_OP_TYPE_WRITE_SLICE, batch);
     }
 
     static inline int replica_binlog_log_alloc_slice(const time_t current_time,
             const int data_group_id, const int64_t data_version,
-            const FSBlockSliceKeyInfo *bs_key, const int source)
+            const FSBlockSliceKeyInfo *bs_key, const int source,
+            FSBinlogWriteBatch *batch)
     {
         return replica_binlog_log_slice(current_time, data_group_id,
                 data_version, bs_key, source,
-                REPLICA_BINLOG_OP_TYPE_ALLOC_SLICE);
+                REPLICA_BINLOG_OP_TYPE_ALLOC_SLICE, batch);
     }
 
     static inline int replica_binlog_log_del_slice(const time_t current_time,
             const int data_group_id, const int64_t data_version,
-            const FSBlockSliceKeyInfo *bs_key, const int source)
+            const FSBlockSliceKeyInfo *bs_key, const int source,
+            FSBinlogWriteBatch *batch)
     {
         return replica_binlog_log_slice(current_time, data_group_id,
                 data_version, bs_key, source,
-                REPLICA_BINLOG_OP_TYPE_DEL_SLICE);
+                REPLICA_BINLOG_OP_TYPE_DEL_SLICE, batch);
     }
 
     const char *replica_binlog_get_op_type_caption(const int op_type);
@@ -291,9 +291,39 @@ void slice_binlog_destroy()
     sf_binlog_writer_finish(&binlog_writer.writer);
 }
 
+static inline void push_to_binlog_write_queue(
+        SFBinlogWriterBuffer *wbuffer, FSBinlogWriteBatch *batch)
+{
+    if (batch != NULL) {
+        /* the reused buffer may keep a stale type */
+        wbuffer->type = SF_BINLOG_BUFFER_TYPE_WRITE_TO_FILE;
+        FS_BINLOG_WRITE_BATCH_APPEND(batch, &batch->slice, wbuffer);
+    } else {
+        sf_push_to_binlog_write_queue(&binlog_writer.writer, wbuffer);
+    }
+}
+
+void slice_binlog_push_batch(struct fc_queue_info *qinfo)
+{
+    bool notify;
+
+    if (qinfo->head == NULL) {
+        return;
+    }
+
+    /* the whole batch is pushed under one lock with one wakeup */
+    fc_queue_push_queue_to_tail_ex(&binlog_writer.thread.queue,
+            qinfo, &notify);
+    if (notify) {
+        pthread_cond_signal(&binlog_writer.thread.queue.lc_pair.cond);
+    }
+    qinfo->head = qinfo->tail = NULL;
+}
+
 int slice_binlog_log_add_slice(const OBSliceEntry *slice,
         const time_t current_time, const uint64_t sn,
-        const uint64_t data_version, const int source)
+        const uint64_t data_version, const int source,
+        struct fs_binlog_write_batch *batch)
 {
     SFBinlogWriterBuffer *wbuffer;
 
@@ -314,13 +344,14 @@ int slice_binlog_log_add_slice(const OBSliceEntry *slice,
             slice->space.store->index, slice->space.id_info.id,
             slice->space.id_info.subdir, slice->space.offset,
             slice->space.size);
-    sf_push_to_binlog_write_queue(&binlog_writer.writer, wbuffer);
+    push_to_binlog_write_queue(wbuffer, batch);
     return 0;
 }
 
 int slice_binlog_log_del_slice(const FSBlockSliceKeyInfo *bs_key,
         const time_t current_time, const uint64_t sn,
-        const uint64_t data_version, const int source)
+        const uint64_t data_version, const int source,
+        struct fs_binlog_write_batch *batch)
 {
     SFBinlogWriterBuffer *wbuffer;
 
@@ -335,13 +366,14 @@ int slice_binlog_log_del_slice(const FSBlockSliceKeyInfo *bs_key,
             SLICE_BINLOG_OP_TYPE_DEL_SLICE, bs_key->block.oid,
             bs_key->block.offset, bs_key->slice.offset,
             bs_key->slice.length);
-    sf_push_to_binlog_write_queue(&binlog_writer.writer, wbuffer);
+    push_to_binlog_write_queue(wbuffer, batch);
     return 0;
 }
 
 int slice_binlog_log_del_block(const FSBlockKey *bkey,
         const time_t current_time, const uint64_t sn,
-        const uint64_t data_version, const int source)
+        const uint64_t data_version, const int source,
+        struct fs_binlog_write_batch *batch)
 {
     SFBinlogWriterBuffer *wbuffer;
 
@@ -355,6 +387,6 @@ int slice_binlog_log_del_block(const FSBlockKey *bkey,
             (int64_t)current_time, data_version, source,
             SLICE_BINLOG_OP_TYPE_DEL_BLOCK,
             bkey->oid, bkey->offset);
-    sf_push_to_binlog_write_queue(&binlog_writer.writer, wbuffer);
+    push_to_binlog_write_queue(wbuffer, batch);
     return 0;
 }
@@ -19,6 +19,7 @@
 
 #include "fastcommon/sched_thread.h"
 #include "../storage/object_block_index.h"
+#include "binlog_types.h"
 
 #define SLICE_BINLOG_OP_TYPE_WRITE_SLICE  BINLOG_OP_TYPE_WRITE_SLICE
 #define SLICE_BINLOG_OP_TYPE_ALLOC_SLICE  BINLOG_OP_TYPE_ALLOC_SLICE
@@ -36,17 +37,23 @@ extern "C" {
 
     struct sf_binlog_writer_info *slice_binlog_get_writer();
 
+    /* push the slice binlog records of the batch to the writer thread */
+    void slice_binlog_push_batch(struct fc_queue_info *qinfo);
+
     int slice_binlog_log_add_slice(const OBSliceEntry *slice,
             const time_t current_time, const uint64_t sn,
-            const uint64_t data_version, const int source);
+            const uint64_t data_version, const int source,
+            struct fs_binlog_write_batch *batch);
 
     int slice_binlog_log_del_slice(const FSBlockSliceKeyInfo *bs_key,
             const time_t current_time, const uint64_t sn,
-            const uint64_t data_version, const int source);
+            const uint64_t data_version, const int source,
+            struct fs_binlog_write_batch *batch);
 
     int slice_binlog_log_del_block(const FSBlockKey *bkey,
             const time_t current_time, const uint64_t sn,
-            const uint64_t data_version, const int source);
+            const uint64_t data_version, const int source,
+            struct fs_binlog_write_batch *batch);
 
 #ifdef __cplusplus
 }
@@ -35,6 +35,7 @@
 #include "server_global.h"
 #include "server_recovery.h"
 #include "cluster_topology.h"
+#include "replication/replication_caller.h"
 #include "cluster_relationship.h"
 
 #define ALIGN_TIME(interval) (((interval) / 60) * 60)
@@ -786,13 +787,8 @@ static void cluster_relationship_on_status_change(FSClusterDataServerInfo *ds,
         }
     } else {
         if (master->cs == CLUSTER_MYSELF_PTR) {  //i am master
-            if ((old_status == FS_SERVER_STATUS_ONLINE) ||
-                    (old_status == FS_SERVER_STATUS_OFFLINE &&
-                     new_status == FS_SERVER_STATUS_ACTIVE))
-            {
-                PTHREAD_MUTEX_LOCK(&ds->replica.notify.lock);
-                pthread_cond_broadcast(&ds->replica.notify.cond);
-                PTHREAD_MUTEX_UNLOCK(&ds->replica.notify.lock);
+            if (old_status == FS_SERVER_STATUS_ONLINE) {
+                replication_caller_resume_parked(ds);
             }
         }
     }
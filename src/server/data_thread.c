@@ -32,7 +32,10 @@
 #include "fastcommon/pthread_func.h"
 #include "sf/sf_global.h"
 #include "server_global.h"
+#include "server_group_info.h"
 #include "server_replication.h"
+#include "binlog/slice_binlog.h"
+#include "binlog/replica_binlog.h"
 #include "data_thread.h"
 
 #define DATA_THREAD_RUNNING_COUNT g_data_thread_vars.running_count
@@ -40,14 +43,21 @@
 FSDataThreadVariables g_data_thread_vars;
 static void *data_thread_func(void *arg);
 
-static inline int init_thread_ctx(FSDataThreadContext *context)
+static inline int init_thread_ctx(FSDataThreadArray *thread_array,
+        FSDataThreadContext *context)
 {
     int result;
 
+    context->index = context - thread_array->contexts;
+    context->array = thread_array;
     if ((result=init_pthread_lock_cond_pair(&context->lc_pair)) != 0) {
         return result;
     }
 
+    if ((result=init_pthread_lock_cond_pair(&context->ready.lc_pair)) != 0) {
+        return result;
+    }
+
     if ((result=fast_mblock_init_ex1(&context->allocator,
                     "data_operation", sizeof(FSDataOperation),
                     4 * 1024, 0, NULL, NULL, true)) != 0)
@@ -55,17 +65,51 @@ static inline int init_thread_ctx(FSDataThreadContext *context)
         return result;
     }
 
-    if ((result=fc_queue_init(&context->queue, (long)
-                    (&((FSDataOperation *)NULL)->next))) != 0)
-    {
-        return result;
+    return 0;
+}
+
+static int init_op_lanes(FSDataThreadArray *thread_array,
+        const bool by_block)
+{
+    int result;
+    int lanes_per_thread;
+    int bytes;
+    FSDataOpLane *lane;
+    FSDataOpLane *end;
+
+    /* one lane per data group, the lane count is a multiple of the
+     * thread count so the lane of a data group is owned by the same
+     * data thread as dispatched by modulo */
+    lanes_per_thread = (CLUSTER_DATA_RGOUP_ARRAY.count +
+            thread_array->count - 1) / thread_array->count;
+    if (by_block && lanes_per_thread < DATA_THREAD_MIN_LANES_PER_THREAD) {
+        lanes_per_thread = DATA_THREAD_MIN_LANES_PER_THREAD;
+    } else if (lanes_per_thread == 0) {
+        lanes_per_thread = 1;
+    }
+
+    thread_array->lane_count = lanes_per_thread * thread_array->count;
+    bytes = sizeof(FSDataOpLane) * thread_array->lane_count;
+    thread_array->lanes = (FSDataOpLane *)fc_malloc(bytes);
+    if (thread_array->lanes == NULL) {
+        return ENOMEM;
+    }
+    memset(thread_array->lanes, 0, bytes);
+
+    end = thread_array->lanes + thread_array->lane_count;
+    for (lane=thread_array->lanes; lane<end; lane++) {
+        if ((result=init_pthread_lock(&lane->lock)) != 0) {
+            return result;
+        }
+        lane->home = thread_array->contexts + (lane -
+                thread_array->lanes) % thread_array->count;
     }
 
     return 0;
 }
 
 static int init_data_thread_array(FSDataThreadArray *thread_array,
-        const int count)
+        const char *caption, const int count, const bool by_block)
 {
     int result;
     int thread_count;
@@ -84,11 +128,16 @@ static int init_data_thread_array(FSDataThreadArray *thread_array,
     for (context=thread_array->contexts;
             context<end; context++)
     {
-        if ((result=init_thread_ctx(context)) != 0) {
+        if ((result=init_thread_ctx(thread_array, context)) != 0) {
             return result;
         }
     }
     thread_array->count = count;
+    thread_array->caption = caption;
+
+    if ((result=init_op_lanes(thread_array, by_block)) != 0) {
+        return result;
+    }
 
     thread_count = thread_array->count;
     return create_work_threads_ex(&thread_count, data_thread_func,
@@ -96,6 +145,109 @@ static int init_data_thread_array(FSDataThreadArray *thread_array,
             SF_G_THREAD_STACK_SIZE);
 }
 
+static int init_sequencers(FSDataGroupSequencerArray *sequencers)
+{
+    int result;
+    int bytes;
+    FSDataGroupSequencer *sequencer;
+    FSDataGroupSequencer *end;
+
+    bytes = sizeof(FSDataGroupSequencer) * CLUSTER_DATA_RGOUP_ARRAY.count;
+    sequencers->entries = (FSDataGroupSequencer *)fc_malloc(bytes);
+    if (sequencers->entries == NULL) {
+        return ENOMEM;
+    }
+    memset(sequencers->entries, 0, bytes);
+
+    end = sequencers->entries + CLUSTER_DATA_RGOUP_ARRAY.count;
+    for (sequencer=sequencers->entries; sequencer<end; sequencer++) {
+        if ((result=init_pthread_lock(&sequencer->lock)) != 0) {
+            return result;
+        }
+    }
+    sequencers->count = CLUSTER_DATA_RGOUP_ARRAY.count;
+    return 0;
+}
+
+static void log_thread_array_stat(FSDataThreadArray *thread_array,
+        const int64_t elapsed_us)
+{
+    FSDataThreadContext *context;
+    FSDataThreadContext *end;
+    FSDataThreadStat *stat;
+    int64_t busy_us;
+    int64_t batches;
+    int64_t steals;
+    int64_t total_batches;
+    char buff[4096];
+    int len;
+
+    len = 0;
+    total_batches = 0;
+    *buff = '\0';
+    end = thread_array->contexts + thread_array->count;
+    for (context=thread_array->contexts; context<end; context++) {
+        stat = &context->stat;
+        busy_us = __sync_add_and_fetch(&stat->busy_us, 0);
+        batches = __sync_add_and_fetch(&stat->batches, 0);
+        steals = __sync_add_and_fetch(&stat->steals, 0);
+        if (len < sizeof(buff) - 64) {
+            len += snprintf(buff + len, sizeof(buff) - len,
+                    "%s#%d: %.1f%% %"PRId64"/%"PRId64, len > 0 ? ", " : "",
+                    context->index, elapsed_us > 0 ? (double)(busy_us -
+                        stat->last_busy_us) * 100.00 / elapsed_us : 0.00,
+                    batches - stat->last_batches, steals - stat->last_steals);
+        }
+        total_batches += batches - stat->last_batches;
+        stat->last_busy_us = busy_us;
+        stat->last_batches = batches;
+        stat->last_steals = steals;
+    }
+
+    if (total_batches == 0) {
+        return;
+    }
+
+    logInfo("file: "__FILE__", line: %d, "
+            "%s data threads (utilization batches/steals): %s",
+            __LINE__, thread_array->caption, buff);
+}
+
+static int log_data_thread_stat_func(void *args)
+{
+    static int64_t last_time_us = 0;
+    int64_t current_time_us;
+    int64_t elapsed_us;
+
+    current_time_us = get_current_time_us();
+    elapsed_us = (last_time_us > 0) ? current_time_us - last_time_us : 0;
+    last_time_us = current_time_us;
+    if (elapsed_us == 0) {  //the first run as the baseline
+        return 0;
+    }
+
+    log_thread_array_stat(&g_data_thread_vars.
+            thread_arrays.master, elapsed_us);
+    log_thread_array_stat(&g_data_thread_vars.
+            thread_arrays.slave, elapsed_us);
+    return 0;
+}
+
+static int setup_data_thread_schedule()
+{
+    ScheduleArray scheduleArray;
+    ScheduleEntry scheduleEntry;
+
+    log_data_thread_stat_func(NULL);
+
+    INIT_SCHEDULE_ENTRY(scheduleEntry, sched_generate_next_id(),
+           TIME_NONE, TIME_NONE, TIME_NONE, 60,
+            log_data_thread_stat_func, NULL);
+    scheduleArray.entries = &scheduleEntry;
+    scheduleArray.count = 1;
+    return sched_add_entries(&scheduleArray);
+}
+
 int data_thread_init()
 {
     int result;
@@ -103,14 +255,21 @@ int data_thread_init()
     int thread_count;
     int n;
 
+    if (DATA_DISPATCH_BY_BLOCK) {
+        if ((result=init_sequencers(&g_data_thread_vars.sequencers)) != 0) {
+            return result;
+        }
+    }
+
     count = (DATA_THREAD_COUNT + 1) / 2;
     if ((result=init_data_thread_array(&g_data_thread_vars.
-                    thread_arrays.master, count)) != 0)
+                    thread_arrays.master, "master", count,
+                    DATA_DISPATCH_BY_BLOCK)) != 0)
     {
         return result;
     }
     if ((result=init_data_thread_array(&g_data_thread_vars.
-                    thread_arrays.slave, count)) != 0)
+                    thread_arrays.slave, "slave", count, false)) != 0)
     {
         return result;
     }
@@ -123,7 +282,7 @@ int data_thread_init()
         fc_sleep_ms(10);
     }
 
-    return 0;
+    return setup_data_thread_schedule();
 }
 
 static void destroy_data_thread_array(FSDataThreadArray *thread_array)
@@ -135,19 +294,38 @@ static void destroy_data_thread_array(FSDataThreadArray *thread_array)
         end = thread_array->contexts + thread_array->count;
         for (context=thread_array->contexts; context<end; context++) {
             destroy_pthread_lock_cond_pair(&context->lc_pair);
-            fc_queue_destroy(&context->queue);
+            destroy_pthread_lock_cond_pair(&context->ready.lc_pair);
             fast_mblock_destroy(&context->allocator);
         }
         free(thread_array->contexts);
         thread_array->contexts = NULL;
         thread_array->count = 0;
     }
+
+    if (thread_array->lanes != NULL) {
+        FSDataOpLane *lane;
+        FSDataOpLane *end;
+
+        end = thread_array->lanes + thread_array->lane_count;
+        for (lane=thread_array->lanes; lane<end; lane++) {
+            pthread_mutex_destroy(&lane->lock);
+        }
+        free(thread_array->lanes);
+        thread_array->lanes = NULL;
+        thread_array->lane_count = 0;
+    }
 }
 
 void data_thread_destroy()
 {
     destroy_data_thread_array(&g_data_thread_vars.thread_arrays.master);
     destroy_data_thread_array(&g_data_thread_vars.thread_arrays.slave);
+
+    if (g_data_thread_vars.sequencers.entries != NULL) {
+        free(g_data_thread_vars.sequencers.entries);
+        g_data_thread_vars.sequencers.entries = NULL;
+        g_data_thread_vars.sequencers.count = 0;
+    }
 }
 
 static void terminate_data_thread_array(FSDataThreadArray *thread_array)
@@ -158,7 +336,9 @@ static void terminate_data_thread_array(FSDataThreadArray *thread_array)
 
     end = thread_array->contexts + thread_array->count;
     for (context=thread_array->contexts; context<end; context++) {
-        fc_queue_terminate(&context->queue);
+        PTHREAD_MUTEX_LOCK(&context->ready.lc_pair.lock);
+        pthread_cond_broadcast(&context->ready.lc_pair.cond);
+        PTHREAD_MUTEX_UNLOCK(&context->ready.lc_pair.lock);
     }
 
     count = 0;
@@ -190,12 +370,185 @@ void data_thread_terminate()
         }  \
     } while (0)
 
+static void flush_binlog_batch(FSDataThreadContext *thread_ctx)
+{
+    if (thread_ctx->binlog_batch.count == 0) {
+        return;
+    }
+
+    slice_binlog_push_batch(&thread_ctx->binlog_batch.slice);
+    replica_binlog_push_batch(&thread_ctx->binlog_batch.replica);
+    thread_ctx->binlog_batch.count = 0;
+}
+
 static void data_thread_rw_done_callback(
         FSSliceOpContext *op_ctx, void *arg)
 {
     data_thread_notify((FSDataThreadContext *)arg);
 }
 
+static inline FSDataGroupSequencer *get_sequencer(const int data_group_id)
+{
+    return g_data_thread_vars.sequencers.entries + (data_group_id -
+            CLUSTER_DATA_RGOUP_ARRAY.base_id);
+}
+
+void data_thread_sequencer_enter(FSSliceOpContext *op_ctx)
+{
+    FSDataGroupSequencer *sequencer;
+
+    sequencer = get_sequencer(op_ctx->info.data_group_id);
+    PTHREAD_MUTEX_LOCK(&sequencer->lock);
+    if (sequencer->inflight++ == 0) {
+        /* no pending data version, the next one is assigned from here */
+        sequencer->next_version = __sync_add_and_fetch(
+                &op_ctx->info.myself->data.version, 0) + 1;
+    }
+    PTHREAD_MUTEX_UNLOCK(&sequencer->lock);
+}
+
+static void sequencer_buffer_insert(FSDataGroupSequencer *sequencer,
+        FSDataOperation *op)
+{
+    FSDataOperation *previous;
+    FSDataOperation *current;
+
+    previous = NULL;
+    current = sequencer->head;
+    while (current != NULL && current->ctx->info.data_version <
+            op->ctx->info.data_version)
+    {
+        previous = current;
+        current = current->next;
+    }
+
+    op->next = current;
+    if (previous == NULL) {
+        sequencer->head = op;
+    } else {
+        previous->next = op;
+    }
+    sequencer->buffered++;
+}
+
+static FSDataOperation *sequencer_pop_ready(FSDataGroupSequencer *sequencer)
+{
+    FSDataOperation *op;
+
+    if ((op=sequencer->head) == NULL) {
+        return NULL;
+    }
+
+    /* when all inflight operations are buffered, the gap will never
+     * be filled (the data version consumed by others such as the
+     * operations before master switching), skip it */
+    if (op->ctx->info.data_version > sequencer->next_version &&
+            sequencer->buffered < sequencer->inflight)
+    {
+        return NULL;
+    }
+
+    sequencer->head = op->next;
+    sequencer->buffered--;
+    sequencer->inflight--;
+    if (op->ctx->info.data_version >= sequencer->next_version) {
+        sequencer->next_version = op->ctx->info.data_version + 1;
+    }
+    return op;
+}
+
+static inline void finish_operation(FSDataOperation *op)
+{
+    op->ctx->notify_func(op);
+    fast_mblock_free_object(op->allocator, op);
+}
+
+/* called by the replication thread when the slaves responded */
+static void replication_done_notify(FSReplicaRPCWaiter *waiter)
+{
+    FSDataOperation *op;
+    int result;
+
+    op = (FSDataOperation *)waiter->notify_arg;
+    if ((result=replication_caller_finish_waiting(op->ctx)) != 0) {
+        op->ctx->result = result;
+    }
+    finish_operation(op);
+}
+
+/* the operation is finished and freed here or by the replication
+ * thread, the data thread never waits for the slaves */
+static void commit_operation(FSDataThreadContext *thread_ctx,
+        FSDataOperation *op, const bool is_update)
+{
+    int result;
+
+    if (op->ctx->result == 0 && is_update) {
+        /* the data version is consumed by the local update,
+         * log it in the order of the data version before replication */
+        op->ctx->info.write_binlog.batch = &thread_ctx->binlog_batch;
+        log_data_update(op->operation, op->ctx);
+        op->ctx->info.write_binlog.batch = NULL;
+        if (thread_ctx->binlog_batch.count >= DATA_THREAD_BINLOG_BATCH_SIZE) {
+            flush_binlog_batch(thread_ctx);
+        }
+
+        if (op->source == DATA_SOURCE_MASTER_SERVICE) {
+            if ((result=replication_caller_push_to_slave_queues(
+                            (struct fast_task_info *)op->arg,
+                            replication_done_notify, op)) ==
+                    TASK_STATUS_CONTINUE)
+            {
+                return;  //the op maybe freed already
+            }
+
+            /* the client gets the error to retry */
+            if (result != 0) {
+                op->ctx->result = result;
+            }
+        }
+    }
+
+    finish_operation(op);
+}
+
+static void sequencer_commit(FSDataThreadContext *thread_ctx,
+        FSDataOperation *op)
+{
+    FSDataGroupSequencer *sequencer;
+    FSDataOperation *current;
+    bool failed;
+
+    sequencer = get_sequencer(op->ctx->info.data_group_id);
+    failed = (op->ctx->result != 0);  //without data version
+    PTHREAD_MUTEX_LOCK(&sequencer->lock);
+    if (failed) {
+        sequencer->inflight--;
+    } else {
+        sequencer_buffer_insert(sequencer, op);
+    }
+
+    /* the committer only logs and pushes the ready operations in the
+     * order of the data version, the slave responses are waited by
+     * the replication threads, so the drain never blocks */
+    if (sequencer->committing) {
+        PTHREAD_MUTEX_UNLOCK(&sequencer->lock);
+    } else {
+        sequencer->committing = true;
+        while ((current=sequencer_pop_ready(sequencer)) != NULL) {
+            PTHREAD_MUTEX_UNLOCK(&sequencer->lock);
+            commit_operation(thread_ctx, current, true);
+            PTHREAD_MUTEX_LOCK(&sequencer->lock);
+        }
+        sequencer->committing = false;
+        PTHREAD_MUTEX_UNLOCK(&sequencer->lock);
+    }
+
+    if (failed) {
+        finish_operation(op);
+    }
+}
+
 static void deal_one_operation(FSDataThreadContext *thread_ctx,
         FSDataOperation *op)
 {
@@ -243,21 +596,12 @@ static void deal_one_operation(FSDataThreadContext *thread_ctx,
             break;
     }
 
-    if (op->ctx->result == 0 && is_update) {
-        if (op->source == DATA_SOURCE_MASTER_SERVICE) {
-            if ((result=replication_caller_push_to_slave_queues(
-                            (struct fast_task_info *)op->arg)) ==
-                    TASK_STATUS_CONTINUE)
-            {
-                DATA_THREAD_COND_WAIT(thread_ctx);
-            }
-        }
-
-        log_data_update(op->operation, op->ctx);
+    if (op->sequenced) {
+        sequencer_commit(thread_ctx, op);
+    } else {
+        commit_operation(thread_ctx, op, is_update);
     }
 
-    op->ctx->notify_func(op);
-
     /*
     logInfo("file: "__FILE__", line: %d, record: %p, "
             "operation: %d, hash code: %u, inode: %"PRId64
@@ -267,26 +611,171 @@ static void deal_one_operation(FSDataThreadContext *thread_ctx,
              */
 }
 
-static void *data_thread_func(void *arg)
+static void ready_queue_push(FSDataReadyQueue *ready, FSDataOpLane *lane)
+{
+    lane->next = NULL;
+    PTHREAD_MUTEX_LOCK(&ready->lc_pair.lock);
+    if (ready->tail == NULL) {
+        ready->head = lane;
+        pthread_cond_signal(&ready->lc_pair.cond);
+    } else {
+        ready->tail->next = lane;
+    }
+    ready->tail = lane;
+    ready->count++;
+    PTHREAD_MUTEX_UNLOCK(&ready->lc_pair.lock);
+}
+
+static FSDataOpLane *ready_queue_pop(FSDataReadyQueue *ready,
+        const int timeout_ms)
+{
+    FSDataOpLane *lane;
+    struct timespec ts;
+    int64_t expires_ms;
+
+    PTHREAD_MUTEX_LOCK(&ready->lc_pair.lock);
+    if (ready->head == NULL && timeout_ms > 0 && SF_G_CONTINUE_FLAG) {
+        expires_ms = get_current_time_ms() + timeout_ms;
+        ts.tv_sec = expires_ms / 1000;
+        ts.tv_nsec = (expires_ms % 1000) * 1000 * 1000;
+        pthread_cond_timedwait(&ready->lc_pair.cond,
+                &ready->lc_pair.lock, &ts);
+    }
+
+    if ((lane=ready->head) != NULL) {
+        ready->head = lane->next;
+        if (ready->head == NULL) {
+            ready->tail = NULL;
+        }
+        ready->count--;
+    }
+    PTHREAD_MUTEX_UNLOCK(&ready->lc_pair.lock);
+
+    return lane;
+}
+
+void data_thread_lane_push(FSDataOpLane *lane, FSDataOperation *op)
+{
+    bool notify;
+
+    op->next = NULL;
+    PTHREAD_MUTEX_LOCK(&lane->lock);
+    if (lane->tail == NULL) {
+        lane->head = op;
+    } else {
+        lane->tail->next = op;
+    }
+    lane->tail = op;
+    if (lane->scheduled) {
+        notify = false;
+    } else {
+        lane->scheduled = true;
+        notify = true;
+    }
+    PTHREAD_MUTEX_UNLOCK(&lane->lock);
+
+    if (notify) {
+        ready_queue_push(&lane->home->ready, lane);
+    }
+}
+
+/* steal a lane from the busy data thread, the idle one deals its own */
+static FSDataOpLane *steal_lane(FSDataThreadContext *thread_ctx)
+{
+    FSDataThreadArray *thread_array;
+    FSDataThreadContext *victim;
+    FSDataOpLane *lane;
+    int i;
+
+    thread_array = thread_ctx->array;
+    for (i=1; i<thread_array->count; i++) {
+        victim = thread_array->contexts + (thread_ctx->index + i) %
+            thread_array->count;
+        if (!victim->dealing || __sync_add_and_fetch(
+                    &victim->ready.count, 0) == 0)
+        {
+            continue;
+        }
+
+        if ((lane=ready_queue_pop(&victim->ready, 0)) != NULL) {
+            return lane;
+        }
+    }
+
+    return NULL;
+}
+
+static void deal_lane(FSDataThreadContext *thread_ctx, FSDataOpLane *lane)
 {
     FSDataOperation *op;
     FSDataOperation *current;
+    bool requeue;
+
+    /* take the whole batch of the lane */
+    PTHREAD_MUTEX_LOCK(&lane->lock);
+    op = lane->head;
+    lane->head = lane->tail = NULL;
+    PTHREAD_MUTEX_UNLOCK(&lane->lock);
+
+    while (op != NULL) {
+        current = op;
+        op = op->next;
+
+        /* the operation is freed by the committer */
+        deal_one_operation(thread_ctx, current);
+    }
+
+    /* group commit: push the binlog records of the batch at once */
+    flush_binlog_batch(thread_ctx);
+
+    PTHREAD_MUTEX_LOCK(&lane->lock);
+    if (lane->head != NULL) {
+        requeue = true;
+    } else {
+        lane->scheduled = false;
+        requeue = false;
+    }
+    PTHREAD_MUTEX_UNLOCK(&lane->lock);
+
+    if (requeue) {
+        ready_queue_push(&lane->home->ready, lane);
+    }
+}
+
+static void *data_thread_func(void *arg)
+{
+    FSDataOpLane *lane;
     FSDataThreadContext *thread_ctx;
+    int64_t start_time_us;
+    bool stolen;
 
     __sync_add_and_fetch(&DATA_THREAD_RUNNING_COUNT, 1);
     thread_ctx = (FSDataThreadContext *)arg;
     while (SF_G_CONTINUE_FLAG) {
-        op = (FSDataOperation *)fc_queue_pop_all(&thread_ctx->queue);
-        if (op == NULL) {
-            continue;
+        stolen = false;
+        if ((lane=ready_queue_pop(&thread_ctx->ready, 0)) == NULL) {
+            if (DATA_WORK_STEALING && (lane=steal_lane(thread_ctx)) != NULL) {
+                stolen = true;
+            } else {
+                lane = ready_queue_pop(&thread_ctx->ready, DATA_WORK_STEALING ?
+                        DATA_THREAD_STEAL_INTERVAL_MS : 1000);
+                if (lane == NULL) {
+                    continue;
+                }
+            }
         }
 
-        do {
-            current = op;
-            op = op->next;
-            deal_one_operation(thread_ctx, current);
-            fast_mblock_free_object(&thread_ctx->allocator, current);
-        } while (op != NULL);
+        thread_ctx->dealing = true;
+        start_time_us = get_current_time_us();
+        deal_lane(thread_ctx, lane);
+        thread_ctx->dealing = false;
+
+        __sync_add_and_fetch(&thread_ctx->stat.busy_us,
+                get_current_time_us() - start_time_us);
+        __sync_add_and_fetch(&thread_ctx->stat.batches, 1);
+        if (stolen) {
+            __sync_add_and_fetch(&thread_ctx->stat.steals, 1);
+        }
     }
 
     __sync_sub_and_fetch(&DATA_THREAD_RUNNING_COUNT, 1);
@@ -19,6 +19,8 @@
 #define _DATA_THREAD_H_
 
 #include "fastcommon/fc_queue.h"
+#include "server_global.h"
+#include "binlog/binlog_types.h"
 #include "storage/slice_op.h"
 
 #define DATA_OPERATION_NONE           '\0'
@@ -32,31 +34,98 @@
 #define DATA_SOURCE_SLAVE_REPLICA      2
 #define DATA_SOURCE_SLAVE_RECOVERY     3
 
+/* flush the binlog records when the batch is full */
+#define DATA_THREAD_BINLOG_BATCH_SIZE  256
+
+/* the idle data thread tries to steal in this interval */
+#define DATA_THREAD_STEAL_INTERVAL_MS  10
+
+/* the min op lanes per data thread when dispatched by block */
+#define DATA_THREAD_MIN_LANES_PER_THREAD  16
+
 typedef struct fs_data_operation {
     int operation;
     int source;
+    bool sequenced;  //committed by the data group sequencer
     FSSliceOpContext *ctx;
     void *arg;
-    struct fs_data_operation *next;  //for queue
+    struct fast_mblock_man *allocator;  //for free
+    struct fs_data_operation *next;  //for queue and reorder buffer
 } FSDataOperation;
 
+/* the operations of a data group (or a block hash bucket when dispatched
+ * by block) queue in an op lane. the lane is dealt by one data thread at
+ * a time, the idle data thread steals the whole lane from the busy one
+ * so the operation order of the lane is kept */
+typedef struct fs_data_op_lane {
+    pthread_mutex_t lock;
+    bool scheduled;  //in a ready queue or being dealt
+    FSDataOperation *head;
+    FSDataOperation *tail;
+    struct fs_data_thread_context *home;  //the owner data thread
+    struct fs_data_op_lane *next;  //for ready queue
+} FSDataOpLane;
+
+typedef struct fs_data_ready_queue {
+    pthread_lock_cond_pair_t lc_pair;
+    FSDataOpLane *head;
+    FSDataOpLane *tail;
+    volatile int count;
+} FSDataReadyQueue;
+
+typedef struct fs_data_thread_stat {
+    volatile int64_t busy_us;
+    volatile int64_t batches;  //the lane batches dealt
+    volatile int64_t steals;   //the lane batches stolen from other threads
+    int64_t last_busy_us;
+    int64_t last_batches;
+    int64_t last_steals;
+} FSDataThreadStat;
+
 typedef struct fs_data_thread_context {
+    int index;
     bool notify_done;
+    volatile bool dealing;
     pthread_lock_cond_pair_t lc_pair;
-    struct fc_queue queue;
+    FSDataReadyQueue ready;    //the lanes to deal
     struct fast_mblock_man allocator;
+    FSBinlogWriteBatch binlog_batch;  //for binlog group commit
+    FSDataThreadStat stat;
+    struct fs_data_thread_array *array;
 } FSDataThreadContext;
 
 typedef struct fs_data_thread_array {
     FSDataThreadContext *contexts;
     int count;
+    int lane_count;
+    FSDataOpLane *lanes;
+    const char *caption;
 } FSDataThreadArray;
 
+/* when the master operations are dispatched by block, the updates of
+ * a data group are done by many data threads concurrently. the sequencer
+ * commits them (push to the slaves and write the binlogs) in the order
+ * of the data version with a reorder buffer */
+typedef struct fs_data_group_sequencer {
+    pthread_mutex_t lock;
+    bool committing;     //only one thread commits at a time
+    int inflight;        //the operations dispatched but not committed
+    int buffered;        //the operations in the reorder buffer
+    uint64_t next_version;   //the data version to commit next
+    FSDataOperation *head;   //the reorder buffer, sorted by data version
+} FSDataGroupSequencer;
+
+typedef struct fs_data_group_sequencer_array {
+    FSDataGroupSequencer *entries;
+    int count;
+} FSDataGroupSequencerArray;
+
 typedef struct fdir_data_thread_variables {
     struct {
         FSDataThreadArray master;  //for master data groups
         FSDataThreadArray slave;   //for slave data groups
     } thread_arrays;
+    FSDataGroupSequencerArray sequencers;  //by data group index
     volatile int running_count;
 } FSDataThreadVariables;
 
@@ -70,33 +139,52 @@ extern "C" {
     void data_thread_destroy();
     void data_thread_terminate();
 
+    /* register the update operation to the sequencer of its data group */
+    void data_thread_sequencer_enter(FSSliceOpContext *op_ctx);
+
+    void data_thread_lane_push(FSDataOpLane *lane, FSDataOperation *op);
+
     static inline int push_to_data_thread_queue(const int operation,
             const int source, void *arg, FSSliceOpContext *op_ctx)
     {
-        FSDataThreadContext *context;
+        FSDataThreadArray *thread_array;
+        FSDataOpLane *lane;
         FSDataOperation *op;
         uint32_t hash_code;
+        bool sequenced;
 
-        /* hash_code = FS_BLOCK_HASH_CODE(op_ctx->info.bs_key.block); */
-        hash_code = op_ctx->info.data_group_id;
+        sequenced = false;
         if (__sync_add_and_fetch(&op_ctx->info.myself->is_master, 0)) {
-            context = g_data_thread_vars.thread_arrays.master.contexts +
-                 hash_code % g_data_thread_vars.thread_arrays.master.count;
+            if (DATA_DISPATCH_BY_BLOCK) {
+                hash_code = FS_BLOCK_HASH_CODE(op_ctx->info.bs_key.block);
+                sequenced = (source == DATA_SOURCE_MASTER_SERVICE &&
+                        operation != DATA_OPERATION_SLICE_READ);
+            } else {
+                hash_code = op_ctx->info.data_group_id;
+            }
+            thread_array = &g_data_thread_vars.thread_arrays.master;
         } else {
-            context = g_data_thread_vars.thread_arrays.slave.contexts +
-                hash_code % g_data_thread_vars.thread_arrays.slave.count;
+            hash_code = op_ctx->info.data_group_id;
+            thread_array = &g_data_thread_vars.thread_arrays.slave;
         }
 
-        op = (FSDataOperation *)fast_mblock_alloc_object(&context->allocator);
+        lane = thread_array->lanes + hash_code % thread_array->lane_count;
+        op = (FSDataOperation *)fast_mblock_alloc_object(
+                &lane->home->allocator);
         if (op == NULL) {
             return ENOMEM;
         }
 
         op->operation = operation;
         op->source = source;
+        op->sequenced = sequenced;
         op->arg = arg;
         op->ctx = op_ctx;
-        fc_queue_push(&context->queue, op);
+        op->allocator = &lane->home->allocator;
+        if (sequenced) {
+            data_thread_sequencer_enter(op_ctx);
+        }
+        data_thread_lane_push(lane, op);
         return 0;
     }
 
@@ -292,7 +292,11 @@ static void slave_data_update_done_notify(FSDataOperation *op)
          */
     }
 
-    if (SERVER_TASK_TYPE == FS_SERVER_TASK_TYPE_REPLICATION &&
+    if (op->ctx->info.chain_waiter != NULL) {
+        /* the result is pushed when the downstream done */
+        replication_caller_chain_local_done(op->ctx->info.chain_waiter,
+                op->ctx->result);
+    } else if (SERVER_TASK_TYPE == FS_SERVER_TASK_TYPE_REPLICATION &&
             REPLICA_REPLICATION != NULL)
     {
         FSReplication *replication;
@@ -382,6 +386,7 @@ static inline int du_push_to_data_queue(struct fast_task_info *task,
 
     sf_hold_task(task);
     op_ctx->info.write_binlog.log_replica = true;
+    op_ctx->info.write_binlog.batch = NULL;  //set by the data thread
     if ((result=push_to_data_thread_queue(operation,
                    TASK_CTX.which_side == FS_WHICH_SIDE_MASTER ?
                    DATA_SOURCE_MASTER_SERVICE : DATA_SOURCE_SLAVE_REPLICA,
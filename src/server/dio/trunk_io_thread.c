@@ -39,6 +39,7 @@ typedef struct trunk_io_thread_context {
         TrunkIdFDPair pair;
     } fd_cache;
     int role;
+    FSStoragePathInfo *path_info;
 } TrunkIOThreadContext;
 
 typedef struct trunk_io_thread_context_array {
@@ -130,7 +131,7 @@ static int init_thread_context(TrunkIOThreadContext *ctx)
 }
 
 static int init_thread_contexts(TrunkIOThreadContextArray *ctx_array,
-        const int role)
+        FSStoragePathInfo *path_info, const int role)
 {
     int result;
     TrunkIOThreadContext *ctx;
@@ -139,6 +140,7 @@ static int init_thread_contexts(TrunkIOThreadContextArray *ctx_array,
     end = ctx_array->contexts + ctx_array->count;
     for (ctx=ctx_array->contexts; ctx<end; ctx++) {
         ctx->role = role;
+        ctx->path_info = path_info;
         if ((result=init_thread_context(ctx)) != 0) {
             return result;
         }
@@ -168,7 +170,7 @@ static int init_path_contexts(FSStoragePathArray *parray)
         path_ctx->writes.contexts = thread_ctxs;
         path_ctx->writes.count = p->write_thread_count;
         if ((result=init_thread_contexts(&path_ctx->writes,
-                        IO_THREAD_ROLE_WRITER)) != 0)
+                        p, IO_THREAD_ROLE_WRITER)) != 0)
         {
             return result;
         }
@@ -176,7 +178,7 @@ static int init_path_contexts(FSStoragePathArray *parray)
         path_ctx->reads.contexts = thread_ctxs + p->write_thread_count;
         path_ctx->reads.count = p->read_thread_count;
         if ((result=init_thread_contexts(&path_ctx->reads,
-                        IO_THREAD_ROLE_READER)) != 0)
+                        p, IO_THREAD_ROLE_READER)) != 0)
         {
             return result;
         }
@@ -250,6 +252,8 @@ int trunk_io_thread_push(const int type, const int path_index,
     iob->notify.arg = notify_arg;
     iob->next = NULL;
 
+    /* counted before the IO thread can pop and decrease it */
+    __sync_add_and_fetch(&thread_ctx->path_info->io_stat.queue_depth, 1);
     if (thread_ctx->tail == NULL) {
         thread_ctx->head = iob;
         notify = true;
@@ -510,10 +514,24 @@ static int do_read_slice(TrunkIOThreadContext *ctx, TrunkIOBuffer *iob)
     return 0;
 }
 
+static inline void update_io_latency(FSStoragePathInfo *path_info,
+        const int64_t elapsed_us)
+{
+    int64_t latency_us;
+
+    /* EWMA with alpha 1/8, the lost update of the racing threads
+     * is acceptable for the path selection */
+    latency_us = path_info->io_stat.latency_us;
+    path_info->io_stat.latency_us = latency_us +
+        (elapsed_us - latency_us) / 8;
+}
+
 static int trunk_io_deal_buffer(TrunkIOThreadContext *ctx, TrunkIOBuffer *iob)
 {
     int result;
+    int64_t start_time_us;
 
+    start_time_us = get_current_time_us();
     switch (iob->type) {
         case FS_IO_TYPE_CREATE_TRUNK:
             result = do_create_trunk(ctx, iob);
@@ -534,6 +552,14 @@ static int trunk_io_deal_buffer(TrunkIOThreadContext *ctx, TrunkIOBuffer *iob)
             break;
     }
 
+    __sync_sub_and_fetch(&ctx->path_info->io_stat.queue_depth, 1);
+    if (iob->type == FS_IO_TYPE_WRITE_SLICE ||
+            iob->type == FS_IO_TYPE_READ_SLICE)
+    {
+        update_io_latency(ctx->path_info,
+                get_current_time_us() - start_time_us);
+    }
+
     if (iob->notify.func != NULL) {
         iob->notify.func(iob, result);
     }
@@ -36,11 +36,24 @@
 #include "data_recovery.h"
 #include "binlog_dedup.h"
 
+/* the estimated memory of the hashtables per record for the partitioning,
+ * including the object entry, the slice entry and the skiplist node */
+#define DEDUP_MEMORY_PER_RECORD       256
+#define DEDUP_MAX_PARTITIONS          256
+#define DEDUP_PARTITION_FILE_SUFFIX   ".part"
+#define DEDUP_LINE_BUFFER_SIZE        256
+
 typedef struct {
     FILE *fp;
     char filename[PATH_MAX];
 } BinlogFileWriter;
 
+typedef struct {
+    FILE *fp;
+    int64_t count;   //the record count
+    char filename[PATH_MAX];
+} BinlogDedupPartition;
+
 typedef struct {
     OBHashtable create;   //create operation
     OBHashtable remove;   //remove operation
@@ -67,6 +80,14 @@ typedef struct {
             int64_t remove;
         } binlog_counts;
     } out;
+
+    /* spill the records to the partition files by block when the
+     * hashtables of all records exceed the memory limit, then dedup
+     * the partitions one by one */
+    struct {
+        int count;   //0 for dedup in memory
+        BinlogDedupPartition *partitions;
+    } spill;
 } BinlogDedupContext;
 
 static int realloc_slice_ptr_array(OBSlicePtrArray *sarray);
@@ -87,6 +108,104 @@ static inline int add_slice(OBHashtable *htable,
     return ob_index_add_slice_ex(htable, slice, NULL, &inc_alloc, false);
 }
 
+static int deal_binlog_record(BinlogDedupContext *dedup_ctx,
+        char *error_info)
+{
+    int result;
+    int r;
+    int op_type;
+    int target_len;
+    int dec_alloc;
+
+    result = 0;
+    dec_alloc = 0;
+    op_type = dedup_ctx->record.op_type;
+    switch (op_type) {
+        case REPLICA_BINLOG_OP_TYPE_WRITE_SLICE:
+        case REPLICA_BINLOG_OP_TYPE_ALLOC_SLICE:
+            if (op_type == REPLICA_BINLOG_OP_TYPE_WRITE_SLICE) {
+                result = add_slice(&dedup_ctx->htables.create,
+                        &dedup_ctx->record, OB_SLICE_TYPE_FILE);
+            } else {
+                result = add_slice(&dedup_ctx->htables.create,
+                        &dedup_ctx->record, OB_SLICE_TYPE_ALLOC);
+            }
+            dedup_ctx->rstat.create.total++;
+            if (result == 0) {
+                dedup_ctx->rstat.create.success++;
+            }
+            break;
+        case REPLICA_BINLOG_OP_TYPE_DEL_SLICE:
+        case REPLICA_BINLOG_OP_TYPE_DEL_BLOCK:
+            if (op_type == REPLICA_BINLOG_OP_TYPE_DEL_SLICE) {
+                result = ob_index_delete_slices_ex(&dedup_ctx->
+                        htables.create, &dedup_ctx->record.bs_key,
+                        NULL, &dec_alloc, false);
+                target_len = dedup_ctx->record.bs_key.slice.length;
+            } else {
+                result = ob_index_delete_block_ex(&dedup_ctx->
+                        htables.create, &dedup_ctx->record.bs_key.
+                        block, NULL, &dec_alloc, false);
+                target_len = FS_FILE_BLOCK_SIZE;
+            }
+
+            if (dec_alloc != target_len) {
+                if (op_type == REPLICA_BINLOG_OP_TYPE_DEL_BLOCK) {
+                    dedup_ctx->record.bs_key.slice.offset = 0;
+                    dedup_ctx->record.bs_key.slice.length =
+                        FS_FILE_BLOCK_SIZE;
+                }
+
+                if ((r=add_slice(&dedup_ctx->htables.remove,
+                                &dedup_ctx->record,
+                                OB_SLICE_TYPE_FILE)) == 0)
+                {
+                    dedup_ctx->rstat.partial_deletes++;
+                } else {
+                    result = r;
+                }
+            }
+
+            dedup_ctx->rstat.remove.total++;
+            if (result == 0) {
+                dedup_ctx->rstat.remove.success++;
+            } else if (result == ENOENT) {
+                dedup_ctx->rstat.remove.ignore++;
+                result = 0;
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (result != 0) {
+        sprintf(error_info, "%s fail, errno: %d, error info: %s",
+                replica_binlog_get_op_type_caption(op_type),
+                result, STRERROR(result));
+    }
+    return result;
+}
+
+static int spill_binlog_record(BinlogDedupContext *dedup_ctx,
+        const string_t *line, char *error_info)
+{
+    BinlogDedupPartition *partition;
+    int result;
+
+    partition = dedup_ctx->spill.partitions + dedup_ctx->record.
+        bs_key.block.hash_code % dedup_ctx->spill.count;
+    if (fwrite(line->str, line->len, 1, partition->fp) != 1) {
+        result = errno != 0 ? errno : EIO;
+        sprintf(error_info, "write to partition file #%d fail, "
+                "errno: %d, error info: %s", (int)(partition -
+                    dedup_ctx->spill.partitions), result, STRERROR(result));
+        return result;
+    }
+
+    partition->count++;
+    return 0;
+}
+
 static int deal_binlog_buffer(BinlogDedupContext *dedup_ctx)
 {
     char *p;
@@ -96,13 +215,8 @@ static int deal_binlog_buffer(BinlogDedupContext *dedup_ctx)
     string_t line;
     char error_info[256];
     int result;
-    int r;
-    int op_type;
-    int target_len;
-    int dec_alloc;
 
     result = 0;
-    dec_alloc = 0;
     *error_info = '\0';
     buffer = &dedup_ctx->r->buffer;
     end = buffer->buff + buffer->length;
@@ -124,71 +238,13 @@ static int deal_binlog_buffer(BinlogDedupContext *dedup_ctx)
             break;
         }
 
-        op_type = dedup_ctx->record.op_type;
         fs_calc_block_hashcode(&dedup_ctx->record.bs_key.block);
-        switch (op_type) {
-            case REPLICA_BINLOG_OP_TYPE_WRITE_SLICE:
-            case REPLICA_BINLOG_OP_TYPE_ALLOC_SLICE:
-                if (op_type == REPLICA_BINLOG_OP_TYPE_WRITE_SLICE) {
-                    result = add_slice(&dedup_ctx->htables.create,
-                            &dedup_ctx->record, OB_SLICE_TYPE_FILE);
-                } else {
-                    result = add_slice(&dedup_ctx->htables.create,
-                            &dedup_ctx->record, OB_SLICE_TYPE_ALLOC);
-                }
-                dedup_ctx->rstat.create.total++;
-                if (result == 0) {
-                    dedup_ctx->rstat.create.success++;
-                }
-                break;
-            case REPLICA_BINLOG_OP_TYPE_DEL_SLICE:
-            case REPLICA_BINLOG_OP_TYPE_DEL_BLOCK:
-                if (op_type == REPLICA_BINLOG_OP_TYPE_DEL_SLICE) {
-                    result = ob_index_delete_slices_ex(&dedup_ctx->
-                            htables.create, &dedup_ctx->record.bs_key,
-                            NULL, &dec_alloc, false);
-                    target_len = dedup_ctx->record.bs_key.slice.length;
-                } else {
-                    result = ob_index_delete_block_ex(&dedup_ctx->
-                            htables.create, &dedup_ctx->record.bs_key.
-                            block, NULL, &dec_alloc, false);
-                    target_len = FS_FILE_BLOCK_SIZE;
-                }
-
-                if (dec_alloc != target_len) {
-                    if (op_type == REPLICA_BINLOG_OP_TYPE_DEL_BLOCK) {
-                        dedup_ctx->record.bs_key.slice.offset = 0;
-                        dedup_ctx->record.bs_key.slice.length =
-                            FS_FILE_BLOCK_SIZE;
-                    }
-
-                    if ((r=add_slice(&dedup_ctx->htables.remove,
-                                    &dedup_ctx->record,
-                                    OB_SLICE_TYPE_FILE)) == 0)
-                    {
-                        dedup_ctx->rstat.partial_deletes++;
-                    } else {
-                        result = r;
-                    }
-                }
-
-                dedup_ctx->rstat.remove.total++;
-                if (result == 0) {
-                    dedup_ctx->rstat.remove.success++;
-                } else if (result == ENOENT) {
-                    dedup_ctx->rstat.remove.ignore++;
-                    result = 0;
-                }
-                break;
-            default:
-                break;
+        if (dedup_ctx->spill.count > 0) {
+            result = spill_binlog_record(dedup_ctx, &line, error_info);
+        } else {
+            result = deal_binlog_record(dedup_ctx, error_info);
         }
-
         if (result != 0) {
-            snprintf(error_info, sizeof(error_info),
-                    "%s fail, errno: %d, error info: %s",
-                    replica_binlog_get_op_type_caption(op_type),
-                    result, STRERROR(result));
             break;
         }
 
@@ -443,7 +499,7 @@ static int htable_dump(BinlogDedupContext *dedup_ctx, OBHashtable *htable,
         } while (ob != NULL);
     }
 
-    *binlog_count = dedup_ctx->out.slice_array.count;
+    *binlog_count += dedup_ctx->out.slice_array.count;
     if (dedup_ctx->out.slice_array.count > 1) {
         qsort(dedup_ctx->out.slice_array.slices,
                 dedup_ctx->out.slice_array.count,
@@ -553,38 +609,23 @@ static int realloc_slice_ptr_array(OBSlicePtrArray *sarray)
     return 0;
 }
 
-static int dedup_binlog(DataRecoveryContext *ctx)
+/* output the deletes then the creates of the hashtables */
+static int dump_htables(BinlogDedupContext *dedup_ctx,
+        const int64_t creates, const int64_t partial_deletes)
 {
-    BinlogDedupContext *dedup_ctx;
     int result;
     int64_t count;
 
-    dedup_ctx = (BinlogDedupContext *)ctx->arg;
-    if ((result=do_dedup_binlog(ctx)) != 0) {
-        return result;
-    }
-
-    if (dedup_ctx->rstat.create.success == 0 && 
-            dedup_ctx->rstat.partial_deletes == 0)
-    {
-        return 0;
-    }
-
-    if ((result=open_output_files(ctx)) != 0) {
-        close_output_files(dedup_ctx);
-        return result;
-    }
-
-    count = FC_MAX(dedup_ctx->rstat.partial_deletes,
-            dedup_ctx->rstat.create.success);
+    count = FC_MAX(partial_deletes, creates);
     if ((result=init_slice_ptr_array(&dedup_ctx->out.
                     slice_array, count)) != 0)
     {
         return result;
     }
 
-    if (dedup_ctx->rstat.partial_deletes > 0) {
-        if (dedup_ctx->rstat.create.success > 0) {
+    result = 0;
+    if (partial_deletes > 0) {
+        if (creates > 0) {
             htable_reverse_remove(&dedup_ctx->htables);
         }
 
@@ -593,28 +634,52 @@ static int dedup_binlog(DataRecoveryContext *ctx)
                  &dedup_ctx->out.binlog_counts.remove);
     }
 
-    if (dedup_ctx->rstat.create.success > 0) {
+    if (result == 0 && creates > 0) {
         dedup_ctx->out.current_op_type = SLICE_BINLOG_OP_TYPE_WRITE_SLICE;
         result = htable_dump(dedup_ctx, &dedup_ctx->htables.create,
                 &dedup_ctx->out.binlog_counts.create);
     }
 
     free(dedup_ctx->out.slice_array.slices);
-    close_output_files(dedup_ctx);
+    dedup_ctx->out.slice_array.slices = NULL;
     return result;
 }
 
-static int init_htables(DataRecoveryContext *ctx)
+static int dedup_binlog(DataRecoveryContext *ctx)
 {
     BinlogDedupContext *dedup_ctx;
     int result;
-    int64_t slice_capacity;
-    int64_t deleted_capacity;
 
     dedup_ctx = (BinlogDedupContext *)ctx->arg;
+    if ((result=do_dedup_binlog(ctx)) != 0) {
+        return result;
+    }
+
+    if (dedup_ctx->rstat.create.success == 0 && 
+            dedup_ctx->rstat.partial_deletes == 0)
+    {
+        return 0;
+    }
+
+    if ((result=open_output_files(ctx)) != 0) {
+        close_output_files(dedup_ctx);
+        return result;
+    }
+
+    result = dump_htables(dedup_ctx, dedup_ctx->rstat.create.success,
+            dedup_ctx->rstat.partial_deletes);
+    close_output_files(dedup_ctx);
+    return result;
+}
+
+static int init_htables(BinlogDedupContext *dedup_ctx,
+        const int64_t record_count)
+{
+    int result;
+    int64_t slice_capacity;
+    int64_t deleted_capacity;
 
-    slice_capacity = ctx->master->data.version -
-        ctx->master->dg->myself->data.version;
+    slice_capacity = record_count;
     if (slice_capacity < 256) {
         slice_capacity = 256;
     } else if (slice_capacity > STORAGE_CFG.object_block.hashtable_capacity) {
@@ -639,10 +704,238 @@ static int init_htables(DataRecoveryContext *ctx)
     return 0;
 }
 
+static void destroy_htables(BinlogDedupContext *dedup_ctx)
+{
+    ob_index_destroy_htable(&dedup_ctx->htables.create);
+    ob_index_destroy_htable(&dedup_ctx->htables.remove);
+}
+
+static int open_partition_files(DataRecoveryContext *ctx)
+{
+    BinlogDedupContext *dedup_ctx;
+    BinlogDedupPartition *partition;
+    BinlogDedupPartition *end;
+    char subdir_name[FS_BINLOG_SUBDIR_NAME_SIZE];
+    int bytes;
+    int result;
+
+    dedup_ctx = (BinlogDedupContext *)ctx->arg;
+    bytes = sizeof(BinlogDedupPartition) * dedup_ctx->spill.count;
+    dedup_ctx->spill.partitions = (BinlogDedupPartition *)fc_malloc(bytes);
+    if (dedup_ctx->spill.partitions == NULL) {
+        return ENOMEM;
+    }
+    memset(dedup_ctx->spill.partitions, 0, bytes);
+
+    data_recovery_get_subdir_name(ctx, RECOVERY_BINLOG_SUBDIR_NAME_REPLAY,
+            subdir_name);
+    end = dedup_ctx->spill.partitions + dedup_ctx->spill.count;
+    for (partition=dedup_ctx->spill.partitions; partition<end; partition++) {
+        binlog_reader_get_filename_ex(subdir_name,
+                DEDUP_PARTITION_FILE_SUFFIX, partition -
+                dedup_ctx->spill.partitions, partition->filename,
+                sizeof(partition->filename));
+        if ((partition->fp=fopen(partition->filename, "wb")) == NULL) {
+            result = errno != 0 ? errno : EPERM;
+            logError("file: "__FILE__", line: %d, "
+                    "open file: %s to write fail, "
+                    "errno: %d, error info: %s", __LINE__,
+                    partition->filename, result, STRERROR(result));
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static int close_partition_files(BinlogDedupContext *dedup_ctx)
+{
+    BinlogDedupPartition *partition;
+    BinlogDedupPartition *end;
+    int result;
+
+    result = 0;
+    end = dedup_ctx->spill.partitions + dedup_ctx->spill.count;
+    for (partition=dedup_ctx->spill.partitions; partition<end; partition++) {
+        if (partition->fp == NULL) {
+            continue;
+        }
+
+        if (fclose(partition->fp) != 0 && result == 0) {
+            result = errno != 0 ? errno : EIO;
+            logError("file: "__FILE__", line: %d, "
+                    "close file: %s fail, errno: %d, error info: %s",
+                    __LINE__, partition->filename, result, STRERROR(result));
+        }
+        partition->fp = NULL;
+    }
+
+    return result;
+}
+
+static void remove_partition_files(BinlogDedupContext *dedup_ctx)
+{
+    BinlogDedupPartition *partition;
+    BinlogDedupPartition *end;
+
+    end = dedup_ctx->spill.partitions + dedup_ctx->spill.count;
+    for (partition=dedup_ctx->spill.partitions; partition<end; partition++) {
+        if (*partition->filename != '\0') {
+            fc_delete_file(partition->filename);
+        }
+    }
+}
+
+static int load_partition(BinlogDedupContext *dedup_ctx,
+        BinlogDedupPartition *partition)
+{
+    FILE *fp;
+    string_t line;
+    char line_buff[DEDUP_LINE_BUFFER_SIZE];
+    char error_info[256];
+    int64_t line_no;
+    int result;
+
+    if ((fp=fopen(partition->filename, "rb")) == NULL) {
+        result = errno != 0 ? errno : ENOENT;
+        logError("file: "__FILE__", line: %d, "
+                "open file: %s to read fail, errno: %d, error info: %s",
+                __LINE__, partition->filename, result, STRERROR(result));
+        return result;
+    }
+
+    result = 0;
+    line_no = 0;
+    while (SF_G_CONTINUE_FLAG && fgets(line_buff,
+                sizeof(line_buff), fp) != NULL)
+    {
+        line_no++;
+        line.str = line_buff;
+        line.len = strlen(line_buff);
+        if ((result=replica_binlog_record_unpack(&line,
+                        &dedup_ctx->record, error_info)) != 0)
+        {
+            break;
+        }
+
+        fs_calc_block_hashcode(&dedup_ctx->record.bs_key.block);
+        if ((result=deal_binlog_record(dedup_ctx, error_info)) != 0) {
+            break;
+        }
+    }
+
+    if (result != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "partition file %s, line no: %"PRId64", %s",
+                __LINE__, partition->filename, line_no, error_info);
+    } else if (ferror(fp)) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "read file: %s fail, errno: %d, error info: %s",
+                __LINE__, partition->filename, result, STRERROR(result));
+    } else if (!SF_G_CONTINUE_FLAG) {
+        result = EINTR;
+    }
+
+    fclose(fp);
+    return result;
+}
+
+static int dedup_partition(BinlogDedupContext *dedup_ctx,
+        BinlogDedupPartition *partition)
+{
+    int result;
+    int64_t creates;
+    int64_t partial_deletes;
+
+    if ((result=init_htables(dedup_ctx, partition->count)) != 0) {
+        return result;
+    }
+
+    creates = dedup_ctx->rstat.create.success;
+    partial_deletes = dedup_ctx->rstat.partial_deletes;
+    if ((result=load_partition(dedup_ctx, partition)) == 0) {
+        result = dump_htables(dedup_ctx, dedup_ctx->rstat.create.success -
+                creates, dedup_ctx->rstat.partial_deletes - partial_deletes);
+    }
+
+    destroy_htables(dedup_ctx);
+    return result;
+}
+
+static int dedup_binlog_by_partitions(DataRecoveryContext *ctx)
+{
+    BinlogDedupContext *dedup_ctx;
+    BinlogDedupPartition *partition;
+    BinlogDedupPartition *end;
+    int result;
+
+    dedup_ctx = (BinlogDedupContext *)ctx->arg;
+    if ((result=open_partition_files(ctx)) == 0) {
+        result = do_dedup_binlog(ctx);
+    }
+    if (dedup_ctx->spill.partitions == NULL) {
+        return result;
+    }
+
+    if (close_partition_files(dedup_ctx) != 0 && result == 0) {
+        result = EIO;
+    }
+    if (result == 0) {
+        result = open_output_files(ctx);
+    }
+
+    end = dedup_ctx->spill.partitions + dedup_ctx->spill.count;
+    for (partition=dedup_ctx->spill.partitions; result == 0 &&
+            partition<end; partition++)
+    {
+        if (partition->count > 0) {
+            result = dedup_partition(dedup_ctx, partition);
+        }
+        fc_delete_file(partition->filename);
+    }
+
+    close_output_files(dedup_ctx);
+    remove_partition_files(dedup_ctx);
+    free(dedup_ctx->spill.partitions);
+    dedup_ctx->spill.partitions = NULL;
+    return result;
+}
+
+static int get_partition_count(DataRecoveryContext *ctx,
+        const int64_t record_count)
+{
+    int64_t memory;
+    int64_t count;
+
+    if (RECOVERY_DEDUP_MAX_MEMORY <= 0) {
+        return 0;
+    }
+
+    memory = record_count * DEDUP_MEMORY_PER_RECORD;
+    if (memory <= RECOVERY_DEDUP_MAX_MEMORY) {
+        return 0;
+    }
+
+    count = (memory + RECOVERY_DEDUP_MAX_MEMORY - 1) /
+        RECOVERY_DEDUP_MAX_MEMORY;
+    if (count > DEDUP_MAX_PARTITIONS) {
+        logWarning("file: "__FILE__", line: %d, "
+                "data group id: %d, the records to dedup: %"PRId64", "
+                "the partitions: %"PRId64" exceed the limit: %d, "
+                "the memory may exceed the recovery_dedup_max_memory",
+                __LINE__, ctx->ds->dg->id, record_count,
+                count, DEDUP_MAX_PARTITIONS);
+        count = DEDUP_MAX_PARTITIONS;
+    }
+    return count;
+}
+
 int data_recovery_dedup_binlog(DataRecoveryContext *ctx, int64_t *binlog_count)
 {
     int result;
     BinlogDedupContext dedup_ctx;
+    int64_t record_count;
     int64_t start_time;
     int64_t end_time;
     char time_buff[32];
@@ -651,15 +944,19 @@ int data_recovery_dedup_binlog(DataRecoveryContext *ctx, int64_t *binlog_count)
     memset(&dedup_ctx, 0, sizeof(dedup_ctx));
     ctx->arg = &dedup_ctx;
 
-    if ((result=init_htables(ctx)) != 0) {
-        return result;
-    }
-    
     dedup_ctx.out.current_version = __sync_fetch_and_add(
             &ctx->master->dg->myself->data.version, 0);
+    record_count = ctx->master->data.version - dedup_ctx.out.current_version;
+    if ((dedup_ctx.spill.count=get_partition_count(ctx, record_count)) > 0) {
+        result = dedup_binlog_by_partitions(ctx);
+    } else {
+        if ((result=init_htables(&dedup_ctx, record_count)) != 0) {
+            return result;
+        }
 
-    result = dedup_binlog(ctx);
-    ob_index_destroy_htable(&dedup_ctx.htables.create);
+        result = dedup_binlog(ctx);
+        destroy_htables(&dedup_ctx);
+    }
 
     *binlog_count = dedup_ctx.out.binlog_counts.remove +
         dedup_ctx.out.binlog_counts.create;
@@ -674,14 +971,15 @@ int data_recovery_dedup_binlog(DataRecoveryContext *ctx, int64_t *binlog_count)
                 "delete : {total : %"PRId64", success : %"PRId64", "
                 "ignore : %"PRId64", partial : %"PRId64"}}, "
                 "output: {create : %"PRId64", delete : %"PRId64"}, "
-                "time used: %s ms", __LINE__, ctx->ds->dg->id,
+                "partitions: %d, time used: %s ms", __LINE__, ctx->ds->dg->id,
                 dedup_ctx.rstat.create.total + dedup_ctx.rstat.remove.total,
                 dedup_ctx.rstat.create.success + dedup_ctx.rstat.remove.success,
                 dedup_ctx.rstat.create.total, dedup_ctx.rstat.create.success,
                 dedup_ctx.rstat.remove.total, dedup_ctx.rstat.remove.success,
                 dedup_ctx.rstat.remove.ignore, dedup_ctx.rstat.partial_deletes,
                 dedup_ctx.out.binlog_counts.create,
-                dedup_ctx.out.binlog_counts.remove, time_buff);
+                dedup_ctx.out.binlog_counts.remove,
+                dedup_ctx.spill.count, time_buff);
     } else {
         logError("file: "__FILE__", line: %d, "
                 "dedup binlog fail, result: %d",
@@ -42,6 +42,7 @@ typedef struct {
     int wait_count;
     uint64_t until_version;
     SharedBuffer *buffer;  //for network
+    SharedBuffer *raw_buffer;  //for decompress, alloc on demand
 } BinlogFetchContext;
 
 static inline void get_fetched_binlog_filename(DataRecoveryContext *ctx,
@@ -330,7 +331,22 @@ static int fetch_binlog_to_local(ConnectionInfo *conn,
         fetch_ctx->buffer->buff;
     binlog.len = buff2int(common_bheader->binlog_length);
     *is_last = common_bheader->is_last;
-    if (response.header.body_len != bheader_size + binlog.len) {
+    if (common_bheader->compression == FS_REPLICA_COMPRESSION_LZ4) {
+        if (fetch_ctx->raw_buffer == NULL) {
+            if ((fetch_ctx->raw_buffer=replication_callee_alloc_shared_buffer(
+                            ctx->server_ctx)) == NULL)
+            {
+                return ENOMEM;
+            }
+        }
+        if ((result=replication_decompress(fetch_ctx->buffer->buff +
+                        bheader_size, response.header.body_len -
+                        bheader_size, fetch_ctx->raw_buffer->buff,
+                        fetch_ctx->raw_buffer->capacity, binlog.len)) != 0)
+        {
+            return result;
+        }
+    } else if (response.header.body_len != bheader_size + binlog.len) {
         logError("file: "__FILE__", line: %d, "
                 "response body length: %d != body header size: %d"
                 " + binlog_length: %d ", __LINE__, response.header.body_len,
@@ -371,7 +387,11 @@ static int fetch_binlog_to_local(ConnectionInfo *conn,
                 ctx->fetch.last_data_version, fetch_ctx->until_version);
     }
 
-    binlog.str = fetch_ctx->buffer->buff + bheader_size;
+    if (common_bheader->compression == FS_REPLICA_COMPRESSION_LZ4) {
+        binlog.str = fetch_ctx->raw_buffer->buff;
+    } else {
+        binlog.str = fetch_ctx->buffer->buff + bheader_size;
+    }
     if (ctx->is_online) {
         if ((result=find_binlog_length(ctx, &binlog, is_last)) != 0) {
             return result;
@@ -423,6 +443,8 @@ static int fetch_binlog_first_to_local(ConnectionInfo *conn,
     } else {
         rheader->catch_up = 0;
     }
+    rheader->compression = REPLICA_COMPRESSION;
+    memset(rheader->padding, 0, sizeof(rheader->padding));
 
     pkg_len = sizeof(FSProtoHeader) + sizeof(*rheader);
     if (SLAVE_BINLOG_CHECK_LAST_ROWS > 0) {
@@ -565,6 +587,9 @@ int data_recovery_fetch_binlog(DataRecoveryContext *ctx, int64_t *binlog_size)
 
     close(fetch_ctx.fd);
     shared_buffer_release(fetch_ctx.buffer);
+    if (fetch_ctx.raw_buffer != NULL) {
+        shared_buffer_release(fetch_ctx.raw_buffer);
+    }
 
     if (result == 0 && *binlog_size > 0) {
         char full_filename[PATH_MAX];
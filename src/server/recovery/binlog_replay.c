@@ -40,20 +40,50 @@
 #include "../server_replication.h"
 #include "../server_storage.h"
 #include "data_recovery.h"
+#include "recovery_governor.h"
 #include "binlog_replay.h"
 
 #define FIXED_THREAD_CONTEXT_COUNT  16
 
+/* the tasks are held by the data operations and the bulk read
+ * frames in flight, and the waiting queue */
+#define REPLAY_TASKS_PER_THREAD  (2 * RECOVERY_MAX_QUEUE_DEPTH + \
+        RECOVERY_BULK_READ_SLICES * RECOVERY_BULK_READ_WINDOW)
+
+#define BULK_READ_RETRY_CONNECT_INTERVAL  1
+
 struct binlog_replay_context;
 struct replay_thread_context;
 
 typedef struct replay_task_info {
     int op_type;
+    int operation;       //the data operation in flight
+    bool use_thread_buff;  //the slice data in the buffer of the thread
     FSSliceOpContext op_ctx;
+    struct {
+        struct replay_bulk_frame *frame;  //NULL for NOT in a frame
+        bool fetched;     //the slice data fetched by the bulk read
+        int entry_index;  //-1 for NOT in the bulk read
+        int read_bytes;
+        char *data;       //point to the buffer of the bulk frame
+        struct replay_task_info *next;  //for the bulk frame
+    } bulk;
     struct replay_thread_context *thread_ctx;
     struct replay_task_info *next;
 } ReplayTaskInfo;
 
+typedef struct replay_bulk_frame {
+    ReplayTaskInfo *head;  //the tasks in the binlog order
+    ReplayTaskInfo *tail;
+    int read_count;        //the slices to read
+    int read_bytes;        //the expect response body length
+    int result;            //0 for the response received
+    int inflight;          //the data operations in flight
+    bool sent;
+    FSClientBulkReadEntry *entries;
+    char *buff;
+} ReplayBulkFrame;
+
 typedef struct {
     FSCounterTripple write;
     FSCounterTripple allocate;
@@ -66,11 +96,32 @@ typedef struct replay_thread_context {
         struct fc_queue waiting;  //element: ReplayTaskInfo
     } queues;
 
+    /* the data operations are asynchronous, the completed
+     * tasks are pushed to the done list by the data threads */
     struct {
         pthread_lock_cond_pair_t lcp;
-        bool done;
+        ReplayTaskInfo *done_head;
     } notify;
 
+    struct {
+        ReplayTaskInfo **tasks;  //for the block ordering check
+        int count;
+        bool thread_buff_busy;
+    } inflight;
+
+    /* the bulk read frames are pipelined on one connection, the next
+     * frames are requested while the current one is replayed */
+    struct {
+        ConnectionInfo *conn;
+        int conn_error;   //the in-flight frames are lost when error
+        time_t next_connect_time;
+        int frame_size;   //the max response body size
+        ReplayBulkFrame *frames;  //the window ring
+        int head;         //the earliest frame in flight
+        int count;        //the frames in flight
+        ReplayTaskInfo *pending;  //popped but out of the last frame
+    } bulk;
+
     ReplayStatInfo stat;
     struct binlog_replay_context *replay_ctx;
 } ReplayThreadContext;
@@ -146,26 +197,87 @@ void binlog_replay_destroy()
 
 static void slice_write_done_notify(FSDataOperation *op)
 {
+    ReplayTaskInfo *task;
     ReplayThreadContext *thread_ctx;
 
-    thread_ctx = ((ReplayTaskInfo *)op->arg)->thread_ctx;
+    task = (ReplayTaskInfo *)op->arg;
+    thread_ctx = task->thread_ctx;
     PTHREAD_MUTEX_LOCK(&thread_ctx->notify.lcp.lock);
-    thread_ctx->notify.done = true;
+    task->next = thread_ctx->notify.done_head;
+    thread_ctx->notify.done_head = task;
     pthread_cond_signal(&thread_ctx->notify.lcp.cond);
     PTHREAD_MUTEX_UNLOCK(&thread_ctx->notify.lcp.lock);
 }
 
-static int deal_task(ReplayTaskInfo *task, char *buff)
+static int replay_task_finish(ReplayTaskInfo *task, int result,
+        bool log_padding)
+{
+    if (task->operation != DATA_OPERATION_NONE) {
+        if (result == 0) {
+            switch (task->operation) {
+                case DATA_OPERATION_SLICE_WRITE:
+                    task->thread_ctx->stat.write.success++;
+                    break;
+                case DATA_OPERATION_SLICE_ALLOCATE:
+                    task->thread_ctx->stat.allocate.success++;
+                    break;
+                default:
+                    task->thread_ctx->stat.remove.success++;
+                    break;
+            }
+        } else if (result == ENOENT) {
+            if (task->operation == DATA_OPERATION_SLICE_DELETE) {
+                result = 0;
+                log_padding = true;
+                task->thread_ctx->stat.remove.ignore++;
+            }
+        }
+    }
+
+    if (result == 0) {
+        if (log_padding) {
+            result = replica_binlog_log_no_op(task->thread_ctx->
+                    replay_ctx->recovery_ctx->ds->dg->id,
+                    task->op_ctx.info.data_version,
+                    &task->op_ctx.info.bs_key.block);
+        }
+    } else {
+        __sync_add_and_fetch(&task->thread_ctx->replay_ctx->fail_count, 1);
+        task->thread_ctx->replay_ctx->continue_flag = false;
+        logError("file: "__FILE__", line: %d, "
+                "data group id: %d, %s fail, "
+                "oid: %"PRId64", block offset: %"PRId64", "
+                "slice offset: %d, length: %d, "
+                "errno: %d, error info: %s",
+                __LINE__, task->thread_ctx->replay_ctx->
+                recovery_ctx->ds->dg->id,
+                replica_binlog_get_op_type_caption(task->op_type),
+                task->op_ctx.info.bs_key.block.oid,
+                task->op_ctx.info.bs_key.block.offset,
+                task->op_ctx.info.bs_key.slice.offset,
+                task->op_ctx.info.bs_key.slice.length,
+                result, STRERROR(result));
+    }
+
+    __sync_add_and_fetch(&task->thread_ctx->replay_ctx->
+            recovery_ctx->progress.done, 1);
+    return result;
+}
+
+/* fetch the slice data when write, then push the data operation to
+ * the data thread without waiting, the task is finished by
+ * replay_task_finish when the data operation done */
+static int replay_task_start(ReplayTaskInfo *task,
+        char *buff, bool *in_flight)
 {
     int result;
     int read_bytes;
-    int operation;
+    char *data;
     bool log_padding;
-    int64_t *success_ptr;
 
+    *in_flight = false;
     log_padding = false;
-    operation = DATA_OPERATION_NONE;
-    success_ptr = NULL;
+    task->operation = DATA_OPERATION_NONE;
     switch (task->op_type) {
         case REPLICA_BINLOG_OP_TYPE_WRITE_SLICE:
             task->thread_ctx->stat.write.total++;
@@ -178,11 +290,19 @@ static int deal_task(ReplayTaskInfo *task, char *buff)
                 break;
             }
 
-            if ((result=fs_client_slice_read_by_slave(&g_fs_client_vars.
-                            client_ctx, task->thread_ctx->replay_ctx->
-                            recovery_ctx->is_online ? CLUSTER_MY_SERVER_ID : 0,
-                            &task->op_ctx.info.bs_key, buff, &read_bytes)) == 0)
-            {
+            if (task->bulk.fetched) {
+                data = task->bulk.data;
+                read_bytes = task->bulk.read_bytes;
+                result = (read_bytes > 0) ? 0 : ENODATA;
+            } else {
+                data = buff;
+                result = fs_client_slice_read_by_slave(&g_fs_client_vars.
+                        client_ctx, task->thread_ctx->replay_ctx->
+                        recovery_ctx->is_online ? CLUSTER_MY_SERVER_ID : 0,
+                        &task->op_ctx.info.bs_key, buff, &read_bytes);
+            }
+
+            if (result == 0) {
                 if (read_bytes != task->op_ctx.info.bs_key.slice.length) {
                     logWarning("file: "__FILE__", line: %d, "
                             "oid: %"PRId64", block offset: %"PRId64", "
@@ -196,9 +316,8 @@ static int deal_task(ReplayTaskInfo *task, char *buff)
                             read_bytes);
                     task->op_ctx.info.bs_key.slice.length = read_bytes;
                 }
-                task->op_ctx.info.buff = buff;
-                operation = DATA_OPERATION_SLICE_WRITE;
-                success_ptr = &task->thread_ctx->stat.write.success;
+                task->op_ctx.info.buff = data;
+                task->operation = DATA_OPERATION_SLICE_WRITE;
             } else if (result == ENODATA) {
                 logWarning("file: "__FILE__", line: %d, "
                         "oid: %"PRId64", block offset: %"PRId64", "
@@ -215,13 +334,13 @@ static int deal_task(ReplayTaskInfo *task, char *buff)
             break;
         case REPLICA_BINLOG_OP_TYPE_ALLOC_SLICE:
             task->thread_ctx->stat.allocate.total++;
-            operation = DATA_OPERATION_SLICE_ALLOCATE;
-            success_ptr = &task->thread_ctx->stat.allocate.success;
+            task->operation = DATA_OPERATION_SLICE_ALLOCATE;
+            result = 0;
             break;
         case REPLICA_BINLOG_OP_TYPE_DEL_SLICE:
             task->thread_ctx->stat.remove.total++;
-            operation = DATA_OPERATION_SLICE_DELETE;
-            success_ptr = &task->thread_ctx->stat.remove.success;
+            task->operation = DATA_OPERATION_SLICE_DELETE;
+            result = 0;
             break;
         default:
             logError("file: "__FILE__", line: %d, "
@@ -231,90 +350,466 @@ static int deal_task(ReplayTaskInfo *task, char *buff)
             break;
     }
 
-    if (operation != DATA_OPERATION_NONE) {
-        if ((result=push_to_data_thread_queue(operation,
+    if (task->operation != DATA_OPERATION_NONE) {
+        if ((result=push_to_data_thread_queue(task->operation,
                         DATA_SOURCE_SLAVE_RECOVERY, task,
                         &task->op_ctx)) == 0)
         {
-            PTHREAD_MUTEX_LOCK(&task->thread_ctx->notify.lcp.lock);
-            while (!task->thread_ctx->notify.done) {
-                pthread_cond_wait(&task->thread_ctx->notify.lcp.cond,
-                        &task->thread_ctx->notify.lcp.lock);
-            }
-            task->thread_ctx->notify.done = false;  /* reset for next */
-            PTHREAD_MUTEX_UNLOCK(&task->thread_ctx->notify.lcp.lock);
-            result = task->op_ctx.result;
+            *in_flight = true;
+            return 0;
         }
+    }
 
-        if (result == 0) {
-            (*success_ptr)++;
-        } else if (result == ENOENT) {
-            if (operation == DATA_OPERATION_SLICE_DELETE) {
-                result = 0;
-                log_padding = true;
-                task->thread_ctx->stat.remove.ignore++;
+    return replay_task_finish(task, result, log_padding);
+}
+
+static void replay_task_release(ReplayThreadContext *thread_ctx,
+        ReplayTaskInfo *task)
+{
+    if (task->bulk.frame != NULL) {
+        task->bulk.frame->inflight--;
+    }
+    fc_queue_push(&thread_ctx->queues.freelist, task);
+}
+
+static void replay_remove_inflight(ReplayThreadContext *thread_ctx,
+        ReplayTaskInfo *task)
+{
+    int i;
+
+    for (i=0; i<thread_ctx->inflight.count; i++) {
+        if (thread_ctx->inflight.tasks[i] == task) {
+            thread_ctx->inflight.tasks[i] = thread_ctx->inflight.tasks[
+                --thread_ctx->inflight.count];
+            break;
+        }
+    }
+
+    if (task->use_thread_buff) {
+        thread_ctx->inflight.thread_buff_busy = false;
+    }
+}
+
+/* finish the tasks which data operation done,
+ * wait for one at least when blocked */
+static void replay_reap_done(ReplayThreadContext *thread_ctx,
+        const bool blocked)
+{
+    ReplayTaskInfo *task;
+    ReplayTaskInfo *next;
+
+    PTHREAD_MUTEX_LOCK(&thread_ctx->notify.lcp.lock);
+    while (blocked && thread_ctx->notify.done_head == NULL) {
+        pthread_cond_wait(&thread_ctx->notify.lcp.cond,
+                &thread_ctx->notify.lcp.lock);
+    }
+    task = thread_ctx->notify.done_head;
+    thread_ctx->notify.done_head = NULL;
+    PTHREAD_MUTEX_UNLOCK(&thread_ctx->notify.lcp.lock);
+
+    while (task != NULL) {
+        next = task->next;
+        replay_remove_inflight(thread_ctx, task);
+        replay_task_finish(task, task->op_ctx.result, false);
+        replay_task_release(thread_ctx, task);
+        task = next;
+    }
+}
+
+static void replay_wait_all_done(ReplayThreadContext *thread_ctx)
+{
+    while (thread_ctx->inflight.count > 0) {
+        replay_reap_done(thread_ctx, true);
+    }
+}
+
+static bool replay_block_inflight(ReplayThreadContext *thread_ctx,
+        ReplayTaskInfo *task)
+{
+    int i;
+
+    for (i=0; i<thread_ctx->inflight.count; i++) {
+        if (FS_BLOCK_KEY_EQUAL(thread_ctx->inflight.tasks[i]->
+                    op_ctx.info.bs_key.block, task->op_ctx.info.bs_key.block))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* keep up to recovery_max_queue_depth data operations in flight,
+ * the operations of the same block are done in the binlog order */
+static int deal_task(ReplayThreadContext *thread_ctx,
+        ReplayTaskInfo *task, char *buff)
+{
+    int result;
+    bool in_flight;
+
+    recovery_governor_acquire(thread_ctx->replay_ctx->recovery_ctx,
+            (task->op_type == REPLICA_BINLOG_OP_TYPE_WRITE_SLICE ?
+             task->op_ctx.info.bs_key.slice.length : 0), 1);
+
+    task->use_thread_buff = (task->op_type ==
+            REPLICA_BINLOG_OP_TYPE_WRITE_SLICE && !task->bulk.fetched);
+    while (thread_ctx->inflight.count >= RECOVERY_MAX_QUEUE_DEPTH ||
+            (task->use_thread_buff && thread_ctx->inflight.
+             thread_buff_busy) || replay_block_inflight(thread_ctx, task))
+    {
+        replay_reap_done(thread_ctx, true);
+    }
+
+    if (task->bulk.frame != NULL) {
+        task->bulk.frame->inflight++;
+    }
+    result = replay_task_start(task, buff, &in_flight);
+    if (!in_flight) {
+        replay_task_release(thread_ctx, task);
+        return result;
+    }
+
+    thread_ctx->inflight.tasks[thread_ctx->inflight.count++] = task;
+    if (task->use_thread_buff) {
+        thread_ctx->inflight.thread_buff_busy = true;
+    }
+    return 0;
+}
+
+static int replay_tasks(ReplayThreadContext *thread_ctx, char *buff)
+{
+    ReplayTaskInfo *task;
+    int result;
+    int count;
+
+    count = 0;
+    while (SF_G_CONTINUE_FLAG && (task=(ReplayTaskInfo *)
+                fc_queue_try_pop(&thread_ctx->queues.waiting)) != NULL)
+    {
+        ++count;
+        if ((result=deal_task(thread_ctx, task, buff)) != 0) {
+            break;
+        }
+    }
+
+    return count;
+}
+
+static void bulk_release_connection(ReplayThreadContext *thread_ctx,
+        const int result)
+{
+    FSClientContext *client_ctx;
+
+    client_ctx = &g_fs_client_vars.client_ctx;
+    SF_CLIENT_RELEASE_CONNECTION(client_ctx, thread_ctx->bulk.conn, result);
+    thread_ctx->bulk.conn = NULL;
+    thread_ctx->bulk.conn_error = 0;
+}
+
+static void bulk_check_connection(ReplayThreadContext *thread_ctx)
+{
+    FSClientContext *client_ctx;
+    const FSConnectionParameters *connection_params;
+    ReplayBulkFrame *frame;
+    ReplayBulkFrame *end;
+    int frame_size;
+    int result;
+
+    if (thread_ctx->bulk.conn != NULL || thread_ctx->bulk.count > 0 ||
+            g_current_time < thread_ctx->bulk.next_connect_time)
+    {
+        return;
+    }
+
+    client_ctx = &g_fs_client_vars.client_ctx;
+    thread_ctx->bulk.next_connect_time = g_current_time +
+        BULK_READ_RETRY_CONNECT_INTERVAL;
+    if ((thread_ctx->bulk.conn=client_ctx->conn_manager.
+                get_readable_connection(client_ctx, thread_ctx->
+                    replay_ctx->recovery_ctx->ds->dg->id - 1,
+                    &result)) == NULL)
+    {
+        return;
+    }
+
+    connection_params = client_ctx->conn_manager.get_connection_params(
+            client_ctx, thread_ctx->bulk.conn);
+    frame_size = connection_params->buffer_size - sizeof(FSProtoHeader);
+    if (thread_ctx->bulk.frame_size == 0) {
+        end = thread_ctx->bulk.frames + RECOVERY_BULK_READ_WINDOW;
+        for (frame=thread_ctx->bulk.frames; frame<end; frame++) {
+            if ((frame->buff=(char *)fc_malloc(frame_size)) == NULL) {
+                bulk_release_connection(thread_ctx, 0);
+                return;
             }
         }
+        thread_ctx->bulk.frame_size = frame_size;
+    } else if (frame_size < thread_ctx->bulk.frame_size) {
+        thread_ctx->bulk.frame_size = frame_size;
     }
+}
 
-    if (result == 0) {
-        if (log_padding) {
-            result = replica_binlog_log_no_op(task->thread_ctx->
-                    replay_ctx->recovery_ctx->ds->dg->id,
-                    task->op_ctx.info.data_version,
-                    &task->op_ctx.info.bs_key.block);
+static inline void bulk_frame_append(ReplayBulkFrame *frame,
+        ReplayTaskInfo *task)
+{
+    task->bulk.next = NULL;
+    if (frame->tail == NULL) {
+        frame->head = task;
+    } else {
+        frame->tail->bulk.next = task;
+    }
+    frame->tail = task;
+}
+
+/* pop the waiting tasks to the frame, the slices of the write tasks
+ * are read by the frame, the others are replayed in order with them */
+static bool bulk_frame_fill(ReplayThreadContext *thread_ctx,
+        ReplayBulkFrame *frame)
+{
+    ReplayTaskInfo *task;
+    FSClientBulkReadEntry *entry;
+    int length;
+    int bytes;
+
+    frame->head = frame->tail = NULL;
+    frame->read_count = 0;
+    frame->read_bytes = 0;
+    frame->result = 0;
+    frame->sent = false;
+    while (frame->read_count < RECOVERY_BULK_READ_SLICES) {
+        if (thread_ctx->bulk.pending != NULL) {
+            task = thread_ctx->bulk.pending;
+            thread_ctx->bulk.pending = NULL;
+        } else if ((task=(ReplayTaskInfo *)fc_queue_try_pop(
+                        &thread_ctx->queues.waiting)) == NULL)
+        {
+            break;
         }
+
+        task->bulk.frame = frame;
+        task->bulk.fetched = false;
+        task->bulk.entry_index = -1;
+        if (task->op_type == REPLICA_BINLOG_OP_TYPE_WRITE_SLICE &&
+                thread_ctx->bulk.conn != NULL)
+        {
+            length = task->op_ctx.info.bs_key.slice.length;
+            bytes = sizeof(FSProtoReplicaSliceBulkReadRespPart) + length;
+            if (length > 0 && bytes <= thread_ctx->bulk.frame_size) {
+                if (frame->read_bytes + bytes > thread_ctx->bulk.frame_size) {
+                    thread_ctx->bulk.pending = task;  //for the next frame
+                    break;
+                }
+
+                entry = frame->entries + frame->read_count;
+                entry->bs_key = &task->op_ctx.info.bs_key;
+                task->bulk.entry_index = frame->read_count++;
+                frame->read_bytes += bytes;
+            }  //else read by the slice read
+        }
+
+        bulk_frame_append(frame, task);
+    }
+
+    return frame->head != NULL;
+}
+
+static void bulk_frame_send(ReplayThreadContext *thread_ctx,
+        ReplayBulkFrame *frame)
+{
+    if (frame->read_count == 0) {
+        return;
+    }
+
+    if (thread_ctx->bulk.conn_error != 0) {
+        frame->result = thread_ctx->bulk.conn_error;
+        return;
+    }
+
+    if ((frame->result=fs_client_proto_slice_bulk_read_send(
+                    &g_fs_client_vars.client_ctx, thread_ctx->bulk.conn,
+                    thread_ctx->replay_ctx->recovery_ctx->is_online ?
+                    CLUSTER_MY_SERVER_ID : 0, frame->entries,
+                    frame->read_count)) == 0)
+    {
+        frame->sent = true;
     } else {
-        __sync_add_and_fetch(&task->thread_ctx->replay_ctx->fail_count, 1);
-        task->thread_ctx->replay_ctx->continue_flag = false;
-        logError("file: "__FILE__", line: %d, "
-                "data group id: %d, %s fail, "
-                "oid: %"PRId64", block offset: %"PRId64", "
-                "slice offset: %d, length: %d, "
-                "errno: %d, error info: %s",
-                __LINE__, task->thread_ctx->replay_ctx->
-                recovery_ctx->ds->dg->id,
-                replica_binlog_get_op_type_caption(task->op_type),
-                task->op_ctx.info.bs_key.block.oid,
-                task->op_ctx.info.bs_key.block.offset,
-                task->op_ctx.info.bs_key.slice.offset,
-                task->op_ctx.info.bs_key.slice.length,
-                result, STRERROR(result));
+        thread_ctx->bulk.conn_error = frame->result;
     }
+}
 
-    return result;
+static void bulk_frame_recv(ReplayThreadContext *thread_ctx,
+        ReplayBulkFrame *frame)
+{
+    if (!frame->sent) {
+        return;
+    }
+
+    if (thread_ctx->bulk.conn_error != 0) {
+        frame->result = thread_ctx->bulk.conn_error;
+        return;
+    }
+
+    if ((frame->result=fs_client_proto_slice_bulk_read_recv(
+                    &g_fs_client_vars.client_ctx, thread_ctx->bulk.conn,
+                    frame->buff, thread_ctx->bulk.frame_size,
+                    frame->entries, frame->read_count)) != 0)
+    {
+        thread_ctx->bulk.conn_error = frame->result;
+    }
+}
+
+static void bulk_task_set_fetched(ReplayBulkFrame *frame,
+        ReplayTaskInfo *task)
+{
+    FSClientBulkReadEntry *entry;
+
+    if (task->bulk.entry_index < 0 || frame->result != 0) {
+        return;
+    }
+
+    /* the partial read is done by the slice read for the holes */
+    entry = frame->entries + task->bulk.entry_index;
+    if (entry->err_no == ENOENT || (entry->err_no == 0 &&
+                entry->read_bytes == 0))
+    {
+        task->bulk.fetched = true;
+        task->bulk.read_bytes = 0;
+    } else if (entry->err_no == 0 && entry->read_bytes ==
+            task->op_ctx.info.bs_key.slice.length)
+    {
+        task->bulk.fetched = true;
+        task->bulk.read_bytes = entry->read_bytes;
+        task->bulk.data = entry->data;
+    }
+}
+
+static int bulk_frame_replay(ReplayThreadContext *thread_ctx,
+        ReplayBulkFrame *frame, char *buff)
+{
+    ReplayTaskInfo *task;
+    ReplayTaskInfo *next;
+    int result;
+    int count;
+
+    result = 0;
+    count = 0;
+    task = frame->head;
+    while (task != NULL) {
+        next = task->bulk.next;
+        if (result == 0 && SF_G_CONTINUE_FLAG) {
+            bulk_task_set_fetched(frame, task);
+            result = deal_task(thread_ctx, task, buff);
+        } else {
+            fc_queue_push(&thread_ctx->queues.freelist, task);
+        }
+        ++count;
+        task = next;
+    }
+
+    frame->head = frame->tail = NULL;
+    return count;
+}
+
+static int bulk_replay_tasks(ReplayThreadContext *thread_ctx, char *buff)
+{
+    ReplayBulkFrame *frame;
+    int count;
+
+    bulk_check_connection(thread_ctx);
+    while (thread_ctx->bulk.count < RECOVERY_BULK_READ_WINDOW) {
+        frame = thread_ctx->bulk.frames + (thread_ctx->bulk.head +
+                thread_ctx->bulk.count) % RECOVERY_BULK_READ_WINDOW;
+        while (frame->inflight > 0) {  //the buffer is used by the writes
+            replay_reap_done(thread_ctx, true);
+        }
+        if (!bulk_frame_fill(thread_ctx, frame)) {
+            break;
+        }
+
+        bulk_frame_send(thread_ctx, frame);
+        thread_ctx->bulk.count++;
+    }
+
+    if (thread_ctx->bulk.count == 0) {
+        return 0;
+    }
+
+    frame = thread_ctx->bulk.frames + thread_ctx->bulk.head;
+    bulk_frame_recv(thread_ctx, frame);
+    count = bulk_frame_replay(thread_ctx, frame, buff);
+    thread_ctx->bulk.head = (thread_ctx->bulk.head + 1) %
+        RECOVERY_BULK_READ_WINDOW;
+    thread_ctx->bulk.count--;
+
+    if (thread_ctx->bulk.count == 0 && thread_ctx->bulk.conn_error != 0) {
+        bulk_release_connection(thread_ctx, thread_ctx->bulk.conn_error);
+    }
+    return count;
+}
+
+static void bulk_replay_cleanup(ReplayThreadContext *thread_ctx)
+{
+    ReplayBulkFrame *frame;
+    ReplayTaskInfo *task;
+
+    while (thread_ctx->bulk.count > 0) {
+        frame = thread_ctx->bulk.frames + thread_ctx->bulk.head;
+        while (frame->head != NULL) {
+            task = frame->head;
+            frame->head = task->bulk.next;
+            fc_queue_push(&thread_ctx->queues.freelist, task);
+        }
+        frame->tail = NULL;
+        if (frame->sent && thread_ctx->bulk.conn_error == 0) {
+            thread_ctx->bulk.conn_error = EINTR;  //the response is lost
+        }
+
+        thread_ctx->bulk.head = (thread_ctx->bulk.head + 1) %
+            RECOVERY_BULK_READ_WINDOW;
+        thread_ctx->bulk.count--;
+    }
+
+    if (thread_ctx->bulk.pending != NULL) {
+        fc_queue_push(&thread_ctx->queues.freelist,
+                thread_ctx->bulk.pending);
+        thread_ctx->bulk.pending = NULL;
+    }
+
+    if (thread_ctx->bulk.conn != NULL) {
+        bulk_release_connection(thread_ctx, thread_ctx->bulk.conn_error);
+    }
 }
 
 static void binlog_replay_run(void *arg, void *thread_data)
 {
     ReplayThreadContext *thread_ctx;
-    ReplayTaskInfo *task;
     char *buff;
-    int result;
+    int count;
 
     buff = (char *)thread_data;
     thread_ctx = (ReplayThreadContext *)arg;
     __sync_add_and_fetch(&thread_ctx->replay_ctx->running_count, 1);
     while (thread_ctx->replay_ctx->continue_flag) {
-        if ((task=(ReplayTaskInfo *)fc_queue_try_pop(
-                        &thread_ctx->queues.waiting)) == NULL)
-        {
-            fc_sleep_ms(100);
-            continue;
+        replay_reap_done(thread_ctx, false);
+        if (RECOVERY_BULK_READ_SLICES > 0) {
+            count = bulk_replay_tasks(thread_ctx, buff);
+        } else {
+            count = replay_tasks(thread_ctx, buff);
         }
 
-        do {
-            result = deal_task(task, buff);
-            fc_queue_push(&thread_ctx->queues.freelist, task);
-            if (result != 0) {
-                break;
+        if (count == 0) {
+            if (thread_ctx->inflight.count > 0) {
+                replay_reap_done(thread_ctx, true);
+            } else {
+                fc_sleep_ms(100);
             }
-
-            task = (ReplayTaskInfo *)fc_queue_try_pop(
-                    &thread_ctx->queues.waiting);
-        } while (task != NULL && SF_G_CONTINUE_FLAG);
+        }
     }
 
+    replay_wait_all_done(thread_ctx);
+    if (RECOVERY_BULK_READ_SLICES > 0) {
+        bulk_replay_cleanup(thread_ctx);
+    }
     __sync_sub_and_fetch(&thread_ctx->replay_ctx->running_count, 1);
 }
 
@@ -375,6 +870,8 @@ static int deal_binlog_buffer(DataRecoveryContext *ctx)
         task->op_type = replay_ctx->record.op_type;
         task->op_ctx.info.data_version = replay_ctx->record.data_version;
         task->op_ctx.info.bs_key = replay_ctx->record.bs_key;
+        task->bulk.frame = NULL;
+        task->bulk.fetched = false;
         fc_queue_push(&thread_ctx->queues.waiting, task);
         replay_ctx->total_count++;
 
@@ -555,6 +1052,8 @@ static int do_replay_binlog(DataRecoveryContext *ctx)
             "%s, replay start offset: %"PRId64" ...",
             __LINE__, subdir_name, position.offset);
 
+    ctx->progress.done = 0;
+    ctx->progress.start_time = get_current_time_ms();
     result = 0;
     while (SF_G_CONTINUE_FLAG && replay_ctx->continue_flag) {
         if ((replay_ctx->r=binlog_read_thread_fetch_result(
@@ -587,9 +1086,62 @@ static int do_replay_binlog(DataRecoveryContext *ctx)
     binlog_read_thread_terminate(&replay_ctx->rdthread_ctx);
 
     replay_finish(ctx, result);
+    ctx->progress.start_time = 0;
     return replay_output(ctx, result);
 }
 
+/* the frame buffers are allocated when the frame size is known */
+static int init_bulk_frames(ReplayThreadContext *thread_ctx)
+{
+    ReplayBulkFrame *frame;
+    ReplayBulkFrame *end;
+    int bytes;
+
+    if (RECOVERY_BULK_READ_SLICES == 0) {
+        return 0;
+    }
+
+    bytes = sizeof(ReplayBulkFrame) * RECOVERY_BULK_READ_WINDOW;
+    thread_ctx->bulk.frames = (ReplayBulkFrame *)fc_malloc(bytes);
+    if (thread_ctx->bulk.frames == NULL) {
+        return ENOMEM;
+    }
+    memset(thread_ctx->bulk.frames, 0, bytes);
+
+    bytes = sizeof(FSClientBulkReadEntry) * RECOVERY_BULK_READ_SLICES;
+    end = thread_ctx->bulk.frames + RECOVERY_BULK_READ_WINDOW;
+    for (frame=thread_ctx->bulk.frames; frame<end; frame++) {
+        frame->entries = (FSClientBulkReadEntry *)fc_malloc(bytes);
+        if (frame->entries == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    return 0;
+}
+
+static void destroy_bulk_frames(ReplayThreadContext *thread_ctx)
+{
+    ReplayBulkFrame *frame;
+    ReplayBulkFrame *end;
+
+    if (thread_ctx->bulk.frames == NULL) {
+        return;
+    }
+
+    end = thread_ctx->bulk.frames + RECOVERY_BULK_READ_WINDOW;
+    for (frame=thread_ctx->bulk.frames; frame<end; frame++) {
+        if (frame->entries != NULL) {
+            free(frame->entries);
+        }
+        if (frame->buff != NULL) {
+            free(frame->buff);
+        }
+    }
+    free(thread_ctx->bulk.frames);
+    thread_ctx->bulk.frames = NULL;
+}
+
 static int init_rthread_context(ReplayThreadContext *thread_ctx,
         ReplayTaskInfo *tasks)
 {
@@ -614,7 +1166,17 @@ static int init_rthread_context(ReplayThreadContext *thread_ctx,
         return result;
     }
 
-    end = tasks + RECOVERY_MAX_QUEUE_DEPTH;
+    thread_ctx->inflight.tasks = (ReplayTaskInfo **)fc_malloc(
+            sizeof(ReplayTaskInfo *) * RECOVERY_MAX_QUEUE_DEPTH);
+    if (thread_ctx->inflight.tasks == NULL) {
+        return ENOMEM;
+    }
+
+    if ((result=init_bulk_frames(thread_ctx)) != 0) {
+        return result;
+    }
+
+    end = tasks + REPLAY_TASKS_PER_THREAD;
     for (task=tasks; task<end; task++) {
         task->op_ctx.notify_func = slice_write_done_notify;
         task->thread_ctx = thread_ctx;
@@ -634,7 +1196,7 @@ static int init_replay_tasks(DataRecoveryContext *ctx)
     int bytes;
 
     replay_ctx = (BinlogReplayContext *)ctx->arg;
-    count = RECOVERY_THREADS_PER_DATA_GROUP * RECOVERY_MAX_QUEUE_DEPTH;
+    count = RECOVERY_THREADS_PER_DATA_GROUP * REPLAY_TASKS_PER_THREAD;
     bytes = sizeof(ReplayTaskInfo) * count;
     replay_ctx->thread_env.tasks = (ReplayTaskInfo *)fc_malloc(bytes);
     if (replay_ctx->thread_env.tasks == NULL) {
@@ -645,6 +1207,7 @@ static int init_replay_tasks(DataRecoveryContext *ctx)
     for (task=replay_ctx->thread_env.tasks; task<end; task++) {
         task->op_ctx.info.source = BINLOG_SOURCE_REPLAY;
         task->op_ctx.info.write_binlog.log_replica = true;
+        task->op_ctx.info.write_binlog.batch = NULL;
         task->op_ctx.info.data_group_id = ctx->ds->dg->id;
         task->op_ctx.info.myself = ctx->master->dg->myself;
 
@@ -687,7 +1250,7 @@ static int int_replay_context(DataRecoveryContext *ctx)
     end = replay_ctx->thread_env.contexts + RECOVERY_THREADS_PER_DATA_GROUP;
     for (context=replay_ctx->thread_env.contexts,
             tasks=replay_ctx->thread_env.tasks; context<end;
-            context++, tasks += RECOVERY_MAX_QUEUE_DEPTH)
+            context++, tasks += REPLAY_TASKS_PER_THREAD)
     {
         context->replay_ctx = replay_ctx;
         if ((result=init_rthread_context(context, tasks)) != 0) {
@@ -721,6 +1284,10 @@ static void destroy_replay_context(BinlogReplayContext *replay_ctx)
         fc_queue_destroy(&context->queues.waiting);
 
         destroy_pthread_lock_cond_pair(&context->notify.lcp);
+        if (context->inflight.tasks != NULL) {
+            free(context->inflight.tasks);
+        }
+        destroy_bulk_frames(context);
     }
 
     tend = replay_ctx->thread_env.tasks + replay_ctx->thread_env.task_count;
@@ -38,6 +38,8 @@
 #include "binlog_fetch.h"
 #include "binlog_dedup.h"
 #include "binlog_replay.h"
+#include "recovery_governor.h"
+#include "diff_recovery.h"
 #include "data_recovery.h"
 
 #define DATA_RECOVERY_SYS_DATA_FILENAME       "data_recovery.dat"
@@ -376,6 +378,33 @@ static int replica_binlog_log_padding(DataRecoveryContext *ctx)
     return result;
 }
 
+static int data_recovery_diff(DataRecoveryContext *ctx)
+{
+    int result;
+    int unlink_result;
+    uint64_t old_version;
+    uint64_t until_version;
+
+    old_version = __sync_add_and_fetch(&ctx->ds->data.version, 0);
+    result = data_recovery_diff_blocks(ctx, &until_version);
+
+    /* the fetched binlog is stale when any block transferred, the binlog
+     * fetched after the current data version replays onto the blocks */
+    if (__sync_add_and_fetch(&ctx->ds->data.version, 0) != old_version) {
+        if ((unlink_result=data_recovery_unlink_fetched_binlog(ctx)) != 0) {
+            return unlink_result;
+        }
+    }
+
+    /* fall back to the binlog recovery on fail */
+    if (result != 0 || until_version == 0) {
+        return 0;
+    }
+
+    ctx->fetch.last_data_version = until_version;
+    return replica_binlog_log_padding(ctx);
+}
+
 static int proto_active_confirm(ConnectionInfo *conn,
         DataRecoveryContext *ctx, const bool last_retry)
 {
@@ -476,6 +505,14 @@ static int do_data_recovery(DataRecoveryContext *ctx)
     switch (ctx->stage) {
         case DATA_RECOVERY_STAGE_FETCH:
             start_time = get_current_time_ms();
+            if (CHECKSUM_TREE_ENABLED && !ctx->is_online &&
+                    ctx->catch_up == DATA_RECOVERY_CATCH_UP_DOING)
+            {
+                if ((result=data_recovery_diff(ctx)) != 0) {
+                    break;
+                }
+            }
+
             if ((result=data_recovery_fetch_binlog(ctx, &binlog_size)) != 0) {
                 break;
             }
@@ -503,6 +540,7 @@ static int do_data_recovery(DataRecoveryContext *ctx)
                 result = replica_binlog_log_padding(ctx);
                 break;
             }
+            ctx->progress.total = binlog_count;
 
             ctx->stage = DATA_RECOVERY_STAGE_REPLAY;
             if ((result=data_recovery_save_sys_data(ctx)) != 0) {
@@ -607,6 +645,7 @@ int data_recovery_start(FSClusterDataServerInfo *ds)
         return result;
     }
 
+    recovery_governor_register(&ctx);
     ctx.catch_up = DATA_RECOVERY_CATCH_UP_DOING;
     do {
         if ((ctx.master=data_recovery_get_master(&ctx, &result)) == NULL) {
@@ -635,8 +674,10 @@ int data_recovery_start(FSClusterDataServerInfo *ds)
         }
 
         ctx.stage = DATA_RECOVERY_STAGE_FETCH;
+        ctx.progress.total = 0;
     } while (!ctx.is_online);
 
+    recovery_governor_unregister(&ctx);
     destroy_data_recovery_ctx(&ctx);
     return result;
 }
@@ -0,0 +1,910 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/pthread_func.h"
+#include "sf/sf_global.h"
+#include "../../common/fs_proto.h"
+#include "../../common/fs_func.h"
+#include "../../client/fs_client.h"
+#include "../server_global.h"
+#include "../server_group_info.h"
+#include "../data_thread.h"
+#include "../server_binlog.h"
+#include "../server_replication.h"
+#include "../server_storage.h"
+#include "recovery_governor.h"
+#include "diff_recovery.h"
+
+#define DIFF_RECOVERY_MAX_LEAF_BLOCKS  (64 * 1024)
+#define DIFF_RECOVERY_INIT_ACTIONS     (4 * 1024)
+
+typedef struct {
+    ChecksumTreeBlockInfo block;
+    bool remove;  //the block unknown to the master
+} DiffRecoveryAction;
+
+typedef struct {
+    char type;
+    FSSliceSize ssize;
+} DiffRecoverySlice;
+
+typedef struct {
+    DataRecoveryContext *ctx;
+    ConnectionInfo conn;
+    SharedBuffer *buffer;  //for the response body
+    char *data;            //the data of the block to transfer
+
+    struct {
+        int indexes[FS_REPLICA_CHECKSUM_MAX_NODES];
+        uint64_t master[FS_REPLICA_CHECKSUM_MAX_NODES];
+        uint64_t local[FS_REPLICA_CHECKSUM_MAX_NODES];
+        int count;
+        char out_buff[sizeof(FSProtoHeader) + sizeof(
+                FSProtoReplicaChecksumNodesReqHeader) +
+            4 * FS_REPLICA_CHECKSUM_MAX_NODES];
+    } nodes;
+
+    struct {
+        ChecksumTreeBlockInfo *master;
+        ChecksumTreeBlockInfo *local;
+        int master_size;
+        int master_count;
+        int local_count;
+    } blocks;
+
+    struct {
+        DiffRecoveryAction *entries;
+        int count;
+        int alloc;
+    } actions;
+
+    struct {
+        DiffRecoverySlice *entries;
+        int count;
+        int size;
+    } slices;
+
+    uint64_t master_version;  //the written data version of the master
+
+    FSSliceOpContext op_ctx;
+    struct {
+        pthread_lock_cond_pair_t lcp;
+        bool done;
+    } notify;
+
+    struct {
+        int leaves;
+        int64_t transferred;
+        int64_t removed;
+        int64_t bytes;
+    } stat;
+} DiffRecoveryContext;
+
+static int recv_response_body(DiffRecoveryContext *dctx,
+        SFResponseInfo *response)
+{
+    int result;
+
+    if (response->header.body_len > dctx->buffer->capacity) {
+        logError("file: "__FILE__", line: %d, "
+                "response body length: %d is too large, "
+                "the max body length is %d", __LINE__,
+                response->header.body_len, dctx->buffer->capacity);
+        return EOVERFLOW;
+    }
+
+    if ((result=tcprecvdata_nb(dctx->conn.sock, dctx->buffer->buff,
+                    response->header.body_len, SF_G_NETWORK_TIMEOUT)) != 0)
+    {
+        response->error.length = snprintf(response->error.message,
+                sizeof(response->error.message),
+                "recv data fail, errno: %d, error info: %s",
+                result, STRERROR(result));
+        sf_log_network_error(response, &dctx->conn, result);
+    }
+    return result;
+}
+
+static int proto_checksum_nodes(DiffRecoveryContext *dctx, const int level,
+        uint64_t *data_version, bool *ready)
+{
+    FSProtoReplicaChecksumNodesReqHeader *req_header;
+    FSProtoReplicaChecksumNodesRespHeader *resp_header;
+    SFResponseInfo response;
+    char *p;
+    int out_bytes;
+    int expect_len;
+    int result;
+    int i;
+
+    req_header = (FSProtoReplicaChecksumNodesReqHeader *)
+        (dctx->nodes.out_buff + sizeof(FSProtoHeader));
+    int2buff(dctx->ctx->ds->dg->id, req_header->data_group_id);
+    int2buff(dctx->nodes.count, req_header->count);
+    req_header->level = level;
+    memset(req_header->padding, 0, sizeof(req_header->padding));
+    p = (char *)(req_header + 1);
+    for (i=0; i<dctx->nodes.count; i++, p+=4) {
+        int2buff(dctx->nodes.indexes[i], p);
+    }
+    out_bytes = p - dctx->nodes.out_buff;
+    SF_PROTO_SET_HEADER((FSProtoHeader *)dctx->nodes.out_buff,
+            FS_REPLICA_PROTO_CHECKSUM_NODES_REQ,
+            out_bytes - sizeof(FSProtoHeader));
+
+    response.error.length = 0;
+    if ((result=sf_send_and_check_response_header(&dctx->conn,
+                    dctx->nodes.out_buff, out_bytes, &response,
+                    SF_G_NETWORK_TIMEOUT,
+                    FS_REPLICA_PROTO_CHECKSUM_NODES_RESP)) != 0)
+    {
+        sf_log_network_error(&response, &dctx->conn, result);
+        return result;
+    }
+
+    expect_len = sizeof(FSProtoReplicaChecksumNodesRespHeader) +
+        8 * dctx->nodes.count;
+    if (response.header.body_len != expect_len) {
+        logError("file: "__FILE__", line: %d, "
+                "response body length: %d != expected: %d",
+                __LINE__, response.header.body_len, expect_len);
+        return EINVAL;
+    }
+    if ((result=recv_response_body(dctx, &response)) != 0) {
+        return result;
+    }
+
+    resp_header = (FSProtoReplicaChecksumNodesRespHeader *)
+        dctx->buffer->buff;
+    *data_version = buff2long(resp_header->data_version);
+    *ready = resp_header->ready;
+    p = (char *)(resp_header + 1);
+    for (i=0; i<dctx->nodes.count; i++, p+=8) {
+        dctx->nodes.master[i] = buff2long(p);
+    }
+    return 0;
+}
+
+static int proto_checksum_blocks(DiffRecoveryContext *dctx,
+        const int leaf_index)
+{
+    FSProtoReplicaChecksumBlocksReq *req;
+    FSProtoReplicaChecksumBlocksRespHeader *resp_header;
+    FSProtoReplicaChecksumBlock *pb;
+    ChecksumTreeBlockInfo *block;
+    ChecksumTreeBlockInfo *end;
+    SFResponseInfo response;
+    char out_buff[sizeof(FSProtoHeader) + sizeof(
+            FSProtoReplicaChecksumBlocksReq)];
+    int expect_len;
+    int count;
+    int result;
+
+    req = (FSProtoReplicaChecksumBlocksReq *)
+        (out_buff + sizeof(FSProtoHeader));
+    int2buff(dctx->ctx->ds->dg->id, req->data_group_id);
+    int2buff(leaf_index, req->leaf_index);
+    SF_PROTO_SET_HEADER((FSProtoHeader *)out_buff,
+            FS_REPLICA_PROTO_CHECKSUM_BLOCKS_REQ,
+            sizeof(FSProtoReplicaChecksumBlocksReq));
+
+    response.error.length = 0;
+    if ((result=sf_send_and_check_response_header(&dctx->conn, out_buff,
+                    sizeof(out_buff), &response, SF_G_NETWORK_TIMEOUT,
+                    FS_REPLICA_PROTO_CHECKSUM_BLOCKS_RESP)) != 0)
+    {
+        sf_log_network_error(&response, &dctx->conn, result);
+        return result;
+    }
+
+    if (response.header.body_len < (int)sizeof(
+                FSProtoReplicaChecksumBlocksRespHeader))
+    {
+        logError("file: "__FILE__", line: %d, "
+                "response body length: %d is too short", __LINE__,
+                response.header.body_len);
+        return EINVAL;
+    }
+    if ((result=recv_response_body(dctx, &response)) != 0) {
+        return result;
+    }
+
+    resp_header = (FSProtoReplicaChecksumBlocksRespHeader *)
+        dctx->buffer->buff;
+    count = buff2int(resp_header->count);
+    expect_len = sizeof(FSProtoReplicaChecksumBlocksRespHeader) +
+        sizeof(FSProtoReplicaChecksumBlock) * count;
+    if (count < 0 || count > dctx->blocks.master_size ||
+            response.header.body_len != expect_len)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "response body length: %d != expected: %d, "
+                "block count: %d", __LINE__,
+                response.header.body_len, expect_len, count);
+        return EINVAL;
+    }
+
+    pb = (FSProtoReplicaChecksumBlock *)(resp_header + 1);
+    end = dctx->blocks.master + count;
+    for (block=dctx->blocks.master; block<end; block++, pb++) {
+        block->bkey.oid = buff2long(pb->bkey.oid);
+        block->bkey.offset = buff2long(pb->bkey.offset);
+        fs_calc_block_hashcode(&block->bkey);
+        block->data_version = buff2long(pb->data_version);
+    }
+    dctx->blocks.master_count = count;
+    return 0;
+}
+
+static int proto_block_slices(DiffRecoveryContext *dctx,
+        const FSBlockKey *bkey)
+{
+    FSProtoReplicaBlockSlicesReq *req;
+    FSProtoReplicaBlockSlicesRespHeader *resp_header;
+    FSProtoReplicaBlockSlice *ps;
+    DiffRecoverySlice *slice;
+    DiffRecoverySlice *end;
+    SFResponseInfo response;
+    char out_buff[sizeof(FSProtoHeader) + sizeof(
+            FSProtoReplicaBlockSlicesReq)];
+    int expect_len;
+    int count;
+    int result;
+
+    req = (FSProtoReplicaBlockSlicesReq *)(out_buff + sizeof(FSProtoHeader));
+    int2buff(dctx->ctx->ds->dg->id, req->data_group_id);
+    memset(req->padding, 0, sizeof(req->padding));
+    long2buff(bkey->oid, req->bkey.oid);
+    long2buff(bkey->offset, req->bkey.offset);
+    SF_PROTO_SET_HEADER((FSProtoHeader *)out_buff,
+            FS_REPLICA_PROTO_BLOCK_SLICES_REQ,
+            sizeof(FSProtoReplicaBlockSlicesReq));
+
+    response.error.length = 0;
+    if ((result=sf_send_and_check_response_header(&dctx->conn, out_buff,
+                    sizeof(out_buff), &response, SF_G_NETWORK_TIMEOUT,
+                    FS_REPLICA_PROTO_BLOCK_SLICES_RESP)) != 0)
+    {
+        sf_log_network_error(&response, &dctx->conn, result);
+        return result;
+    }
+
+    if (response.header.body_len < (int)sizeof(
+                FSProtoReplicaBlockSlicesRespHeader))
+    {
+        logError("file: "__FILE__", line: %d, "
+                "response body length: %d is too short", __LINE__,
+                response.header.body_len);
+        return EINVAL;
+    }
+    if ((result=recv_response_body(dctx, &response)) != 0) {
+        return result;
+    }
+
+    resp_header = (FSProtoReplicaBlockSlicesRespHeader *)dctx->buffer->buff;
+    count = buff2int(resp_header->count);
+    expect_len = sizeof(FSProtoReplicaBlockSlicesRespHeader) +
+        sizeof(FSProtoReplicaBlockSlice) * count;
+    if (count < 0 || count > dctx->slices.size ||
+            response.header.body_len != expect_len)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "response body length: %d != expected: %d, "
+                "slice count: %d", __LINE__,
+                response.header.body_len, expect_len, count);
+        return EINVAL;
+    }
+
+    ps = (FSProtoReplicaBlockSlice *)(resp_header + 1);
+    end = dctx->slices.entries + count;
+    for (slice=dctx->slices.entries; slice<end; slice++, ps++) {
+        slice->type = ps->type;
+        slice->ssize.offset = buff2int(ps->offset);
+        slice->ssize.length = buff2int(ps->length);
+        if (slice->ssize.offset < 0 || slice->ssize.length <= 0 ||
+                slice->ssize.offset + slice->ssize.length >
+                FS_FILE_BLOCK_SIZE)
+        {
+            logError("file: "__FILE__", line: %d, "
+                    "invalid slice offset: %d, length: %d", __LINE__,
+                    slice->ssize.offset, slice->ssize.length);
+            return EINVAL;
+        }
+    }
+    dctx->slices.count = count;
+    return 0;
+}
+
+static void diff_op_done_notify(FSDataOperation *op)
+{
+    DiffRecoveryContext *dctx;
+
+    dctx = (DiffRecoveryContext *)op->arg;
+    PTHREAD_MUTEX_LOCK(&dctx->notify.lcp.lock);
+    dctx->notify.done = true;
+    pthread_cond_signal(&dctx->notify.lcp.cond);
+    PTHREAD_MUTEX_UNLOCK(&dctx->notify.lcp.lock);
+}
+
+/* the records of a transferred block are logged to the replica binlog
+ * with the data versions NOT less than the master's version of the block,
+ * so a peer which recovers from this node after the block changed gets
+ * the whole block. the versions between are skipped as the padding does,
+ * and the versions should NOT exceed the master's written version */
+static int next_data_version(DiffRecoveryContext *dctx,
+        const uint64_t min_version, uint64_t *data_version)
+{
+    uint64_t current_version;
+
+    current_version = __sync_add_and_fetch(&dctx->ctx->ds->data.version, 0);
+    if (min_version > current_version + 1) {
+        current_version = min_version - 1;
+        replica_binlog_set_data_version(dctx->ctx->ds, current_version);
+    }
+
+    if (current_version >= dctx->master_version) {
+        logWarning("file: "__FILE__", line: %d, "
+                "data group id: %d, no data version left for the "
+                "transferred blocks, master's data version: %"PRId64,
+                __LINE__, dctx->ctx->ds->dg->id, dctx->master_version);
+        return EOVERFLOW;
+    }
+
+    *data_version = current_version + 1;
+    return 0;
+}
+
+static int do_data_operation(DiffRecoveryContext *dctx,
+        const int operation, const FSBlockKey *bkey,
+        const uint64_t data_version, const FSSliceSize *ssize)
+{
+    int result;
+
+    dctx->op_ctx.info.data_version = data_version;
+    dctx->op_ctx.info.bs_key.block = *bkey;
+    dctx->op_ctx.info.bs_key.slice = *ssize;
+    dctx->op_ctx.info.buff = dctx->data;
+
+    dctx->notify.done = false;
+    if ((result=push_to_data_thread_queue(operation,
+                    DATA_SOURCE_SLAVE_RECOVERY, dctx,
+                    &dctx->op_ctx)) != 0)
+    {
+        return result;
+    }
+
+    PTHREAD_MUTEX_LOCK(&dctx->notify.lcp.lock);
+    while (!dctx->notify.done) {
+        pthread_cond_wait(&dctx->notify.lcp.cond, &dctx->notify.lcp.lock);
+    }
+    PTHREAD_MUTEX_UNLOCK(&dctx->notify.lcp.lock);
+
+    return dctx->op_ctx.result;
+}
+
+/* the data version is NOT consumed when the local block NOT exist */
+static int delete_local_block(DiffRecoveryContext *dctx,
+        const FSBlockKey *bkey, const uint64_t min_version)
+{
+    FSSliceSize ssize;
+    uint64_t data_version;
+    int result;
+
+    if ((result=next_data_version(dctx, min_version, &data_version)) != 0) {
+        return result;
+    }
+
+    recovery_governor_acquire(dctx->ctx, 0, 1);
+    ssize.offset = 0;
+    ssize.length = 0;
+    result = do_data_operation(dctx, DATA_OPERATION_BLOCK_DELETE,
+            bkey, data_version, &ssize);
+    return (result == ENOENT) ? 0 : result;
+}
+
+static int transfer_slice(DiffRecoveryContext *dctx,
+        const FSBlockKey *bkey, const DiffRecoverySlice *slice,
+        int *read_bytes)
+{
+    FSBlockSliceKeyInfo bs_key;
+    FSSliceSize ssize;
+    uint64_t data_version;
+    int operation;
+    int result;
+
+    if (slice->type == FS_REPLICA_SLICE_TYPE_FILE) {
+        bs_key.block = *bkey;
+        bs_key.slice = slice->ssize;
+        result = fs_client_slice_read_by_slave(&g_fs_client_vars.
+                client_ctx, 0, &bs_key, dctx->data, read_bytes);
+        if (result == ENODATA) {
+            /* changed by the master, the binlog fetched after catches up */
+            *read_bytes = 0;
+            return 0;
+        } else if (result != 0) {
+            logError("file: "__FILE__", line: %d, "
+                    "data group id: %d, read slice from the master fail, "
+                    "oid: %"PRId64", block offset: %"PRId64", slice "
+                    "offset: %d, length: %d, errno: %d, error info: %s",
+                    __LINE__, dctx->ctx->ds->dg->id, bkey->oid,
+                    bkey->offset, slice->ssize.offset, slice->ssize.length,
+                    result, STRERROR(result));
+            return result;
+        }
+
+        operation = DATA_OPERATION_SLICE_WRITE;
+        ssize.offset = slice->ssize.offset;
+        ssize.length = *read_bytes;
+    } else {
+        operation = DATA_OPERATION_SLICE_ALLOCATE;
+        ssize = slice->ssize;
+        *read_bytes = 0;
+    }
+
+    if ((result=next_data_version(dctx, 0, &data_version)) != 0) {
+        return result;
+    }
+
+    recovery_governor_acquire(dctx->ctx, *read_bytes, 1);
+    return do_data_operation(dctx, operation, bkey, data_version, &ssize);
+}
+
+/* replace the local block with the existing slices of the master's */
+static int transfer_block(DiffRecoveryContext *dctx,
+        const ChecksumTreeBlockInfo *block)
+{
+    DiffRecoverySlice *slice;
+    DiffRecoverySlice *end;
+    int read_bytes;
+    int result;
+
+    if ((result=proto_block_slices(dctx, &block->bkey)) != 0) {
+        return result;
+    }
+
+    if ((result=delete_local_block(dctx, &block->bkey,
+                    block->data_version)) != 0)
+    {
+        return result;
+    }
+
+    end = dctx->slices.entries + dctx->slices.count;
+    for (slice=dctx->slices.entries; slice<end; slice++) {
+        if ((result=transfer_slice(dctx, &block->bkey,
+                        slice, &read_bytes)) != 0)
+        {
+            return result;
+        }
+        dctx->stat.bytes += read_bytes;
+    }
+
+    /* the records are logged with the local versions */
+    checksum_tree_set_block(dctx->ctx->ds->dg->id,
+            &block->bkey, block->data_version);
+    dctx->stat.transferred++;
+    return 0;
+}
+
+static int remove_block(DiffRecoveryContext *dctx,
+        const ChecksumTreeBlockInfo *block)
+{
+    int result;
+
+    if ((result=delete_local_block(dctx, &block->bkey, 0)) != 0) {
+        return result;
+    }
+
+    checksum_tree_remove_block(dctx->ctx->ds->dg->id, &block->bkey);
+    dctx->stat.removed++;
+    return 0;
+}
+
+static inline int compare_block_key(const FSBlockKey *bkey1,
+        const FSBlockKey *bkey2)
+{
+    int sub;
+    if ((sub=fc_compare_int64(bkey1->oid, bkey2->oid)) != 0) {
+        return sub;
+    }
+    return fc_compare_int64(bkey1->offset, bkey2->offset);
+}
+
+static int add_action(DiffRecoveryContext *dctx,
+        const ChecksumTreeBlockInfo *block, const bool remove)
+{
+    DiffRecoveryAction *entries;
+    int alloc;
+
+    if (dctx->actions.count == dctx->actions.alloc) {
+        alloc = (dctx->actions.alloc == 0) ? DIFF_RECOVERY_INIT_ACTIONS :
+            dctx->actions.alloc * 2;
+        entries = (DiffRecoveryAction *)fc_malloc(
+                sizeof(DiffRecoveryAction) * alloc);
+        if (entries == NULL) {
+            return ENOMEM;
+        }
+
+        if (dctx->actions.count > 0) {
+            memcpy(entries, dctx->actions.entries, sizeof(
+                        DiffRecoveryAction) * dctx->actions.count);
+        }
+        if (dctx->actions.entries != NULL) {
+            free(dctx->actions.entries);
+        }
+        dctx->actions.entries = entries;
+        dctx->actions.alloc = alloc;
+    }
+
+    dctx->actions.entries[dctx->actions.count].block = *block;
+    dctx->actions.entries[dctx->actions.count].remove = remove;
+    dctx->actions.count++;
+    return 0;
+}
+
+static int diff_leaf(DiffRecoveryContext *dctx, const int leaf_index)
+{
+    ChecksumTreeBlockInfo *master;
+    ChecksumTreeBlockInfo *mend;
+    ChecksumTreeBlockInfo *local;
+    ChecksumTreeBlockInfo *lend;
+    int sub;
+    int result;
+
+    if ((result=proto_checksum_blocks(dctx, leaf_index)) != 0) {
+        return result;
+    }
+    if ((result=checksum_tree_get_leaf_blocks(dctx->ctx->ds->dg->id,
+                    leaf_index, dctx->blocks.local,
+                    DIFF_RECOVERY_MAX_LEAF_BLOCKS,
+                    &dctx->blocks.local_count)) != 0)
+    {
+        return result;
+    }
+
+    /* merge the two block lists sorted by block key */
+    master = dctx->blocks.master;
+    mend = master + dctx->blocks.master_count;
+    local = dctx->blocks.local;
+    lend = local + dctx->blocks.local_count;
+    while ((master < mend || local < lend) && SF_G_CONTINUE_FLAG) {
+        result = 0;
+        if (local == lend) {
+            sub = -1;
+        } else if (master == mend) {
+            sub = 1;
+        } else {
+            sub = compare_block_key(&master->bkey, &local->bkey);
+        }
+
+        if (sub < 0) {
+            result = add_action(dctx, master++, false);
+        } else if (sub > 0) {
+            result = add_action(dctx, local++, true);
+        } else {
+            if (master->data_version != local->data_version) {
+                result = add_action(dctx, master, false);
+            }
+            master++;
+            local++;
+        }
+
+        if (result != 0) {
+            return result;
+        }
+    }
+
+    dctx->stat.leaves++;
+    return SF_G_CONTINUE_FLAG ? 0 : EINTR;
+}
+
+/* the transferred blocks by the master's data version, and then
+ * the removed blocks which are unknown to the master */
+static int compare_action(const DiffRecoveryAction *a1,
+        const DiffRecoveryAction *a2)
+{
+    int sub;
+
+    if ((sub=(int)a1->remove - (int)a2->remove) != 0) {
+        return sub;
+    }
+    if ((sub=fc_compare_int64(a1->block.data_version,
+                    a2->block.data_version)) != 0)
+    {
+        return sub;
+    }
+    return compare_block_key(&a1->block.bkey, &a2->block.bkey);
+}
+
+static int apply_actions(DiffRecoveryContext *dctx)
+{
+    DiffRecoveryAction *action;
+    DiffRecoveryAction *end;
+    int result;
+
+    if (dctx->actions.count > 1) {
+        qsort(dctx->actions.entries, dctx->actions.count,
+                sizeof(DiffRecoveryAction), (int (*)(const void *,
+                        const void *))compare_action);
+    }
+
+    end = dctx->actions.entries + dctx->actions.count;
+    for (action=dctx->actions.entries; action<end &&
+            SF_G_CONTINUE_FLAG; action++)
+    {
+        if (action->remove) {
+            result = remove_block(dctx, &action->block);
+        } else {
+            result = transfer_block(dctx, &action->block);
+        }
+
+        if (result != 0) {
+            return result;
+        }
+    }
+
+    return SF_G_CONTINUE_FLAG ? 0 : EINTR;
+}
+
+/* keep the nodes different from the master's as the parents */
+static int compare_nodes(DiffRecoveryContext *dctx, const int level)
+{
+    int result;
+    int count;
+    int i;
+
+    if ((result=checksum_tree_get_nodes(dctx->ctx->ds->dg->id, level,
+                    dctx->nodes.indexes, dctx->nodes.count,
+                    dctx->nodes.local)) != 0)
+    {
+        return result;
+    }
+
+    count = 0;
+    for (i=0; i<dctx->nodes.count; i++) {
+        if (dctx->nodes.master[i] != dctx->nodes.local[i]) {
+            dctx->nodes.indexes[count++] = dctx->nodes.indexes[i];
+        }
+    }
+    dctx->nodes.count = count;
+    return 0;
+}
+
+static void expand_children(DiffRecoveryContext *dctx)
+{
+    int parents[FS_REPLICA_CHECKSUM_MAX_NODES / CHECKSUM_TREE_FANOUT];
+    int count;
+    int i;
+    int k;
+
+    count = dctx->nodes.count;
+    memcpy(parents, dctx->nodes.indexes, sizeof(int) * count);
+    dctx->nodes.count = 0;
+    for (i=0; i<count; i++) {
+        for (k=0; k<CHECKSUM_TREE_FANOUT; k++) {
+            dctx->nodes.indexes[dctx->nodes.count++] =
+                parents[i] * CHECKSUM_TREE_FANOUT + k;
+        }
+    }
+}
+
+static int do_diff_blocks(DiffRecoveryContext *dctx,
+        uint64_t *until_version)
+{
+    uint64_t master_version;
+    uint64_t my_version;
+    uint64_t dummy_version;
+    bool ready;
+    int level;
+    int result;
+    int i;
+
+    dctx->nodes.indexes[0] = 0;
+    dctx->nodes.count = 1;
+    if ((result=proto_checksum_nodes(dctx, 0,
+                    &master_version, &ready)) != 0)
+    {
+        return result;
+    }
+    if (!ready) {
+        logInfo("file: "__FILE__", line: %d, "
+                "data group id: %d, the checksum tree of the master "
+                "is NOT ready, skip the differential recovery",
+                __LINE__, dctx->ctx->ds->dg->id);
+        return 0;
+    }
+
+    my_version = __sync_add_and_fetch(&dctx->ctx->ds->data.version, 0);
+    if (master_version < my_version + RECOVERY_DIFF_MIN_GAP) {
+        return 0;
+    }
+
+    if ((result=compare_nodes(dctx, 0)) != 0) {
+        return result;
+    }
+
+    /* the nodes of the leaf level is NOT more than the max nodes */
+    for (level=1; level<=CHECKSUM_TREE_LEAF_LEVEL &&
+            dctx->nodes.count > 0; level++)
+    {
+        expand_children(dctx);
+        if ((result=proto_checksum_nodes(dctx, level,
+                        &dummy_version, &ready)) != 0)
+        {
+            return result;
+        }
+        if ((result=compare_nodes(dctx, level)) != 0) {
+            return result;
+        }
+    }
+
+    for (i=0; i<dctx->nodes.count; i++) {
+        if ((result=diff_leaf(dctx, dctx->nodes.indexes[i])) != 0) {
+            return result;
+        }
+    }
+
+    dctx->master_version = master_version;
+    if ((result=apply_actions(dctx)) != 0) {
+        return result;
+    }
+
+    *until_version = master_version;
+    return 0;
+}
+
+static int init_diff_context(DiffRecoveryContext *dctx,
+        DataRecoveryContext *ctx)
+{
+    int result;
+
+    dctx->ctx = ctx;
+    if ((dctx->buffer=replication_callee_alloc_shared_buffer(
+                    ctx->server_ctx)) == NULL)
+    {
+        return ENOMEM;
+    }
+    dctx->blocks.master_size = (dctx->buffer->capacity - sizeof(
+                FSProtoReplicaChecksumBlocksRespHeader)) /
+        sizeof(FSProtoReplicaChecksumBlock);
+
+    dctx->blocks.master = (ChecksumTreeBlockInfo *)fc_malloc(
+            sizeof(ChecksumTreeBlockInfo) * dctx->blocks.master_size);
+    if (dctx->blocks.master == NULL) {
+        return ENOMEM;
+    }
+    dctx->blocks.local = (ChecksumTreeBlockInfo *)fc_malloc(
+            sizeof(ChecksumTreeBlockInfo) * DIFF_RECOVERY_MAX_LEAF_BLOCKS);
+    if (dctx->blocks.local == NULL) {
+        return ENOMEM;
+    }
+    dctx->slices.size = (dctx->buffer->capacity - sizeof(
+                FSProtoReplicaBlockSlicesRespHeader)) /
+        sizeof(FSProtoReplicaBlockSlice);
+    dctx->slices.entries = (DiffRecoverySlice *)fc_malloc(
+            sizeof(DiffRecoverySlice) * dctx->slices.size);
+    if (dctx->slices.entries == NULL) {
+        return ENOMEM;
+    }
+    if ((dctx->data=(char *)fc_malloc(FS_FILE_BLOCK_SIZE)) == NULL) {
+        return ENOMEM;
+    }
+
+    if ((result=init_pthread_lock_cond_pair(&dctx->notify.lcp)) != 0) {
+        return result;
+    }
+
+    dctx->op_ctx.notify_func = diff_op_done_notify;
+    dctx->op_ctx.info.source = BINLOG_SOURCE_REPLAY;
+    dctx->op_ctx.info.write_binlog.log_replica = true;
+    dctx->op_ctx.info.write_binlog.batch = NULL;
+    dctx->op_ctx.info.data_group_id = ctx->ds->dg->id;
+    dctx->op_ctx.info.myself = ctx->ds;
+    if ((result=fs_init_slice_op_ctx(&dctx->op_ctx.update.sarray)) != 0) {
+        return result;
+    }
+
+    return fc_server_make_connection_ex(&REPLICA_GROUP_ADDRESS_ARRAY(
+                ctx->master->cs->server), &dctx->conn,
+            SF_G_CONNECT_TIMEOUT, NULL, true);
+}
+
+static void destroy_diff_context(DiffRecoveryContext *dctx)
+{
+    if (dctx->conn.sock >= 0) {
+        conn_pool_disconnect_server(&dctx->conn);
+    }
+    if (dctx->op_ctx.notify_func != NULL) {
+        fs_free_slice_op_ctx(&dctx->op_ctx.update.sarray);
+        destroy_pthread_lock_cond_pair(&dctx->notify.lcp);
+    }
+    if (dctx->buffer != NULL) {
+        shared_buffer_release(dctx->buffer);
+    }
+    if (dctx->data != NULL) {
+        free(dctx->data);
+    }
+    if (dctx->slices.entries != NULL) {
+        free(dctx->slices.entries);
+    }
+    if (dctx->actions.entries != NULL) {
+        free(dctx->actions.entries);
+    }
+    if (dctx->blocks.local != NULL) {
+        free(dctx->blocks.local);
+    }
+    if (dctx->blocks.master != NULL) {
+        free(dctx->blocks.master);
+    }
+    free(dctx);
+}
+
+int data_recovery_diff_blocks(DataRecoveryContext *ctx,
+        uint64_t *until_version)
+{
+    DiffRecoveryContext *dctx;
+    int64_t start_time;
+    int result;
+
+    *until_version = 0;
+    if (!checksum_tree_is_ready(ctx->ds->dg->id)) {
+        return 0;
+    }
+
+    dctx = (DiffRecoveryContext *)fc_malloc(sizeof(DiffRecoveryContext));
+    if (dctx == NULL) {
+        return ENOMEM;
+    }
+    memset(dctx, 0, sizeof(DiffRecoveryContext));
+    dctx->conn.sock = -1;
+
+    start_time = get_current_time_ms();
+    if ((result=init_diff_context(dctx, ctx)) == 0) {
+        result = do_diff_blocks(dctx, until_version);
+    }
+
+    if (result == 0) {
+        if (*until_version > 0) {
+            logInfo("file: "__FILE__", line: %d, "
+                    "data group id: %d, differential recovery done, "
+                    "different leaves: %d, transferred blocks: %"PRId64", "
+                    "removed blocks: %"PRId64", transferred bytes: %"PRId64
+                    ", until data version: %"PRId64", time used: %"PRId64
+                    " ms", __LINE__, ctx->ds->dg->id, dctx->stat.leaves,
+                    dctx->stat.transferred, dctx->stat.removed,
+                    dctx->stat.bytes, *until_version,
+                    get_current_time_ms() - start_time);
+        }
+    } else {
+        *until_version = 0;
+        logWarning("file: "__FILE__", line: %d, "
+                "data group id: %d, differential recovery fail, "
+                "errno: %d, error info: %s, fall back to the binlog "
+                "recovery", __LINE__, ctx->ds->dg->id,
+                result, STRERROR(result));
+    }
+
+    destroy_diff_context(dctx);
+    return result;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+//diff_recovery.h
+
+/* the differential data recovery by the block checksum trees.
+ *
+ * the slave compares its checksum tree with the master's top down, and
+ * replaces the different blocks with the existing slices of the master's.
+ * the transferred slices are logged to the replica binlog ordered by the
+ * master's data versions of the blocks, so the replica binlog of the slave
+ * stays usable for the peers. the records NOT after the until version
+ * are covered, so the binlog fetching continues from the until version.
+ */
+
+#ifndef _DIFF_RECOVERY_H_
+#define _DIFF_RECOVERY_H_
+
+#include "recovery_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* until_version is 0 when the differential recovery is NOT done,
+ * the caller should fall back to the binlog recovery */
+int data_recovery_diff_blocks(DataRecoveryContext *ctx,
+        uint64_t *until_version);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,425 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/sched_thread.h"
+#include "fastcommon/logger.h"
+#include "sf/sf_global.h"
+#include "../server_global.h"
+#include "recovery_governor.h"
+
+#define GOVERNOR_MIN_FACTOR          5  //the min percentage of the rate
+#define GOVERNOR_RESTORE_STEP       10  //restore the rate per second
+#define GOVERNOR_MAX_SLEEP_MS      100
+#define GOVERNOR_PROGRESS_INTERVAL  10  //log the progress in seconds
+
+/* the base rate of the backoff when no limit configured */
+#define GOVERNOR_MIN_BASE_BYTES   (1024 * 1024)
+#define GOVERNOR_MIN_BASE_OPS     64
+
+typedef struct {
+    volatile int64_t rate;  //per second, 0 for unlimited
+    double tokens;   //negative for the debt of the large record
+} RecoveryTokenBucket;
+
+typedef struct {
+    pthread_mutex_t lock;
+    int64_t last_refill_us;
+    struct {
+        RecoveryTokenBucket bytes;
+        RecoveryTokenBucket ops;
+    } buckets;
+    int waitings[RECOVERY_GOVERNOR_PRIORITY_LEVELS];
+
+    /* the percentage of the base rate, the base rate is the configured
+     * limit, or the observed rate when the backoff starts */
+    struct {
+        int factor;
+        int64_t bytes;
+        int64_t ops;
+    } backoff;
+
+    struct {
+        volatile int64_t bytes;
+        volatile int64_t ops;
+        int64_t last_bytes;
+        int64_t last_ops;
+    } acquired;
+
+    struct {
+        volatile int64_t time_used;  //in us
+        volatile int64_t count;
+    } latency;
+
+    DataRecoveryContext *head;  //the recoveries in progress
+    volatile int running_count;
+    int schedule_count;
+} RecoveryGovernorContext;
+
+static RecoveryGovernorContext governor_ctx;
+
+static inline void bucket_refill(RecoveryTokenBucket *bucket,
+        const int64_t elapsed_us)
+{
+    if (bucket->rate == 0) {
+        return;
+    }
+
+    bucket->tokens += (double)bucket->rate * elapsed_us / 1000000;
+    if (bucket->tokens > bucket->rate) {  //the burst of one second
+        bucket->tokens = bucket->rate;
+    }
+}
+
+static inline bool bucket_ready(RecoveryTokenBucket *bucket)
+{
+    return (bucket->rate == 0 || bucket->tokens > 0);
+}
+
+static inline int bucket_wait_ms(RecoveryTokenBucket *bucket)
+{
+    if (bucket_ready(bucket)) {
+        return 0;
+    }
+    return (int)(-1 * bucket->tokens * 1000 / bucket->rate) + 1;
+}
+
+static inline bool higher_priority_waiting(const int priority)
+{
+    int i;
+
+    for (i=0; i<priority; i++) {
+        if (governor_ctx.waitings[i] > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void recovery_governor_acquire(DataRecoveryContext *ctx,
+        const int bytes, const int ops)
+{
+    int64_t current_time_us;
+    int priority;
+    int sleep_ms;
+    bool waiting;
+
+    __sync_add_and_fetch(&governor_ctx.acquired.bytes, bytes);
+    __sync_add_and_fetch(&governor_ctx.acquired.ops, ops);
+    if (governor_ctx.buckets.bytes.rate == 0 &&
+            governor_ctx.buckets.ops.rate == 0)
+    {
+        return;
+    }
+
+    priority = ctx->priority;
+    waiting = false;
+    PTHREAD_MUTEX_LOCK(&governor_ctx.lock);
+    while (1) {
+        current_time_us = get_current_time_us();
+        bucket_refill(&governor_ctx.buckets.bytes, current_time_us -
+                governor_ctx.last_refill_us);
+        bucket_refill(&governor_ctx.buckets.ops, current_time_us -
+                governor_ctx.last_refill_us);
+        governor_ctx.last_refill_us = current_time_us;
+
+        if (bucket_ready(&governor_ctx.buckets.bytes) &&
+                bucket_ready(&governor_ctx.buckets.ops) &&
+                !higher_priority_waiting(priority))
+        {
+            if (governor_ctx.buckets.bytes.rate > 0) {
+                governor_ctx.buckets.bytes.tokens -= bytes;
+            }
+            if (governor_ctx.buckets.ops.rate > 0) {
+                governor_ctx.buckets.ops.tokens -= ops;
+            }
+            break;
+        }
+
+        if (!SF_G_CONTINUE_FLAG) {
+            break;
+        }
+
+        if (!waiting) {
+            governor_ctx.waitings[priority]++;
+            waiting = true;
+        }
+
+        sleep_ms = FC_MAX(bucket_wait_ms(&governor_ctx.buckets.bytes),
+                bucket_wait_ms(&governor_ctx.buckets.ops));
+        if (sleep_ms <= 0) {
+            sleep_ms = 1;
+        } else if (sleep_ms > GOVERNOR_MAX_SLEEP_MS) {
+            sleep_ms = GOVERNOR_MAX_SLEEP_MS;
+        }
+
+        PTHREAD_MUTEX_UNLOCK(&governor_ctx.lock);
+        fc_sleep_ms(sleep_ms);
+        PTHREAD_MUTEX_LOCK(&governor_ctx.lock);
+    }
+
+    if (waiting) {
+        governor_ctx.waitings[priority]--;
+    }
+    PTHREAD_MUTEX_UNLOCK(&governor_ctx.lock);
+}
+
+void recovery_governor_add_latency(const int64_t time_used_us)
+{
+    if (__sync_add_and_fetch(&governor_ctx.running_count, 0) == 0) {
+        return;
+    }
+
+    __sync_add_and_fetch(&governor_ctx.latency.time_used, time_used_us);
+    __sync_add_and_fetch(&governor_ctx.latency.count, 1);
+}
+
+static int get_recovery_priority(FSClusterDataGroupInfo *dg)
+{
+    FSClusterDataServerInfo *ds;
+    FSClusterDataServerInfo *end;
+    int count;
+
+    count = 0;
+    end = dg->data_server_array.servers + dg->data_server_array.count;
+    for (ds=dg->data_server_array.servers; ds<end; ds++) {
+        if (__sync_add_and_fetch(&ds->status, 0) ==
+                FS_SERVER_STATUS_ACTIVE)
+        {
+            count++;
+        }
+    }
+
+    return FC_MIN(count, RECOVERY_GOVERNOR_PRIORITY_LEVELS - 1);
+}
+
+void recovery_governor_register(DataRecoveryContext *ctx)
+{
+    ctx->priority = get_recovery_priority(ctx->ds->dg);
+    PTHREAD_MUTEX_LOCK(&governor_ctx.lock);
+    ctx->next = governor_ctx.head;
+    governor_ctx.head = ctx;
+    PTHREAD_MUTEX_UNLOCK(&governor_ctx.lock);
+    __sync_add_and_fetch(&governor_ctx.running_count, 1);
+}
+
+void recovery_governor_unregister(DataRecoveryContext *ctx)
+{
+    DataRecoveryContext **pp;
+
+    PTHREAD_MUTEX_LOCK(&governor_ctx.lock);
+    pp = &governor_ctx.head;
+    while (*pp != NULL) {
+        if (*pp == ctx) {
+            *pp = ctx->next;
+            __sync_sub_and_fetch(&governor_ctx.running_count, 1);
+            break;
+        }
+        pp = &(*pp)->next;
+    }
+    PTHREAD_MUTEX_UNLOCK(&governor_ctx.lock);
+}
+
+static void governor_set_rates()
+{
+    int64_t bytes;
+    int64_t ops;
+
+    if (governor_ctx.backoff.factor >= 100) {
+        bytes = RECOVERY_MAX_BANDWIDTH;
+        ops = RECOVERY_MAX_IOPS;
+    } else {
+        bytes = FC_MAX(governor_ctx.backoff.bytes *
+                governor_ctx.backoff.factor / 100, 1);
+        ops = FC_MAX(governor_ctx.backoff.ops *
+                governor_ctx.backoff.factor / 100, 1);
+    }
+
+    governor_ctx.buckets.bytes.rate = bytes;
+    governor_ctx.buckets.ops.rate = ops;
+}
+
+static void governor_adjust(const int64_t avg_latency,
+        const int64_t bytes_rate, const int64_t ops_rate)
+{
+    if (governor_ctx.head == NULL) {
+        governor_ctx.backoff.factor = 100;
+    } else if (RECOVERY_BACKOFF_LATENCY_MS > 0 && avg_latency >
+            RECOVERY_BACKOFF_LATENCY_MS * 1000LL)
+    {
+        if (governor_ctx.backoff.factor >= 100) {
+            governor_ctx.backoff.bytes = RECOVERY_MAX_BANDWIDTH > 0 ?
+                RECOVERY_MAX_BANDWIDTH : FC_MAX(bytes_rate,
+                        GOVERNOR_MIN_BASE_BYTES);
+            governor_ctx.backoff.ops = RECOVERY_MAX_IOPS > 0 ?
+                RECOVERY_MAX_IOPS : FC_MAX(ops_rate, GOVERNOR_MIN_BASE_OPS);
+            logWarning("file: "__FILE__", line: %d, "
+                    "foreground latency: %"PRId64" us > %d ms, "
+                    "throttle the data recovery, current rate: "
+                    "%"PRId64" KB/s, %"PRId64" ops/s", __LINE__,
+                    avg_latency, RECOVERY_BACKOFF_LATENCY_MS,
+                    bytes_rate / 1024, ops_rate);
+        }
+        governor_ctx.backoff.factor = FC_MAX(governor_ctx.
+                backoff.factor / 2, GOVERNOR_MIN_FACTOR);
+    } else if (governor_ctx.backoff.factor < 100) {
+        governor_ctx.backoff.factor = FC_MIN(governor_ctx.
+                backoff.factor + GOVERNOR_RESTORE_STEP, 100);
+        if (governor_ctx.backoff.factor == 100) {
+            logInfo("file: "__FILE__", line: %d, "
+                    "foreground latency: %"PRId64" us, "
+                    "stop throttling the data recovery",
+                    __LINE__, avg_latency);
+        }
+    }
+
+    governor_set_rates();
+}
+
+static void log_recovery_progress(DataRecoveryContext *ctx,
+        const int64_t current_time_ms)
+{
+    int64_t done;
+    int64_t speed;
+    char progress[64];
+    char eta[32];
+
+    done = __sync_add_and_fetch(&ctx->progress.done, 0);
+    if (ctx->progress.start_time == 0) {  //NOT in the replay stage
+        logInfo("file: "__FILE__", line: %d, "
+                "data group id: %d, data recovery stage: %c, "
+                "healthy replicas: %d", __LINE__, ctx->ds->dg->id,
+                ctx->stage, ctx->priority);
+        return;
+    }
+
+    if (current_time_ms > ctx->progress.start_time) {
+        speed = done * 1000 / (current_time_ms - ctx->progress.start_time);
+    } else {
+        speed = 0;
+    }
+
+    if (ctx->progress.total > 0) {
+        sprintf(progress, "%"PRId64" / %"PRId64" (%.1f%%)", done,
+                ctx->progress.total, done * 100.00 / ctx->progress.total);
+        if (speed > 0) {
+            sprintf(eta, "%"PRId64" s", (ctx->progress.total - done) / speed);
+        } else {
+            strcpy(eta, "unknown");
+        }
+    } else {
+        sprintf(progress, "%"PRId64, done);
+        strcpy(eta, "unknown");
+    }
+
+    logInfo("file: "__FILE__", line: %d, "
+            "data group id: %d, data recovery stage: %c, "
+            "healthy replicas: %d, replayed records: %s, "
+            "speed: %"PRId64" records/s, ETA: %s", __LINE__,
+            ctx->ds->dg->id, ctx->stage, ctx->priority,
+            progress, speed, eta);
+}
+
+static int governor_schedule_func(void *args)
+{
+    DataRecoveryContext *ctx;
+    int64_t time_used;
+    int64_t count;
+    int64_t avg_latency;
+    int64_t bytes;
+    int64_t ops;
+    int64_t bytes_rate;
+    int64_t ops_rate;
+    int64_t current_time_ms;
+    bool log_progress;
+
+    time_used = __sync_lock_test_and_set(&governor_ctx.latency.time_used, 0);
+    count = __sync_lock_test_and_set(&governor_ctx.latency.count, 0);
+    avg_latency = (count > 0) ? time_used / count : 0;
+
+    bytes = __sync_add_and_fetch(&governor_ctx.acquired.bytes, 0);
+    ops = __sync_add_and_fetch(&governor_ctx.acquired.ops, 0);
+    bytes_rate = bytes - governor_ctx.acquired.last_bytes;
+    ops_rate = ops - governor_ctx.acquired.last_ops;
+    governor_ctx.acquired.last_bytes = bytes;
+    governor_ctx.acquired.last_ops = ops;
+
+    log_progress = (++governor_ctx.schedule_count %
+            GOVERNOR_PROGRESS_INTERVAL == 0);
+    current_time_ms = get_current_time_ms();
+
+    PTHREAD_MUTEX_LOCK(&governor_ctx.lock);
+    for (ctx=governor_ctx.head; ctx!=NULL; ctx=ctx->next) {
+        ctx->priority = get_recovery_priority(ctx->ds->dg);
+        if (log_progress) {
+            log_recovery_progress(ctx, current_time_ms);
+        }
+    }
+
+    governor_adjust(avg_latency, bytes_rate, ops_rate);
+    if (log_progress && governor_ctx.head != NULL) {
+        logInfo("file: "__FILE__", line: %d, "
+                "data recovery running count: %d, rate limit: "
+                "%"PRId64" KB/s, %"PRId64" ops/s (0 for unlimited), "
+                "backoff factor: %d%%, foreground latency: %"PRId64" us",
+                __LINE__, governor_ctx.running_count,
+                governor_ctx.buckets.bytes.rate / 1024,
+                governor_ctx.buckets.ops.rate,
+                governor_ctx.backoff.factor, avg_latency);
+    }
+    PTHREAD_MUTEX_UNLOCK(&governor_ctx.lock);
+
+    return 0;
+}
+
+static int setup_governor_schedule()
+{
+    ScheduleArray scheduleArray;
+    ScheduleEntry scheduleEntry;
+
+    INIT_SCHEDULE_ENTRY(scheduleEntry, sched_generate_next_id(),
+           TIME_NONE, TIME_NONE, TIME_NONE, 1,
+            governor_schedule_func, NULL);
+    scheduleArray.entries = &scheduleEntry;
+    scheduleArray.count = 1;
+    return sched_add_entries(&scheduleArray);
+}
+
+int recovery_governor_init()
+{
+    int result;
+
+    memset(&governor_ctx, 0, sizeof(governor_ctx));
+    if ((result=init_pthread_lock(&governor_ctx.lock)) != 0) {
+        return result;
+    }
+
+    governor_ctx.backoff.factor = 100;
+    governor_ctx.last_refill_us = get_current_time_us();
+    governor_set_rates();
+    return setup_governor_schedule();
+}
+
+void recovery_governor_destroy()
+{
+    pthread_mutex_destroy(&governor_ctx.lock);
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//recovery_governor.h
+
+/* the node-wide governor of the data recovery.
+ *
+ * the replayed records of all data groups take the tokens of two buckets,
+ * one for the bytes and another for the operations. the data groups with
+ * fewer healthy replicas take the tokens first. the rate is halved when
+ * the latency of the foreground requests exceeds the threshold, and
+ * restored step by step when the latency falls.
+ */
+
+#ifndef _RECOVERY_GOVERNOR_H_
+#define _RECOVERY_GOVERNOR_H_
+
+#include "recovery_types.h"
+
+#define RECOVERY_GOVERNOR_PRIORITY_LEVELS  8
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int recovery_governor_init();
+void recovery_governor_destroy();
+
+void recovery_governor_register(DataRecoveryContext *ctx);
+void recovery_governor_unregister(DataRecoveryContext *ctx);
+
+/* wait for the tokens of a record to replay */
+void recovery_governor_acquire(DataRecoveryContext *ctx,
+        const int bytes, const int ops);
+
+/* the time used of a foreground data request */
+void recovery_governor_add_latency(const int64_t time_used_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
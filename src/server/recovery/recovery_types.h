@@ -41,6 +41,16 @@ typedef struct data_recovery_context {
     } fetch;
     FSServerContext *server_ctx;
     FSClusterDataServerInfo *master;
+
+    /* for the recovery governor */
+    struct {
+        int64_t total;   //the records to replay, 0 for unknown
+        volatile int64_t done;
+        int64_t start_time;  //the replay start time in ms
+    } progress;
+    int priority;  //the healthy replicas of the data group, less is urgent
+    struct data_recovery_context *next;  //for the governor
+
     void *arg;
 } DataRecoveryContext;
 
@@ -39,6 +39,7 @@
 #include "sf/sf_service.h"
 #include "sf/sf_global.h"
 #include "common/fs_proto.h"
+#include "common/fs_func.h"
 #include "server_global.h"
 #include "server_func.h"
 #include "server_binlog.h"
@@ -237,6 +238,7 @@ static int fetch_binlog_output(struct fast_task_info *task, char *buff,
     int result;
     int size;
     int read_bytes;
+    int length;
     FSProtoReplicaFetchBinlogRespBodyHeader *bheader;
 
     bheader = (FSProtoReplicaFetchBinlogRespBodyHeader *)REQUEST.body;
@@ -254,8 +256,17 @@ static int fetch_binlog_output(struct fast_task_info *task, char *buff,
         bheader->is_last = binlog_reader_is_last_file(REPLICA_READER);
     }
 
+    length = read_bytes;
+    if (TASK_CTX.shared.replica.compress_binlog && replication_compress(
+                &SERVER_CTX->replica.compress_buffer, NULL, buff, &length))
+    {
+        bheader->compression = FS_REPLICA_COMPRESSION_LZ4;
+    } else {
+        bheader->compression = FS_REPLICA_COMPRESSION_NONE;
+    }
+
     RESPONSE.header.cmd = resp_cmd;
-    RESPONSE.header.body_len = body_header_size + read_bytes;
+    RESPONSE.header.body_len = body_header_size + length;
     TASK_ARG->context.response_done = true;
     return 0;
 }
@@ -371,6 +382,9 @@ static int replica_deal_fetch_binlog_first(struct fast_task_info *task)
     if ((result=replica_alloc_reader(task)) != 0) {
         return result;
     }
+    TASK_CTX.shared.replica.compress_binlog = (rheader->compression ==
+            FS_REPLICA_COMPRESSION_LZ4 && REPLICA_COMPRESSION ==
+            FS_REPLICA_COMPRESSION_LZ4);
 
     if ((result=replica_binlog_reader_init(REPLICA_READER,
                     data_group_id, last_data_version)) != 0)
@@ -480,14 +494,25 @@ static int replica_deal_join_server_req(struct fast_task_info *task)
     int server_id;
     int buffer_size;
     int replica_channels_between_two_servers;
+    int compression;
+    bool has_ext;
     FSProtoJoinServerReq *req;
+    FSProtoJoinServerReqExt *ext;
+    FSProtoJoinServerResp *resp;
     FSClusterServerInfo *peer;
     FSReplication *replication;
 
-    if ((result=server_expect_body_length(task,
+    /* the join request of the older servers has no extension */
+    if (REQUEST.header.body_len == sizeof(FSProtoJoinServerReq) +
+            sizeof(FSProtoJoinServerReqExt))
+    {
+        has_ext = true;
+    } else if ((result=server_expect_body_length(task,
                     sizeof(FSProtoJoinServerReq))) != 0)
     {
         return result;
+    } else {
+        has_ext = false;
     }
 
     req = (FSProtoJoinServerReq *)REQUEST.body;
@@ -535,8 +560,30 @@ static int replica_deal_join_server_req(struct fast_task_info *task)
         return ENOENT;
     }
 
+    if (has_ext) {
+        ext = (FSProtoJoinServerReqExt *)(req + 1);
+        compression = ext->compression;
+    } else {
+        compression = FS_REPLICA_COMPRESSION_NONE;
+    }
+    replication->compress.enabled = (compression ==
+            FS_REPLICA_COMPRESSION_LZ4 && REPLICA_COMPRESSION ==
+            FS_REPLICA_COMPRESSION_LZ4);
+    replication->compress.skip_count = 0;
     replication_processor_bind_task(replication, task);
+
+    /* the older servers expect the empty join response */
+    if (has_ext) {
+        resp = (FSProtoJoinServerResp *)REQUEST.body;
+        resp->compression = (replication->compress.enabled ?
+                FS_REPLICA_COMPRESSION_LZ4 : FS_REPLICA_COMPRESSION_NONE);
+        memset(resp->padding, 0, sizeof(resp->padding));
+        RESPONSE.header.body_len = sizeof(FSProtoJoinServerResp);
+    } else {
+        RESPONSE.header.body_len = 0;
+    }
     RESPONSE.header.cmd = FS_REPLICA_PROTO_JOIN_SERVER_RESP;
+    TASK_ARG->context.response_done = true;
 
     logInfo("file: "__FILE__", line: %d, "
             "replication peer id: %d, %s:%u join in",
@@ -548,6 +595,9 @@ static int replica_deal_join_server_req(struct fast_task_info *task)
 
 static int replica_deal_join_server_resp(struct fast_task_info *task)
 {
+    FSProtoJoinServerResp *resp;
+    int result;
+
     if (!(SERVER_TASK_TYPE == FS_SERVER_TASK_TYPE_REPLICATION &&
                 REPLICA_REPLICATION != NULL))
     {
@@ -556,6 +606,21 @@ static int replica_deal_join_server_resp(struct fast_task_info *task)
         return EINVAL;
     }
 
+    /* the older servers respond with the empty body,
+     * the compression is off for them */
+    if (REQUEST.header.body_len == 0) {
+        REPLICA_REPLICATION->compress.enabled = false;
+    } else if ((result=server_expect_body_length(task,
+                    sizeof(FSProtoJoinServerResp))) != 0)
+    {
+        return result;
+    } else {
+        resp = (FSProtoJoinServerResp *)REQUEST.body;
+        REPLICA_REPLICATION->compress.enabled = (resp->compression ==
+                FS_REPLICA_COMPRESSION_LZ4 && REPLICA_COMPRESSION ==
+                FS_REPLICA_COMPRESSION_LZ4);
+    }
+
     set_replication_stage(REPLICA_REPLICATION, FS_REPLICATION_STAGE_SYNCING);
     return 0;
 }
@@ -593,8 +658,50 @@ static inline int replica_deal_active_test_req(struct fast_task_info *task)
     return sf_proto_deal_active_test(task, &REQUEST, &RESPONSE);
 }
 
+static int forward_to_chain(struct fast_task_info *task,
+        FSProtoReplicaRPCReqBodyPart *body_part, const int blen,
+        FSSliceOpContext *op_ctx)
+{
+    FSProtoBlockKey *bkey;
+    FSBlockKey block;
+    int chain_server_ids[FS_MAX_GROUP_SERVERS];
+    char *p;
+    int i;
+
+    /* the body of all replica commands starts with the block key */
+    if (blen < (int)sizeof(FSProtoBlockKey)) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "rpc body length: %d < %d", blen,
+                (int)sizeof(FSProtoBlockKey));
+        return EINVAL;
+    }
+    if (body_part->chain_count > FS_MAX_GROUP_SERVERS) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "chain count: %d > %d", body_part->chain_count,
+                FS_MAX_GROUP_SERVERS);
+        return EINVAL;
+    }
+
+    bkey = (FSProtoBlockKey *)body_part->body;
+    block.oid = buff2long(bkey->oid);
+    block.offset = buff2long(bkey->offset);
+    fs_calc_block_hashcode(&block);
+
+    p = body_part->body + blen;
+    for (i=0; i<body_part->chain_count; i++) {
+        chain_server_ids[i] = buff2int(p);
+        p += 4;
+    }
+
+    op_ctx->info.chain_waiter = replication_caller_chain_forward(
+            REPLICA_REPLICATION, FS_DATA_GROUP_ID(block),
+            op_ctx->info.data_version, body_part->cmd, body_part->body,
+            blen, chain_server_ids, body_part->chain_count);
+    return (op_ctx->info.chain_waiter != NULL ? 0 : ENOMEM);
+}
+
 static int handle_rpc_req(struct fast_task_info *task, SharedBuffer *buffer,
-        const int count)
+        const int body_len, const int count)
 {
     FSProtoReplicaRPCReqBodyPart *body_part;
     FSSliceOpBufferContext *op_buffer_ctx;
@@ -617,19 +724,20 @@ static int handle_rpc_req(struct fast_task_info *task, SharedBuffer *buffer,
                     "rpc body length: %d <= 0", blen);
             return EINVAL;
         }
-        current_len += sizeof(*body_part) + blen;
+        current_len += sizeof(*body_part) + blen +
+            4 * body_part->chain_count;
         if (i < last_index) {
-            if (REQUEST.header.body_len < current_len) {
+            if (body_len < current_len) {
                 RESPONSE.error.length = sprintf(RESPONSE.error.message,
                         "body length: %d < %d, rpc count: %d, current: %d",
-                        REQUEST.header.body_len, current_len, count, i + 1);
+                        body_len, current_len, count, i + 1);
                 return EINVAL;
             }
         } else {
-            if (REQUEST.header.body_len != current_len) {
+            if (body_len != current_len) {
                 RESPONSE.error.length = sprintf(RESPONSE.error.message,
                         "body length: %d != %d, rpc count: %d",
-                        REQUEST.header.body_len, current_len, count);
+                        body_len, current_len, count);
                 return EINVAL;
             }
         }
@@ -656,6 +764,19 @@ static int handle_rpc_req(struct fast_task_info *task, SharedBuffer *buffer,
             return EINVAL;
         }
 
+        /* prepare the chain forward before the local update which may
+         * be done by the data thread at once, the RPC is sent to the
+         * next server after the local update succeeded */
+        if (body_part->chain_count > 0) {
+            if ((result=forward_to_chain(task, body_part,
+                            blen, op_ctx)) != 0)
+            {
+                return result;
+            }
+        } else {
+            op_ctx->info.chain_waiter = NULL;
+        }
+
         op_ctx->info.body = (char *)(body_part + 1);
         op_ctx->info.body_len = blen;
         switch (body_part->cmd) {
@@ -674,12 +795,23 @@ static int handle_rpc_req(struct fast_task_info *task, SharedBuffer *buffer,
             default:
                 RESPONSE.error.length = sprintf(RESPONSE.error.message,
                         "unkown cmd: %d", body_part->cmd);
+                if (op_ctx->info.chain_waiter != NULL) {
+                    replication_caller_chain_local_done(op_ctx->
+                            info.chain_waiter, EINVAL);
+                }
                 return EINVAL;
         }
 
         if (result != TASK_STATUS_CONTINUE) {
             int r;
 
+            if (op_ctx->info.chain_waiter != NULL) {
+                /* the result is pushed when the downstream done */
+                replication_caller_chain_local_done(op_ctx->
+                        info.chain_waiter, result);
+                continue;
+            }
+
             r = replication_callee_push_to_rpc_result_queue(
                     REPLICA_REPLICATION, op_ctx->info.data_group_id,
                     op_ctx->info.data_version, result);
@@ -698,20 +830,26 @@ static int replica_deal_rpc_req(struct fast_task_info *task)
     SharedBuffer *buffer;
     int result;
     int min_body_len;
+    int body_len;
+    int raw_length;
     int count;
 
     if ((result=replica_check_replication_task(task)) != 0) {
         return result;
     }
 
+    body_header = (FSProtoReplicaRPCReqBodyHeader *)REQUEST.body;
+    /* the raw length is the padding of the older servers */
+    raw_length = (REPLICA_REPLICATION->compress.enabled ?
+            buff2int(body_header->raw_length) : 0);
     if ((result=server_check_min_body_length(task,
                     sizeof(FSProtoReplicaRPCReqBodyHeader) +
-                    sizeof(FSProtoReplicaRPCReqBodyPart))) != 0)
+                    (raw_length > 0 ? 1 : sizeof(
+                        FSProtoReplicaRPCReqBodyPart)))) != 0)
     {
         return result;
     }
 
-    body_header = (FSProtoReplicaRPCReqBodyHeader *)REQUEST.body;
     count = buff2int(body_header->count);
     if (count <= 0) {
         RESPONSE.error.length = sprintf(RESPONSE.error.message,
@@ -719,12 +857,17 @@ static int replica_deal_rpc_req(struct fast_task_info *task)
         return EINVAL;
     }
 
+    if (raw_length > 0) {
+        body_len = sizeof(FSProtoReplicaRPCReqBodyHeader) + raw_length;
+    } else {
+        body_len = REQUEST.header.body_len;
+    }
     min_body_len = sizeof(FSProtoReplicaRPCReqBodyHeader) +
         sizeof(FSProtoReplicaRPCReqBodyPart) * count;
-    if (REQUEST.header.body_len < min_body_len) {
+    if (body_len < min_body_len) {
         RESPONSE.error.length = sprintf(RESPONSE.error.message,
                 "body length: %d < min length: %d, rpc count: %d",
-                REQUEST.header.body_len, min_body_len, count);
+                body_len, min_body_len, count);
         return EINVAL;
     }
 
@@ -732,8 +875,28 @@ static int replica_deal_rpc_req(struct fast_task_info *task)
         return ENOMEM;
     }
 
-    memcpy(buffer->buff, REQUEST.body, task->length - sizeof(FSProtoHeader));
-    result = handle_rpc_req(task, buffer, count);
+    if (raw_length > 0) {
+        memcpy(buffer->buff, REQUEST.body,
+                sizeof(FSProtoReplicaRPCReqBodyHeader));
+        if ((result=replication_decompress(REQUEST.body + sizeof(
+                            FSProtoReplicaRPCReqBodyHeader),
+                        REQUEST.header.body_len - sizeof(
+                            FSProtoReplicaRPCReqBodyHeader),
+                        buffer->buff + sizeof(FSProtoReplicaRPCReqBodyHeader),
+                        buffer->capacity - sizeof(
+                            FSProtoReplicaRPCReqBodyHeader),
+                        raw_length)) != 0)
+        {
+            RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                    "decompress the rpc package fail, raw length: %d",
+                    raw_length);
+            shared_buffer_release(buffer);
+            return result;
+        }
+    } else {
+        memcpy(buffer->buff, REQUEST.body, REQUEST.header.body_len);
+    }
+    result = handle_rpc_req(task, buffer, body_len, count);
     shared_buffer_release(buffer);
 
     return result;
@@ -879,6 +1042,457 @@ static int replica_deal_slice_read(struct fast_task_info *task)
     return TASK_STATUS_CONTINUE;
 }
 
+static void bulk_read_continue(struct fast_task_info *task);
+
+static void bulk_read_set_part(struct fast_task_info *task,
+        const int err_no, const int read_bytes)
+{
+    FSProtoReplicaSliceBulkReadRespPart *part;
+
+    part = (FSProtoReplicaSliceBulkReadRespPart *)(REQUEST.body +
+            REPLICA_BULK_READ.offset);
+    int2buff(read_bytes, part->read_bytes);
+    short2buff(err_no, part->err_no);
+    part->padding[0] = part->padding[1] = 0;
+    REPLICA_BULK_READ.offset += sizeof(*part) + read_bytes;
+    REPLICA_BULK_READ.index++;
+}
+
+static void bulk_slice_read_done_callback(FSSliceOpContext *op_ctx,
+        struct fast_task_info *task)
+{
+    if (op_ctx->result == 0) {
+        bulk_read_set_part(task, 0, op_ctx->done_bytes);
+    } else {
+        if (op_ctx->result != ENOENT) {
+            logError("file: "__FILE__", line: %d, "
+                    "client ip: %s, bulk read slice fail, "
+                    "oid: %"PRId64", block offset: %"PRId64", "
+                    "slice offset: %d, length: %d, "
+                    "errno: %d, error info: %s",
+                    __LINE__, task->client_ip,
+                    OP_CTX_INFO.bs_key.block.oid,
+                    OP_CTX_INFO.bs_key.block.offset,
+                    OP_CTX_INFO.bs_key.slice.offset,
+                    OP_CTX_INFO.bs_key.slice.length,
+                    op_ctx->result, STRERROR(op_ctx->result));
+        }
+        bulk_read_set_part(task, op_ctx->result, 0);
+    }
+
+    bulk_read_continue(task);
+}
+
+static void bulk_slice_read_done_notify(FSDataOperation *op)
+{
+    bulk_slice_read_done_callback(op->ctx, op->arg);
+}
+
+static int bulk_read_start_slice(struct fast_task_info *task)
+{
+    int result;
+
+    if ((result=du_handler_parse_check_readable_block_slice(task,
+                    REPLICA_BULK_READ.slices + REPLICA_BULK_READ.index)) != 0)
+    {
+        return result;
+    }
+
+    OP_CTX_INFO.source = BINLOG_SOURCE_RPC;
+    OP_CTX_INFO.buff = REQUEST.body + REPLICA_BULK_READ.offset +
+        sizeof(FSProtoReplicaSliceBulkReadRespPart);
+    /* the same rule as replica_deal_slice_read */
+    if (REPLICA_BULK_READ.by_slave && __sync_add_and_fetch(
+                &OP_CTX_INFO.myself->is_master, 0))
+    {
+        SLICE_OP_CTX.rw_done_callback = (fs_rw_done_callback_func)
+            bulk_slice_read_done_callback;
+        SLICE_OP_CTX.arg = task;
+        return fs_slice_read(&SLICE_OP_CTX);
+    } else {
+        OP_CTX_NOTIFY_FUNC = bulk_slice_read_done_notify;
+        return push_to_data_thread_queue(DATA_OPERATION_SLICE_READ,
+                DATA_SOURCE_MASTER_SERVICE, task, &SLICE_OP_CTX);
+    }
+}
+
+/* read the slices one by one, the response is sent
+ * when all slices are done */
+static void bulk_read_continue(struct fast_task_info *task)
+{
+    int result;
+
+    while (REPLICA_BULK_READ.index < REPLICA_BULK_READ.count) {
+        if ((result=bulk_read_start_slice(task)) == 0) {
+            return;  //the callback continue the next slice
+        }
+        bulk_read_set_part(task, result, 0);
+    }
+
+    free(REPLICA_BULK_READ.slices);
+    REPLICA_BULK_READ.slices = NULL;
+    RESPONSE.error.length = 0;  //the errors are in the parts
+    RESPONSE.header.body_len = REPLICA_BULK_READ.offset;
+    TASK_ARG->context.response_done = true;
+    RESPONSE_STATUS = 0;
+    sf_nio_notify(task, SF_NIO_STAGE_CONTINUE);
+    sf_release_task(task);
+}
+
+static int replica_deal_slice_bulk_read(struct fast_task_info *task)
+{
+    int result;
+    int count;
+    int bytes;
+    int length;
+    int64_t total_bytes;
+    FSProtoReplicaSliceBulkReadReqHeader *req_header;
+    FSProtoBlockSlice *bs;
+    FSProtoBlockSlice *end;
+
+    RESPONSE.header.cmd = FS_REPLICA_PROTO_SLICE_BULK_READ_RESP;
+    if ((result=server_check_min_body_length(task,
+                    sizeof(FSProtoReplicaSliceBulkReadReqHeader))) != 0)
+    {
+        return result;
+    }
+
+    req_header = (FSProtoReplicaSliceBulkReadReqHeader *)REQUEST.body;
+    count = buff2int(req_header->count);
+    if (count <= 0 || count > FS_REPLICA_BULK_READ_MAX_SLICES) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "invalid slice count: %d", count);
+        return EINVAL;
+    }
+
+    bytes = sizeof(FSProtoBlockSlice) * count;
+    if (REQUEST.header.body_len != sizeof(
+                FSProtoReplicaSliceBulkReadReqHeader) + bytes)
+    {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "body length: %d != expected: %d, slice count: %d",
+                REQUEST.header.body_len, (int)(sizeof(
+                        FSProtoReplicaSliceBulkReadReqHeader) + bytes),
+                count);
+        return EINVAL;
+    }
+
+    total_bytes = 0;
+    bs = (FSProtoBlockSlice *)(req_header + 1);
+    end = bs + count;
+    for (; bs<end; bs++) {
+        length = buff2int(bs->slice_size.length);
+        if (length <= 0) {
+            RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                    "invalid slice length: %d", length);
+            return EINVAL;
+        }
+        total_bytes += sizeof(FSProtoReplicaSliceBulkReadRespPart) + length;
+    }
+    if (total_bytes > task->size - sizeof(FSProtoHeader)) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "bulk read bytes: %"PRId64" > task buffer size: %d",
+                total_bytes, (int)(task->size - sizeof(FSProtoHeader)));
+        return EOVERFLOW;
+    }
+
+    if ((REPLICA_BULK_READ.slices=(FSProtoBlockSlice *)fc_malloc(
+                    bytes)) == NULL)
+    {
+        return ENOMEM;
+    }
+    memcpy(REPLICA_BULK_READ.slices, req_header + 1, bytes);
+    REPLICA_BULK_READ.count = count;
+    REPLICA_BULK_READ.index = 0;
+    REPLICA_BULK_READ.offset = 0;
+    REPLICA_BULK_READ.by_slave = (buff2int(req_header->slave_id) != 0);
+
+    sf_hold_task(task);
+    bulk_read_continue(task);
+    return TASK_STATUS_CONTINUE;
+}
+
+static int checksum_tree_get_written_version(const int data_group_id,
+        uint64_t *data_version)
+{
+    char subdir_name[FS_BINLOG_SUBDIR_NAME_SIZE];
+    char filename[PATH_MAX];
+
+    replica_binlog_get_subdir_name(subdir_name, data_group_id);
+    sf_binlog_writer_get_filename(subdir_name,
+            replica_binlog_get_current_write_index(data_group_id),
+            filename, sizeof(filename));
+    return replica_binlog_get_last_data_version(filename, data_version);
+}
+
+static int replica_deal_checksum_nodes(struct fast_task_info *task)
+{
+    FSProtoReplicaChecksumNodesReqHeader *req_header;
+    FSProtoReplicaChecksumNodesRespHeader *resp_header;
+    FSClusterDataServerInfo *myself;
+    char *p;
+    char *end;
+    int indexes[FS_REPLICA_CHECKSUM_MAX_NODES];
+    uint64_t values[FS_REPLICA_CHECKSUM_MAX_NODES];
+    uint64_t data_version;
+    int data_group_id;
+    int level;
+    int count;
+    int i;
+    int result;
+
+    RESPONSE.header.cmd = FS_REPLICA_PROTO_CHECKSUM_NODES_RESP;
+    if ((result=server_check_min_body_length(task,
+                    sizeof(FSProtoReplicaChecksumNodesReqHeader))) != 0)
+    {
+        return result;
+    }
+
+    req_header = (FSProtoReplicaChecksumNodesReqHeader *)REQUEST.body;
+    data_group_id = buff2int(req_header->data_group_id);
+    count = buff2int(req_header->count);
+    level = req_header->level;
+    if (count <= 0 || count > FS_REPLICA_CHECKSUM_MAX_NODES) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "invalid node count: %d", count);
+        return EINVAL;
+    }
+    if (REQUEST.header.body_len != sizeof(
+                FSProtoReplicaChecksumNodesReqHeader) + 4 * count)
+    {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "body length: %d != expected: %d, node count: %d",
+                REQUEST.header.body_len, (int)(sizeof(
+                        FSProtoReplicaChecksumNodesReqHeader) +
+                    4 * count), count);
+        return EINVAL;
+    }
+
+    if ((result=check_myself_master(task, data_group_id, &myself)) != 0) {
+        return result;
+    }
+
+    p = (char *)(req_header + 1);
+    for (i=0; i<count; i++, p+=4) {
+        indexes[i] = buff2int(p);
+    }
+
+    /* the records NOT after the written version are in the tree,
+     * the slave fetches the binlog after this version */
+    data_version = 0;
+    if (level == 0 && (result=checksum_tree_get_written_version(
+                    data_group_id, &data_version)) != 0)
+    {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "data group id: %d, get the written data version "
+                "fail, error info: %s", data_group_id, STRERROR(result));
+        return result;
+    }
+
+    if ((result=checksum_tree_get_nodes(data_group_id, level,
+                    indexes, count, values)) != 0)
+    {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "data group id: %d, level: %d, get checksum nodes fail, "
+                "error info: %s", data_group_id, level, STRERROR(result));
+        return result;
+    }
+
+    resp_header = (FSProtoReplicaChecksumNodesRespHeader *)REQUEST.body;
+    long2buff(data_version, resp_header->data_version);
+    resp_header->ready = checksum_tree_is_ready(data_group_id);
+    memset(resp_header->padding, 0, sizeof(resp_header->padding));
+    p = (char *)(resp_header + 1);
+    end = p + 8 * count;
+    for (i=0; p<end; i++, p+=8) {
+        long2buff(values[i], p);
+    }
+
+    RESPONSE.header.body_len = p - REQUEST.body;
+    TASK_ARG->context.response_done = true;
+    return 0;
+}
+
+static int replica_deal_checksum_blocks(struct fast_task_info *task)
+{
+    FSProtoReplicaChecksumBlocksReq *req;
+    FSProtoReplicaChecksumBlocksRespHeader *resp_header;
+    FSProtoReplicaChecksumBlock *pb;
+    FSClusterDataServerInfo *myself;
+    ChecksumTreeBlockInfo *blocks;
+    ChecksumTreeBlockInfo *block;
+    ChecksumTreeBlockInfo *end;
+    int data_group_id;
+    int leaf_index;
+    int size;
+    int count;
+    int result;
+
+    RESPONSE.header.cmd = FS_REPLICA_PROTO_CHECKSUM_BLOCKS_RESP;
+    if ((result=server_expect_body_length(task,
+                    sizeof(FSProtoReplicaChecksumBlocksReq))) != 0)
+    {
+        return result;
+    }
+
+    req = (FSProtoReplicaChecksumBlocksReq *)REQUEST.body;
+    data_group_id = buff2int(req->data_group_id);
+    leaf_index = buff2int(req->leaf_index);
+    if ((result=check_myself_master(task, data_group_id, &myself)) != 0) {
+        return result;
+    }
+
+    size = (task->size - sizeof(FSProtoHeader) - sizeof(
+                FSProtoReplicaChecksumBlocksRespHeader)) /
+        sizeof(FSProtoReplicaChecksumBlock);
+    if ((blocks=(ChecksumTreeBlockInfo *)fc_malloc(sizeof(
+                        ChecksumTreeBlockInfo) * size)) == NULL)
+    {
+        return ENOMEM;
+    }
+
+    if ((result=checksum_tree_get_leaf_blocks(data_group_id,
+                    leaf_index, blocks, size, &count)) != 0)
+    {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "data group id: %d, leaf index: %d, get checksum blocks "
+                "fail, error info: %s", data_group_id, leaf_index,
+                STRERROR(result));
+        free(blocks);
+        return result;
+    }
+
+    resp_header = (FSProtoReplicaChecksumBlocksRespHeader *)REQUEST.body;
+    int2buff(count, resp_header->count);
+    memset(resp_header->padding, 0, sizeof(resp_header->padding));
+    pb = (FSProtoReplicaChecksumBlock *)(resp_header + 1);
+    end = blocks + count;
+    for (block=blocks; block<end; block++, pb++) {
+        long2buff(block->bkey.oid, pb->bkey.oid);
+        long2buff(block->bkey.offset, pb->bkey.offset);
+        long2buff(block->data_version, pb->data_version);
+    }
+    free(blocks);
+
+    RESPONSE.header.body_len = (char *)pb - REQUEST.body;
+    TASK_ARG->context.response_done = true;
+    return 0;
+}
+
+static inline void pack_block_slice(FSProtoReplicaBlockSlice *ps,
+        const char type, const FSSliceSize *ssize)
+{
+    ps->type = type;
+    memset(ps->padding, 0, sizeof(ps->padding));
+    int2buff(ssize->offset, ps->offset);
+    int2buff(ssize->length, ps->length);
+}
+
+/* the slices of the block, the adjacent slices of the same type
+ * are merged for the slave to transfer the existing slices only */
+static int replica_deal_block_slices(struct fast_task_info *task)
+{
+    FSProtoReplicaBlockSlicesReq *req;
+    FSProtoReplicaBlockSlicesRespHeader *resp_header;
+    FSProtoReplicaBlockSlice *ps;
+    FSProtoReplicaBlockSlice *send;
+    FSClusterDataServerInfo *myself;
+    FSBlockSliceKeyInfo bs_key;
+    OBSlicePtrArray sarray;
+    OBSliceEntry **pp;
+    OBSliceEntry **end;
+    FSSliceSize last;
+    char last_type;
+    char type;
+    int data_group_id;
+    int result;
+
+    RESPONSE.header.cmd = FS_REPLICA_PROTO_BLOCK_SLICES_RESP;
+    if ((result=server_expect_body_length(task,
+                    sizeof(FSProtoReplicaBlockSlicesReq))) != 0)
+    {
+        return result;
+    }
+
+    req = (FSProtoReplicaBlockSlicesReq *)REQUEST.body;
+    data_group_id = buff2int(req->data_group_id);
+    if ((result=check_myself_master(task, data_group_id, &myself)) != 0) {
+        return result;
+    }
+
+    bs_key.block.oid = buff2long(req->bkey.oid);
+    bs_key.block.offset = buff2long(req->bkey.offset);
+    fs_calc_block_hashcode(&bs_key.block);
+    bs_key.slice.offset = 0;
+    bs_key.slice.length = FS_FILE_BLOCK_SIZE;
+
+    ob_index_init_slice_ptr_array(&sarray);
+    if ((result=ob_index_get_slices(&bs_key, &sarray, false)) != 0) {
+        if (result != ENOENT) {
+            RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                    "data group id: %d, get the slices of the block fail, "
+                    "error info: %s", data_group_id, STRERROR(result));
+            ob_index_free_slice_ptr_array(&sarray);
+            return result;
+        }
+        result = 0;
+    }
+
+    resp_header = (FSProtoReplicaBlockSlicesRespHeader *)REQUEST.body;
+    ps = (FSProtoReplicaBlockSlice *)(resp_header + 1);
+    send = ps + (task->size - sizeof(FSProtoHeader) - sizeof(
+                FSProtoReplicaBlockSlicesRespHeader)) /
+        sizeof(FSProtoReplicaBlockSlice);
+    last_type = 0;
+    last.offset = last.length = 0;
+    end = sarray.slices + sarray.count;
+    for (pp=sarray.slices; pp<end; pp++) {
+        type = ((*pp)->type == OB_SLICE_TYPE_FILE ?
+                FS_REPLICA_SLICE_TYPE_FILE : FS_REPLICA_SLICE_TYPE_ALLOC);
+        if (result == 0) {
+            if (type == last_type && last.offset + last.length ==
+                    (*pp)->ssize.offset)
+            {
+                last.length += (*pp)->ssize.length;
+            } else {
+                if (last_type != 0) {
+                    if (ps == send) {
+                        result = EOVERFLOW;
+                    } else {
+                        pack_block_slice(ps++, last_type, &last);
+                    }
+                }
+                last_type = type;
+                last = (*pp)->ssize;
+            }
+        }
+        ob_index_free_slice(*pp);
+    }
+    ob_index_free_slice_ptr_array(&sarray);
+
+    if (result == 0 && last_type != 0) {
+        if (ps == send) {
+            result = EOVERFLOW;
+        } else {
+            pack_block_slice(ps++, last_type, &last);
+        }
+    }
+    if (result != 0) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "data group id: %d, too many slices of the block, "
+                "oid: %"PRId64", block offset: %"PRId64, data_group_id,
+                bs_key.block.oid, bs_key.block.offset);
+        return result;
+    }
+
+    int2buff(ps - (FSProtoReplicaBlockSlice *)(resp_header + 1),
+            resp_header->count);
+    memset(resp_header->padding, 0, sizeof(resp_header->padding));
+    RESPONSE.header.body_len = (char *)ps - REQUEST.body;
+    TASK_ARG->context.response_done = true;
+    return 0;
+}
+
 int replica_deal_task(struct fast_task_info *task, const int stage)
 {
     int result;
@@ -942,9 +1556,21 @@ int replica_deal_task(struct fast_task_info *task, const int stage)
             case FS_REPLICA_PROTO_ACTIVE_CONFIRM_REQ:
                 result = replica_deal_active_confirm(task);
                 break;
+            case FS_REPLICA_PROTO_SLICE_BULK_READ_REQ:
+                result = replica_deal_slice_bulk_read(task);
+                break;
             case FS_REPLICA_PROTO_SLICE_READ_REQ:
                 result = replica_deal_slice_read(task);
                 break;
+            case FS_REPLICA_PROTO_CHECKSUM_NODES_REQ:
+                result = replica_deal_checksum_nodes(task);
+                break;
+            case FS_REPLICA_PROTO_CHECKSUM_BLOCKS_REQ:
+                result = replica_deal_checksum_blocks(task);
+                break;
+            case FS_REPLICA_PROTO_BLOCK_SLICES_REQ:
+                result = replica_deal_block_slices(task);
+                break;
             default:
                 RESPONSE.error.length = sprintf(RESPONSE.error.message,
                         "unkown cmd: %d", REQUEST.header.cmd);
@@ -997,6 +1623,6 @@ int replica_thread_loop_callback(struct nio_thread_data *thread_data)
     }
     */
 
-    replication_processor_process(server_ctx);
+    replication_processor_process(server_ctx, thread_data);
     return 0;
 }
@@ -0,0 +1,906 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/pthread_func.h"
+#include "fastcommon/logger.h"
+#include "sf/sf_global.h"
+#include "../../common/fs_func.h"
+#include "../server_global.h"
+#include "../server_group_info.h"
+#include "../binlog/binlog_reader.h"
+#include "../binlog/replica_binlog.h"
+#include "checksum_tree.h"
+
+/* per data group, the bucket of a block is in its leaf
+ * because the capacity is a multiple of the leaf count */
+#define CHECKSUM_TREE_HTABLE_CAPACITY  (16 * CHECKSUM_TREE_LEAF_COUNT)
+
+#define CHECKSUM_TREE_LOAD_BUFFER_SIZE  (256 * 1024)
+
+/* the block states are saved to the snapshot file periodically */
+#define CHECKSUM_TREE_SNAPSHOT_FILENAME  "checksum_tree.dat"
+#define CHECKSUM_TREE_SNAPSHOT_INTERVAL  600
+
+/* the snapshot file: data version (8 bytes) + block count (8 bytes)
+ * + block records, the record: oid (8), offset (8), data version (8) */
+#define CHECKSUM_TREE_SNAPSHOT_HEADER_SIZE  16
+#define CHECKSUM_TREE_SNAPSHOT_RECORD_SIZE  24
+
+typedef struct {
+    int64_t oid;
+    int64_t offset;
+    uint64_t data_version;
+} ChecksumTreeBlock;
+
+/* the blocks are sorted by block key, no pointer per block */
+typedef struct {
+    int count;
+    int alloc;
+    ChecksumTreeBlock *blocks;
+} ChecksumTreeBucket;
+
+typedef struct {
+    int data_group_id;
+    volatile bool ready;
+    pthread_mutex_t lock;
+    int64_t block_count;
+    uint64_t snapshot_version;  //the data version of the last snapshot
+    ChecksumTreeBucket *buckets;
+    uint64_t nodes[CHECKSUM_TREE_NODE_COUNT];
+} ChecksumTreeInstance;
+
+typedef struct {
+    int base_id;
+    int count;
+    ChecksumTreeInstance **instances; //NULL for NOT my data group
+    pthread_t tid;   //for loading and saving the snapshot
+} ChecksumTreeContext;
+
+static ChecksumTreeContext checksum_tree_ctx;
+
+static inline uint64_t checksum_mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static inline uint64_t block_hash_code(const int64_t oid,
+        const int64_t offset)
+{
+    return checksum_mix64((uint64_t)oid * 31 + (uint64_t)offset);
+}
+
+static inline uint64_t block_digest(const int64_t oid,
+        const int64_t offset, const uint64_t data_version)
+{
+    return checksum_mix64(oid ^ checksum_mix64(offset ^
+                checksum_mix64(data_version)));
+}
+
+static inline ChecksumTreeInstance *get_instance(const int data_group_id)
+{
+    int index;
+
+    if (checksum_tree_ctx.instances == NULL) {
+        return NULL;
+    }
+
+    index = data_group_id - checksum_tree_ctx.base_id;
+    if (index < 0 || index >= checksum_tree_ctx.count) {
+        return NULL;
+    }
+    return checksum_tree_ctx.instances[index];
+}
+
+/* XOR the delta to the leaf and its ancestors */
+static void tree_xor(ChecksumTreeInstance *instance,
+        const int leaf_index, const uint64_t delta)
+{
+    int level;
+    int index;
+
+    index = leaf_index;
+    for (level=CHECKSUM_TREE_LEAF_LEVEL; level>=0; level--) {
+        instance->nodes[checksum_tree_level_offset(level) + index] ^= delta;
+        index /= CHECKSUM_TREE_FANOUT;
+    }
+}
+
+static inline int compare_block(const ChecksumTreeBlock *block,
+        const FSBlockKey *bkey)
+{
+    int sub;
+    if ((sub=fc_compare_int64(block->oid, bkey->oid)) != 0) {
+        return sub;
+    }
+    return fc_compare_int64(block->offset, bkey->offset);
+}
+
+/* return the index of the block or the insert position */
+static int find_block(ChecksumTreeBucket *bucket,
+        const FSBlockKey *bkey, bool *found)
+{
+    int low;
+    int high;
+    int mid;
+    int cmpr;
+
+    low = 0;
+    high = bucket->count - 1;
+    while (low <= high) {
+        mid = (low + high) / 2;
+        cmpr = compare_block(bucket->blocks + mid, bkey);
+        if (cmpr == 0) {
+            *found = true;
+            return mid;
+        } else if (cmpr < 0) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    *found = false;
+    return low;
+}
+
+static int insert_block(ChecksumTreeBucket *bucket, const int index,
+        const FSBlockKey *bkey, const uint64_t data_version)
+{
+    ChecksumTreeBlock *blocks;
+    int alloc;
+
+    if (bucket->alloc <= bucket->count) {
+        alloc = bucket->alloc > 0 ? bucket->alloc * 3 / 2 + 1 : 4;
+        blocks = (ChecksumTreeBlock *)fc_malloc(
+                sizeof(ChecksumTreeBlock) * alloc);
+        if (blocks == NULL) {
+            return ENOMEM;
+        }
+        if (bucket->blocks != NULL) {
+            memcpy(blocks, bucket->blocks, sizeof(
+                        ChecksumTreeBlock) * bucket->count);
+            free(bucket->blocks);
+        }
+        bucket->blocks = blocks;
+        bucket->alloc = alloc;
+    }
+
+    if (index < bucket->count) {
+        memmove(bucket->blocks + index + 1, bucket->blocks + index,
+                sizeof(ChecksumTreeBlock) * (bucket->count - index));
+    }
+    bucket->blocks[index].oid = bkey->oid;
+    bucket->blocks[index].offset = bkey->offset;
+    bucket->blocks[index].data_version = data_version;
+    bucket->count++;
+    return 0;
+}
+
+static void do_update(ChecksumTreeInstance *instance,
+        const FSBlockKey *bkey, const uint64_t data_version,
+        const bool force)
+{
+    ChecksumTreeBucket *bucket;
+    ChecksumTreeBlock *block;
+    uint64_t hash_code;
+    uint64_t delta;
+    int index;
+    bool found;
+
+    hash_code = block_hash_code(bkey->oid, bkey->offset);
+    bucket = instance->buckets + (hash_code % CHECKSUM_TREE_HTABLE_CAPACITY);
+    PTHREAD_MUTEX_LOCK(&instance->lock);
+    index = find_block(bucket, bkey, &found);
+    if (found) {
+        block = bucket->blocks + index;
+        if (block->data_version == data_version ||
+                (!force && data_version < block->data_version))
+        {
+            PTHREAD_MUTEX_UNLOCK(&instance->lock);
+            return;
+        }
+
+        delta = block_digest(block->oid, block->offset,
+                block->data_version) ^ block_digest(bkey->oid,
+                    bkey->offset, data_version);
+        block->data_version = data_version;
+    } else {
+        if (insert_block(bucket, index, bkey, data_version) != 0) {
+            instance->ready = false;  //the tree is NOT accurate any more
+            PTHREAD_MUTEX_UNLOCK(&instance->lock);
+            return;
+        }
+
+        instance->block_count++;
+        delta = block_digest(bkey->oid, bkey->offset, data_version);
+    }
+
+    tree_xor(instance, hash_code % CHECKSUM_TREE_LEAF_COUNT, delta);
+    PTHREAD_MUTEX_UNLOCK(&instance->lock);
+}
+
+void checksum_tree_update(const int data_group_id,
+        const FSBlockKey *bkey, const uint64_t data_version)
+{
+    ChecksumTreeInstance *instance;
+
+    if ((instance=get_instance(data_group_id)) != NULL) {
+        do_update(instance, bkey, data_version, false);
+    }
+}
+
+void checksum_tree_set_block(const int data_group_id,
+        const FSBlockKey *bkey, const uint64_t data_version)
+{
+    ChecksumTreeInstance *instance;
+
+    if ((instance=get_instance(data_group_id)) != NULL) {
+        do_update(instance, bkey, data_version, true);
+    }
+}
+
+void checksum_tree_remove_block(const int data_group_id,
+        const FSBlockKey *bkey)
+{
+    ChecksumTreeInstance *instance;
+    ChecksumTreeBucket *bucket;
+    ChecksumTreeBlock *block;
+    uint64_t hash_code;
+    int index;
+    bool found;
+
+    if ((instance=get_instance(data_group_id)) == NULL) {
+        return;
+    }
+
+    hash_code = block_hash_code(bkey->oid, bkey->offset);
+    bucket = instance->buckets + (hash_code % CHECKSUM_TREE_HTABLE_CAPACITY);
+    PTHREAD_MUTEX_LOCK(&instance->lock);
+    index = find_block(bucket, bkey, &found);
+    if (found) {
+        block = bucket->blocks + index;
+        instance->block_count--;
+        tree_xor(instance, hash_code % CHECKSUM_TREE_LEAF_COUNT,
+                block_digest(block->oid, block->offset,
+                    block->data_version));
+        bucket->count--;
+        if (index < bucket->count) {
+            memmove(block, block + 1, sizeof(ChecksumTreeBlock) *
+                    (bucket->count - index));
+        }
+    }
+    PTHREAD_MUTEX_UNLOCK(&instance->lock);
+}
+
+bool checksum_tree_is_ready(const int data_group_id)
+{
+    ChecksumTreeInstance *instance;
+
+    if ((instance=get_instance(data_group_id)) == NULL) {
+        return false;
+    }
+    return instance->ready;
+}
+
+int checksum_tree_get_nodes(const int data_group_id, const int level,
+        const int *indexes, const int count, uint64_t *values)
+{
+    ChecksumTreeInstance *instance;
+    const int *index;
+    const int *end;
+    uint64_t *nodes;
+    int node_count;
+
+    if ((instance=get_instance(data_group_id)) == NULL) {
+        return ENOENT;
+    }
+
+    if (level < 0 || level >= CHECKSUM_TREE_LEVEL_COUNT) {
+        return EINVAL;
+    }
+
+    node_count = checksum_tree_level_node_count(level);
+    end = indexes + count;
+    for (index=indexes; index<end; index++) {
+        if (*index < 0 || *index >= node_count) {
+            return EINVAL;
+        }
+    }
+
+    nodes = instance->nodes + checksum_tree_level_offset(level);
+    PTHREAD_MUTEX_LOCK(&instance->lock);
+    for (index=indexes; index<end; index++) {
+        *values++ = nodes[*index];
+    }
+    PTHREAD_MUTEX_UNLOCK(&instance->lock);
+    return 0;
+}
+
+static int compare_block_info(const ChecksumTreeBlockInfo *b1,
+        const ChecksumTreeBlockInfo *b2)
+{
+    int sub;
+    if ((sub=fc_compare_int64(b1->bkey.oid, b2->bkey.oid)) != 0) {
+        return sub;
+    }
+    return fc_compare_int64(b1->bkey.offset, b2->bkey.offset);
+}
+
+int checksum_tree_get_leaf_blocks(const int data_group_id,
+        const int leaf_index, ChecksumTreeBlockInfo *blocks,
+        const int size, int *count)
+{
+    ChecksumTreeInstance *instance;
+    ChecksumTreeBucket *bucket;
+    ChecksumTreeBucket *end;
+    ChecksumTreeBlock *block;
+    ChecksumTreeBlock *bend;
+    int result;
+
+    *count = 0;
+    if ((instance=get_instance(data_group_id)) == NULL) {
+        return ENOENT;
+    }
+    if (leaf_index < 0 || leaf_index >= CHECKSUM_TREE_LEAF_COUNT) {
+        return EINVAL;
+    }
+
+    result = 0;
+    end = instance->buckets + CHECKSUM_TREE_HTABLE_CAPACITY;
+    PTHREAD_MUTEX_LOCK(&instance->lock);
+    for (bucket=instance->buckets + leaf_index; bucket<end;
+            bucket+=CHECKSUM_TREE_LEAF_COUNT)
+    {
+        bend = bucket->blocks + bucket->count;
+        for (block=bucket->blocks; block<bend; block++) {
+            if (*count == size) {
+                result = EOVERFLOW;
+                break;
+            }
+            blocks[*count].bkey.oid = block->oid;
+            blocks[*count].bkey.offset = block->offset;
+            fs_calc_block_hashcode(&blocks[*count].bkey);
+            blocks[*count].data_version = block->data_version;
+            (*count)++;
+        }
+
+        if (result != 0) {
+            break;
+        }
+    }
+    PTHREAD_MUTEX_UNLOCK(&instance->lock);
+
+    if (result == 0 && *count > 1) {
+        qsort(blocks, *count, sizeof(ChecksumTreeBlockInfo),
+                (int (*)(const void *, const void *))compare_block_info);
+    }
+    return result;
+}
+
+static int load_binlog_buffer(ChecksumTreeInstance *instance,
+        const char *buff, const int length)
+{
+    ReplicaBinlogRecord record;
+    string_t line;
+    const char *p;
+    const char *end;
+    const char *line_end;
+    char error_info[256];
+    int result;
+
+    p = buff;
+    end = buff + length;
+    while (p < end) {
+        if ((line_end=(const char *)memchr(p, '\n', end - p)) == NULL) {
+            break;
+        }
+
+        line_end++;
+        line.str = (char *)p;
+        line.len = line_end - p;
+        if ((result=replica_binlog_record_unpack(&line,
+                        &record, error_info)) != 0)
+        {
+            logError("file: "__FILE__", line: %d, "
+                    "data group id: %d, unpack replica binlog fail, %s",
+                    __LINE__, instance->data_group_id, error_info);
+            return result;
+        }
+
+        if (record.op_type != REPLICA_BINLOG_OP_TYPE_NO_OP) {
+            do_update(instance, &record.bs_key.block,
+                    record.data_version, false);
+        }
+        p = line_end;
+    }
+
+    return 0;
+}
+
+static inline void get_snapshot_filename(ChecksumTreeInstance *instance,
+        char *filename, const int size)
+{
+    char subdir_name[FS_BINLOG_SUBDIR_NAME_SIZE];
+
+    replica_binlog_get_subdir_name(subdir_name, instance->data_group_id);
+    snprintf(filename, size, "%s/%s/%s", DATA_PATH_STR,
+            subdir_name, CHECKSUM_TREE_SNAPSHOT_FILENAME);
+}
+
+static int write_snapshot_buffer(const int fd, const char *filename,
+        const char *buff, const int length)
+{
+    int result;
+
+    if (fc_safe_write(fd, buff, length) != length) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "write to file %s fail, errno: %d, error info: %s",
+                __LINE__, filename, result, STRERROR(result));
+        return result;
+    }
+
+    return 0;
+}
+
+/* the snapshot covers the data version written to the binlog before it,
+ * the blocks are copied bucket by bucket without stopping the updating,
+ * so a block MAY be newer than the data version of the snapshot, and
+ * the records after this data version are replayed on loading */
+static int save_snapshot(ChecksumTreeInstance *instance,
+        const uint64_t data_version, char *buff)
+{
+    ChecksumTreeBucket *bucket;
+    ChecksumTreeBucket *end;
+    ChecksumTreeBlock *block;
+    ChecksumTreeBlock *bend;
+    char filename[PATH_MAX];
+    char tmp_filename[PATH_MAX];
+    char *p;
+    int64_t block_count;
+    int fd;
+    int result;
+
+    get_snapshot_filename(instance, filename, sizeof(filename));
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename);
+    if ((fd=open(tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        result = errno != 0 ? errno : EACCES;
+        logError("file: "__FILE__", line: %d, "
+                "open file %s fail, errno: %d, error info: %s",
+                __LINE__, tmp_filename, result, STRERROR(result));
+        return result;
+    }
+
+    result = 0;
+    block_count = 0;
+    p = buff + CHECKSUM_TREE_SNAPSHOT_HEADER_SIZE;
+    end = instance->buckets + CHECKSUM_TREE_HTABLE_CAPACITY;
+    for (bucket=instance->buckets; bucket<end && result == 0; bucket++) {
+        PTHREAD_MUTEX_LOCK(&instance->lock);
+        bend = bucket->blocks + bucket->count;
+        for (block=bucket->blocks; block<bend; block++) {
+            if ((p - buff) + CHECKSUM_TREE_SNAPSHOT_RECORD_SIZE >
+                    CHECKSUM_TREE_LOAD_BUFFER_SIZE)
+            {
+                if ((result=write_snapshot_buffer(fd, tmp_filename,
+                                buff, p - buff)) != 0)
+                {
+                    break;
+                }
+                p = buff;
+            }
+
+            long2buff(block->oid, p);
+            long2buff(block->offset, p + 8);
+            long2buff(block->data_version, p + 16);
+            p += CHECKSUM_TREE_SNAPSHOT_RECORD_SIZE;
+            block_count++;
+        }
+        PTHREAD_MUTEX_UNLOCK(&instance->lock);
+    }
+
+    if (result == 0 && p > buff) {
+        result = write_snapshot_buffer(fd, tmp_filename, buff, p - buff);
+    }
+    if (result == 0) {
+        long2buff(data_version, buff);
+        long2buff(block_count, buff + 8);
+        if (pwrite(fd, buff, CHECKSUM_TREE_SNAPSHOT_HEADER_SIZE, 0) !=
+                CHECKSUM_TREE_SNAPSHOT_HEADER_SIZE || fsync(fd) != 0)
+        {
+            result = errno != 0 ? errno : EIO;
+            logError("file: "__FILE__", line: %d, "
+                    "write to file %s fail, errno: %d, error info: %s",
+                    __LINE__, tmp_filename, result, STRERROR(result));
+        }
+    }
+    close(fd);
+
+    if (result == 0 && rename(tmp_filename, filename) != 0) {
+        result = errno != 0 ? errno : EPERM;
+        logError("file: "__FILE__", line: %d, "
+                "rename file %s to %s fail, errno: %d, error info: %s",
+                __LINE__, tmp_filename, filename, result, STRERROR(result));
+    }
+    if (result != 0) {
+        unlink(tmp_filename);
+        return result;
+    }
+
+    instance->snapshot_version = data_version;
+    return 0;
+}
+
+static int load_snapshot(ChecksumTreeInstance *instance,
+        char *buff, uint64_t *data_version)
+{
+    FSBlockKey bkey;
+    char filename[PATH_MAX];
+    char *p;
+    char *end;
+    int64_t block_count;
+    int64_t loaded;
+    int fd;
+    int bytes;
+    int length;
+    int result;
+
+    *data_version = 0;
+    get_snapshot_filename(instance, filename, sizeof(filename));
+    if ((fd=open(filename, O_RDONLY)) < 0) {
+        result = errno != 0 ? errno : EACCES;
+        if (result == ENOENT) {
+            return 0;
+        }
+        logError("file: "__FILE__", line: %d, "
+                "open file %s fail, errno: %d, error info: %s",
+                __LINE__, filename, result, STRERROR(result));
+        return result;
+    }
+
+    result = 0;
+    loaded = 0;
+    block_count = -1;
+    length = 0;
+    while (SF_G_CONTINUE_FLAG) {
+        if ((bytes=read(fd, buff + length, CHECKSUM_TREE_LOAD_BUFFER_SIZE
+                        - length)) < 0)
+        {
+            result = errno != 0 ? errno : EIO;
+            logError("file: "__FILE__", line: %d, "
+                    "read from file %s fail, errno: %d, error info: %s",
+                    __LINE__, filename, result, STRERROR(result));
+            break;
+        }
+        if (bytes == 0) {
+            break;
+        }
+
+        length += bytes;
+        p = buff;
+        end = buff + length;
+        if (block_count < 0) {
+            if (length < CHECKSUM_TREE_SNAPSHOT_HEADER_SIZE) {
+                continue;
+            }
+            *data_version = buff2long(p);
+            block_count = buff2long(p + 8);
+            p += CHECKSUM_TREE_SNAPSHOT_HEADER_SIZE;
+        }
+
+        while (end - p >= CHECKSUM_TREE_SNAPSHOT_RECORD_SIZE) {
+            bkey.oid = buff2long(p);
+            bkey.offset = buff2long(p + 8);
+            do_update(instance, &bkey, buff2long(p + 16), false);
+            p += CHECKSUM_TREE_SNAPSHOT_RECORD_SIZE;
+            loaded++;
+        }
+
+        length = end - p;
+        if (length > 0) {
+            memmove(buff, p, length);
+        }
+    }
+    close(fd);
+
+    if (result == 0 && SF_G_CONTINUE_FLAG && (loaded != block_count ||
+                length != 0))
+    {
+        logError("file: "__FILE__", line: %d, "
+                "checksum tree snapshot file %s is corrupted, "
+                "expect block count: %"PRId64", loaded: %"PRId64,
+                __LINE__, filename, block_count, loaded);
+        result = EINVAL;
+    }
+    if (result != 0) {
+        *data_version = 0;
+        return result;
+    }
+
+    instance->snapshot_version = *data_version;
+    return 0;
+}
+
+static void clear_blocks(ChecksumTreeInstance *instance)
+{
+    ChecksumTreeBucket *bucket;
+    ChecksumTreeBucket *end;
+
+    PTHREAD_MUTEX_LOCK(&instance->lock);
+    end = instance->buckets + CHECKSUM_TREE_HTABLE_CAPACITY;
+    for (bucket=instance->buckets; bucket<end; bucket++) {
+        bucket->count = 0;
+    }
+    instance->block_count = 0;
+    memset(instance->nodes, 0, sizeof(instance->nodes));
+    PTHREAD_MUTEX_UNLOCK(&instance->lock);
+}
+
+/* the head binlog files MAY be purged */
+static int get_first_record(ChecksumTreeInstance *instance,
+        ReplicaBinlogRecord *record)
+{
+    char subdir_name[FS_BINLOG_SUBDIR_NAME_SIZE];
+    char filename[PATH_MAX];
+    int current_windex;
+    int binlog_index;
+    int result;
+
+    replica_binlog_get_subdir_name(subdir_name, instance->data_group_id);
+    current_windex = replica_binlog_get_current_write_index(
+            instance->data_group_id);
+    for (binlog_index=0; binlog_index<=current_windex; binlog_index++) {
+        binlog_reader_get_filename(subdir_name, binlog_index,
+                filename, sizeof(filename));
+        if ((result=replica_binlog_get_first_record(
+                        filename, record)) != ENOENT)
+        {
+            return result;
+        }
+    }
+
+    return ENOENT;
+}
+
+/* load the snapshot and replay the replica binlog after it,
+ * so the tree is rebuilt after the head of the binlog purged */
+static int load_instance(ChecksumTreeInstance *instance, char *buff)
+{
+    ServerBinlogReader reader;
+    ReplicaBinlogRecord record;
+    uint64_t snapshot_version;
+    int64_t start_time;
+    int read_bytes;
+    int result;
+
+    start_time = get_current_time_ms();
+    if ((result=load_snapshot(instance, buff, &snapshot_version)) != 0) {
+        clear_blocks(instance);  //rebuild from the whole binlog
+    }
+
+    if ((result=get_first_record(instance, &record)) != 0) {
+        if (result == ENOENT) {  //empty binlog
+            instance->ready = true;
+            return 0;
+        }
+        return result;
+    }
+
+    if (record.data_version > snapshot_version + 1) {
+        logWarning("file: "__FILE__", line: %d, "
+                "data group id: %d, the first data version of the replica "
+                "binlog: %"PRId64" > the data version of the checksum tree "
+                "snapshot: %"PRId64" + 1, the checksum tree is disabled",
+                __LINE__, instance->data_group_id, record.data_version,
+                snapshot_version);
+        return 0;
+    }
+
+    if ((result=replica_binlog_reader_init(&reader,
+                    instance->data_group_id, snapshot_version)) != 0)
+    {
+        return result;
+    }
+
+    while (SF_G_CONTINUE_FLAG) {
+        if ((result=binlog_reader_integral_read(&reader, buff,
+                        CHECKSUM_TREE_LOAD_BUFFER_SIZE, &read_bytes)) != 0)
+        {
+            if (result == ENOENT) {
+                result = 0;
+            }
+            break;
+        }
+
+        if ((result=load_binlog_buffer(instance, buff, read_bytes)) != 0) {
+            break;
+        }
+    }
+    binlog_reader_destroy(&reader);
+
+    if (result == 0 && SF_G_CONTINUE_FLAG) {
+        instance->ready = true;
+        logInfo("file: "__FILE__", line: %d, "
+                "data group id: %d, checksum tree loaded, snapshot data "
+                "version: %"PRId64", block count: %"PRId64", time used: "
+                "%"PRId64" ms", __LINE__, instance->data_group_id,
+                snapshot_version, instance->block_count,
+                get_current_time_ms() - start_time);
+    }
+    return result;
+}
+
+static int get_written_version(ChecksumTreeInstance *instance,
+        uint64_t *data_version)
+{
+    char subdir_name[FS_BINLOG_SUBDIR_NAME_SIZE];
+    char filename[PATH_MAX];
+
+    replica_binlog_get_subdir_name(subdir_name, instance->data_group_id);
+    sf_binlog_writer_get_filename(subdir_name,
+            replica_binlog_get_current_write_index(
+                instance->data_group_id), filename, sizeof(filename));
+    return replica_binlog_get_last_data_version(filename, data_version);
+}
+
+static void save_snapshots(char *buff)
+{
+    ChecksumTreeInstance **instance;
+    ChecksumTreeInstance **end;
+    uint64_t data_version;
+    int result;
+
+    end = checksum_tree_ctx.instances + checksum_tree_ctx.count;
+    for (instance=checksum_tree_ctx.instances; instance<end &&
+            SF_G_CONTINUE_FLAG; instance++)
+    {
+        if (*instance == NULL || !(*instance)->ready) {
+            continue;
+        }
+
+        /* the records before the written version are in the tree */
+        if (get_written_version(*instance, &data_version) != 0 ||
+                data_version <= (*instance)->snapshot_version)
+        {
+            continue;
+        }
+
+        if ((result=save_snapshot(*instance, data_version, buff)) != 0) {
+            logError("file: "__FILE__", line: %d, "
+                    "data group id: %d, save checksum tree snapshot fail, "
+                    "errno: %d, error info: %s", __LINE__,
+                    (*instance)->data_group_id, result, STRERROR(result));
+        }
+    }
+}
+
+static void *checksum_tree_load_entrance(void *arg)
+{
+    ChecksumTreeInstance **instance;
+    ChecksumTreeInstance **end;
+    char *buff;
+    int next_time;
+    int result;
+
+    if ((buff=(char *)fc_malloc(CHECKSUM_TREE_LOAD_BUFFER_SIZE)) == NULL) {
+        return NULL;
+    }
+
+    end = checksum_tree_ctx.instances + checksum_tree_ctx.count;
+    for (instance=checksum_tree_ctx.instances; instance<end &&
+            SF_G_CONTINUE_FLAG; instance++)
+    {
+        if (*instance == NULL) {
+            continue;
+        }
+
+        if ((result=load_instance(*instance, buff)) != 0) {
+            logError("file: "__FILE__", line: %d, "
+                    "data group id: %d, load checksum tree fail, "
+                    "errno: %d, error info: %s", __LINE__,
+                    (*instance)->data_group_id, result, STRERROR(result));
+        }
+    }
+
+    next_time = g_current_time + CHECKSUM_TREE_SNAPSHOT_INTERVAL;
+    while (SF_G_CONTINUE_FLAG) {
+        sleep(1);
+        if (g_current_time >= next_time) {
+            save_snapshots(buff);
+            next_time = g_current_time + CHECKSUM_TREE_SNAPSHOT_INTERVAL;
+        }
+    }
+
+    free(buff);
+    return NULL;
+}
+
+static int init_instance(ChecksumTreeInstance *instance,
+        const int data_group_id)
+{
+    int bytes;
+
+    instance->data_group_id = data_group_id;
+    bytes = sizeof(ChecksumTreeBucket) * CHECKSUM_TREE_HTABLE_CAPACITY;
+    if ((instance->buckets=(ChecksumTreeBucket *)fc_malloc(bytes)) == NULL) {
+        return ENOMEM;
+    }
+    memset(instance->buckets, 0, bytes);
+
+    return init_pthread_lock(&instance->lock);
+}
+
+int checksum_tree_init()
+{
+    FSClusterDataGroupInfo *group;
+    FSClusterDataGroupInfo *end;
+    ChecksumTreeInstance *instance;
+    int bytes;
+    int result;
+
+    if (!CHECKSUM_TREE_ENABLED) {
+        return 0;
+    }
+
+    checksum_tree_ctx.base_id = CLUSTER_DATA_RGOUP_ARRAY.base_id;
+    checksum_tree_ctx.count = CLUSTER_DATA_RGOUP_ARRAY.count;
+    bytes = sizeof(ChecksumTreeInstance *) * checksum_tree_ctx.count;
+    checksum_tree_ctx.instances = (ChecksumTreeInstance **)fc_malloc(bytes);
+    if (checksum_tree_ctx.instances == NULL) {
+        return ENOMEM;
+    }
+    memset(checksum_tree_ctx.instances, 0, bytes);
+
+    end = CLUSTER_DATA_RGOUP_ARRAY.groups + CLUSTER_DATA_RGOUP_ARRAY.count;
+    for (group=CLUSTER_DATA_RGOUP_ARRAY.groups; group<end; group++) {
+        if (group->myself == NULL) {
+            continue;
+        }
+
+        instance = (ChecksumTreeInstance *)fc_malloc(
+                sizeof(ChecksumTreeInstance));
+        if (instance == NULL) {
+            return ENOMEM;
+        }
+        memset(instance, 0, sizeof(ChecksumTreeInstance));
+        if ((result=init_instance(instance, group->id)) != 0) {
+            return result;
+        }
+        checksum_tree_ctx.instances[group->id -
+            checksum_tree_ctx.base_id] = instance;
+    }
+
+    return fc_create_thread(&checksum_tree_ctx.tid,
+            checksum_tree_load_entrance, NULL, SF_G_THREAD_STACK_SIZE);
+}
+
+void checksum_tree_destroy()
+{
+}
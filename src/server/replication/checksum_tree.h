@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//checksum_tree.h
+
+/* the block checksum tree of the data group.
+ *
+ * the state of a block is the data version of its last replica binlog
+ * record. the digest of the block state is XORed into a leaf chosen by
+ * the block key, and the node of the upper level is the XOR of its
+ * children, so the tree is updated incrementally on each record.
+ *
+ * the master and the slave with the same block states have the same
+ * tree, the slave compares the tree top down to find the different
+ * blocks. the block states are saved to a snapshot file periodically,
+ * and the tree is rebuilt from the snapshot and the replica binlog
+ * after it on startup. it is NOT ready when the binlog is purged
+ * beyond the snapshot.
+ */
+
+#ifndef _CHECKSUM_TREE_H_
+#define _CHECKSUM_TREE_H_
+
+#include "../server_types.h"
+
+#define CHECKSUM_TREE_FANOUT       16
+#define CHECKSUM_TREE_LEVEL_COUNT   4   //the root level is 0
+#define CHECKSUM_TREE_LEAF_LEVEL   (CHECKSUM_TREE_LEVEL_COUNT - 1)
+#define CHECKSUM_TREE_LEAF_COUNT   (16 * 16 * 16)
+#define CHECKSUM_TREE_NODE_COUNT   (1 + 16 + 16 * 16 + 16 * 16 * 16)
+
+typedef struct {
+    FSBlockKey bkey;
+    uint64_t data_version;
+} ChecksumTreeBlockInfo;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    static inline int checksum_tree_level_node_count(const int level)
+    {
+        int count;
+        int i;
+
+        count = 1;
+        for (i=0; i<level; i++) {
+            count *= CHECKSUM_TREE_FANOUT;
+        }
+        return count;
+    }
+
+    /* the nodes are stored level by level from the root */
+    static inline int checksum_tree_level_offset(const int level)
+    {
+        return (checksum_tree_level_node_count(level) - 1) /
+            (CHECKSUM_TREE_FANOUT - 1);
+    }
+
+    int checksum_tree_init();
+    void checksum_tree_destroy();
+
+    /* called when the replica binlog record is logged, the block state
+     * is changed only when the data version is newer */
+    void checksum_tree_update(const int data_group_id,
+            const FSBlockKey *bkey, const uint64_t data_version);
+
+    /* set the block state to the master's after the block transferred */
+    void checksum_tree_set_block(const int data_group_id,
+            const FSBlockKey *bkey, const uint64_t data_version);
+
+    void checksum_tree_remove_block(const int data_group_id,
+            const FSBlockKey *bkey);
+
+    bool checksum_tree_is_ready(const int data_group_id);
+
+    /* get the values of the nodes of the level by the indexes */
+    int checksum_tree_get_nodes(const int data_group_id, const int level,
+            const int *indexes, const int count, uint64_t *values);
+
+    /* get the blocks of the leaf sorted by block key,
+     * return EOVERFLOW when the blocks more than size */
+    int checksum_tree_get_leaf_blocks(const int data_group_id,
+            const int leaf_index, ChecksumTreeBlockInfo *blocks,
+            const int size, int *count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
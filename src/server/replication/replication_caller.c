@@ -29,28 +29,66 @@
 #include "fastcommon/sockopt.h"
 #include "fastcommon/shared_func.h"
 #include "fastcommon/pthread_func.h"
+#include "fastcommon/sched_thread.h"
 #include "fastcommon/ioevent_loop.h"
 #include "sf/sf_global.h"
+#include "../../common/fs_proto.h"
 #include "../server_global.h"
 #include "../server_group_info.h"
 #include "../cluster_relationship.h"
+#include "../data_thread.h"
 #include "replication_processor.h"
+#include "replication_callee.h"
 #include "rpc_result_ring.h"
 #include "replication_caller.h"
 
+typedef struct {
+    volatile int64_t parked;     //the RPCs parked for the ONLINE slaves
+    volatile int64_t resumed;    //the parked RPCs pushed to the slaves
+    volatile int64_t discarded;  //the parked RPCs discarded
+    volatile int64_t timeouts;   //the slaves set OFFLINE for parked timeout
+    int64_t last_parked;
+    int64_t last_resumed;
+    int64_t last_discarded;
+    int64_t last_timeouts;
+} ReplicationParkedStat;
+
 typedef struct {
     struct fast_mblock_man rpc_allocator;
+    struct fast_mblock_man waiter_allocator;
+    ReplicationParkedStat parked_stat;
 } ReplicationMasterContext;
 
 static ReplicationMasterContext repl_mctx;
 
+static int check_parked_timeouts_func(void *args);
+static int log_parked_stat_func(void *args);
+
+static int setup_caller_schedules()
+{
+#define REPLICATION_CALLER_SCHEDULE_COUNT  2
+    ScheduleArray scheduleArray;
+    ScheduleEntry scheduleEntries[REPLICATION_CALLER_SCHEDULE_COUNT];
+
+    INIT_SCHEDULE_ENTRY(scheduleEntries[0], sched_generate_next_id(),
+           TIME_NONE, TIME_NONE, TIME_NONE, 1,
+            check_parked_timeouts_func, NULL);
+    INIT_SCHEDULE_ENTRY(scheduleEntries[1], sched_generate_next_id(),
+           TIME_NONE, TIME_NONE, TIME_NONE, 60,
+            log_parked_stat_func, NULL);
+    scheduleArray.entries = scheduleEntries;
+    scheduleArray.count = REPLICATION_CALLER_SCHEDULE_COUNT;
+    return sched_add_entries(&scheduleArray);
+}
+
 int replication_caller_init()
 {
     int result;
     int element_size;
 
     element_size = sizeof(ReplicationRPCEntry) +
-        sizeof(ReplicationRPCEntry *) * CLUSTER_SERVER_ARRAY.count;
+        (sizeof(ReplicationRPCEntry *) + sizeof(int)) *
+        CLUSTER_SERVER_ARRAY.count;
     if ((result=fast_mblock_init_ex1(&repl_mctx.rpc_allocator,
                     "rpc_entry", element_size, 1024, 0, NULL,
                     NULL, true)) != 0)
@@ -58,7 +96,14 @@ int replication_caller_init()
         return result;
     }
 
-    return 0;
+    if ((result=fast_mblock_init_ex1(&repl_mctx.waiter_allocator,
+                    "rpc_waiter", sizeof(FSReplicaRPCWaiter), 1024,
+                    0, NULL, NULL, true)) != 0)
+    {
+        return result;
+    }
+
+    return setup_caller_schedules();
 }
 
 void replication_caller_destroy()
@@ -75,6 +120,7 @@ static inline ReplicationRPCEntry *replication_caller_alloc_rpc_entry()
         return NULL;
     }
 
+    rpc->chain_server_ids = (int *)(rpc->nexts + CLUSTER_SERVER_ARRAY.count);
     return rpc;
 }
 
@@ -85,48 +131,307 @@ void replication_caller_release_rpc_entry(ReplicationRPCEntry *rpc)
         logInfo("file: "__FILE__", line: %d, "
                 "free record buffer: %p", __LINE__, rpc);
                 */
+        if (rpc->body_copied) {
+            free(rpc->body);
+        }
         fast_mblock_free_object(&repl_mctx.rpc_allocator, rpc);
     }
 }
 
+static inline void release_rpc_waiter(FSReplicaRPCWaiter *waiter,
+        const int count)
+{
+    if (__sync_sub_and_fetch(&waiter->reffer_count, count) == 0) {
+        fast_mblock_free_object(&repl_mctx.waiter_allocator, waiter);
+    }
+}
+
+static inline FSReplicaRPCWaiter *alloc_rpc_waiter()
+{
+    FSReplicaRPCWaiter *waiter;
+
+    if ((waiter=(FSReplicaRPCWaiter *)fast_mblock_alloc_object(
+                    &repl_mctx.waiter_allocator)) == NULL)
+    {
+        return NULL;
+    }
+
+    waiter->reffer_count = 0;
+    waiter->waiting_count = 0;
+    waiter->result = 0;
+    waiter->quorum = false;
+    waiter->spare_count = 0;
+    waiter->notified = 0;
+    waiter->notify_func = NULL;
+    waiter->chain_rpc = NULL;
+    waiter->downstream = NULL;
+    return waiter;
+}
+
+void replication_caller_rpc_done(FSReplicaRPCWaiter *waiter,
+        const int result)
+{
+    bool done;
+
+    if (result == 0 || !waiter->quorum) {
+        if (result != 0) {
+            __sync_bool_compare_and_swap(&waiter->result, 0, result);
+        }
+
+        /* only the response reaching the quorum notifies, the later
+         * responses make the waiting count negative */
+        done = (__sync_sub_and_fetch(&waiter->waiting_count, 1) == 0);
+    } else {
+        /* the failed slave is not counted for the quorum */
+        done = (__sync_sub_and_fetch(&waiter->spare_count, 1) < 0);
+    }
+
+    if (done && __sync_bool_compare_and_swap(&waiter->notified, 0, 1)) {
+        if (waiter->quorum && result != 0) {
+            /* the quorum can't be reached any more */
+            __sync_bool_compare_and_swap(&waiter->result, 0, result);
+        }
+        waiter->notify_func(waiter);
+    }
+    release_rpc_waiter(waiter, 1);
+}
+
+int replication_caller_finish_waiting(FSSliceOpContext *op_ctx)
+{
+    FSReplicaRPCWaiter *waiter;
+    int result;
+
+    waiter = op_ctx->info.rpc_waiter;
+    result = (waiter->quorum ? __sync_add_and_fetch(&waiter->result, 0) : 0);
+    op_ctx->info.rpc_waiter = NULL;
+    release_rpc_waiter(waiter, 1);
+    return result;
+}
+
 static inline void push_to_slave_replica_queue(FSReplication *replication,
         ReplicationRPCEntry *rpc)
 {
     bool notify;
 
+    __sync_add_and_fetch(&replication->context.caller.queued_rpcs, 1);
+    __sync_add_and_fetch(&replication->context.caller.queued_bytes,
+            REPLICATION_RPC_PKG_SIZE(rpc));
     fc_queue_push_ex(&replication->context.caller.rpc_queue, rpc, &notify);
     if (notify) {
         ioevent_notify_thread(replication->task->thread_data);
     }
 }
 
+/* the parked RPC is a copy for the slave because the task body is
+ * reused before it is sent. it takes the waiter reference of the slave,
+ * so the write still waits for the slave which was ONLINE */
+static ReplicationRPCEntry *clone_rpc_entry(const ReplicationRPCEntry *rpc)
+{
+    ReplicationRPCEntry *parked;
+
+    if ((parked=replication_caller_alloc_rpc_entry()) == NULL) {
+        return NULL;
+    }
+
+    if ((parked->body=(char *)fc_malloc(rpc->body_length)) == NULL) {
+        fast_mblock_free_object(&repl_mctx.rpc_allocator, parked);
+        return NULL;
+    }
+    memcpy(parked->body, rpc->body, rpc->body_length);
+    parked->body_copied = true;
+    parked->body_length = rpc->body_length;
+    parked->cmd = rpc->cmd;
+    parked->data_group_id = rpc->data_group_id;
+    parked->data_version = rpc->data_version;
+    parked->create_time = g_current_time;
+    parked->push_time_us = rpc->push_time_us;
+    parked->waiter = rpc->waiter;
+    parked->chain_count = 0;
+    parked->reffer_count = 1;
+    return parked;
+}
+
+static inline FSReplication *get_ds_replication(FSClusterDataServerInfo *ds,
+        const uint32_t hash_code)
+{
+    return ds->cs->repl_ptr_array.replications[hash_code %
+        ds->cs->repl_ptr_array.count];
+}
+
+static void discard_parked_rpcs(FSClusterDataServerInfo *ds,
+        ReplicationRPCEntry *head)
+{
+    ReplicationRPCEntry *rpc;
+    int count;
+
+    count = 0;
+    while (head != NULL) {
+        rpc = head;
+        head = head->nexts[ds->cs->link_index];
+
+        /* the slave left ONLINE without becoming ACTIVE,
+         * it is NOT counted for the write as the inactive slave */
+        if (rpc->waiter != NULL) {
+            replication_caller_rpc_done(rpc->waiter, ENOTCONN);
+        }
+        replication_caller_release_rpc_entry(rpc);
+        ++count;
+    }
+
+    if (count > 0) {
+        __sync_add_and_fetch(&repl_mctx.parked_stat.discarded, count);
+        logWarning("file: "__FILE__", line: %d, "
+                "data group id: %d, peer id: %d, discard %d parked RPCs, "
+                "the slave will catch up by recovery", __LINE__,
+                ds->dg->id, ds->cs->server->id, count);
+    }
+}
+
+/* push the parked RPCs in order, caller MUST hold the notify lock */
+static bool flush_parked_rpcs(FSClusterDataServerInfo *ds)
+{
+    ReplicationRPCEntry *head;
+    ReplicationRPCEntry *rpc;
+    FSReplication *replication;
+    int status;
+    int count;
+
+    if ((head=ds->replica.parked.head) == NULL) {
+        return true;
+    }
+    ds->replica.parked.head = ds->replica.parked.tail = NULL;
+    ds->replica.parked.count = 0;  //changed under the notify lock only
+
+    status = __sync_add_and_fetch(&ds->status, 0);
+    if (status != FS_SERVER_STATUS_ACTIVE || ds->dg->myself == NULL ||
+            !__sync_add_and_fetch(&ds->dg->myself->is_master, 0))
+    {
+        discard_parked_rpcs(ds, head);
+        return true;
+    }
+
+    replication = get_ds_replication(ds, ds->dg->id);
+    if (!replication_channel_is_ready(replication)) {
+        discard_parked_rpcs(ds, head);
+        return false;
+    }
+
+    count = 0;
+    while (head != NULL) {
+        rpc = head;
+        head = head->nexts[ds->cs->link_index];
+        push_to_slave_replica_queue(replication, rpc);
+        ++count;
+    }
+    __sync_add_and_fetch(&repl_mctx.parked_stat.resumed, count);
+    return true;
+}
+
+void replication_caller_resume_parked(FSClusterDataServerInfo *ds)
+{
+    bool success;
+
+    PTHREAD_MUTEX_LOCK(&ds->replica.notify.lock);
+    success = flush_parked_rpcs(ds);
+    PTHREAD_MUTEX_UNLOCK(&ds->replica.notify.lock);
+
+    if (!success) {  //the replica connection NOT established
+        cluster_relationship_swap_report_ds_status(ds,
+                FS_SERVER_STATUS_ACTIVE, FS_SERVER_STATUS_OFFLINE,
+                FS_EVENT_SOURCE_MASTER_REPORT);
+    }
+}
+
+/* park the RPC when the slave is ONLINE or has parked RPCs,
+ * return 0 for parked, EAGAIN for NOT parked, ENOMEM for out of memory */
+static int park_rpc_entry(FSClusterDataServerInfo *ds,
+        const ReplicationRPCEntry *rpc)
+{
+    ReplicationRPCEntry *parked;
+    int status;
+    int result;
+
+    PTHREAD_MUTEX_LOCK(&ds->replica.notify.lock);
+    status = __sync_add_and_fetch(&ds->status, 0);
+    if (status == FS_SERVER_STATUS_ONLINE || ds->replica.parked.head != NULL) {
+        if ((parked=clone_rpc_entry(rpc)) != NULL) {
+            parked->nexts[ds->cs->link_index] = NULL;
+            if (ds->replica.parked.tail == NULL) {
+                ds->replica.parked.head = parked;
+            } else {
+                ds->replica.parked.tail->nexts[ds->cs->link_index] = parked;
+            }
+            ds->replica.parked.tail = parked;
+            __sync_add_and_fetch(&ds->replica.parked.count, 1);
+            __sync_add_and_fetch(&repl_mctx.parked_stat.parked, 1);
+            result = 0;
+        } else {
+            logError("file: "__FILE__", line: %d, "
+                    "data group id: %d, peer id: %d, park the RPC "
+                    "fail, data version: %"PRId64, __LINE__, ds->dg->id,
+                    ds->cs->server->id, rpc->data_version);
+            result = ENOMEM;
+        }
+
+        if (status != FS_SERVER_STATUS_ONLINE) {  //the status changed
+            flush_parked_rpcs(ds);
+        }
+    } else {
+        result = EAGAIN;
+    }
+    PTHREAD_MUTEX_UNLOCK(&ds->replica.notify.lock);
+
+    return result;
+}
+
 static int push_to_slave_queues(FSClusterDataGroupInfo *group,
-        const uint32_t hash_code, ReplicationRPCEntry *rpc)
+        const uint32_t hash_code, ReplicationRPCEntry *rpc,
+        const int wait_count)
 {
     FSClusterDataServerInfo **ds;
     FSClusterDataServerInfo **end;
     FSReplication *replication;
+    FSReplication *chain_head;
     int status;
     int inactive_count;
+    int parked_count;
+    int done_count;
+    bool done;
+    int result;
 
-    __sync_add_and_fetch(&rpc->reffer_count,
-            group->slave_ds_array.count);
+    chain_head = NULL;
+    rpc->chain_count = 0;
 
-    __sync_add_and_fetch(&((FSServerTaskArg *)rpc->task->arg)->context.
-            service.waiting_rpc_count, group->slave_ds_array.count);
+    /* one reference for the pusher, and the pusher holds one
+     * waiting count until all RPCs are pushed */
+    __sync_add_and_fetch(&rpc->reffer_count,
+            group->slave_ds_array.count + 1);
+    __sync_add_and_fetch(&rpc->waiter->reffer_count,
+            group->slave_ds_array.count + 1);
+    if (wait_count < group->slave_ds_array.count) {
+        rpc->waiter->quorum = true;
+        rpc->waiter->spare_count = group->slave_ds_array.count - wait_count;
+    }
+    __sync_add_and_fetch(&rpc->waiter->waiting_count, wait_count + 1);
 
     inactive_count = 0;
+    parked_count = 0;
     end = group->slave_ds_array.servers + group->slave_ds_array.count;
     for (ds=group->slave_ds_array.servers; ds<end; ds++) {
         status = __sync_fetch_and_add(&(*ds)->status, 0);
-        if (status == FS_SERVER_STATUS_ONLINE) {  //waiting for status change
-            do {
-                PTHREAD_MUTEX_LOCK(&(*ds)->replica.notify.lock);
-                pthread_cond_wait(&(*ds)->replica.notify.cond,
-                        &(*ds)->replica.notify.lock);
-                PTHREAD_MUTEX_UNLOCK(&(*ds)->replica.notify.lock);
-                status = __sync_fetch_and_add(&(*ds)->status, 0);
-            } while (status == FS_SERVER_STATUS_ONLINE && SF_G_CONTINUE_FLAG);
+        if (status == FS_SERVER_STATUS_ONLINE || __sync_add_and_fetch(
+                    &(*ds)->replica.parked.count, 0) > 0)
+        {
+            /* the parked copy is pushed when the ONLINE slave becomes
+             * ACTIVE, the writer goes on and the waiter waits for it */
+            if ((result=park_rpc_entry(*ds, rpc)) == 0) {
+                parked_count++;
+                continue;
+            } else if (result != EAGAIN) {
+                inactive_count++;
+                continue;
+            }
+            status = __sync_fetch_and_add(&(*ds)->status, 0);
         }
 
         if (status != FS_SERVER_STATUS_ACTIVE) {
@@ -134,48 +439,299 @@ static int push_to_slave_queues(FSClusterDataGroupInfo *group,
             continue;
         }
 
-        replication = (*ds)->cs->repl_ptr_array.replications[hash_code %
-            (*ds)->cs->repl_ptr_array.count];
+        replication = get_ds_replication(*ds, hash_code);
         if (!replication_channel_is_ready(replication)) {
-            int64_t data_version;
-
             cluster_relationship_swap_report_ds_status(*ds,
                     FS_SERVER_STATUS_ACTIVE, FS_SERVER_STATUS_OFFLINE,
                     FS_EVENT_SOURCE_MASTER_REPORT);
-            data_version = ((FSServerTaskArg *)rpc->task->arg)->
-                context.slice_op_ctx.info.data_version;
             logWarning("file: "__FILE__", line: %d, "
                     "the replica connection for peer id %d %s:%u "
                     "NOT established, skip the RPC call: %"PRId64, __LINE__,
                     (*ds)->cs->server->id, REPLICA_GROUP_ADDRESS_FIRST_IP(
                         (*ds)->cs->server), REPLICA_GROUP_ADDRESS_FIRST_PORT(
-                            (*ds)->cs->server), data_version);
+                            (*ds)->cs->server), rpc->data_version);
 
             inactive_count++;
             continue;
         }
 
+        if (group->chain_replication) {
+            /* only the chain head is sent by me */
+            if (chain_head == NULL) {
+                chain_head = replication;
+            } else {
+                rpc->chain_server_ids[rpc->chain_count++] =
+                    (*ds)->cs->server->id;
+                inactive_count++;
+            }
+            continue;
+        }
+
         push_to_slave_replica_queue(replication, rpc);
     }
 
-    if (inactive_count > 0) {
-        __sync_sub_and_fetch(&rpc->reffer_count, inactive_count);
+    if (chain_head != NULL) {
+        /* the response of the chain head covers the whole chain,
+         * the other servers of the chain are counted as inactive */
+        push_to_slave_replica_queue(chain_head, rpc);
     }
 
-    if (__sync_sub_and_fetch(&((FSServerTaskArg *)rpc->task->arg)->
-                context.service.waiting_rpc_count, inactive_count) == 0)
+    done = false;
+    if (rpc->waiter->quorum) {
+        /* the quorum can't be reached without the inactive slaves */
+        if (__sync_sub_and_fetch(&rpc->waiter->spare_count,
+                    inactive_count) < 0)
+        {
+            done = true;
+        }
+        done_count = 1;
+    } else {
+        /* wait for the active slaves only */
+        done_count = inactive_count + 1;
+    }
+    if (__sync_sub_and_fetch(&rpc->waiter->waiting_count, done_count) == 0) {
+        done = true;  //all slaves to wait responded already
+    }
+
+    if (done && __sync_bool_compare_and_swap(
+                &rpc->waiter->notified, 0, 1))
     {
-        return 0;
+        if (rpc->waiter->quorum && __sync_add_and_fetch(
+                    &rpc->waiter->waiting_count, 0) > 0)
+        {
+            result = ENOTCONN;
+        } else {
+            result = 0;
+        }
+        release_rpc_waiter(rpc->waiter, inactive_count + 1);
+    } else {
+        /* the pusher reference is released after waiting */
+        result = TASK_STATUS_CONTINUE;
+        release_rpc_waiter(rpc->waiter, inactive_count);
+    }
+
+    /* the parked slaves are sent the copies */
+    __sync_sub_and_fetch(&rpc->reffer_count, inactive_count + parked_count);
+    replication_caller_release_rpc_entry(rpc);
+    return result;
+}
+
+static void chain_forward_done(FSReplicaRPCWaiter *waiter)
+{
+    int result;
+
+    if ((result=replication_callee_push_to_rpc_result_queue(
+                    (FSReplication *)waiter->notify_arg,
+                    waiter->data_group_id, waiter->data_version,
+                    __sync_add_and_fetch(&waiter->result, 0))) != 0)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "data group id: %d, push the chain result fail, "
+                "data version: %"PRId64", errno: %d, error info: %s",
+                __LINE__, waiter->data_group_id, waiter->data_version,
+                result, STRERROR(result));
+    }
+}
+
+FSReplicaRPCWaiter *replication_caller_chain_forward(
+        FSReplication *upstream, const int data_group_id,
+        const uint64_t data_version, const unsigned char cmd,
+        const char *body, const int body_len,
+        const int *chain_server_ids, const int chain_count)
+{
+    FSReplicaRPCWaiter *waiter;
+    FSClusterDataServerInfo *ds;
+    FSReplication *replication;
+    ReplicationRPCEntry *rpc;
+
+    if ((waiter=alloc_rpc_waiter()) == NULL) {
+        return NULL;
+    }
+    waiter->notify_func = chain_forward_done;
+    waiter->notify_arg = upstream;
+    waiter->data_group_id = data_group_id;
+    waiter->data_version = data_version;
+
+    /* wait for the local update and the downstream, the local update
+     * holds the reference of the downstream until the RPC is sent */
+    waiter->reffer_count = 2;
+    waiter->waiting_count = 2;
+
+    ds = fs_get_data_server(data_group_id, chain_server_ids[0]);
+    if (ds == NULL || __sync_add_and_fetch(&ds->status, 0) !=
+            FS_SERVER_STATUS_ACTIVE)
+    {
+        replication = NULL;
     } else {
-        return TASK_STATUS_CONTINUE;
+        replication = get_ds_replication(ds, data_group_id);
+        if (!replication_channel_is_ready(replication)) {
+            replication = NULL;
+        }
+    }
+
+    rpc = NULL;
+    if (replication != NULL && (rpc=replication_caller_alloc_rpc_entry())
+            != NULL)
+    {
+        if ((rpc->body=(char *)fc_malloc(body_len)) == NULL) {
+            fast_mblock_free_object(&repl_mctx.rpc_allocator, rpc);
+            rpc = NULL;
+        }
+    }
+
+    if (rpc == NULL) {
+        logWarning("file: "__FILE__", line: %d, "
+                "data group id: %d, forward the RPC to the next server "
+                "id: %d of the chain fail, data version: %"PRId64,
+                __LINE__, data_group_id, chain_server_ids[0], data_version);
+
+        /* the upstream breaks the connection and the chain
+         * is rebuilt by the status change */
+        waiter->result = ENOTCONN;
+        waiter->reffer_count = 1;
+        waiter->waiting_count = 1;
+        return waiter;
+    }
+
+    memcpy(rpc->body, body, body_len);
+    rpc->body_copied = true;
+    rpc->body_length = body_len;
+    rpc->cmd = cmd;
+    rpc->data_group_id = data_group_id;
+    rpc->data_version = data_version;
+    rpc->create_time = g_current_time;
+    rpc->push_time_us = get_current_time_us();
+    rpc->waiter = waiter;
+    rpc->chain_count = chain_count - 1;
+    if (rpc->chain_count > 0) {
+        memcpy(rpc->chain_server_ids, chain_server_ids + 1,
+                sizeof(int) * rpc->chain_count);
+    }
+    rpc->reffer_count = 1;
+    waiter->chain_rpc = rpc;
+    waiter->downstream = replication;
+    return waiter;
+}
+
+void replication_caller_chain_local_done(FSReplicaRPCWaiter *waiter,
+        const int result)
+{
+    ReplicationRPCEntry *rpc;
+
+    if ((rpc=waiter->chain_rpc) == NULL) {
+        replication_caller_rpc_done(waiter, result);
+        return;
+    }
+
+    waiter->chain_rpc = NULL;
+    if (result == 0) {
+        push_to_slave_replica_queue(waiter->downstream, rpc);
+        replication_caller_rpc_done(waiter, result);
+        return;
+    }
+
+    /* the downstream must NOT apply the update failed locally,
+     * the upstream gets the local error */
+    rpc->waiter = NULL;
+    replication_caller_release_rpc_entry(rpc);
+    replication_caller_rpc_done(waiter, result);
+    replication_caller_rpc_done(waiter, result);
+}
+
+static void check_parked_timeouts(FSClusterDataServerInfo *ds)
+{
+    time_t create_time;
+    int status;
+
+    PTHREAD_MUTEX_LOCK(&ds->replica.notify.lock);
+    create_time = (ds->replica.parked.head != NULL ?
+            ds->replica.parked.head->create_time : 0);
+    PTHREAD_MUTEX_UNLOCK(&ds->replica.notify.lock);
+    if (create_time == 0) {
+        return;
+    }
+
+    status = __sync_add_and_fetch(&ds->status, 0);
+    if (status != FS_SERVER_STATUS_ONLINE) {  //missed the status change
+        replication_caller_resume_parked(ds);
+    } else if (g_current_time - create_time > SF_G_NETWORK_TIMEOUT) {
+        logWarning("file: "__FILE__", line: %d, "
+                "data group id: %d, peer id: %d, the slave is ONLINE "
+                "for more than %d seconds with %d parked RPCs, "
+                "set it to OFFLINE", __LINE__, ds->dg->id,
+                ds->cs->server->id, SF_G_NETWORK_TIMEOUT,
+                __sync_add_and_fetch(&ds->replica.parked.count, 0));
+        if (cluster_relationship_swap_report_ds_status(ds,
+                    FS_SERVER_STATUS_ONLINE, FS_SERVER_STATUS_OFFLINE,
+                    FS_EVENT_SOURCE_MASTER_REPORT))
+        {
+            __sync_add_and_fetch(&repl_mctx.parked_stat.timeouts, 1);
+        }
+    }
+}
+
+static int check_parked_timeouts_func(void *args)
+{
+    FSClusterDataGroupInfo *group;
+    FSClusterDataGroupInfo *gend;
+    FSClusterDataServerInfo **ds;
+    FSClusterDataServerInfo **end;
+
+    gend = CLUSTER_DATA_RGOUP_ARRAY.groups + CLUSTER_DATA_RGOUP_ARRAY.count;
+    for (group=CLUSTER_DATA_RGOUP_ARRAY.groups; group<gend; group++) {
+        end = group->slave_ds_array.servers + group->slave_ds_array.count;
+        for (ds=group->slave_ds_array.servers; ds<end; ds++) {
+            if (__sync_add_and_fetch(&(*ds)->replica.parked.count, 0) > 0) {
+                check_parked_timeouts(*ds);
+            }
+        }
     }
+
+    return 0;
 }
 
-int replication_caller_push_to_slave_queues(struct fast_task_info *task)
+static int log_parked_stat_func(void *args)
+{
+    ReplicationParkedStat *stat;
+    int64_t parked;
+    int64_t resumed;
+    int64_t discarded;
+    int64_t timeouts;
+
+    stat = &repl_mctx.parked_stat;
+    parked = __sync_add_and_fetch(&stat->parked, 0);
+    resumed = __sync_add_and_fetch(&stat->resumed, 0);
+    discarded = __sync_add_and_fetch(&stat->discarded, 0);
+    timeouts = __sync_add_and_fetch(&stat->timeouts, 0);
+    if (parked == stat->last_parked && resumed == stat->last_resumed &&
+            discarded == stat->last_discarded &&
+            timeouts == stat->last_timeouts)
+    {
+        return 0;
+    }
+
+    logInfo("file: "__FILE__", line: %d, "
+            "parked RPCs for the ONLINE slaves: %"PRId64", "
+            "resumed: %"PRId64", discarded: %"PRId64", slave timeouts: "
+            "%"PRId64", total parked: %"PRId64", total resumed: %"PRId64
+            ", total discarded: %"PRId64, __LINE__,
+            parked - stat->last_parked, resumed - stat->last_resumed,
+            discarded - stat->last_discarded, timeouts - stat->last_timeouts,
+            parked, resumed, discarded);
+    stat->last_parked = parked;
+    stat->last_resumed = resumed;
+    stat->last_discarded = discarded;
+    stat->last_timeouts = timeouts;
+    return 0;
+}
+
+int replication_caller_push_to_slave_queues(struct fast_task_info *task,
+        void (*notify_func)(FSReplicaRPCWaiter *waiter), void *notify_arg)
 {
     FSClusterDataGroupInfo *group;
     ReplicationRPCEntry *rpc;
     uint32_t hash_code;
+    int wait_count;
     int result;
 
     if ((group=fs_get_data_group(OP_CTX_INFO.data_group_id)) == NULL) {
@@ -190,14 +746,53 @@ int replication_caller_push_to_slave_queues(struct fast_task_info *task)
         return ENOMEM;
     }
 
-    rpc->task = task;
-    rpc->body_offset = OP_CTX_INFO.body - task->data;
+    if ((rpc->waiter=alloc_rpc_waiter()) == NULL) {
+        fast_mblock_free_object(&repl_mctx.rpc_allocator, rpc);
+        return ENOMEM;
+    }
+    rpc->waiter->notify_func = notify_func;
+    rpc->waiter->notify_arg = notify_arg;
+
+    /* the master is counted in the write quorum. the chain mode is
+     * all-or-nothing: the chain head responds after all servers of the
+     * chain are done, so the write quorum does NOT apply to it */
+    if (!group->chain_replication && group->write_quorum > 0 &&
+            group->write_quorum - 1 < group->slave_ds_array.count)
+    {
+        wait_count = group->write_quorum - 1;
+    } else {
+        wait_count = group->slave_ds_array.count;
+    }
+
+    rpc->cmd = ((FSProtoHeader *)task->data)->cmd;
+    rpc->data_group_id = OP_CTX_INFO.data_group_id;
+    rpc->data_version = OP_CTX_INFO.data_version;
+    rpc->create_time = g_current_time;
+    rpc->push_time_us = get_current_time_us();
     rpc->body_length = OP_CTX_INFO.body_len;
+    if (wait_count < group->slave_ds_array.count) {
+        /* the task is reused before the lagging slaves send the RPC */
+        if ((rpc->body=(char *)fc_malloc(rpc->body_length)) == NULL) {
+            fast_mblock_free_object(&repl_mctx.waiter_allocator,
+                    rpc->waiter);
+            fast_mblock_free_object(&repl_mctx.rpc_allocator, rpc);
+            return ENOMEM;
+        }
+        memcpy(rpc->body, OP_CTX_INFO.body, rpc->body_length);
+        rpc->body_copied = true;
+    } else {
+        rpc->body = OP_CTX_INFO.body;
+        rpc->body_copied = false;
+    }
+
     /* hash_code = FS_BLOCK_HASH_CODE(OP_CTX_INFO.bs_key.block); */
     hash_code = OP_CTX_INFO.data_group_id;
-    result = push_to_slave_queues(group, hash_code, rpc);
-    if (result != TASK_STATUS_CONTINUE) {
-        fast_mblock_free_object(&repl_mctx.rpc_allocator, rpc);
+    OP_CTX_INFO.rpc_waiter = rpc->waiter;
+    if ((result=push_to_slave_queues(group, hash_code, rpc,
+                    wait_count)) != TASK_STATUS_CONTINUE)
+    {
+        /* done synchronously, the waiter is released already */
+        OP_CTX_INFO.rpc_waiter = NULL;
     }
     return result;
 }
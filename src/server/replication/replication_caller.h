@@ -29,7 +29,37 @@ void replication_caller_destroy();
 
 void replication_caller_release_rpc_entry(ReplicationRPCEntry *rpc);
 
-int replication_caller_push_to_slave_queues(struct fast_task_info *task);
+/* the slave responded (result is 0), timeout or discarded */
+void replication_caller_rpc_done(FSReplicaRPCWaiter *waiter,
+        const int result);
+
+/* prepare the RPC for the next server of the chain, the RPC is sent by
+ * replication_caller_chain_local_done when the local update succeeded.
+ * the response is pushed to the upstream when both the local update and
+ * the downstream are done */
+FSReplicaRPCWaiter *replication_caller_chain_forward(
+        FSReplication *upstream, const int data_group_id,
+        const uint64_t data_version, const unsigned char cmd,
+        const char *body, const int body_len,
+        const int *chain_server_ids, const int chain_count);
+
+/* the local update of the chain forward is done, the RPC is sent to
+ * the downstream only when the local update succeeded */
+void replication_caller_chain_local_done(FSReplicaRPCWaiter *waiter,
+        const int result);
+
+/* resume or discard the parked RPCs when the slave status changed */
+void replication_caller_resume_parked(FSClusterDataServerInfo *ds);
+
+/* return TASK_STATUS_CONTINUE for waiting the slaves, the notify_func
+ * is called by the replication thread when the slaves responded.
+ * return ENOTCONN when the write quorum can't be reached */
+int replication_caller_push_to_slave_queues(struct fast_task_info *task,
+        void (*notify_func)(FSReplicaRPCWaiter *waiter), void *notify_arg);
+
+/* called by the notify_func, return ENOTCONN or the slave
+ * error when the write quorum is not reached */
+int replication_caller_finish_waiting(FSSliceOpContext *op_ctx);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <lz4.h>
+#include "fastcommon/logger.h"
+#include "fastcommon/shared_func.h"
+#include "fastcommon/sched_thread.h"
+#include "../server_global.h"
+#include "replication_compress.h"
+
+typedef struct {
+    volatile int64_t raw_bytes;        //the input of the compressed
+    volatile int64_t compressed_bytes; //the output of the compressed
+    volatile int64_t incompressible;   //the samples NOT compressed
+    volatile int64_t skipped_bytes;    //sent raw without trying
+    int64_t last_raw_bytes;
+    int64_t last_compressed_bytes;
+    int64_t last_incompressible;
+    int64_t last_skipped_bytes;
+} ReplicationCompressStat;
+
+static ReplicationCompressStat compress_stat;
+
+void replication_compress_get_stat(int64_t *raw_bytes,
+        int64_t *compressed_bytes, int64_t *incompressible,
+        int64_t *skipped_bytes)
+{
+    *raw_bytes = __sync_add_and_fetch(&compress_stat.raw_bytes, 0);
+    *compressed_bytes = __sync_add_and_fetch(
+            &compress_stat.compressed_bytes, 0);
+    *incompressible = __sync_add_and_fetch(&compress_stat.incompressible, 0);
+    *skipped_bytes = __sync_add_and_fetch(&compress_stat.skipped_bytes, 0);
+}
+
+static int log_compress_stat_func(void *args)
+{
+    ReplicationCompressStat *stat;
+    int64_t raw_bytes;
+    int64_t compressed_bytes;
+    int64_t incompressible;
+    int64_t skipped_bytes;
+
+    stat = &compress_stat;
+    raw_bytes = __sync_add_and_fetch(&stat->raw_bytes, 0);
+    compressed_bytes = __sync_add_and_fetch(&stat->compressed_bytes, 0);
+    incompressible = __sync_add_and_fetch(&stat->incompressible, 0);
+    skipped_bytes = __sync_add_and_fetch(&stat->skipped_bytes, 0);
+    if (raw_bytes == stat->last_raw_bytes &&
+            incompressible == stat->last_incompressible &&
+            skipped_bytes == stat->last_skipped_bytes)
+    {
+        return 0;
+    }
+
+    logInfo("file: "__FILE__", line: %d, "
+            "replica compression in last minute {raw: %"PRId64" KB, "
+            "compressed: %"PRId64" KB, ratio: %.2f%%, "
+            "incompressible samples: %"PRId64", skipped: %"PRId64" KB}, "
+            "total {raw: %"PRId64" KB, compressed: %"PRId64" KB, "
+            "ratio: %.2f%%}", __LINE__,
+            (raw_bytes - stat->last_raw_bytes) / 1024,
+            (compressed_bytes - stat->last_compressed_bytes) / 1024,
+            raw_bytes > stat->last_raw_bytes ? 100.00 * (double)
+            (compressed_bytes - stat->last_compressed_bytes) /
+            (double)(raw_bytes - stat->last_raw_bytes) : 100.00,
+            incompressible - stat->last_incompressible,
+            (skipped_bytes - stat->last_skipped_bytes) / 1024,
+            raw_bytes / 1024, compressed_bytes / 1024, raw_bytes > 0 ?
+            100.00 * (double)compressed_bytes / (double)raw_bytes : 100.00);
+
+    stat->last_raw_bytes = raw_bytes;
+    stat->last_compressed_bytes = compressed_bytes;
+    stat->last_incompressible = incompressible;
+    stat->last_skipped_bytes = skipped_bytes;
+    return 0;
+}
+
+int replication_compress_init()
+{
+    ScheduleArray scheduleArray;
+    ScheduleEntry scheduleEntry;
+
+    if (REPLICA_COMPRESSION == FS_REPLICA_COMPRESSION_NONE) {
+        return 0;
+    }
+
+    INIT_SCHEDULE_ENTRY(scheduleEntry, sched_generate_next_id(),
+           TIME_NONE, TIME_NONE, TIME_NONE, 60,
+            log_compress_stat_func, NULL);
+    scheduleArray.entries = &scheduleEntry;
+    scheduleArray.count = 1;
+    return sched_add_entries(&scheduleArray);
+}
+
+static int check_alloc_buffer(FSReplicaCompressBuffer *buffer,
+        const int size)
+{
+    char *buff;
+
+    if (buffer->size >= size) {
+        return 0;
+    }
+
+    if ((buff=(char *)fc_malloc(size)) == NULL) {
+        return ENOMEM;
+    }
+
+    if (buffer->buff != NULL) {
+        free(buffer->buff);
+    }
+    buffer->buff = buff;
+    buffer->size = size;
+    return 0;
+}
+
+bool replication_compress(FSReplicaCompressBuffer *buffer,
+        int *skip_count, char *data, int *length)
+{
+    int max_length;
+    int compressed_length;
+
+    if (*length < REPLICATION_COMPRESS_MIN_BYTES) {
+        return false;
+    }
+
+    if (skip_count != NULL && *skip_count > 0) {
+        --(*skip_count);
+        __sync_add_and_fetch(&compress_stat.skipped_bytes, *length);
+        return false;
+    }
+
+    /* saving less than 1/8 is NOT worth the decompression */
+    max_length = *length - *length / 8;
+    if (check_alloc_buffer(buffer, max_length) != 0) {
+        return false;
+    }
+
+    compressed_length = LZ4_compress_default(data, buffer->buff,
+            *length, max_length);
+    if (compressed_length <= 0) {  //incompressible
+        __sync_add_and_fetch(&compress_stat.incompressible, 1);
+        if (skip_count != NULL) {
+            *skip_count = REPLICATION_COMPRESS_SKIP_PACKAGES;
+        }
+        return false;
+    }
+
+    __sync_add_and_fetch(&compress_stat.raw_bytes, *length);
+    __sync_add_and_fetch(&compress_stat.compressed_bytes, compressed_length);
+    memcpy(data, buffer->buff, compressed_length);
+    *length = compressed_length;
+    return true;
+}
+
+int replication_decompress(const char *src, const int src_length,
+        char *dest, const int dest_size, const int expect_length)
+{
+    int length;
+
+    if (expect_length > dest_size) {
+        logError("file: "__FILE__", line: %d, "
+                "raw length: %d exceeds the buffer size: %d",
+                __LINE__, expect_length, dest_size);
+        return EOVERFLOW;
+    }
+
+    length = LZ4_decompress_safe(src, dest, src_length, expect_length);
+    if (length != expect_length) {
+        logError("file: "__FILE__", line: %d, "
+                "decompress fail, compressed length: %d, "
+                "raw length: %d != expected: %d", __LINE__,
+                src_length, length, expect_length);
+        return EINVAL;
+    }
+
+    return 0;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//replication_compress.h
+
+#ifndef _REPLICATION_COMPRESS_H_
+#define _REPLICATION_COMPRESS_H_
+
+#include "replication_types.h"
+
+/* the data shorter than this is sent raw */
+#define REPLICATION_COMPRESS_MIN_BYTES       512
+
+/* the packages sent raw after an incompressible sample */
+#define REPLICATION_COMPRESS_SKIP_PACKAGES    64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int replication_compress_init();
+
+/* the totals of the replica compression since startup */
+void replication_compress_get_stat(int64_t *raw_bytes,
+        int64_t *compressed_bytes, int64_t *incompressible,
+        int64_t *skipped_bytes);
+
+/* compress the data in place with LZ4.
+ * skip_count: the packages to skip for the incompressible data,
+ *             NULL for always trying
+ * return true for compressed, false for sent raw */
+bool replication_compress(FSReplicaCompressBuffer *buffer,
+        int *skip_count, char *data, int *length);
+
+/* decompress the data to dest, the raw length MUST be expect_length */
+int replication_decompress(const char *src, const int src_length,
+        char *dest, const int dest_size, const int expect_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
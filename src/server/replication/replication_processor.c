@@ -42,10 +42,85 @@
 #include "replication_common.h"
 #include "replication_caller.h"
 #include "replication_callee.h"
+#include "replication_compress.h"
 #include "replication_processor.h"
 
+typedef struct {
+    /* the RPC count of the packages: 1, 2-3, 4-7, ..., 128+ */
+    volatile int64_t sizes[FS_REPLICA_BATCH_HISTOGRAM_SIZE];
+
+    /* the delay of the oldest RPC in microseconds:
+     * < 50, < 100, < 200, < 500, < 1000, < 2000, < 5000, 5000+ */
+    volatile int64_t delays[FS_REPLICA_BATCH_HISTOGRAM_SIZE];
+
+    int64_t last_sizes[FS_REPLICA_BATCH_HISTOGRAM_SIZE];   //for stat log
+    int64_t last_delays[FS_REPLICA_BATCH_HISTOGRAM_SIZE];  //for stat log
+} ReplicationBatchStat;
+
+static ReplicationBatchStat batch_stat;
+
 static void replication_queue_discard_all(FSReplication *replication);
 
+void replication_processor_get_batch_stat(int64_t *sizes, int64_t *delays)
+{
+    int i;
+
+    for (i=0; i<FS_REPLICA_BATCH_HISTOGRAM_SIZE; i++) {
+        sizes[i] = __sync_add_and_fetch(&batch_stat.sizes[i], 0);
+        delays[i] = __sync_add_and_fetch(&batch_stat.delays[i], 0);
+    }
+}
+
+static int log_batch_stat_func(void *args)
+{
+    int64_t sizes[FS_REPLICA_BATCH_HISTOGRAM_SIZE];
+    int64_t delays[FS_REPLICA_BATCH_HISTOGRAM_SIZE];
+    int64_t current;
+    int64_t packages;
+    int i;
+
+    packages = 0;
+    for (i=0; i<FS_REPLICA_BATCH_HISTOGRAM_SIZE; i++) {
+        current = __sync_add_and_fetch(&batch_stat.sizes[i], 0);
+        sizes[i] = current - batch_stat.last_sizes[i];
+        batch_stat.last_sizes[i] = current;
+
+        current = __sync_add_and_fetch(&batch_stat.delays[i], 0);
+        delays[i] = current - batch_stat.last_delays[i];
+        batch_stat.last_delays[i] = current;
+        packages += sizes[i];
+    }
+    if (packages == 0) {
+        return 0;
+    }
+
+    logInfo("file: "__FILE__", line: %d, "
+            "replica RPC packages: %"PRId64", RPC count histogram "
+            "{1: %"PRId64", 2+: %"PRId64", 4+: %"PRId64", 8+: %"PRId64", "
+            "16+: %"PRId64", 32+: %"PRId64", 64+: %"PRId64", "
+            "128+: %"PRId64"}, delay us histogram {< 50: %"PRId64", "
+            "< 100: %"PRId64", < 200: %"PRId64", < 500: %"PRId64", "
+            "< 1000: %"PRId64", < 2000: %"PRId64", < 5000: %"PRId64", "
+            "5000+: %"PRId64"}", __LINE__, packages, sizes[0], sizes[1],
+            sizes[2], sizes[3], sizes[4], sizes[5], sizes[6], sizes[7],
+            delays[0], delays[1], delays[2], delays[3], delays[4],
+            delays[5], delays[6], delays[7]);
+    return 0;
+}
+
+int replication_processor_init()
+{
+    ScheduleArray scheduleArray;
+    ScheduleEntry scheduleEntry;
+
+    INIT_SCHEDULE_ENTRY(scheduleEntry, sched_generate_next_id(),
+           TIME_NONE, TIME_NONE, TIME_NONE, 60,
+            log_batch_stat_func, NULL);
+    scheduleArray.entries = &scheduleEntry;
+    scheduleArray.count = 1;
+    return sched_add_entries(&scheduleArray);
+}
+
 static int alloc_replication_ptr_array(FSReplicationPtrArray *array)
 {
     int bytes;
@@ -277,25 +352,39 @@ static int check_and_make_replica_connection(FSReplication *replication)
 static int send_join_server_package(FSReplication *replication)
 {
 	int result;
+    int out_bytes;
 	FSProtoHeader *header;
     FSProtoJoinServerReq *req;
-	char out_buff[sizeof(FSProtoHeader) + sizeof(FSProtoJoinServerReq)];
+    FSProtoJoinServerReqExt *ext;
+	char out_buff[sizeof(FSProtoHeader) + sizeof(FSProtoJoinServerReq) +
+        sizeof(FSProtoJoinServerReqExt)];
+
+    /* the older servers accept the join request without the extension */
+    out_bytes = sizeof(FSProtoHeader) + sizeof(FSProtoJoinServerReq);
+    if (REPLICA_COMPRESSION != FS_REPLICA_COMPRESSION_NONE) {
+        ext = (FSProtoJoinServerReqExt *)(out_buff + out_bytes);
+        ext->compression = REPLICA_COMPRESSION;
+        memset(ext->padding, 0, sizeof(ext->padding));
+        out_bytes += sizeof(FSProtoJoinServerReqExt);
+    }
 
     header = (FSProtoHeader *)out_buff;
     SF_PROTO_SET_HEADER(header, FS_REPLICA_PROTO_JOIN_SERVER_REQ,
-            sizeof(out_buff) - sizeof(FSProtoHeader));
+            out_bytes - sizeof(FSProtoHeader));
 
     req = (FSProtoJoinServerReq *)(out_buff + sizeof(FSProtoHeader));
     int2buff(CLUSTER_MY_SERVER_ID, req->server_id);
     int2buff(replication->task->size, req->buffer_size);
     int2buff(REPLICA_CHANNELS_BETWEEN_TWO_SERVERS,
             req->replica_channels_between_two_servers);
+    replication->compress.enabled = false;  //set by the join response
+    replication->compress.skip_count = 0;
     memcpy(req->config_signs.servers, SERVERS_CONFIG_SIGN_BUF,
             SERVERS_CONFIG_SIGN_LEN);
     memcpy(req->config_signs.cluster, CLUSTER_CONFIG_SIGN_BUF,
             CLUSTER_CONFIG_SIGN_LEN);
     if ((result=tcpsenddata_nb(replication->connection_info.conn.sock,
-                    out_buff, sizeof(out_buff), SF_G_NETWORK_TIMEOUT)) != 0)
+                    out_buff, out_bytes, SF_G_NETWORK_TIMEOUT)) != 0)
     {
         logError("file: "__FILE__", line: %d, "
                 "send data to server %s:%u fail, "
@@ -312,19 +401,6 @@ static int send_join_server_package(FSReplication *replication)
     return result;
 }
 
-static void decrease_task_waiting_rpc_count(ReplicationRPCEntry *rb)
-{
-    FSServerTaskArg *task_arg;
-
-    task_arg = (FSServerTaskArg *)rb->task->arg;
-    if (__sync_sub_and_fetch(&task_arg->context.service.
-                waiting_rpc_count, 1) == 0)
-    {
-        data_thread_notify((FSDataThreadContext *)
-                task_arg->context.slice_op_ctx.arg);
-    }
-}
-
 static void discard_queue(FSReplication *replication,
         ReplicationRPCEntry *head)
 {
@@ -333,7 +409,12 @@ static void discard_queue(FSReplication *replication,
         rb = head;
         head = head->nexts[replication->peer->link_index];
 
-        decrease_task_waiting_rpc_count(rb);
+        __sync_sub_and_fetch(&replication->context.caller.queued_rpcs, 1);
+        __sync_sub_and_fetch(&replication->context.caller.queued_bytes,
+                REPLICATION_RPC_PKG_SIZE(rb));
+        if (rb->waiter != NULL) {
+            replication_caller_rpc_done(rb->waiter, ECONNRESET);
+        }
         replication_caller_release_rpc_entry(rb);
     }
 }
@@ -342,6 +423,14 @@ static void replication_queue_discard_all(FSReplication *replication)
 {
     struct fc_queue_info qinfo;
 
+    if (replication->context.caller.batch.head != NULL) {
+        discard_queue(replication, replication->context.caller.batch.head);
+        replication->context.caller.batch.head = NULL;
+        replication->context.caller.batch.tail = NULL;
+        replication->context.caller.batch.count = 0;
+        replication->context.caller.batch.bytes = 0;
+    }
+
     fc_queue_pop_to_queue(&replication->context.caller.rpc_queue, &qinfo);
     if (qinfo.head != NULL) {
         discard_queue(replication, (ReplicationRPCEntry *)qinfo.head);
@@ -460,27 +549,126 @@ void clean_connected_replications(FSServerContext *server_ctx)
     }
 }
 
-static int replication_rpc_from_queue(FSReplication *replication)
+static inline int get_histogram_index(const int64_t value,
+        const int *bounds, const int count)
+{
+    int i;
+
+    for (i=0; i<count; i++) {
+        if (value < bounds[i]) {
+            return i;
+        }
+    }
+    return count;
+}
+
+static void batch_append_from_queue(FSReplication *replication)
 {
     struct fc_queue_info qinfo;
     ReplicationRPCEntry *rb;
+    int link_index;
+
+    fc_queue_pop_to_queue(&replication->context.caller.rpc_queue, &qinfo);
+    if (qinfo.head == NULL) {
+        return;
+    }
+
+    if (replication->context.caller.batch.head == NULL) {
+        replication->context.caller.batch.head = qinfo.head;
+        replication->context.caller.batch.first_time_us =
+            get_current_time_us();
+    } else {
+        replication->context.caller.batch.tail->nexts[replication->
+            peer->link_index] = qinfo.head;
+    }
+    replication->context.caller.batch.tail = qinfo.tail;
+
+    link_index = replication->peer->link_index;
+    for (rb=qinfo.head; rb!=NULL; rb=rb->nexts[link_index]) {
+        replication->context.caller.batch.count++;
+        replication->context.caller.batch.bytes += REPLICATION_RPC_PKG_SIZE(rb);
+    }
+}
+
+/* hold the RPCs when the channel is busy, the responses of the
+ * RPCs waiting wake up the nio thread to check again, and the poll
+ * timeout wakes it up when the delay passed */
+static inline bool batch_should_hold(FSReplication *replication,
+        const int64_t current_time_us)
+{
+    int max_bytes;
+
+    if (REPLICA_BATCH_DELAY_US <= 0 || replication->context.
+            caller.rpc_result_ctx.waiting_count <= 0)
+    {
+        return false;
+    }
+
+    max_bytes = FC_MIN(REPLICA_BATCH_MAX_BYTES, replication->task->size -
+            (int)(sizeof(FSProtoHeader) +
+                sizeof(FSProtoReplicaRPCReqBodyHeader)));
+    return replication->context.caller.batch.bytes < max_bytes &&
+        current_time_us - replication->context.caller.batch.
+        first_time_us < REPLICA_BATCH_DELAY_US;
+}
+
+static void compress_rpc_package(FSReplication *replication,
+        FSProtoReplicaRPCReqBodyHeader *body_header)
+{
+    FSServerContext *server_ctx;
+    char *parts;
+    int raw_length;
+    int length;
+
+    server_ctx = (FSServerContext *)replication->task->thread_data->arg;
+    parts = (char *)(body_header + 1);
+    raw_length = (replication->task->data + replication->task->length) - parts;
+    length = raw_length;
+    if (replication_compress(&server_ctx->replica.compress_buffer,
+                &replication->compress.skip_count, parts, &length))
+    {
+        int2buff(raw_length, body_header->raw_length);
+        replication->task->length -= raw_length - length;
+    } else {
+        int2buff(0, body_header->raw_length);
+    }
+}
+
+static int replication_rpc_from_queue(FSReplication *replication)
+{
+    const int size_bounds[FS_REPLICA_BATCH_HISTOGRAM_SIZE - 1] =
+        {2, 4, 8, 16, 32, 64, 128};
+    const int delay_bounds[FS_REPLICA_BATCH_HISTOGRAM_SIZE - 1] =
+        {50, 100, 200, 500, 1000, 2000, 5000};
+    ReplicationRPCEntry *rb;
     ReplicationRPCEntry *deleted;
     struct fast_task_info *task;
     FSProtoReplicaRPCReqBodyHeader *body_header;
     FSProtoReplicaRPCReqBodyPart *body_part;
+    char *p;
+    int64_t current_time_us;
+    int64_t delay_us;
     uint64_t data_version;
     int data_group_id;
     int count;
     int body_len;
     int pkg_len;
     int result;
+    int i;
 
-    fc_queue_pop_to_queue(&replication->context.caller.rpc_queue, &qinfo);
-    if (qinfo.head == NULL) {
+    batch_append_from_queue(replication);
+    if (replication->context.caller.batch.head == NULL) {
+        return 0;
+    }
+
+    current_time_us = get_current_time_us();
+    if (batch_should_hold(replication, current_time_us)) {
         return 0;
     }
+    delay_us = current_time_us - replication->context.
+        caller.batch.first_time_us;
 
-    rb = qinfo.head;
+    rb = replication->context.caller.batch.head;
     count = 0;
     task = replication->task;
     task->length = sizeof(FSProtoHeader) +
@@ -488,23 +676,21 @@ static int replication_rpc_from_queue(FSReplication *replication)
     do {
         body_part = (FSProtoReplicaRPCReqBodyPart *)(task->data +
                 task->length);
-        pkg_len = task->length + sizeof(*body_part) + rb->body_length;
+        pkg_len = task->length + REPLICATION_RPC_PKG_SIZE(rb);
         if (pkg_len > task->size) {
-            bool notify;
-
-            qinfo.head = rb;
-            fc_queue_push_queue_to_head_ex(&replication->context.caller.rpc_queue,
-                    &qinfo, &notify);
             break;
         }
 
-        body_part->cmd = ((FSProtoHeader *)rb->task->data)->cmd;
-        data_group_id = ((FSServerTaskArg *)rb->task->arg)->
-            context.slice_op_ctx.info.data_group_id;
-        data_version = ((FSServerTaskArg *)rb->task->arg)->
-            context.slice_op_ctx.info.data_version;
-        memcpy(body_part->body, rb->task->data +
-                rb->body_offset, rb->body_length);
+        body_part->cmd = rb->cmd;
+        data_group_id = rb->data_group_id;
+        data_version = rb->data_version;
+        memcpy(body_part->body, rb->body, rb->body_length);
+        body_part->chain_count = rb->chain_count;
+        p = body_part->body + rb->body_length;
+        for (i=0; i<rb->chain_count; i++) {
+            int2buff(rb->chain_server_ids[i], p);
+            p += 4;
+        }
 
         ++count;
         task->length = pkg_len;
@@ -512,7 +698,8 @@ static int replication_rpc_from_queue(FSReplication *replication)
         int2buff(rb->body_length, body_part->body_len);
         if ((result=rpc_result_ring_add(&replication->context.caller.
                         rpc_result_ctx, data_group_id, data_version,
-                        rb->task)) != 0)
+                        rb->waiter, rb->push_time_us,
+                        REPLICATION_RPC_PKG_SIZE(rb))) != 0)
         {
             sf_terminate_myself();
             return result;
@@ -521,17 +708,40 @@ static int replication_rpc_from_queue(FSReplication *replication)
         deleted = rb;
         rb = rb->nexts[replication->peer->link_index];
 
+        replication->context.caller.batch.count--;
+        replication->context.caller.batch.bytes -=
+            REPLICATION_RPC_PKG_SIZE(deleted);
+        __sync_sub_and_fetch(&replication->context.caller.queued_rpcs, 1);
+        __sync_sub_and_fetch(&replication->context.caller.queued_bytes,
+                REPLICATION_RPC_PKG_SIZE(deleted));
         replication_caller_release_rpc_entry(deleted);
     } while (rb != NULL);
 
+    replication->context.caller.batch.head = rb;
+    if (rb == NULL) {
+        replication->context.caller.batch.tail = NULL;
+    } else {  //the left RPCs are sent without delay next time
+        replication->context.caller.batch.first_time_us = 0;
+    }
+
     if (count == 0) {
         return 0;
     }
 
+    __sync_add_and_fetch(&batch_stat.sizes[get_histogram_index(count,
+                size_bounds, FS_REPLICA_BATCH_HISTOGRAM_SIZE - 1)], 1);
+    __sync_add_and_fetch(&batch_stat.delays[get_histogram_index(delay_us,
+                delay_bounds, FS_REPLICA_BATCH_HISTOGRAM_SIZE - 1)], 1);
+
     body_header = (FSProtoReplicaRPCReqBodyHeader *)
         (task->data + sizeof(FSProtoHeader));
-    body_len = task->length - sizeof(FSProtoHeader);
     int2buff(count, body_header->count);
+    if (replication->compress.enabled) {
+        compress_rpc_package(replication, body_header);
+    } else {
+        int2buff(0, body_header->raw_length);
+    }
+    body_len = task->length - sizeof(FSProtoHeader);
 
     SF_PROTO_SET_HEADER((FSProtoHeader *)task->data,
             FS_REPLICA_PROTO_RPC_REQ, body_len);
@@ -581,9 +791,48 @@ static int deal_connected_replication(FSReplication *replication)
     return 0;
 }
 
-static int deal_replication_connected(FSServerContext *server_ctx)
+static inline int64_t get_batch_hold_us(FSReplication *replication,
+        const int64_t current_time_us)
+{
+    int64_t hold_us;
+
+    if (replication->context.caller.batch.head == NULL ||
+            replication->context.caller.batch.first_time_us == 0)
+    {
+        return 0;
+    }
+
+    hold_us = replication->context.caller.batch.first_time_us +
+        REPLICA_BATCH_DELAY_US - current_time_us;
+    return hold_us > 0 ? hold_us : 0;
+}
+
+/* shorten the poll timeout of the nio thread to the remaining delay of
+ * the held batches, so the batch is sent on the next loop in time even
+ * without the responses, and restore it when nothing is held */
+static void set_poll_timeout(FSServerContext *server_ctx,
+        struct nio_thread_data *thread_data, const int64_t hold_us)
+{
+    if (hold_us > 0) {
+        if (server_ctx->replica.saved_poll_timeout == 0) {
+            server_ctx->replica.saved_poll_timeout =
+                thread_data->ev_puller.timeout;
+        }
+        ioevent_set_timeout(&thread_data->ev_puller, (hold_us + 999) / 1000);
+    } else if (server_ctx->replica.saved_poll_timeout != 0) {
+        ioevent_set_timeout(&thread_data->ev_puller,
+                server_ctx->replica.saved_poll_timeout);
+        server_ctx->replica.saved_poll_timeout = 0;
+    }
+}
+
+static int deal_replication_connected(FSServerContext *server_ctx,
+        struct nio_thread_data *thread_data)
 {
     FSReplication *replication;
+    int64_t current_time_us;
+    int64_t hold_us;
+    int64_t min_hold_us;
     int result;
     int i;
     bool send_hb;
@@ -597,9 +846,13 @@ static int deal_replication_connected(FSServerContext *server_ctx)
     */
 
     if (server_ctx->replica.connected.count == 0) {
+        if (server_ctx->replica.saved_poll_timeout != 0) {
+            set_poll_timeout(server_ctx, thread_data, 0);
+        }
         return 0;
     }
 
+    min_hold_us = 0;
     for (i=0; i<server_ctx->replica.connected.count; i++) {
         replication = server_ctx->replica.connected.replications[i];
         if ((result=deal_connected_replication(replication)) == 0) {
@@ -610,6 +863,16 @@ static int deal_replication_connected(FSServerContext *server_ctx)
             continue;
         }
 
+        if (REPLICA_BATCH_DELAY_US > 0) {
+            current_time_us = get_current_time_us();
+            if ((hold_us=get_batch_hold_us(replication,
+                            current_time_us)) > 0 && (min_hold_us == 0 ||
+                        hold_us < min_hold_us))
+            {
+                min_hold_us = hold_us;
+            }
+        }
+
         if (replication->is_client) {
             send_hb = g_current_time - replication->last_net_comm_time >=
                 g_server_global_vars.replica.active_test_interval;
@@ -633,10 +896,14 @@ static int deal_replication_connected(FSServerContext *server_ctx)
         }
     }
 
+    if (REPLICA_BATCH_DELAY_US > 0) {
+        set_poll_timeout(server_ctx, thread_data, min_hold_us);
+    }
     return 0;
 }
 
-int replication_processor_process(FSServerContext *server_ctx)
+int replication_processor_process(FSServerContext *server_ctx,
+        struct nio_thread_data *thread_data)
 {
     int result;
 
@@ -653,5 +920,5 @@ int replication_processor_process(FSServerContext *server_ctx)
         return result;
     }
 
-    return deal_replication_connected(server_ctx);
+    return deal_replication_connected(server_ctx, thread_data);
 }
@@ -25,6 +25,11 @@
 extern "C" {
 #endif
 
+int replication_processor_init();
+
+/* the totals of the replica package histograms since startup */
+void replication_processor_get_batch_stat(int64_t *sizes, int64_t *delays);
+
 int replication_alloc_connection_ptr_arrays(FSServerContext *server_context);
 
 //replication server side
@@ -37,7 +42,8 @@ int replication_processor_bind_thread(FSReplication *replication);
 //replication server and client
 int replication_processor_unbind(FSReplication *replication);
 
-int replication_processor_process(FSServerContext *server_ctx);
+int replication_processor_process(FSServerContext *server_ctx,
+        struct nio_thread_data *thread_data);
 
 void clean_connected_replications(FSServerContext *server_ctx);
 
@@ -21,16 +21,29 @@
 #include <time.h>
 #include <limits.h>
 #include <pthread.h>
+#include "../../common/fs_proto.h"
 #include "../server_types.h"
 
 typedef struct replication_rpc_entry {
-    struct fast_task_info *task;
     volatile short reffer_count;
-    short body_offset;
+    unsigned char cmd;
+    bool body_copied;  //copy the body when the task may finish earlier
+    int data_group_id;
+    uint64_t data_version;
+    char *body;
     int body_length;
+    time_t create_time;
+    int64_t push_time_us;  //for the replica lag
+    FSReplicaRPCWaiter *waiter;  //NULL for nobody waiting
+    int chain_count;   //the servers to forward by the receiver
+    int *chain_server_ids;  //point to the space after nexts
     struct replication_rpc_entry *nexts[0];  //for slave replications
 } ReplicationRPCEntry;
 
+/* the size of the RPC part in the replica package */
+#define REPLICATION_RPC_PKG_SIZE(rpc) (sizeof(FSProtoReplicaRPCReqBodyPart) \
+        + (rpc)->body_length + 4 * (rpc)->chain_count)
+
 typedef struct replication_rpc_result {
     FSReplication *replication;
     short err_no;
@@ -33,8 +33,11 @@
 #include "../../common/fs_cluster_cfg.h"
 #include "../server_global.h"
 #include "../data_thread.h"
+#include "replication_caller.h"
 #include "rpc_result_ring.h"
 
+#define RPC_RESULT_HTABLE_MIN_CAPACITY  1024
+
 static int init_rpc_result_instance(FSReplicaRPCResultInstance *instance,
         const int alloc_size)
 {
@@ -50,34 +53,29 @@ static int init_rpc_result_instance(FSReplicaRPCResultInstance *instance,
     instance->ring.start = instance->ring.end = instance->ring.entries;
     instance->ring.size = alloc_size;
     instance->queue.head = instance->queue.tail = NULL;
+    instance->queue.count = 0;
+    instance->queue.htable.buckets = NULL;  //alloc when overflow
+    instance->queue.htable.capacity = 0;
     return 0;
 }
 
-int rpc_result_ring_check_init(FSReplicaRPCResultContext *ctx,
-        const int alloc_size)
+int rpc_result_ring_init_ex(FSReplicaRPCResultContext *ctx,
+        const int dg_base_id, const int dg_count, const int alloc_size)
 {
     int bytes;
     int result;
-    FSIdArray *id_array;
     FSReplicaRPCResultInstance *instance;
     FSReplicaRPCResultInstance *end;
 
-    if (ctx->instances != NULL) {
-        return 0;
-    }
-
-    id_array = fs_cluster_cfg_get_my_data_group_ids(&CLUSTER_CONFIG_CTX,
-            CLUSTER_MYSELF_PTR->server->id);
-    ctx->dg_base_id = fs_cluster_cfg_get_min_data_group_id(id_array);
-
-    bytes = sizeof(FSReplicaRPCResultInstance) * id_array->count;
+    bytes = sizeof(FSReplicaRPCResultInstance) * dg_count;
     ctx->instances = (FSReplicaRPCResultInstance *)fc_malloc(bytes);
     if (ctx->instances == NULL) {
         return ENOMEM;
     }
     memset(ctx->instances, 0, bytes);
 
-    ctx->dg_count = id_array->count;
+    ctx->dg_base_id = dg_base_id;
+    ctx->dg_count = dg_count;
     end = ctx->instances + ctx->dg_count;
     for (instance=ctx->instances; instance<end; instance++) {
         instance->data_group_id = ctx->dg_base_id +
@@ -92,26 +90,135 @@ int rpc_result_ring_check_init(FSReplicaRPCResultContext *ctx,
         0, NULL, NULL, false);
 }
 
-static inline void desc_task_waiting_rpc_count(
-        FSReplicaRPCResultInstance *instance,
-        FSReplicaRPCResultEntry *entry)
+int rpc_result_ring_check_init(FSReplicaRPCResultContext *ctx,
+        const int alloc_size)
+{
+    FSIdArray *id_array;
+
+    if (ctx->instances != NULL) {
+        return 0;
+    }
+
+    id_array = fs_cluster_cfg_get_my_data_group_ids(&CLUSTER_CONFIG_CTX,
+            CLUSTER_MYSELF_PTR->server->id);
+    return rpc_result_ring_init_ex(ctx, fs_cluster_cfg_get_min_data_group_id(
+                id_array), id_array->count, alloc_size);
+}
+
+static inline int get_rtt_index(const int64_t rtt_us)
 {
-    FSServerTaskArg *task_arg;
+    const int bounds[FS_REPLICA_RTT_HISTOGRAM_SIZE - 1] =
+        {1000, 2000, 5000, 10000, 20000, 50000, 100000};
+    int i;
 
-    if (entry->waiting_task == NULL) {
-        logWarning("file: "__FILE__", line: %d, "
-                "task is NULL, data group id: %d, data_version: %"PRId64,
-                __LINE__, instance->data_group_id, entry->data_version);
+    for (i=0; i<FS_REPLICA_RTT_HISTOGRAM_SIZE - 1; i++) {
+        if (rtt_us < bounds[i]) {
+            return i;
+        }
+    }
+    return FS_REPLICA_RTT_HISTOGRAM_SIZE - 1;
+}
+
+static inline void rpc_result_entry_done(FSReplicaRPCResultContext *ctx,
+        FSReplicaRPCResultEntry *entry, const int result)
+{
+    int64_t current_time_us;
+
+    ctx->waiting_count--;
+    ctx->waiting_bytes -= entry->pkg_size;
+    if (result == 0) {
+        current_time_us = get_current_time_us();
+        ctx->rtt_counts[get_rtt_index(current_time_us -
+                entry->send_time_us)]++;
+        ctx->last_lag_us = current_time_us - entry->push_time_us;
+    } else if (result == ETIMEDOUT) {
+        ctx->timeouts++;
+    }
+
+    if (entry->waiter == NULL) {  //nobody waiting
         return;
     }
 
-    task_arg = (FSServerTaskArg *)entry->waiting_task->arg;
-    if (__sync_sub_and_fetch(&task_arg->context.
-                service.waiting_rpc_count, 1) == 0)
-    {
-        data_thread_notify((FSDataThreadContext *)
-                task_arg->context.slice_op_ctx.arg);
+    replication_caller_rpc_done(entry->waiter, result);
+}
+
+static inline FSReplicaRPCResultEntry **queue_htable_bucket(
+        FSReplicaRPCResultInstance *instance, const uint64_t data_version)
+{
+    return instance->queue.htable.buckets + data_version %
+        instance->queue.htable.capacity;
+}
+
+static inline FSReplicaRPCResultEntry *queue_htable_remove(
+        FSReplicaRPCResultInstance *instance, const uint64_t data_version)
+{
+    FSReplicaRPCResultEntry **pp;
+    FSReplicaRPCResultEntry *entry;
+
+    pp = queue_htable_bucket(instance, data_version);
+    while (*pp != NULL && (*pp)->data_version != data_version) {
+        pp = &(*pp)->hash_next;
+    }
+
+    if ((entry=*pp) != NULL) {
+        *pp = entry->hash_next;
+    }
+    return entry;
+}
+
+static inline void queue_unlink(FSReplicaRPCResultInstance *instance,
+        FSReplicaRPCResultEntry *entry)
+{
+    if (entry->prev == NULL) {
+        instance->queue.head = entry->next;
+    } else {
+        entry->prev->next = entry->next;
+    }
+
+    if (entry->next == NULL) {
+        instance->queue.tail = entry->prev;
+    } else {
+        entry->next->prev = entry->prev;
+    }
+    instance->queue.count--;
+}
+
+static int queue_htable_expand(FSReplicaRPCResultInstance *instance)
+{
+    FSReplicaRPCResultEntry **old_buckets;
+    FSReplicaRPCResultEntry *entry;
+    FSReplicaRPCResultEntry **bucket;
+    int capacity;
+    int bytes;
+
+    if (instance->queue.htable.capacity == 0) {
+        capacity = FC_MAX(instance->ring.size,
+                RPC_RESULT_HTABLE_MIN_CAPACITY);
+    } else {
+        capacity = instance->queue.htable.capacity * 2;
+    }
+
+    bytes = sizeof(FSReplicaRPCResultEntry *) * capacity;
+    old_buckets = instance->queue.htable.buckets;
+    instance->queue.htable.buckets = (FSReplicaRPCResultEntry **)
+        fc_malloc(bytes);
+    if (instance->queue.htable.buckets == NULL) {
+        instance->queue.htable.buckets = old_buckets;
+        return ENOMEM;
+    }
+    memset(instance->queue.htable.buckets, 0, bytes);
+    instance->queue.htable.capacity = capacity;
+
+    for (entry=instance->queue.head; entry!=NULL; entry=entry->next) {
+        bucket = queue_htable_bucket(instance, entry->data_version);
+        entry->hash_next = *bucket;
+        *bucket = entry;
     }
+
+    if (old_buckets != NULL) {
+        free(old_buckets);
+    }
+    return 0;
 }
 
 static void rpc_result_instance_clear_queue_all(FSReplicaRPCResultContext *ctx,
@@ -129,11 +236,14 @@ static void rpc_result_instance_clear_queue_all(FSReplicaRPCResultContext *ctx,
         deleted = current;
         current = current->next;
 
-        desc_task_waiting_rpc_count(instance, deleted);
+        rpc_result_entry_done(ctx, deleted, ECONNRESET);
         fast_mblock_free_object(&ctx->rentry_allocator, deleted);
     }
 
     instance->queue.head = instance->queue.tail = NULL;
+    instance->queue.count = 0;
+    memset(instance->queue.htable.buckets, 0, sizeof(FSReplicaRPCResultEntry *)
+            * instance->queue.htable.capacity);
 }
 
 static void rpc_result_instance_clear_all(FSReplicaRPCResultContext *ctx,
@@ -148,9 +258,11 @@ static void rpc_result_instance_clear_all(FSReplicaRPCResultContext *ctx,
 
     index = instance->ring.start - instance->ring.entries;
     while (instance->ring.start != instance->ring.end) {
-        desc_task_waiting_rpc_count(instance, instance->ring.start);
-        instance->ring.start->data_version = 0;
-        instance->ring.start->waiting_task = NULL;
+        if (instance->ring.start->data_version != 0) {  //skip the acked
+            rpc_result_entry_done(ctx, instance->ring.start, ECONNRESET);
+            instance->ring.start->data_version = 0;
+            instance->ring.start->waiter = NULL;
+        }
 
         instance->ring.start = instance->ring.entries +
             (++index % instance->ring.size);
@@ -192,12 +304,13 @@ static int rpc_result_instance_clear_queue_timeouts(
         deleted = current;
         current = current->next;
 
+        queue_htable_remove(instance, deleted->data_version);
         logWarning("file: "__FILE__", line: %d, "
                 "waiting push response timeout, "
-                "data group id: %d, data_version: %"PRId64", task: %p",
+                "data group id: %d, data_version: %"PRId64", waiter: %p",
                 __LINE__, instance->data_group_id, deleted->data_version,
-                deleted->waiting_task);
-        desc_task_waiting_rpc_count(instance, deleted);
+                deleted->waiter);
+        rpc_result_entry_done(ctx, deleted, ETIMEDOUT);
         fast_mblock_free_object(&ctx->rentry_allocator, deleted);
         ++count;
     }
@@ -205,7 +318,10 @@ static int rpc_result_instance_clear_queue_timeouts(
     instance->queue.head = current;
     if (current == NULL) {
         instance->queue.tail = NULL;
+    } else {
+        current->prev = NULL;
     }
+    instance->queue.count -= count;
 
     return count;
 }
@@ -221,21 +337,25 @@ static void rpc_result_instance_clear_timeouts(
     if (instance->ring.start != instance->ring.end) {
         index = instance->ring.start - instance->ring.entries;
         while (instance->ring.start != instance->ring.end &&
-                instance->ring.start->expires < g_current_time)
+                (instance->ring.start->data_version == 0 ||
+                 instance->ring.start->expires < g_current_time))
         {
-            logWarning("file: "__FILE__", line: %d, "
-                    "waiting push response timeout, "
-                    "data group id: %d, data_version: %"PRId64,
-                    __LINE__, instance->data_group_id,
-                    instance->ring.start->data_version);
-
-            desc_task_waiting_rpc_count(instance, instance->ring.start);
-            instance->ring.start->data_version = 0;
-            instance->ring.start->waiting_task = NULL;
+            /* the entry acked out of order is done already */
+            if (instance->ring.start->data_version != 0) {
+                logWarning("file: "__FILE__", line: %d, "
+                        "waiting push response timeout, "
+                        "data group id: %d, data_version: %"PRId64,
+                        __LINE__, instance->data_group_id,
+                        instance->ring.start->data_version);
+
+                rpc_result_entry_done(ctx, instance->ring.start, ETIMEDOUT);
+                instance->ring.start->data_version = 0;
+                instance->ring.start->waiter = NULL;
+                ++clear_count;
+            }
 
             instance->ring.start = instance->ring.entries +
                 (++index % instance->ring.size);
-            ++clear_count;
         }
     }
 
@@ -243,8 +363,10 @@ static void rpc_result_instance_clear_timeouts(
     if (clear_count > 0) {
         logWarning("file: "__FILE__", line: %d, "
                 "data group id: %d, clear timeout push response "
-                "waiting entries count: %d", __LINE__,
-                instance->data_group_id, clear_count);
+                "waiting entries count: %d, overflow queue count: %d, "
+                "total timeouts: %"PRId64", total overflows: %"PRId64,
+                __LINE__, instance->data_group_id, clear_count,
+                instance->queue.count, ctx->timeouts, ctx->overflows);
     }
 }
 
@@ -277,6 +399,12 @@ void rpc_result_ring_destroy(FSReplicaRPCResultContext *ctx)
                 instance->ring.entries = NULL;
             instance->ring.size = 0;
         }
+
+        if (instance->queue.htable.buckets != NULL) {
+            free(instance->queue.htable.buckets);
+            instance->queue.htable.buckets = NULL;
+            instance->queue.htable.capacity = 0;
+        }
     }
 
     free(ctx->instances);
@@ -284,13 +412,35 @@ void rpc_result_ring_destroy(FSReplicaRPCResultContext *ctx)
     fast_mblock_destroy(&ctx->rentry_allocator);
 }
 
+static inline void set_result_entry(FSReplicaRPCResultEntry *entry,
+        const uint64_t data_version, FSReplicaRPCWaiter *waiter,
+        const int64_t push_time_us, const int pkg_size)
+{
+    entry->data_version = data_version;
+    entry->waiter = waiter;
+    entry->expires = g_current_time + SF_G_NETWORK_TIMEOUT;
+    entry->pkg_size = pkg_size;
+    entry->push_time_us = push_time_us;
+    entry->send_time_us = get_current_time_us();
+}
+
 static int add_to_queue(FSReplicaRPCResultContext *ctx,
         FSReplicaRPCResultInstance *instance, const uint64_t data_version,
-        struct fast_task_info *waiting_task)
+        FSReplicaRPCWaiter *waiter, const int64_t push_time_us,
+        const int pkg_size)
 {
     FSReplicaRPCResultEntry *entry;
-    FSReplicaRPCResultEntry *previous;
-    FSReplicaRPCResultEntry *current;
+    FSReplicaRPCResultEntry **bucket;
+    int result;
+
+    /* keep the load factor under 2 for O(1) lookup */
+    if (instance->queue.count >= 2 * instance->queue.htable.capacity) {
+        if ((result=queue_htable_expand(instance)) != 0 &&
+                instance->queue.htable.buckets == NULL)
+        {
+            return result;
+        }
+    }
 
     entry = (FSReplicaRPCResultEntry *)fast_mblock_alloc_object(
             &ctx->rentry_allocator);
@@ -298,44 +448,36 @@ static int add_to_queue(FSReplicaRPCResultContext *ctx,
         return ENOMEM;
     }
 
-    entry->data_version = data_version;
-    entry->waiting_task = waiting_task;
-    entry->expires = g_current_time + SF_G_NETWORK_TIMEOUT;
-
-    if (instance->queue.tail == NULL) {  //empty queue
-        entry->next = NULL;
-        instance->queue.head = instance->queue.tail = entry;
-        return 0;
-    }
-
-    if (data_version > instance->queue.tail->data_version) {
-        entry->next = NULL;
-        instance->queue.tail->next = entry;
-        instance->queue.tail = entry;
-        return 0;
+    if (instance->queue.count == 0) {
+        logWarning("file: "__FILE__", line: %d, "
+                "data group id: %d, can't found data version %"PRId64", "
+                "in the ring, use the overflow queue, total overflows: "
+                "%"PRId64, __LINE__, instance->data_group_id,
+                data_version, ctx->overflows);
     }
 
-    if (data_version < instance->queue.head->data_version) {
-        entry->next = instance->queue.head;
+    set_result_entry(entry, data_version, waiter, push_time_us, pkg_size);
+    entry->next = NULL;
+    entry->prev = instance->queue.tail;
+    if (instance->queue.tail == NULL) {  //empty queue
         instance->queue.head = entry;
-        return 0;
-    }
-
-    previous = instance->queue.head;
-    current = instance->queue.head->next;
-    while (current != NULL && data_version > current->data_version) {
-        previous = current;
-        current = current->next;
+    } else {
+        instance->queue.tail->next = entry;
     }
+    instance->queue.tail = entry;
 
-    entry->next = previous->next;
-    previous->next = entry;
+    bucket = queue_htable_bucket(instance, data_version);
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    instance->queue.count++;
+    ctx->overflows++;
     return 0;
 }
 
 int rpc_result_ring_add(FSReplicaRPCResultContext *ctx,
         const int data_group_id, const uint64_t data_version,
-        struct fast_task_info *waiting_task)
+        FSReplicaRPCWaiter *waiter, const int64_t push_time_us,
+        const int pkg_size)
 {
     FSReplicaRPCResultInstance *instance;
     FSReplicaRPCResultEntry *entry;
@@ -344,6 +486,8 @@ int rpc_result_ring_add(FSReplicaRPCResultContext *ctx,
     int index;
     bool matched;
 
+    ctx->waiting_count++;
+    ctx->waiting_bytes += pkg_size;
     matched = false;
     instance = ctx->instances + (data_group_id - ctx->dg_base_id);
     index = data_version % instance->ring.size;
@@ -366,56 +510,30 @@ int rpc_result_ring_add(FSReplicaRPCResultContext *ctx,
     }
 
     if (matched) {
-        entry->data_version = data_version;
-        entry->waiting_task = waiting_task;
-        entry->expires = g_current_time + SF_G_NETWORK_TIMEOUT;
+        set_result_entry(entry, data_version, waiter,
+                push_time_us, pkg_size);
         return 0;
     }
 
-    logWarning("file: "__FILE__", line: %d, "
-            "data group id: %d, can't found data version %"PRId64", "
-            "in the ring", __LINE__, instance->data_group_id, data_version);
-    return add_to_queue(ctx, instance, data_version,
-            waiting_task);
+    return add_to_queue(ctx, instance, data_version, waiter,
+            push_time_us, pkg_size);
 }
 
 static int remove_from_queue(FSReplicaRPCResultContext *ctx,
         FSReplicaRPCResultInstance *instance, const uint64_t data_version)
 {
     FSReplicaRPCResultEntry *entry;
-    FSReplicaRPCResultEntry *previous;
-    FSReplicaRPCResultEntry *current;
 
-    if (instance->queue.head == NULL) {  //empty queue
+    if (instance->queue.count == 0) {  //empty queue
         return ENOENT;
     }
 
-    if (data_version == instance->queue.head->data_version) {
-        entry = instance->queue.head;
-        instance->queue.head = entry->next;
-        if (instance->queue.head == NULL) {
-            instance->queue.tail = NULL;
-        }
-    } else {
-        previous = instance->queue.head;
-        current = instance->queue.head->next;
-        while (current != NULL && data_version > current->data_version) {
-            previous = current;
-            current = current->next;
-        }
-
-        if (current == NULL || data_version != current->data_version) {
-            return ENOENT;
-        }
-
-        entry = current;
-        previous->next = current->next;
-        if (instance->queue.tail == current) {
-            instance->queue.tail = previous;
-        }
+    if ((entry=queue_htable_remove(instance, data_version)) == NULL) {
+        return ENOENT;
     }
+    queue_unlink(instance, entry);
 
-    desc_task_waiting_rpc_count(instance, entry);
+    rpc_result_entry_done(ctx, entry, 0);
     fast_mblock_free_object(&ctx->rentry_allocator, entry);
     return 0;
 }
@@ -444,9 +562,9 @@ int rpc_result_ring_remove(FSReplicaRPCResultContext *ctx,
                 }
             }
 
-            desc_task_waiting_rpc_count(instance, entry);
+            rpc_result_entry_done(ctx, entry, 0);
             entry->data_version = 0;
-            entry->waiting_task = NULL;
+            entry->waiter = NULL;
             return 0;
         }
     }
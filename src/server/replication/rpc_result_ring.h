@@ -24,6 +24,10 @@
 extern "C" {
 #endif
 
+/* init the data groups from dg_base_id to dg_base_id + dg_count - 1 */
+int rpc_result_ring_init_ex(FSReplicaRPCResultContext *ctx,
+        const int dg_base_id, const int dg_count, const int alloc_size);
+
 int rpc_result_ring_check_init(FSReplicaRPCResultContext *ctx,
         const int alloc_size);
 
@@ -31,7 +35,8 @@ void rpc_result_ring_destroy(FSReplicaRPCResultContext *ctx);
 
 int rpc_result_ring_add(FSReplicaRPCResultContext *ctx,
         const int data_group_id, const uint64_t data_version,
-        struct fast_task_info *waiting_task);
+        FSReplicaRPCWaiter *waiter, const int64_t push_time_us,
+        const int pkg_size);
 
 int rpc_result_ring_remove(FSReplicaRPCResultContext *ctx,
         const int data_group_id, const uint64_t data_version);
@@ -177,7 +177,7 @@ static int load_data_path_config(IniContext *ini_context, const char *filename)
 
 static void server_log_configs()
 {
-    char sz_server_config[512];
+    char sz_server_config[1536];
     char sz_global_config[512];
     char sz_service_config[128];
     char sz_cluster_config[128];
@@ -193,18 +193,44 @@ static void server_log_configs()
 
     snprintf(sz_server_config, sizeof(sz_server_config),
             "my server id = %d, data_path = %s, data_threads = %d, "
+            "data_dispatch_by_block = %d, "
+            "data_work_stealing = %d, "
             "replica_channels_between_two_servers = %d, "
             "recovery_threads_per_data_group = %d, "
             "recovery_max_queue_depth = %d, "
+            "recovery_bulk_read_slices = %d, "
+            "recovery_bulk_read_window = %d, "
+            "recovery_max_bandwidth = %"PRId64" KB/s, "
+            "recovery_max_iops = %d, "
+            "recovery_backoff_latency_ms = %d, "
+            "recovery_dedup_max_memory = %"PRId64" MB, "
+            "checksum_tree = %d, "
+            "recovery_diff_min_gap = %"PRId64", "
+            "replica_batch_delay_us = %d, "
+            "replica_batch_max_bytes = %d KB, "
+            "replica_compression = %s, "
             "binlog_buffer_size = %d KB, "
             "local_binlog_check_last_seconds = %d s, "
             "slave_binlog_check_last_rows = %d, "
             "cluster server count = %d, "
             "idempotency_max_channel_count: %d",
             CLUSTER_MY_SERVER_ID, DATA_PATH_STR, DATA_THREAD_COUNT,
+            DATA_DISPATCH_BY_BLOCK, DATA_WORK_STEALING,
             REPLICA_CHANNELS_BETWEEN_TWO_SERVERS,
             RECOVERY_THREADS_PER_DATA_GROUP,
             RECOVERY_MAX_QUEUE_DEPTH,
+            RECOVERY_BULK_READ_SLICES,
+            RECOVERY_BULK_READ_WINDOW,
+            RECOVERY_MAX_BANDWIDTH / 1024,
+            RECOVERY_MAX_IOPS,
+            RECOVERY_BACKOFF_LATENCY_MS,
+            RECOVERY_DEDUP_MAX_MEMORY / (1024 * 1024),
+            CHECKSUM_TREE_ENABLED,
+            RECOVERY_DIFF_MIN_GAP,
+            REPLICA_BATCH_DELAY_US,
+            REPLICA_BATCH_MAX_BYTES / 1024,
+            REPLICA_COMPRESSION == FS_REPLICA_COMPRESSION_LZ4 ?
+            "lz4" : "none",
             BINLOG_BUFFER_SIZE / 1024,
             LOCAL_BINLOG_CHECK_LAST_SECONDS,
             SLAVE_BINLOG_CHECK_LAST_ROWS,
@@ -218,6 +244,28 @@ static void server_log_configs()
     log_cluster_server_config();
 }
 
+static int load_replica_compression(IniContext *ini_context,
+        const char *filename)
+{
+    char *compression;
+
+    compression = iniGetStrValue(NULL, "replica_compression", ini_context);
+    if (compression == NULL || *compression == '\0' ||
+            strcasecmp(compression, "none") == 0)
+    {
+        REPLICA_COMPRESSION = FS_REPLICA_COMPRESSION_NONE;
+    } else if (strcasecmp(compression, "lz4") == 0) {
+        REPLICA_COMPRESSION = FS_REPLICA_COMPRESSION_LZ4;
+    } else {
+        logError("file: "__FILE__", line: %d, "
+                "config file: %s, invalid replica_compression: %s, "
+                "expect none or lz4", __LINE__, filename, compression);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
 static int load_binlog_buffer_size(IniContext *ini_context,
         const char *filename)
 {
@@ -265,6 +313,7 @@ static int load_storage_cfg(IniContext *ini_context, const char *filename)
 int server_load_config(const char *filename)
 {
     IniContext ini_context;
+    int64_t bytes;
     int result;
 
     if ((result=iniLoadFromFile(filename, &ini_context)) != 0) {
@@ -311,6 +360,10 @@ int server_load_config(const char *filename)
                 FS_MIN_DATA_THREAD_COUNT);
         DATA_THREAD_COUNT = FS_MIN_DATA_THREAD_COUNT;
     }
+    DATA_DISPATCH_BY_BLOCK = iniGetBoolValue(NULL,
+            "data_dispatch_by_block", &ini_context, false);
+    DATA_WORK_STEALING = iniGetBoolValue(NULL,
+            "data_work_stealing", &ini_context, true);
 
     REPLICA_CHANNELS_BETWEEN_TWO_SERVERS = iniGetIntValue(NULL,
             "replica_channels_between_two_servers",
@@ -336,6 +389,80 @@ int server_load_config(const char *filename)
             FS_DEFAULT_RECOVERY_MAX_QUEUE_DEPTH;
     }
 
+    RECOVERY_BULK_READ_SLICES = iniGetIntValue(NULL,
+            "recovery_bulk_read_slices", &ini_context,
+            FS_DEFAULT_RECOVERY_BULK_READ_SLICES);
+    if (RECOVERY_BULK_READ_SLICES < 0) {
+        RECOVERY_BULK_READ_SLICES = 0;
+    } else if (RECOVERY_BULK_READ_SLICES > FS_REPLICA_BULK_READ_MAX_SLICES) {
+        RECOVERY_BULK_READ_SLICES = FS_REPLICA_BULK_READ_MAX_SLICES;
+    }
+
+    RECOVERY_BULK_READ_WINDOW = iniGetIntValue(NULL,
+            "recovery_bulk_read_window", &ini_context,
+            FS_DEFAULT_RECOVERY_BULK_READ_WINDOW);
+    if (RECOVERY_BULK_READ_WINDOW <= 0) {
+        RECOVERY_BULK_READ_WINDOW = FS_DEFAULT_RECOVERY_BULK_READ_WINDOW;
+    }
+
+    if ((result=get_bytes_item_config(&ini_context, filename,
+                    "recovery_max_bandwidth",
+                    FS_DEFAULT_RECOVERY_MAX_BANDWIDTH, &bytes)) != 0)
+    {
+        return result;
+    }
+    RECOVERY_MAX_BANDWIDTH = (bytes > 0) ? bytes : 0;
+
+    RECOVERY_MAX_IOPS = iniGetIntValue(NULL,
+            "recovery_max_iops", &ini_context,
+            FS_DEFAULT_RECOVERY_MAX_IOPS);
+    if (RECOVERY_MAX_IOPS < 0) {
+        RECOVERY_MAX_IOPS = 0;
+    }
+
+    RECOVERY_BACKOFF_LATENCY_MS = iniGetIntValue(NULL,
+            "recovery_backoff_latency_ms", &ini_context,
+            FS_DEFAULT_RECOVERY_BACKOFF_LATENCY_MS);
+    if (RECOVERY_BACKOFF_LATENCY_MS < 0) {
+        RECOVERY_BACKOFF_LATENCY_MS = 0;
+    }
+
+    if ((result=get_bytes_item_config(&ini_context, filename,
+                    "recovery_dedup_max_memory",
+                    FS_DEFAULT_RECOVERY_DEDUP_MAX_MEMORY, &bytes)) != 0)
+    {
+        return result;
+    }
+    RECOVERY_DEDUP_MAX_MEMORY = (bytes > 0) ? bytes : 0;
+
+    CHECKSUM_TREE_ENABLED = iniGetBoolValue(NULL,
+            "checksum_tree", &ini_context, false);
+    RECOVERY_DIFF_MIN_GAP = iniGetInt64Value(NULL,
+            "recovery_diff_min_gap", &ini_context,
+            FS_DEFAULT_RECOVERY_DIFF_MIN_GAP);
+    if (RECOVERY_DIFF_MIN_GAP <= 0) {
+        RECOVERY_DIFF_MIN_GAP = FS_DEFAULT_RECOVERY_DIFF_MIN_GAP;
+    }
+
+    REPLICA_BATCH_DELAY_US = iniGetIntValue(NULL,
+            "replica_batch_delay_us", &ini_context,
+            FS_DEFAULT_REPLICA_BATCH_DELAY_US);
+    if (REPLICA_BATCH_DELAY_US < 0) {
+        REPLICA_BATCH_DELAY_US = 0;
+    }
+
+    if ((result=get_bytes_item_config(&ini_context, filename,
+                    "replica_batch_max_bytes",
+                    FS_DEFAULT_REPLICA_BATCH_MAX_BYTES, &bytes)) != 0)
+    {
+        return result;
+    }
+    REPLICA_BATCH_MAX_BYTES = bytes;
+
+    if ((result=load_replica_compression(&ini_context, filename)) != 0) {
+        return result;
+    }
+
     LOCAL_BINLOG_CHECK_LAST_SECONDS = iniGetIntValue(NULL,
             "local_binlog_check_last_seconds", &ini_context,
             FS_DEFAULT_LOCAL_BINLOG_CHECK_LAST_SECONDS);
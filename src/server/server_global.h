@@ -47,6 +47,8 @@ typedef struct server_global_vars {
     struct {
         string_t path;   //data path
         int thread_count;
+        bool dispatch_by_block;  //dispatch the master operations by block
+        bool work_stealing;      //the idle data threads steal op lanes
         int binlog_buffer_size;
         int local_binlog_check_last_seconds;
         int slave_binlog_check_last_rows;
@@ -59,7 +61,18 @@ typedef struct server_global_vars {
         int channels_between_two_servers;
         int recovery_threads_per_data_group;
         int recovery_max_queue_depth;
+        int recovery_bulk_read_slices;  //0 for disable bulk read
+        int recovery_bulk_read_window;  //the bulk reads in flight
+        int64_t recovery_max_bandwidth; //bytes per second, 0 for unlimited
+        int recovery_max_iops;          //0 for unlimited
+        int recovery_backoff_latency_ms;  //0 for never backoff
+        int64_t recovery_dedup_max_memory;  //0 for unlimited
+        bool checksum_tree;   //maintain the block checksum trees
+        int64_t recovery_diff_min_gap;  //min data versions for diff recovery
         int active_test_interval;   //round(nework_timeout / 2)
+        int batch_delay_us;   //hold the RPCs when the channel is busy
+        int batch_max_bytes;
+        int compression;      //FS_REPLICA_COMPRESSION_NONE or LZ4
         SFContext sf_context;       //for replica communication
     } replica;
 
@@ -94,6 +107,8 @@ typedef struct server_global_vars {
 #define PATHS_BY_INDEX_PPTR   STORAGE_CFG.paths_by_index.paths
 
 #define DATA_THREAD_COUNT     g_server_global_vars.data.thread_count
+#define DATA_DISPATCH_BY_BLOCK g_server_global_vars.data.dispatch_by_block
+#define DATA_WORK_STEALING    g_server_global_vars.data.work_stealing
 #define BINLOG_BUFFER_SIZE    g_server_global_vars.data.binlog_buffer_size
 #define DATA_PATH             g_server_global_vars.data.path
 #define DATA_PATH_STR         DATA_PATH.str
@@ -108,6 +123,33 @@ typedef struct server_global_vars {
 #define RECOVERY_MAX_QUEUE_DEPTH \
     g_server_global_vars.replica.recovery_max_queue_depth
 
+#define RECOVERY_BULK_READ_SLICES \
+    g_server_global_vars.replica.recovery_bulk_read_slices
+
+#define RECOVERY_BULK_READ_WINDOW \
+    g_server_global_vars.replica.recovery_bulk_read_window
+
+#define RECOVERY_MAX_BANDWIDTH \
+    g_server_global_vars.replica.recovery_max_bandwidth
+
+#define RECOVERY_MAX_IOPS \
+    g_server_global_vars.replica.recovery_max_iops
+
+#define RECOVERY_BACKOFF_LATENCY_MS \
+    g_server_global_vars.replica.recovery_backoff_latency_ms
+
+#define RECOVERY_DEDUP_MAX_MEMORY \
+    g_server_global_vars.replica.recovery_dedup_max_memory
+
+#define CHECKSUM_TREE_ENABLED  g_server_global_vars.replica.checksum_tree
+
+#define RECOVERY_DIFF_MIN_GAP \
+    g_server_global_vars.replica.recovery_diff_min_gap
+
+#define REPLICA_BATCH_DELAY_US  g_server_global_vars.replica.batch_delay_us
+#define REPLICA_BATCH_MAX_BYTES g_server_global_vars.replica.batch_max_bytes
+#define REPLICA_COMPRESSION     g_server_global_vars.replica.compression
+
 #define FS_DATA_GROUP_ID(bkey) (FS_BLOCK_HASH_CODE(bkey) % \
        FS_DATA_GROUP_COUNT(CLUSTER_CONFIG_CTX) + 1)
 
@@ -213,6 +213,7 @@ static int init_cluster_data_group_array(const char *filename,
 {
     FSIdArray *id_array;
     FSClusterDataGroupInfo *group;
+    FSServerGroup *server_group;
     int result;
     int bytes;
     int count;
@@ -251,6 +252,12 @@ static int init_cluster_data_group_array(const char *filename,
         group->index = data_group_index;
         group->hash_code = fs_cluster_cfg_get_dg_hash_code(
                 &CLUSTER_CONFIG_CTX, data_group_id - 1);
+        if ((server_group=fs_cluster_cfg_get_server_group(
+                        &CLUSTER_CONFIG_CTX, data_group_id - 1)) != NULL)
+        {
+            group->write_quorum = server_group->write_quorum;
+            group->chain_replication = server_group->chain_replication;
+        }
         if ((result=init_cluster_data_server_array(group)) != 0) {
             return result;
         }
@@ -36,6 +36,10 @@ int server_recovery_init()
         return result;
     }
 
+    if ((result=recovery_governor_init()) != 0) {
+        return result;
+    }
+
 	return 0;
 }
 
@@ -43,6 +47,7 @@ void server_recovery_destroy()
 {
     recovery_thread_destroy();
     data_recovery_destroy();
+    recovery_governor_destroy();
 }
  
 void server_recovery_terminate()
@@ -20,6 +20,7 @@
 
 #include "recovery/recovery_thread.h"
 #include "recovery/data_recovery.h"
+#include "recovery/recovery_governor.h"
 
 #ifdef __cplusplus
 extern "C" {
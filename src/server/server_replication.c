@@ -45,6 +45,18 @@ int server_replication_init()
         return result;
     }
 
+    if ((result=replication_processor_init()) != 0) {
+        return result;
+    }
+
+    if ((result=replication_compress_init()) != 0) {
+        return result;
+    }
+
+    if ((result=checksum_tree_init()) != 0) {
+        return result;
+    }
+
 	return 0;
 }
 
@@ -53,6 +65,7 @@ void server_replication_destroy()
     replication_common_destroy();
     replication_caller_destroy();
     replication_callee_destroy();
+    checksum_tree_destroy();
 }
  
 void server_replication_terminate()
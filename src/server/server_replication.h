@@ -22,6 +22,8 @@
 #include "replication/replication_common.h"
 #include "replication/replication_caller.h"
 #include "replication/replication_callee.h"
+#include "replication/replication_compress.h"
+#include "replication/checksum_tree.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -62,7 +62,19 @@
 #define FS_MIN_DATA_THREAD_COUNT                         2
 #define FS_DEFAULT_REPLICA_CHANNELS_BETWEEN_TWO_SERVERS  2
 #define FS_DEFAULT_RECOVERY_THREADS_PER_DATA_GROUP       2
-#define FS_DEFAULT_RECOVERY_MAX_QUEUE_DEPTH              2
+#define FS_DEFAULT_RECOVERY_MAX_QUEUE_DEPTH              8
+#define FS_DEFAULT_RECOVERY_BULK_READ_SLICES            64
+#define FS_DEFAULT_RECOVERY_BULK_READ_WINDOW             4
+#define FS_DEFAULT_RECOVERY_MAX_BANDWIDTH                0
+#define FS_DEFAULT_RECOVERY_MAX_IOPS                     0
+#define FS_DEFAULT_RECOVERY_BACKOFF_LATENCY_MS          20
+#define FS_DEFAULT_RECOVERY_DIFF_MIN_GAP           1000000
+#define FS_DEFAULT_RECOVERY_DEDUP_MAX_MEMORY  (1024 * 1024 * 1024)
+#define FS_DEFAULT_REPLICA_BATCH_DELAY_US              200
+#define FS_DEFAULT_REPLICA_BATCH_MAX_BYTES      (64 * 1024)
+
+#define FS_REPLICA_COMPRESSION_NONE   0
+#define FS_REPLICA_COMPRESSION_LZ4    1
 #define FS_DEFAULT_LOCAL_BINLOG_CHECK_LAST_SECONDS       3
 #define FS_DEFAULT_SLAVE_BINLOG_CHECK_LAST_ROWS          3
 #define FS_MAX_SLAVE_BINLOG_CHECK_LAST_ROWS            128
@@ -75,6 +87,8 @@
 #define FS_DISCARD_REMAIN_SPACE_MIN_SIZE       256
 #define FS_DISCARD_REMAIN_SPACE_MAX_SIZE      (256 * 1024)
 
+#define FS_DEFAULT_BLOCK_EXTENT_SIZE  (256 * 1024)
+
 #define TASK_STATUS_CONTINUE   12345
 
 #define FS_WHICH_SIDE_MASTER    'M'
@@ -104,9 +118,9 @@
 #define CLUSTER_PEER         TASK_CTX.shared.cluster.peer
 #define REPLICA_REPLICATION  TASK_CTX.shared.replica.replication
 #define REPLICA_READER       TASK_CTX.shared.replica.reader
+#define REPLICA_BULK_READ    TASK_CTX.shared.replica.bulk_read
 #define IDEMPOTENCY_CHANNEL  TASK_CTX.shared.service.idempotency_channel
 #define IDEMPOTENCY_REQUEST  TASK_CTX.service.idempotency_request
-#define WAITING_RPC_COUNT    TASK_CTX.service.waiting_rpc_count
 #define SERVER_TASK_TYPE  TASK_CTX.task_type
 #define SLICE_OP_CTX      TASK_CTX.slice_op_ctx
 #define OP_CTX_INFO       TASK_CTX.slice_op_ctx.info
@@ -199,8 +213,16 @@ typedef struct fs_cluster_data_server_info {
     } recovery;
 
     struct {
-        pthread_lock_cond_pair_t notify; //lock and waiting for slave status change
+        pthread_lock_cond_pair_t notify; //lock for slave status change
         volatile uint64_t rpc_last_version;  //check rpc finished when recovery
+
+        /* the RPCs parked when the slave is ONLINE, they are pushed
+         * to the replication when the slave becomes ACTIVE */
+        struct {
+            struct replication_rpc_entry *head;
+            struct replication_rpc_entry *tail;
+            volatile int count;
+        } parked;
     } replica;
 
     struct {
@@ -229,6 +251,8 @@ typedef struct fs_cluster_data_group_info {
     FSClusterDataServerPtrArray slave_ds_array;
     FSClusterDataServerInfo *myself;
     volatile FSClusterDataServerInfo *master;
+    int write_quorum;       //the servers to persist a write, 0 for all
+    bool chain_replication; //replicate along the chain of the slaves
     pthread_mutex_t lock;   //for master select
 } FSClusterDataGroupInfo;
 
@@ -239,11 +263,43 @@ typedef struct fs_cluster_data_group_array {
     volatile int delay_decision_count;
 } FSClusterDataGroupArray;
 
+/* the responses of a replicated write to wait for, it outlives the
+ * waiting task when the write is acknowledged by the write quorum */
+typedef struct fs_replica_rpc_waiter {
+    volatile int reffer_count;   //the pusher and the slaves to respond
+    volatile int waiting_count;  //notify the data thread when reach 0
+    volatile int result;         //the first error, or the quorum error
+
+    /* for the write quorum, only the successful responses are counted
+     * and the waiter is notified with the error when the failures
+     * exceed the spare count */
+    bool quorum;
+    volatile int spare_count;
+    volatile char notified;      //notify only once
+
+    /* finish the data operation, or the chain forward
+     * responses to the upstream replication */
+    void (*notify_func)(struct fs_replica_rpc_waiter *waiter);
+    void *notify_arg;  //the data operation or upstream replication
+    int data_group_id;
+    uint64_t data_version;
+
+    /* the chain RPC is sent to the downstream after the local
+     * update succeeded, NULL for no downstream */
+    struct replication_rpc_entry *chain_rpc;
+    struct fs_replication *downstream;
+} FSReplicaRPCWaiter;
+
 typedef struct fs_rpc_result_entry {
     uint64_t data_version;
     time_t expires;
-    struct fast_task_info *waiting_task;
+    int pkg_size;
+    int64_t push_time_us;  //pushed to the replication queue
+    int64_t send_time_us;
+    FSReplicaRPCWaiter *waiter;
+    struct fs_rpc_result_entry *prev;       //for the overflow queue
     struct fs_rpc_result_entry *next;
+    struct fs_rpc_result_entry *hash_next;  //for the overflow index
 } FSReplicaRPCResultEntry;
 
 typedef struct fs_rpc_result_instance {
@@ -255,25 +311,55 @@ typedef struct fs_rpc_result_instance {
         int size;
     } ring;
 
+    /* for overflow exceptions, the entries are in the send order
+     * so the head expires first, and indexed by data version */
     struct {
         FSReplicaRPCResultEntry *head;
         FSReplicaRPCResultEntry *tail;
-    } queue;   //for overflow exceptions
+        int count;
+        struct {
+            FSReplicaRPCResultEntry **buckets;
+            int capacity;
+        } htable;
+    } queue;
 
 } FSReplicaRPCResultInstance;
 
 typedef struct fs_rpc_result_context {
     time_t last_check_timeout_time;
+
+    /* the stats are changed by the nio thread only */
+    volatile int waiting_count; //the RPCs sent and waiting for the response
+    volatile int64_t waiting_bytes;
+    volatile int64_t last_lag_us; //from the push to the response
+    volatile int64_t timeouts;
+    volatile int64_t overflows;   //the RPCs added to the overflow queue
+    volatile int64_t rtt_counts[FS_REPLICA_RTT_HISTOGRAM_SIZE];
+
     int dg_base_id;    //min data group id
     int dg_count;
     FSReplicaRPCResultInstance *instances;   //for my data groups
     struct fast_mblock_man rentry_allocator; //element: FSReplicaRPCResultEntry
 } FSReplicaRPCResultContext;
 
+typedef struct fs_replica_compress_buffer {
+    char *buff;
+    int size;
+} FSReplicaCompressBuffer;
+
 typedef struct fs_replication_context {
     struct {
         struct fc_queue rpc_queue;
+        volatile int queued_rpcs;       //include the batch
+        volatile int64_t queued_bytes;
         FSReplicaRPCResultContext rpc_result_ctx;   //push result recv from peer
+        struct {
+            struct replication_rpc_entry *head;
+            struct replication_rpc_entry *tail;
+            int count;
+            int bytes;              //the package bytes of the RPCs
+            int64_t first_time_us;  //the time of the oldest RPC held
+        } batch;   //the RPCs popped from rpc_queue and NOT sent
     } caller;  //master side
 
     struct {
@@ -292,6 +378,10 @@ typedef struct fs_replication {
     int thread_index; //for nio thread
     int conn_index;
     int last_net_comm_time;  //last network communication time
+    struct {
+        bool enabled;    //negotiated by join server
+        int skip_count;  //the packages to skip for incompressible
+    } compress;
     struct {
         int start_time;
         int next_connect_time;
@@ -324,12 +414,20 @@ typedef struct {
                 FSReplication *replication;
                 struct server_binlog_reader *reader;  //for fetch binlog
             };
+            bool compress_binlog;  //for fetch binlog
+
+            struct {
+                struct fs_proto_block_slice *slices;
+                int count;
+                int index;      //the slice reading
+                int offset;     //the response body offset
+                bool by_slave;  //read by the slave for recovery
+            } bulk_read;  //for slice bulk read
         } replica;
     } shared;
 
     struct {
         struct idempotency_request *idempotency_request;
-        volatile int waiting_rpc_count;
     } service;
 
     int which_side;   //master or slave
@@ -359,6 +457,8 @@ typedef struct fs_server_context {
             FSReplicationPtrArray connected;
             struct fast_mblock_man op_ctx_allocator; //for slice op buffer context
             SharedBufferContext shared_buffer_ctx;
+            FSReplicaCompressBuffer compress_buffer;  //alloc on demand
+            int saved_poll_timeout;  //0 for the poll timeout not shortened
         } replica;
     };
 
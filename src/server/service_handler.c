@@ -44,6 +44,10 @@
 #include "common/fs_func.h"
 #include "binlog/replica_binlog.h"
 #include "replication/replication_common.h"
+#include "replication/replication_processor.h"
+#include "replication/replication_compress.h"
+#include "storage/storage_allocator.h"
+#include "recovery/recovery_governor.h"
 #include "server_global.h"
 #include "server_func.h"
 #include "server_group_info.h"
@@ -338,6 +342,202 @@ static int service_deal_disk_space_stat(struct fast_task_info *task)
     return 0;
 }
 
+static void fill_replica_link_stat(FSClusterServerInfo *cs,
+        FSProtoReplicaStatRespBodyPart *body_part)
+{
+    FSReplication **repl;
+    FSReplication **end;
+    FSReplicaRPCResultContext *rctx;
+    int queued_rpcs;
+    int inflight_rpcs;
+    int64_t queued_bytes;
+    int64_t inflight_bytes;
+    int64_t last_lag_us;
+    int64_t timeouts;
+    int64_t overflows;
+    int64_t rtt_counts[FS_REPLICA_RTT_HISTOGRAM_SIZE];
+    int i;
+
+    queued_rpcs = inflight_rpcs = 0;
+    queued_bytes = inflight_bytes = 0;
+    last_lag_us = timeouts = overflows = 0;
+    memset(rtt_counts, 0, sizeof(rtt_counts));
+    end = cs->repl_ptr_array.replications + cs->repl_ptr_array.count;
+    for (repl=cs->repl_ptr_array.replications; repl<end; repl++) {
+        rctx = &(*repl)->context.caller.rpc_result_ctx;
+        queued_rpcs += __sync_add_and_fetch(&(*repl)->
+                context.caller.queued_rpcs, 0);
+        queued_bytes += __sync_add_and_fetch(&(*repl)->
+                context.caller.queued_bytes, 0);
+        inflight_rpcs += __sync_add_and_fetch(&rctx->waiting_count, 0);
+        inflight_bytes += __sync_add_and_fetch(&rctx->waiting_bytes, 0);
+        timeouts += __sync_add_and_fetch(&rctx->timeouts, 0);
+        overflows += __sync_add_and_fetch(&rctx->overflows, 0);
+        if (rctx->last_lag_us > last_lag_us) {
+            last_lag_us = rctx->last_lag_us;
+        }
+        for (i=0; i<FS_REPLICA_RTT_HISTOGRAM_SIZE; i++) {
+            rtt_counts[i] += __sync_add_and_fetch(rctx->rtt_counts + i, 0);
+        }
+    }
+
+    int2buff(queued_rpcs, body_part->queued_rpcs);
+    long2buff(queued_bytes, body_part->queued_bytes);
+    int2buff(inflight_rpcs, body_part->inflight_rpcs);
+    long2buff(inflight_bytes, body_part->inflight_bytes);
+    int2buff(last_lag_us / 1000, body_part->last_lag_ms);
+    long2buff(timeouts, body_part->timeouts);
+    long2buff(overflows, body_part->overflows);
+    for (i=0; i<FS_REPLICA_RTT_HISTOGRAM_SIZE; i++) {
+        long2buff(rtt_counts[i], body_part->rtt_counts[i]);
+    }
+}
+
+static int service_deal_replica_stat(struct fast_task_info *task)
+{
+    int result;
+    int data_group_id;
+    int64_t master_version;
+    int64_t lag_versions;
+    FSProtoReplicaStatReq *req;
+    FSProtoReplicaStatRespBodyHeader *body_header;
+    FSProtoReplicaStatRespBodyPart *part_start;
+    FSProtoReplicaStatRespBodyPart *body_part;
+    FSClusterDataGroupInfo *group;
+    FSClusterDataServerInfo **ds;
+    FSClusterDataServerInfo **end;
+
+    if ((result=server_expect_body_length(task,
+                    sizeof(FSProtoReplicaStatReq))) != 0)
+    {
+        return result;
+    }
+
+    req = (FSProtoReplicaStatReq *)REQUEST.body;
+    data_group_id = buff2int(req->data_group_id);
+    if ((group=fs_get_data_group(data_group_id)) == NULL) {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "data_group_id: %d not exist", data_group_id);
+        return ENOENT;
+    }
+    if (group->myself == NULL || !__sync_add_and_fetch(
+                &group->myself->is_master, 0))
+    {
+        RESPONSE.error.length = sprintf(RESPONSE.error.message,
+                "i am not the master of data group %d", data_group_id);
+        return SF_RETRIABLE_ERROR_NOT_MASTER;
+    }
+
+    master_version = __sync_add_and_fetch(&group->myself->data.version, 0);
+    body_header = (FSProtoReplicaStatRespBodyHeader *)REQUEST.body;
+    part_start = (FSProtoReplicaStatRespBodyPart *)(REQUEST.body +
+            sizeof(FSProtoReplicaStatRespBodyHeader));
+    body_part = part_start;
+
+    end = group->slave_ds_array.servers + group->slave_ds_array.count;
+    for (ds=group->slave_ds_array.servers; ds<end; ds++, body_part++) {
+        memset(body_part, 0, sizeof(*body_part));
+        int2buff((*ds)->cs->server->id, body_part->server_id);
+        body_part->status = __sync_add_and_fetch(&(*ds)->status, 0);
+        long2buff((*ds)->data.version, body_part->data_version);
+        lag_versions = master_version - (int64_t)(*ds)->data.version;
+        long2buff(lag_versions > 0 ? lag_versions : 0,
+                body_part->lag_versions);
+        int2buff(__sync_add_and_fetch(&(*ds)->replica.parked.count, 0),
+                body_part->parked_rpcs);
+        fill_replica_link_stat((*ds)->cs, body_part);
+    }
+
+    int2buff(body_part - part_start, body_header->count);
+    long2buff(master_version, body_header->master_data_version);
+    RESPONSE.header.body_len = (char *)body_part - REQUEST.body;
+    RESPONSE.header.cmd = FS_SERVICE_PROTO_REPLICA_STAT_RESP;
+    TASK_ARG->context.response_done = true;
+    return 0;
+}
+
+static void fill_io_stat_header(FSProtoIOStatRespBodyHeader *body_header)
+{
+    FSAllocStreamStat *stream;
+    int64_t sizes[FS_REPLICA_BATCH_HISTOGRAM_SIZE];
+    int64_t delays[FS_REPLICA_BATCH_HISTOGRAM_SIZE];
+    int64_t raw_bytes;
+    int64_t compressed_bytes;
+    int64_t incompressible;
+    int64_t skipped_bytes;
+    int i;
+
+    for (i=0; i<FS_ALLOC_STREAM_COUNT; i++) {
+        stream = g_allocator_mgr->stream_stats + i;
+        long2buff(__sync_add_and_fetch(&stream->written_bytes, 0),
+                body_header->streams[i].written_bytes);
+        long2buff(__sync_add_and_fetch(&stream->migrated_bytes, 0),
+                body_header->streams[i].migrated_bytes);
+    }
+
+    replication_processor_get_batch_stat(sizes, delays);
+    for (i=0; i<FS_REPLICA_BATCH_HISTOGRAM_SIZE; i++) {
+        long2buff(sizes[i], body_header->replica_batch.sizes[i]);
+        long2buff(delays[i], body_header->replica_batch.delays[i]);
+    }
+
+    replication_compress_get_stat(&raw_bytes, &compressed_bytes,
+            &incompressible, &skipped_bytes);
+    long2buff(raw_bytes, body_header->replica_compress.raw_bytes);
+    long2buff(compressed_bytes, body_header->
+            replica_compress.compressed_bytes);
+    long2buff(incompressible, body_header->replica_compress.incompressible);
+    long2buff(skipped_bytes, body_header->replica_compress.skipped_bytes);
+}
+
+static int service_deal_io_stat(struct fast_task_info *task)
+{
+    int result;
+    FSProtoIOStatRespBodyHeader *body_header;
+    FSProtoIOStatRespBodyPart *part_start;
+    FSProtoIOStatRespBodyPart *body_part;
+    FSTrunkAllocator *allocator;
+    FSTrunkAllocator *end;
+    FSStoragePathInfo *path_info;
+
+    if ((result=server_expect_body_length(task, 0)) != 0) {
+        return result;
+    }
+
+    body_header = (FSProtoIOStatRespBodyHeader *)REQUEST.body;
+    part_start = (FSProtoIOStatRespBodyPart *)(REQUEST.body +
+            sizeof(FSProtoIOStatRespBodyHeader));
+    body_part = part_start;
+
+    memset(body_header, 0, sizeof(*body_header));
+    fill_io_stat_header(body_header);
+
+    end = g_allocator_mgr->store_path.all.allocators +
+        g_allocator_mgr->store_path.all.count;
+    for (allocator=g_allocator_mgr->store_path.all.allocators;
+            allocator<end; allocator++, body_part++)
+    {
+        path_info = allocator->path_info;
+        memset(body_part, 0, sizeof(*body_part));
+        int2buff(path_info->store.index, body_part->path_index);
+        int2buff(allocator->select_weight, body_part->select_weight);
+        int2buff(__sync_add_and_fetch(&path_info->io_stat.queue_depth, 0),
+                body_part->queue_depth);
+        long2buff(__sync_add_and_fetch(&path_info->io_stat.latency_us, 0),
+                body_part->latency_us);
+        long2buff(__sync_add_and_fetch(&allocator->freelist.
+                    lock_stat.lock_waits, 0), body_part->lock_waits);
+        long2buff(__sync_add_and_fetch(&allocator->freelist.
+                    lock_stat.lock_wait_us, 0), body_part->lock_wait_us);
+    }
+
+    int2buff(body_part - part_start, body_header->path_count);
+    RESPONSE.header.body_len = (char *)body_part - REQUEST.body;
+    RESPONSE.header.cmd = FS_SERVICE_PROTO_IO_STAT_RESP;
+    TASK_ARG->context.response_done = true;
+    return 0;
+}
+
 static int service_update_prepare_and_check(struct fast_task_info *task,
         const int resp_cmd, bool *deal_done)
 {
@@ -469,6 +669,23 @@ static inline int service_deal_block_delete(struct fast_task_info *task)
     return result;
 }
 
+/* the latency of the client data requests for the recovery backoff */
+static inline void service_add_recovery_latency(struct fast_task_info *task)
+{
+    switch (REQUEST.header.cmd) {
+        case FS_SERVICE_PROTO_SLICE_WRITE_REQ:
+        case FS_SERVICE_PROTO_SLICE_ALLOCATE_REQ:
+        case FS_SERVICE_PROTO_SLICE_DELETE_REQ:
+        case FS_SERVICE_PROTO_BLOCK_DELETE_REQ:
+        case FS_SERVICE_PROTO_SLICE_READ_REQ:
+            recovery_governor_add_latency(get_current_time_us() -
+                    TASK_ARG->req_start_time);
+            break;
+        default:
+            break;
+    }
+}
+
 int service_deal_task(struct fast_task_info *task, const int stage)
 {
     int result;
@@ -535,6 +752,12 @@ int service_deal_task(struct fast_task_info *task, const int stage)
             case FS_SERVICE_PROTO_DISK_SPACE_STAT_REQ:
                 result = service_deal_disk_space_stat(task);
                 break;
+            case FS_SERVICE_PROTO_REPLICA_STAT_REQ:
+                result = service_deal_replica_stat(task);
+                break;
+            case FS_SERVICE_PROTO_IO_STAT_REQ:
+                result = service_deal_io_stat(task);
+                break;
             case SF_SERVICE_PROTO_SETUP_CHANNEL_REQ:
                 if ((result=sf_server_deal_setup_channel(task,
                                 &SERVER_TASK_TYPE, &IDEMPOTENCY_CHANNEL,
@@ -568,6 +791,9 @@ int service_deal_task(struct fast_task_info *task, const int stage)
         return 0;
     } else {
         RESPONSE_STATUS = result;
+        if (RECOVERY_BACKOFF_LATENCY_MS > 0) {
+            service_add_recovery_latency(task);
+        }
         return handler_deal_task_done(task);
     }
 }
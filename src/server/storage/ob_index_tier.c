@@ -0,0 +1,1140 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "fastcommon/shared_func.h"
+#include "fastcommon/logger.h"
+#include "fastcommon/pthread_func.h"
+#include "sf/sf_global.h"
+#include "../server_global.h"
+#include "object_block_index.h"
+#include "ob_index_tier.h"
+
+#define OB_INDEX_TIER_SUBDIR_NAME      "ob_index"
+#define OB_INDEX_TIER_SEGMENT_PREFIX   "segment-"
+
+OBIndexTierStoreArray g_ob_index_tier_stores = {0, NULL};
+OBIndexTierStat g_ob_index_tier_stat = {0, 0, 0, 0, 0, 0};
+
+#define GET_SEGMENT_FILENAME(store, segment_id, filename, size) \
+    snprintf(filename, size, "%s/%s%06"PRId64".dat", (store)->path, \
+            OB_INDEX_TIER_SEGMENT_PREFIX, segment_id)
+
+static inline uint64_t hash_mix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+#define BLOOM_CALC_HASH_PAIR(bkey, h1, h2) \
+    do { \
+        h1 = hash_mix64((uint64_t)(bkey)->oid) ^ \
+            hash_mix64((uint64_t)(bkey)->offset + 0x9e3779b97f4a7c15ULL); \
+        h2 = hash_mix64(h1) | 1;  \
+    } while (0)
+
+static void bloom_add(OBIndexTierBloomFilter *bloom, const FSBlockKey *bkey)
+{
+    uint64_t h1;
+    uint64_t h2;
+    int64_t bit;
+    int i;
+
+    BLOOM_CALC_HASH_PAIR(bkey, h1, h2);
+    for (i=0; i<OB_INDEX_TIER_BLOOM_HASH_COUNT; i++) {
+        bit = (h1 + i * h2) % bloom->bits;
+        bloom->buff[bit / 8] |= (1 << (bit % 8));
+    }
+}
+
+static bool bloom_may_contain(OBIndexTierBloomFilter *bloom,
+        const FSBlockKey *bkey)
+{
+    uint64_t h1;
+    uint64_t h2;
+    int64_t bit;
+    int i;
+
+    BLOOM_CALC_HASH_PAIR(bkey, h1, h2);
+    for (i=0; i<OB_INDEX_TIER_BLOOM_HASH_COUNT; i++) {
+        bit = (h1 + i * h2) % bloom->bits;
+        if ((bloom->buff[bit / 8] & (1 << (bit % 8))) == 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int clear_segment_files(OBIndexTierStore *store)
+{
+    DIR *dir;
+    struct dirent *ent;
+    char filename[PATH_MAX];
+    int prefix_len;
+    int result;
+
+    if ((dir=opendir(store->path)) == NULL) {
+        result = errno != 0 ? errno : EPERM;
+        logError("file: "__FILE__", line: %d, "
+                "opendir %s fail, errno: %d, error info: %s",
+                __LINE__, store->path, result, STRERROR(result));
+        return result;
+    }
+
+    prefix_len = strlen(OB_INDEX_TIER_SEGMENT_PREFIX);
+    while ((ent=readdir(dir)) != NULL) {
+        if (strncmp(ent->d_name, OB_INDEX_TIER_SEGMENT_PREFIX,
+                    prefix_len) != 0)
+        {
+            continue;
+        }
+
+        snprintf(filename, sizeof(filename), "%s/%s",
+                store->path, ent->d_name);
+        if (unlink(filename) != 0 && errno != ENOENT) {
+            logWarning("file: "__FILE__", line: %d, "
+                    "unlink file %s fail, errno: %d, error info: %s",
+                    __LINE__, filename, errno, STRERROR(errno));
+        }
+    }
+    closedir(dir);
+
+    return 0;
+}
+
+static int init_store(OBIndexTierStore *store, FSStoragePathInfo *path_info)
+{
+    int result;
+
+    store->path_info = path_info;
+    snprintf(store->path, sizeof(store->path), "%s/%s",
+            path_info->store.path.str, OB_INDEX_TIER_SUBDIR_NAME);
+    if (access(store->path, F_OK) != 0) {
+        if (mkdir(store->path, 0755) != 0) {
+            result = errno != 0 ? errno : EPERM;
+            logError("file: "__FILE__", line: %d, "
+                    "mkdir %s fail, errno: %d, error info: %s",
+                    __LINE__, store->path, result, STRERROR(result));
+            return result;
+        }
+    } else if ((result=clear_segment_files(store)) != 0) {
+        return result;
+    }
+
+    store->head = NULL;
+    store->current_segment_id = 0;
+    if ((result=pthread_rwlock_init(&store->rwlock, NULL)) != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "pthread_rwlock_init fail, errno: %d, error info: %s",
+                __LINE__, result, STRERROR(result));
+        return result;
+    }
+
+    return 0;
+}
+
+int ob_index_tier_init()
+{
+    int result;
+    int bytes;
+    FSStoragePathInfo *path_info;
+    OBIndexTierStore *store;
+
+    if (!OB_INDEX_TIER_ENABLED) {
+        return 0;
+    }
+
+    g_ob_index_tier_stores.count = STORAGE_CFG.store_path.count;
+    bytes = sizeof(OBIndexTierStore) * g_ob_index_tier_stores.count;
+    g_ob_index_tier_stores.stores = (OBIndexTierStore *)fc_malloc(bytes);
+    if (g_ob_index_tier_stores.stores == NULL) {
+        return ENOMEM;
+    }
+    memset(g_ob_index_tier_stores.stores, 0, bytes);
+
+    store = g_ob_index_tier_stores.stores;
+    for (path_info=STORAGE_CFG.store_path.paths; path_info<STORAGE_CFG.
+            store_path.paths + STORAGE_CFG.store_path.count; path_info++)
+    {
+        if ((result=init_store(store++, path_info)) != 0) {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static void free_segment(OBIndexTierStore *store,
+        OBIndexTierSegment *segment, const bool remove_file)
+{
+    char filename[PATH_MAX];
+
+    if (segment->fd >= 0) {
+        close(segment->fd);
+    }
+    if (remove_file) {
+        GET_SEGMENT_FILENAME(store, segment->id, filename, sizeof(filename));
+        if (unlink(filename) != 0 && errno != ENOENT) {
+            logWarning("file: "__FILE__", line: %d, "
+                    "unlink file %s fail, errno: %d, error info: %s",
+                    __LINE__, filename, errno, STRERROR(errno));
+        }
+    }
+
+    if (segment->indexes != NULL) {
+        free(segment->indexes);
+    }
+    if (segment->live_bits != NULL) {
+        free((void *)segment->live_bits);
+    }
+    if (segment->bloom.buff != NULL) {
+        free(segment->bloom.buff);
+    }
+    if (segment->trunks.keys != NULL) {
+        free(segment->trunks.keys);
+    }
+    free(segment);
+}
+
+void ob_index_tier_destroy()
+{
+    OBIndexTierStore *store;
+    OBIndexTierStore *end;
+    OBIndexTierSegment *segment;
+    OBIndexTierSegment *deleted;
+
+    if (g_ob_index_tier_stores.stores == NULL) {
+        return;
+    }
+
+    end = g_ob_index_tier_stores.stores + g_ob_index_tier_stores.count;
+    for (store=g_ob_index_tier_stores.stores; store<end; store++) {
+        segment = store->head;
+        while (segment != NULL) {
+            deleted = segment;
+            segment = segment->next;
+            free_segment(store, deleted, true);
+        }
+        store->head = NULL;
+        pthread_rwlock_destroy(&store->rwlock);
+    }
+
+    free(g_ob_index_tier_stores.stores);
+    g_ob_index_tier_stores.stores = NULL;
+    g_ob_index_tier_stores.count = 0;
+}
+
+static OBIndexTierSegment *alloc_segment(const int record_count)
+{
+    OBIndexTierSegment *segment;
+    int bytes;
+
+    segment = (OBIndexTierSegment *)fc_malloc(sizeof(OBIndexTierSegment));
+    if (segment == NULL) {
+        return NULL;
+    }
+    memset(segment, 0, sizeof(OBIndexTierSegment));
+    segment->fd = -1;
+    segment->record_count = record_count;
+
+    segment->index_count = (record_count + OB_INDEX_TIER_SPARSE_INTERVAL - 1)
+        / OB_INDEX_TIER_SPARSE_INTERVAL;
+    bytes = sizeof(OBIndexTierSparseEntry) * segment->index_count;
+    if ((segment->indexes=(OBIndexTierSparseEntry *)fc_malloc(bytes)) == NULL) {
+        free(segment);
+        return NULL;
+    }
+
+    bytes = (record_count + 7) / 8;
+    if ((segment->live_bits=(volatile unsigned char *)
+                fc_malloc(bytes)) == NULL)
+    {
+        free(segment->indexes);
+        free(segment);
+        return NULL;
+    }
+    memset((void *)segment->live_bits, 0, bytes);
+
+    segment->bloom.bits = (int64_t)record_count *
+        OB_INDEX_TIER_BLOOM_BITS_PER_KEY;
+    if (segment->bloom.bits < 64) {
+        segment->bloom.bits = 64;
+    }
+    bytes = (segment->bloom.bits + 7) / 8;
+    if ((segment->bloom.buff=(unsigned char *)fc_malloc(bytes)) == NULL) {
+        free((void *)segment->live_bits);
+        free(segment->indexes);
+        free(segment);
+        return NULL;
+    }
+    memset(segment->bloom.buff, 0, bytes);
+
+    return segment;
+}
+
+static int compare_trunk_key(const OBIndexTierTrunkKey *k1,
+        const OBIndexTierTrunkKey *k2)
+{
+    int sub;
+
+    if ((sub=k1->path_index - k2->path_index) != 0) {
+        return sub;
+    }
+    return fc_compare_int64(k1->trunk_id, k2->trunk_id);
+}
+
+int ob_index_tier_add_trunk(OBIndexTierTrunkArray *array,
+        const int path_index, const int64_t trunk_id)
+{
+    OBIndexTierTrunkKey *keys;
+    OBIndexTierTrunkKey *last;
+    int alloc;
+
+    /* the slices of a block are in a few trunks */
+    if (array->count > 0) {
+        last = array->keys + array->count - 1;
+        if (last->path_index == path_index && last->trunk_id == trunk_id) {
+            return 0;
+        }
+    }
+
+    if (array->alloc <= array->count) {
+        alloc = array->alloc > 0 ? array->alloc * 2 : 256;
+        keys = (OBIndexTierTrunkKey *)fc_malloc(
+                sizeof(OBIndexTierTrunkKey) * alloc);
+        if (keys == NULL) {
+            return ENOMEM;
+        }
+        if (array->keys != NULL) {
+            memcpy(keys, array->keys, sizeof(OBIndexTierTrunkKey) *
+                    array->count);
+            free(array->keys);
+        }
+        array->keys = keys;
+        array->alloc = alloc;
+    }
+
+    array->keys[array->count].path_index = path_index;
+    array->keys[array->count].trunk_id = trunk_id;
+    array->count++;
+    return 0;
+}
+
+/* sort and remove the duplicate trunk keys */
+static int set_segment_trunks(OBIndexTierSegment *segment,
+        const OBIndexTierTrunkArray *array)
+{
+    OBIndexTierTrunkKey *src;
+    OBIndexTierTrunkKey *dest;
+    OBIndexTierTrunkKey *end;
+
+    if (array->count == 0) {
+        return 0;
+    }
+
+    segment->trunks.keys = (OBIndexTierTrunkKey *)fc_malloc(
+            sizeof(OBIndexTierTrunkKey) * array->count);
+    if (segment->trunks.keys == NULL) {
+        return ENOMEM;
+    }
+    memcpy(segment->trunks.keys, array->keys,
+            sizeof(OBIndexTierTrunkKey) * array->count);
+    qsort(segment->trunks.keys, array->count, sizeof(OBIndexTierTrunkKey),
+            (int (*)(const void *, const void *))compare_trunk_key);
+
+    dest = segment->trunks.keys;
+    end = segment->trunks.keys + array->count;
+    for (src=segment->trunks.keys + 1; src<end; src++) {
+        if (compare_trunk_key(src, dest) != 0) {
+            *(++dest) = *src;
+        }
+    }
+    segment->trunks.count = (dest - segment->trunks.keys) + 1;
+    segment->trunks.alloc = array->count;
+    return 0;
+}
+
+static inline bool segment_has_trunk(OBIndexTierSegment *segment,
+        const OBIndexTierTrunkKey *trunk)
+{
+    return bsearch(trunk, segment->trunks.keys, segment->trunks.count,
+            sizeof(OBIndexTierTrunkKey), (int (*)(const void *,
+                    const void *))compare_trunk_key) != NULL;
+}
+
+static inline void pack_record_header(const OBIndexTierRecord *record,
+        char *p)
+{
+    long2buff(record->bkey.oid, p);
+    long2buff(record->bkey.offset, p + 8);
+    int2buff(record->bkey.hash_code, p + 16);
+    int2buff(record->body_len, p + 20);
+}
+
+static inline void unpack_record_header(const char *p,
+        OBIndexTierRecord *record)
+{
+    record->bkey.oid = buff2long(p);
+    record->bkey.offset = buff2long(p + 8);
+    record->bkey.hash_code = buff2int(p + 16);
+    record->body_len = buff2int(p + 20);
+}
+
+static int create_segment(OBIndexTierStore *store,
+        const OBIndexTierRecordArray *array,
+        OBIndexTierSegment **segment)
+{
+    OBIndexTierSegment *seg;
+    const OBIndexTierRecord *record;
+    const OBIndexTierRecord *end;
+    OBIndexTierSparseEntry *index;
+    char filename[PATH_MAX];
+    char *buff;
+    char *p;
+    int64_t total;
+    int result;
+
+    *segment = NULL;
+    if (array->count == 0) {
+        return 0;
+    }
+
+    total = 0;
+    end = array->records + array->count;
+    for (record=array->records; record<end; record++) {
+        total += OB_INDEX_TIER_RECORD_HEADER_SIZE + record->body_len;
+    }
+
+    if ((seg=alloc_segment(array->count)) == NULL) {
+        return ENOMEM;
+    }
+    if ((result=set_segment_trunks(seg, &array->trunks)) != 0) {
+        free_segment(store, seg, false);
+        return result;
+    }
+    if ((buff=(char *)fc_malloc(total)) == NULL) {
+        free_segment(store, seg, false);
+        return ENOMEM;
+    }
+
+    p = buff;
+    index = seg->indexes;
+    for (record=array->records; record<end; record++) {
+        if ((record - array->records) % OB_INDEX_TIER_SPARSE_INTERVAL == 0) {
+            index->bkey = record->bkey;
+            index->offset = p - buff;
+            index++;
+        }
+        bloom_add(&seg->bloom, &record->bkey);
+
+        pack_record_header(record, p);
+        p += OB_INDEX_TIER_RECORD_HEADER_SIZE;
+        memcpy(p, record->body, record->body_len);
+        p += record->body_len;
+    }
+
+    seg->file_size = total;
+    seg->id = ++store->current_segment_id;
+    GET_SEGMENT_FILENAME(store, seg->id, filename, sizeof(filename));
+    do {
+        if ((seg->fd=open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+            result = errno != 0 ? errno : EACCES;
+            logError("file: "__FILE__", line: %d, "
+                    "open file %s fail, errno: %d, error info: %s",
+                    __LINE__, filename, result, STRERROR(result));
+            break;
+        }
+
+        if (fc_safe_write(seg->fd, buff, total) != total) {
+            result = errno != 0 ? errno : EIO;
+            logError("file: "__FILE__", line: %d, "
+                    "write to file %s fail, errno: %d, error info: %s",
+                    __LINE__, filename, result, STRERROR(result));
+            break;
+        }
+
+        result = 0;
+    } while (0);
+    free(buff);
+
+    if (result != 0) {
+        free_segment(store, seg, true);
+        return result;
+    }
+
+    *segment = seg;
+    return 0;
+}
+
+int ob_index_tier_write_segment(OBIndexTierStore *store,
+        const OBIndexTierRecordArray *array,
+        OBIndexTierSegment **segment)
+{
+    int result;
+
+    if ((result=create_segment(store, array, segment)) != 0 ||
+            *segment == NULL)
+    {
+        return result;
+    }
+
+    pthread_rwlock_wrlock(&store->rwlock);
+    (*segment)->next = store->head;
+    store->head = *segment;
+    pthread_rwlock_unlock(&store->rwlock);
+    return 0;
+}
+
+static inline void set_live(OBIndexTierSegment *segment,
+        const int record_index)
+{
+    __sync_fetch_and_or(segment->live_bits + record_index / 8,
+            (unsigned char)(1 << (record_index % 8)));
+    __sync_add_and_fetch(&segment->live_count, 1);
+}
+
+void ob_index_tier_set_live(OBIndexTierSegment *segment,
+        const int record_index)
+{
+    set_live(segment, record_index);
+    __sync_add_and_fetch(&g_ob_index_tier_stat.evicted_blocks, 1);
+}
+
+static inline bool test_and_clear_live(OBIndexTierSegment *segment,
+        const int record_index)
+{
+    unsigned char mask;
+    unsigned char old;
+
+    mask = (unsigned char)(1 << (record_index % 8));
+    old = __sync_fetch_and_and(segment->live_bits +
+            record_index / 8, (unsigned char)~mask);
+    if ((old & mask) == 0) {
+        return false;
+    }
+
+    __sync_sub_and_fetch(&segment->live_count, 1);
+    return true;
+}
+
+static inline bool is_live(OBIndexTierSegment *segment,
+        const int record_index)
+{
+    return (segment->live_bits[record_index / 8] &
+            (1 << (record_index % 8))) != 0;
+}
+
+static int check_alloc_buffer(BufferInfo *buffer, const int size)
+{
+    char *buff;
+    int alloc_size;
+
+    if (buffer->alloc_size >= size) {
+        return 0;
+    }
+
+    alloc_size = buffer->alloc_size > 0 ? buffer->alloc_size : 4 * 1024;
+    while (alloc_size < size) {
+        alloc_size *= 2;
+    }
+    if ((buff=(char *)fc_malloc(alloc_size)) == NULL) {
+        return ENOMEM;
+    }
+
+    if (buffer->buff != NULL) {
+        free(buffer->buff);
+    }
+    buffer->buff = buff;
+    buffer->alloc_size = alloc_size;
+    return 0;
+}
+
+static int read_segment_range(OBIndexTierSegment *segment,
+        const int64_t offset, const int size, BufferInfo *buffer)
+{
+    int result;
+
+    if ((result=check_alloc_buffer(buffer, size)) != 0) {
+        return result;
+    }
+
+    if (pread(segment->fd, buffer->buff, size, offset) != size) {
+        result = errno != 0 ? errno : EIO;
+        logError("file: "__FILE__", line: %d, "
+                "pread segment %"PRId64" fail, offset: %"PRId64", "
+                "size: %d, errno: %d, error info: %s", __LINE__,
+                segment->id, offset, size, result, STRERROR(result));
+        return result;
+    }
+
+    buffer->length = size;
+    return 0;
+}
+
+static int find_sparse_index(OBIndexTierSegment *segment,
+        const FSBlockKey *bkey)
+{
+    int low;
+    int high;
+    int mid;
+    int found;
+
+    found = -1;
+    low = 0;
+    high = segment->index_count - 1;
+    while (low <= high) {
+        mid = (low + high) / 2;
+        if (ob_index_compare_block_key(&segment->indexes[mid].bkey,
+                    bkey) <= 0)
+        {
+            found = mid;
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    return found;
+}
+
+static int take_from_segment(OBIndexTierSegment *segment,
+        const FSBlockKey *bkey, BufferInfo *buffer,
+        ob_index_tier_load_func load_func, void *args)
+{
+    OBIndexTierRecord record;
+    int64_t start;
+    int64_t end;
+    int index;
+    int record_index;
+    int cmpr;
+    int result;
+    char *p;
+    char *buff_end;
+
+    if ((index=find_sparse_index(segment, bkey)) < 0) {
+        return ENOENT;
+    }
+
+    start = segment->indexes[index].offset;
+    if (index + 1 < segment->index_count) {
+        end = segment->indexes[index + 1].offset;
+    } else {
+        end = segment->file_size;
+    }
+    if ((result=read_segment_range(segment, start,
+                    end - start, buffer)) != 0)
+    {
+        return result;
+    }
+
+    record_index = index * OB_INDEX_TIER_SPARSE_INTERVAL;
+    p = buffer->buff;
+    buff_end = buffer->buff + buffer->length;
+    while (p < buff_end) {
+        unpack_record_header(p, &record);
+        cmpr = ob_index_compare_block_key(&record.bkey, bkey);
+        if (cmpr > 0) {
+            break;
+        }
+
+        if (cmpr == 0 && is_live(segment, record_index)) {
+            if ((result=load_func(p + OB_INDEX_TIER_RECORD_HEADER_SIZE,
+                            record.body_len, args)) != 0)
+            {
+                return result;
+            }
+            test_and_clear_live(segment, record_index);
+            return 0;
+        }
+
+        p += OB_INDEX_TIER_RECORD_HEADER_SIZE + record.body_len;
+        record_index++;
+    }
+
+    return ENOENT;
+}
+
+int ob_index_tier_take(const FSBlockKey *bkey, BufferInfo *buffer,
+        ob_index_tier_load_func load_func, void *args)
+{
+    OBIndexTierStore *store;
+    OBIndexTierSegment *segment;
+    int result;
+    bool disk_accessed;
+
+    store = OB_INDEX_TIER_GET_STORE(*bkey);
+    if (store->head == NULL) {
+        return ENOENT;
+    }
+
+    result = ENOENT;
+    disk_accessed = false;
+    pthread_rwlock_rdlock(&store->rwlock);
+    for (segment=store->head; segment!=NULL; segment=segment->next) {
+        if (__sync_add_and_fetch(&segment->live_count, 0) == 0) {
+            continue;
+        }
+        if (!bloom_may_contain(&segment->bloom, bkey)) {
+            __sync_add_and_fetch(&g_ob_index_tier_stat.bloom_negatives, 1);
+            continue;
+        }
+
+        disk_accessed = true;
+        __sync_add_and_fetch(&g_ob_index_tier_stat.disk_lookups, 1);
+        if ((result=take_from_segment(segment, bkey, buffer,
+                        load_func, args)) != ENOENT)
+        {
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&store->rwlock);
+
+    if (result == 0) {
+        __sync_add_and_fetch(&g_ob_index_tier_stat.faulted_blocks, 1);
+    } else if (result == ENOENT && disk_accessed) {
+        __sync_add_and_fetch(&g_ob_index_tier_stat.disk_misses, 1);
+    }
+    return result;
+}
+
+static int append_bkey(FSBlockKey **bkeys, int *count,
+        int *alloc, const FSBlockKey *bkey)
+{
+    FSBlockKey *new_bkeys;
+    int new_alloc;
+
+    if (*alloc <= *count) {
+        new_alloc = (*alloc == 0) ? 256 : *alloc * 2;
+        new_bkeys = (FSBlockKey *)fc_malloc(sizeof(FSBlockKey) * new_alloc);
+        if (new_bkeys == NULL) {
+            return ENOMEM;
+        }
+        if (*bkeys != NULL) {
+            memcpy(new_bkeys, *bkeys, sizeof(FSBlockKey) * (*count));
+            free(*bkeys);
+        }
+        *bkeys = new_bkeys;
+        *alloc = new_alloc;
+    }
+
+    (*bkeys)[(*count)++] = *bkey;
+    return 0;
+}
+
+static int scan_segment(OBIndexTierSegment *segment, BufferInfo *buffer,
+        ob_index_tier_scan_filter_func filter_func, void *args,
+        FSBlockKey **bkeys, int *count, int *alloc)
+{
+    OBIndexTierRecord record;
+    int record_index;
+    int result;
+    char *p;
+    char *end;
+
+    if ((result=read_segment_range(segment, 0, segment->
+                    file_size, buffer)) != 0)
+    {
+        return result;
+    }
+
+    record_index = 0;
+    p = buffer->buff;
+    end = buffer->buff + buffer->length;
+    while (p < end) {
+        unpack_record_header(p, &record);
+        record.body = p + OB_INDEX_TIER_RECORD_HEADER_SIZE;
+        if (is_live(segment, record_index) && filter_func(&record, args)) {
+            if ((result=append_bkey(bkeys, count, alloc,
+                            &record.bkey)) != 0)
+            {
+                return result;
+            }
+        }
+
+        p += OB_INDEX_TIER_RECORD_HEADER_SIZE + record.body_len;
+        record_index++;
+    }
+
+    return 0;
+}
+
+int ob_index_tier_scan(const OBIndexTierTrunkKey *trunk,
+        ob_index_tier_scan_filter_func filter_func,
+        void *args, FSBlockKey **bkeys, int *count)
+{
+    OBIndexTierStore *store;
+    OBIndexTierStore *end;
+    OBIndexTierSegment *segment;
+    BufferInfo buffer;
+    int alloc;
+    int result;
+
+    *bkeys = NULL;
+    *count = alloc = 0;
+    memset(&buffer, 0, sizeof(buffer));
+
+    result = 0;
+    end = g_ob_index_tier_stores.stores + g_ob_index_tier_stores.count;
+    for (store=g_ob_index_tier_stores.stores; store<end &&
+            result == 0; store++)
+    {
+        pthread_rwlock_rdlock(&store->rwlock);
+        for (segment=store->head; segment!=NULL; segment=segment->next) {
+            if (__sync_add_and_fetch(&segment->live_count, 0) == 0 ||
+                    !segment_has_trunk(segment, trunk))
+            {
+                continue;
+            }
+            if ((result=scan_segment(segment, &buffer, filter_func,
+                            args, bkeys, count, &alloc)) != 0)
+            {
+                break;
+            }
+        }
+        pthread_rwlock_unlock(&store->rwlock);
+    }
+
+    if (buffer.buff != NULL) {
+        free(buffer.buff);
+    }
+    if (result != 0 && *bkeys != NULL) {
+        free(*bkeys);
+        *bkeys = NULL;
+        *count = 0;
+    }
+    return result;
+}
+
+typedef struct {
+    OBIndexTierSegment *segment;
+    int record_index;
+    int body_len;
+    int64_t body_offset;
+    FSBlockKey bkey;
+} OBIndexTierCompactEntry;
+
+typedef struct {
+    int count;
+    int alloc;
+    OBIndexTierCompactEntry *entries;
+    BufferInfo bodies;  //the record bodies of the entries
+    BufferInfo buffer;  //for reading the segment file
+    OBIndexTierRecordArray rarray;
+} OBIndexTierCompactContext;
+
+static int compare_compact_entry(const OBIndexTierCompactEntry *e1,
+        const OBIndexTierCompactEntry *e2)
+{
+    return ob_index_compare_block_key(&e1->bkey, &e2->bkey);
+}
+
+static int add_compact_entry(OBIndexTierCompactContext *cctx,
+        OBIndexTierSegment *segment, const int record_index,
+        const OBIndexTierRecord *record)
+{
+    OBIndexTierCompactEntry *entries;
+    OBIndexTierCompactEntry *entry;
+    char *buff;
+    int64_t alloc_size;
+    int alloc;
+
+    if (cctx->alloc <= cctx->count) {
+        alloc = cctx->alloc > 0 ? cctx->alloc * 2 : 1024;
+        entries = (OBIndexTierCompactEntry *)fc_malloc(
+                sizeof(OBIndexTierCompactEntry) * alloc);
+        if (entries == NULL) {
+            return ENOMEM;
+        }
+        if (cctx->entries != NULL) {
+            memcpy(entries, cctx->entries, sizeof(
+                        OBIndexTierCompactEntry) * cctx->count);
+            free(cctx->entries);
+        }
+        cctx->entries = entries;
+        cctx->alloc = alloc;
+    }
+
+    if ((int64_t)cctx->bodies.alloc_size - cctx->bodies.length <
+            record->body_len)
+    {
+        alloc_size = cctx->bodies.alloc_size > 0 ?
+            cctx->bodies.alloc_size : 64 * 1024;
+        while (alloc_size - cctx->bodies.length < record->body_len) {
+            alloc_size *= 2;
+        }
+        if ((buff=(char *)fc_malloc(alloc_size)) == NULL) {
+            return ENOMEM;
+        }
+        if (cctx->bodies.buff != NULL) {
+            memcpy(buff, cctx->bodies.buff, cctx->bodies.length);
+            free(cctx->bodies.buff);
+        }
+        cctx->bodies.buff = buff;
+        cctx->bodies.alloc_size = alloc_size;
+    }
+
+    entry = cctx->entries + cctx->count++;
+    entry->segment = segment;
+    entry->record_index = record_index;
+    entry->body_len = record->body_len;
+    entry->body_offset = cctx->bodies.length;
+    entry->bkey = record->bkey;
+    memcpy(cctx->bodies.buff + cctx->bodies.length,
+            record->body, record->body_len);
+    cctx->bodies.length += record->body_len;
+    return 0;
+}
+
+static int collect_live_records(OBIndexTierCompactContext *cctx,
+        OBIndexTierSegment *segment)
+{
+    OBIndexTierTrunkKey *key;
+    OBIndexTierTrunkKey *kend;
+    OBIndexTierRecord record;
+    int record_index;
+    int result;
+    char *p;
+    char *end;
+
+    if ((result=read_segment_range(segment, 0, segment->
+                    file_size, &cctx->buffer)) != 0)
+    {
+        return result;
+    }
+
+    record_index = 0;
+    p = cctx->buffer.buff;
+    end = cctx->buffer.buff + cctx->buffer.length;
+    while (p < end) {
+        unpack_record_header(p, &record);
+        record.body = p + OB_INDEX_TIER_RECORD_HEADER_SIZE;
+        if (is_live(segment, record_index)) {
+            if ((result=add_compact_entry(cctx, segment,
+                            record_index, &record)) != 0)
+            {
+                return result;
+            }
+        }
+
+        p += OB_INDEX_TIER_RECORD_HEADER_SIZE + record.body_len;
+        record_index++;
+    }
+
+    kend = segment->trunks.keys + segment->trunks.count;
+    for (key=segment->trunks.keys; key<kend; key++) {
+        if ((result=ob_index_tier_add_trunk(&cctx->rarray.trunks,
+                        key->path_index, key->trunk_id)) != 0)
+        {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static int build_compact_records(OBIndexTierCompactContext *cctx)
+{
+    OBIndexTierCompactEntry *entry;
+    OBIndexTierCompactEntry *end;
+    OBIndexTierRecord *record;
+
+    if (cctx->rarray.alloc < cctx->count) {
+        if (cctx->rarray.records != NULL) {
+            free(cctx->rarray.records);
+        }
+        cctx->rarray.records = (OBIndexTierRecord *)fc_malloc(
+                sizeof(OBIndexTierRecord) * cctx->alloc);
+        if (cctx->rarray.records == NULL) {
+            cctx->rarray.alloc = 0;
+            return ENOMEM;
+        }
+        cctx->rarray.alloc = cctx->alloc;
+    }
+
+    /* the records of different segments are interleaved */
+    qsort(cctx->entries, cctx->count, sizeof(OBIndexTierCompactEntry),
+            (int (*)(const void *, const void *))compare_compact_entry);
+
+    record = cctx->rarray.records;
+    end = cctx->entries + cctx->count;
+    for (entry=cctx->entries; entry<end; entry++, record++) {
+        record->bkey = entry->bkey;
+        record->body_len = entry->body_len;
+        record->body = cctx->bodies.buff + entry->body_offset;
+    }
+    cctx->rarray.count = cctx->count;
+    return 0;
+}
+
+static inline bool is_sparse_segment(OBIndexTierSegment *segment)
+{
+    return (int64_t)__sync_add_and_fetch(&segment->live_count, 0) * 100 <
+        (int64_t)segment->record_count * OB_INDEX_TIER_COMPACT_LIVE_PERCENT;
+}
+
+/* the segments without live record are removed, and the live records
+ * of the sparse segments are merged into a new segment.
+ * the live bits are cleared by the readers meanwhile, so the record of
+ * the new segment is live only when it is still live in the old one */
+static int compact_store(OBIndexTierStore *store,
+        OBIndexTierCompactContext *cctx, int *compacted_count)
+{
+    OBIndexTierSegment *segment;
+    OBIndexTierSegment *previous;
+    OBIndexTierSegment *merged;
+    OBIndexTierSegment *deleted;
+    OBIndexTierSegment *chain;
+    OBIndexTierCompactEntry *entry;
+    OBIndexTierCompactEntry *end;
+    int record_count;
+    int result;
+
+    cctx->count = 0;
+    cctx->bodies.length = 0;
+    cctx->rarray.count = 0;
+    cctx->rarray.trunks.count = 0;
+    *compacted_count = 0;
+
+    /* the segment list is changed by the evicting thread only */
+    record_count = 0;
+    for (segment=store->head; segment!=NULL; segment=segment->next) {
+        segment->compacting = false;
+        if (!is_sparse_segment(segment)) {
+            continue;
+        }
+
+        if (__sync_add_and_fetch(&segment->live_count, 0) > 0) {
+            if (record_count + segment->record_count >
+                    OB_INDEX_TIER_COMPACT_MAX_RECORDS)
+            {
+                continue;
+            }
+            if ((result=collect_live_records(cctx, segment)) != 0) {
+                return result;
+            }
+            record_count += segment->record_count;
+        }
+        segment->compacting = true;
+        (*compacted_count)++;
+    }
+
+    if (*compacted_count == 0) {
+        return 0;
+    }
+
+    merged = NULL;
+    if (cctx->count > 0) {
+        if ((result=build_compact_records(cctx)) != 0) {
+            return result;
+        }
+        if ((result=create_segment(store, &cctx->rarray, &merged)) != 0) {
+            return result;
+        }
+    }
+
+    pthread_rwlock_wrlock(&store->rwlock);
+    end = cctx->entries + cctx->count;
+    for (entry=cctx->entries; entry<end; entry++) {
+        if (is_live(entry->segment, entry->record_index)) {
+            set_live(merged, entry - cctx->entries);
+        }
+    }
+
+    chain = NULL;
+    previous = NULL;
+    segment = store->head;
+    while (segment != NULL) {
+        if (!segment->compacting) {
+            previous = segment;
+            segment = segment->next;
+            continue;
+        }
+
+        deleted = segment;
+        segment = segment->next;
+        if (previous == NULL) {
+            store->head = segment;
+        } else {
+            previous->next = segment;
+        }
+        deleted->next = chain;
+        chain = deleted;
+    }
+
+    if (merged != NULL) {
+        merged->next = store->head;
+        store->head = merged;
+    }
+    pthread_rwlock_unlock(&store->rwlock);
+
+    while (chain != NULL) {
+        deleted = chain;
+        chain = chain->next;
+        free_segment(store, deleted, true);
+    }
+
+    return 0;
+}
+
+void ob_index_tier_compact_segments()
+{
+    OBIndexTierStore *store;
+    OBIndexTierStore *end;
+    OBIndexTierCompactContext cctx;
+    int compacted_count;
+    int result;
+
+    memset(&cctx, 0, sizeof(cctx));
+    end = g_ob_index_tier_stores.stores + g_ob_index_tier_stores.count;
+    for (store=g_ob_index_tier_stores.stores; store<end; store++) {
+        if ((result=compact_store(store, &cctx, &compacted_count)) != 0) {
+            logError("file: "__FILE__", line: %d, "
+                    "compact the segments of path %s fail, "
+                    "errno: %d, error info: %s", __LINE__,
+                    store->path, result, STRERROR(result));
+            continue;
+        }
+
+        if (compacted_count > 0) {
+            __sync_add_and_fetch(&g_ob_index_tier_stat.
+                    compacted_segments, compacted_count);
+        }
+    }
+
+    if (cctx.entries != NULL) {
+        free(cctx.entries);
+    }
+    if (cctx.bodies.buff != NULL) {
+        free(cctx.bodies.buff);
+    }
+    if (cctx.buffer.buff != NULL) {
+        free(cctx.buffer.buff);
+    }
+    if (cctx.rarray.records != NULL) {
+        free(cctx.rarray.records);
+    }
+    if (cctx.rarray.trunks.keys != NULL) {
+        free(cctx.rarray.trunks.keys);
+    }
+}
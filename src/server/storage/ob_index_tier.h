@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+//ob_index_tier.h
+
+/* the on-disk tier of the object block index.
+ *
+ * the cold object blocks are evicted from the hashtable in batch, each batch
+ * of one store path is written as a segment file which sorted by block key.
+ * the segment keeps a sparse index, a bloom filter and a live bitmap
+ * in memory, about 2 bytes per evicted block.
+ *
+ * a block lives in memory or in exactly one live record of the segments,
+ * the live bit of the record is cleared after the block is faulted in.
+ * the sparse segments are merged by the compaction, and each segment keeps
+ * the trunk ids referenced by its records for the trunk reclaiming to
+ * skip the segments of other trunks.
+ * the segment files are runtime cache only, they are discarded on startup
+ * because the index is rebuilt from the slice binlog.
+ */
+
+#ifndef _OB_INDEX_TIER_H
+#define _OB_INDEX_TIER_H
+
+#include "fastcommon/common_define.h"
+#include "../server_types.h"
+#include "storage_config.h"
+
+#define OB_INDEX_TIER_SPARSE_INTERVAL   32
+#define OB_INDEX_TIER_BLOOM_BITS_PER_KEY 10
+#define OB_INDEX_TIER_BLOOM_HASH_COUNT   4
+
+#define OB_INDEX_TIER_RECORD_HEADER_SIZE  (8 + 8 + 4 + 4)
+
+/* the segments with less live records are merged */
+#define OB_INDEX_TIER_COMPACT_LIVE_PERCENT   50
+#define OB_INDEX_TIER_COMPACT_MAX_RECORDS   (256 * 1024)
+
+typedef struct {
+    FSBlockKey bkey;
+    int64_t offset;   //the record offset of the segment file
+} OBIndexTierSparseEntry;
+
+typedef struct {
+    int64_t bits;
+    unsigned char *buff;
+} OBIndexTierBloomFilter;
+
+typedef struct {
+    int path_index;
+    int64_t trunk_id;
+} OBIndexTierTrunkKey;
+
+typedef struct {
+    int count;
+    int alloc;
+    OBIndexTierTrunkKey *keys;
+} OBIndexTierTrunkArray;
+
+typedef struct ob_index_tier_segment {
+    int64_t id;
+    int fd;
+    int record_count;
+    volatile int live_count;
+    int index_count;
+    int64_t file_size;
+    OBIndexTierSparseEntry *indexes;
+    volatile unsigned char *live_bits;
+    OBIndexTierBloomFilter bloom;
+    OBIndexTierTrunkArray trunks;  //sorted, the trunks referenced
+    bool compacting;  //selected by the compaction
+    struct ob_index_tier_segment *next;  //newer to older
+} OBIndexTierSegment;
+
+typedef struct {
+    FSStoragePathInfo *path_info;
+    char path[PATH_MAX];
+    int64_t current_segment_id;
+    OBIndexTierSegment *head;  //the newest segment
+    pthread_rwlock_t rwlock;
+} OBIndexTierStore;
+
+typedef struct {
+    int count;
+    OBIndexTierStore *stores;
+} OBIndexTierStoreArray;
+
+typedef struct {
+    volatile int64_t evicted_blocks;
+    volatile int64_t faulted_blocks;
+    volatile int64_t bloom_negatives;
+    volatile int64_t disk_lookups;
+    volatile int64_t disk_misses;
+    volatile int64_t compacted_segments;
+} OBIndexTierStat;
+
+typedef struct {
+    FSBlockKey bkey;
+    int body_len;
+    char *body;    //record body, slices encoded by the object block index
+} OBIndexTierRecord;
+
+typedef struct {
+    int count;
+    int alloc;
+    OBIndexTierRecord *records;
+    OBIndexTierTrunkArray trunks;  //the trunks referenced by the records
+} OBIndexTierRecordArray;
+
+/* callback for scanning the live records, return true for collecting */
+typedef bool (*ob_index_tier_scan_filter_func)(const OBIndexTierRecord
+        *record, void *args);
+
+/* callback for taking the live record, return 0 when the block is loaded */
+typedef int (*ob_index_tier_load_func)(const char *body,
+        const int body_len, void *args);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    extern OBIndexTierStoreArray g_ob_index_tier_stores;
+    extern OBIndexTierStat g_ob_index_tier_stat;
+
+#define OB_INDEX_TIER_ENABLED  STORAGE_CFG.object_block.tier.enabled
+
+#define OB_INDEX_TIER_GET_STORE(bkey) (g_ob_index_tier_stores.stores + \
+        FS_BLOCK_HASH_CODE(bkey) % g_ob_index_tier_stores.count)
+
+    int ob_index_tier_init();
+    void ob_index_tier_destroy();
+
+    /* the block MAY be in the tier when its store has any segment */
+    static inline bool ob_index_tier_has_records(const FSBlockKey *bkey)
+    {
+        return OB_INDEX_TIER_GET_STORE(*bkey)->head != NULL;
+    }
+
+    /* write the records as a new segment, the records MUST be sorted
+     * by block key. all records are NOT live until set by
+     * ob_index_tier_set_live. the trunk keys of the array can be unsorted */
+    int ob_index_tier_write_segment(OBIndexTierStore *store,
+            const OBIndexTierRecordArray *array,
+            OBIndexTierSegment **segment);
+
+    /* caller MUST hold the shared lock of the object block */
+    void ob_index_tier_set_live(OBIndexTierSegment *segment,
+            const int record_index);
+
+    /* find the live record and take it away from the disk tier.
+     * the live bit is cleared only when the load callback returns 0,
+     * so the record is kept when the block fails to load.
+     * the segment file is read under the store lock, so caller MUST NOT
+     * hold the shared lock of the object block, the callback acquires it.
+     * return 0 for found, ENOENT for not found, other for error */
+    int ob_index_tier_take(const FSBlockKey *bkey, BufferInfo *buffer,
+            ob_index_tier_load_func load_func, void *args);
+
+    /* scan the live records of the segments which reference the trunk,
+     * the block keys of the matched records are appended to bkey array */
+    int ob_index_tier_scan(const OBIndexTierTrunkKey *trunk,
+            ob_index_tier_scan_filter_func filter_func,
+            void *args, FSBlockKey **bkeys, int *count);
+
+    int ob_index_tier_add_trunk(OBIndexTierTrunkArray *array,
+            const int path_index, const int64_t trunk_id);
+
+    /* remove the segments without live record and merge the sparse
+     * segments, called by the evicting thread only because the evicting
+     * sets the live records without the store lock */
+    void ob_index_tier_compact_segments();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -14,14 +14,18 @@
  */
 
 #include <limits.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include "fastcommon/shared_func.h"
 #include "fastcommon/logger.h"
+#include "fastcommon/pthread_func.h"
 #include "fastcommon/uniq_skiplist.h"
+#include "fastcommon/sched_thread.h"
 #include "sf/sf_global.h"
 #include "../server_global.h"
 #include "../binlog/slice_binlog.h"
 #include "storage_allocator.h"
+#include "ob_index_tier.h"
 #include "object_block_index.h"
 
 #define SLICE_ARRAY_FIXED_COUNT  64
@@ -72,47 +76,11 @@ OBHashtable g_ob_hashtable = {0, 0, NULL};
         } \
     } while (0)
 
-static OBEntry *get_ob_entry_ex(OBSharedContext *ctx, OBEntry **bucket,
-        const FSBlockKey *bkey, const bool create_flag, OBEntry **pprev)
+static inline OBEntry *alloc_ob_entry(OBSharedContext *ctx,
+        const FSBlockKey *bkey)
 {
     const int init_level_count = 2;
-    OBEntry *previous;
     OBEntry *ob;
-    int cmpr;
-
-    if (pprev == NULL) {
-        pprev = &previous;
-    }
-    if (*bucket == NULL) {
-        if (!create_flag) {
-            return NULL;
-        }
-        *pprev = NULL;
-    } else {
-        cmpr = ob_index_compare_block_key(bkey, &(*bucket)->bkey);
-        if (cmpr == 0) {
-            *pprev = NULL;
-            return *bucket;
-        } else if (cmpr < 0) {
-            *pprev = NULL;
-        } else {
-            *pprev = *bucket;
-            while ((*pprev)->next != NULL) {
-                cmpr = ob_index_compare_block_key(bkey, &(*pprev)->next->bkey);
-                if (cmpr == 0) {
-                    return (*pprev)->next;
-                } else if (cmpr < 0) {
-                    break;
-                }
-
-                *pprev = (*pprev)->next;
-            }
-        }
-
-        if (!create_flag) {
-            return NULL;
-        }
-    }
 
     ob = (OBEntry *)fast_mblock_alloc_object(&ctx->ob_allocator);
     if (ob == NULL) {
@@ -125,19 +93,130 @@ static OBEntry *get_ob_entry_ex(OBSharedContext *ctx, OBEntry **bucket,
     }
 
     ob->bkey = *bkey;
-    if (*pprev == NULL) {
+    ob->ref_count = 1;  //for the hashtable
+    ob->reclaiming_count = 0;
+    ob->last_access_time = g_current_time;
+    ob->removed = false;
+    ob->loading = false;
+    return ob;
+}
+
+/* the entry is freed when the hashtable and all slices release it,
+ * the slice held by the reader keeps the entry after removed */
+static inline void ob_entry_hold(OBEntry *ob)
+{
+    __sync_add_and_fetch(&ob->ref_count, 1);
+}
+
+static void ob_entry_release(OBEntry *ob)
+{
+    if (__sync_sub_and_fetch(&ob->ref_count, 1) == 0) {
+        OB_INDEX_SET_HASHTABLE_CTX(&g_ob_hashtable, ob->bkey);
+        fast_mblock_free_object(&ctx->ob_allocator, ob);
+    }
+}
+
+/* caller MUST hold the shared lock and the skiplist MUST be freed */
+static inline void remove_ob_entry(OBEntry **bucket,
+        OBEntry *previous, OBEntry *ob)
+{
+    if (previous == NULL) {
+        *bucket = ob->next;
+    } else {
+        previous->next = ob->next;
+    }
+    ob->removed = true;
+    ob_entry_release(ob);
+}
+
+static inline void link_ob_entry(OBEntry **bucket,
+        OBEntry *previous, OBEntry *ob)
+{
+    if (previous == NULL) {
         ob->next = *bucket;
         *bucket = ob;
     } else {
-        ob->next = (*pprev)->next;
-        (*pprev)->next = ob;
+        ob->next = previous->next;
+        previous->next = ob;
+    }
+}
+
+/* set the previous entry of the found or the insert position */
+static OBEntry *find_ob_entry(OBEntry **bucket,
+        const FSBlockKey *bkey, OBEntry **pprev)
+{
+    int cmpr;
+
+    *pprev = NULL;
+    if (*bucket == NULL) {
+        return NULL;
+    }
+
+    cmpr = ob_index_compare_block_key(bkey, &(*bucket)->bkey);
+    if (cmpr == 0) {
+        return *bucket;
+    } else if (cmpr < 0) {
+        return NULL;
+    }
+
+    *pprev = *bucket;
+    while ((*pprev)->next != NULL) {
+        cmpr = ob_index_compare_block_key(bkey, &(*pprev)->next->bkey);
+        if (cmpr == 0) {
+            return (*pprev)->next;
+        } else if (cmpr < 0) {
+            break;
+        }
+
+        *pprev = (*pprev)->next;
+    }
+
+    return NULL;
+}
+
+static OBEntry *load_from_tier(OBSharedContext *ctx, OBEntry **bucket,
+        const FSBlockKey *bkey, const bool create_flag, OBEntry **pprev);
+
+#define OB_INDEX_TIER_USED(htable) \
+    ((htable) == &g_ob_hashtable && OB_INDEX_TIER_ENABLED)
+
+static OBEntry *get_ob_entry_ex(OBHashtable *htable, OBSharedContext *ctx,
+        OBEntry **bucket, const FSBlockKey *bkey, const bool create_flag,
+        OBEntry **pprev)
+{
+    OBEntry *previous;
+    OBEntry *ob;
+
+    if (pprev == NULL) {
+        pprev = &previous;
+    }
+
+    /* the placeholder of the block loading from the on-disk tier */
+    while ((ob=find_ob_entry(bucket, bkey, pprev)) != NULL && ob->loading) {
+        pthread_cond_wait(&ctx->lcp.cond, &ctx->lcp.lock);
+    }
+    if (ob != NULL) {
+        ob->last_access_time = g_current_time;
+        return ob;
     }
 
+    if (OB_INDEX_TIER_USED(htable) && ob_index_tier_has_records(bkey)) {
+        return load_from_tier(ctx, bucket, bkey, create_flag, pprev);
+    }
+
+    if (!create_flag) {
+        return NULL;
+    }
+    if ((ob=alloc_ob_entry(ctx, bkey)) == NULL) {
+        return NULL;
+    }
+
+    link_ob_entry(bucket, *pprev, ob);
     return ob;
 }
 
-#define get_ob_entry(ctx, bucket, bkey, create_flag)  \
-    get_ob_entry_ex(ctx, bucket, bkey, create_flag, NULL)
+#define get_ob_entry(htable, ctx, bucket, bkey, create_flag)  \
+    get_ob_entry_ex(htable, ctx, bucket, bkey, create_flag, NULL)
 
 OBEntry *ob_index_get_ob_entry_ex(OBHashtable *htable,
         const FSBlockKey *bkey)
@@ -146,7 +225,7 @@ OBEntry *ob_index_get_ob_entry_ex(OBHashtable *htable,
     OB_INDEX_SET_BUCKET_AND_CTX(htable, *bkey);
 
     OB_INDEX_SHARED_CTX_LOCK(htable, ctx);
-    ob = get_ob_entry(ctx, bucket, bkey, true);
+    ob = get_ob_entry(htable, ctx, bucket, bkey, true);
     OB_INDEX_SHARED_CTX_UNLOCK(htable, ctx);
 
     return ob;
@@ -158,8 +237,9 @@ OBEntry *ob_index_reclaim_lock(const FSBlockKey *bkey)
 
     OB_INDEX_SET_BUCKET_AND_CTX(&g_ob_hashtable, *bkey);
     OB_INDEX_SHARED_CTX_LOCK(&g_ob_hashtable, ctx);
-    ob = get_ob_entry(ctx, bucket, bkey, false);
+    ob = get_ob_entry(&g_ob_hashtable, ctx, bucket, bkey, false);
     if (ob != NULL) {
+        ob_entry_hold(ob);
         ++(ob->reclaiming_count);
     }
     OB_INDEX_SHARED_CTX_UNLOCK(&g_ob_hashtable, ctx);
@@ -175,6 +255,7 @@ void ob_index_reclaim_unlock(OBEntry *ob)
         pthread_cond_broadcast(&ctx->lcp.cond);
     }
     OB_INDEX_SHARED_CTX_UNLOCK(&g_ob_hashtable, ctx);
+    ob_entry_release(ob);
 }
 
 OBSliceEntry *ob_index_alloc_slice_ex(OBHashtable *htable,
@@ -185,7 +266,10 @@ OBSliceEntry *ob_index_alloc_slice_ex(OBHashtable *htable,
 
     OB_INDEX_SET_BUCKET_AND_CTX(htable, *bkey);
     OB_INDEX_SHARED_CTX_LOCK(htable, ctx);
-    ob = get_ob_entry(ctx, bucket, bkey, true);
+    ob = get_ob_entry(htable, ctx, bucket, bkey, true);
+    if (ob != NULL) {
+        ob_entry_hold(ob);  //for the slice
+    }
     OB_INDEX_SHARED_CTX_UNLOCK(htable, ctx);
 
     if (ob == NULL) {
@@ -198,6 +282,8 @@ OBSliceEntry *ob_index_alloc_slice_ex(OBHashtable *htable,
             if (init_refer > 0) {
                 __sync_add_and_fetch(&slice->ref_count, init_refer);
             }
+        } else {
+            ob_entry_release(ob);
         }
     }
 
@@ -206,6 +292,8 @@ OBSliceEntry *ob_index_alloc_slice_ex(OBHashtable *htable,
 
 void ob_index_free_slice(OBSliceEntry *slice)
 {
+    OBEntry *ob;
+
     if (__sync_sub_and_fetch(&slice->ref_count, 1) == 0) {
         OB_INDEX_SET_HASHTABLE_CTX(&g_ob_hashtable, slice->ob->bkey);
 
@@ -216,7 +304,9 @@ void ob_index_free_slice(OBSliceEntry *slice)
                 slice->ob->bkey.oid, slice->ob->bkey.offset, ctx);
                 */
 
+        ob = slice->ob;
         fast_mblock_free_object(&ctx->slice_allocator, slice);
+        ob_entry_release(ob);
     }
 }
 
@@ -229,6 +319,7 @@ static int slice_compare(const void *p1, const void *p2)
 static void slice_free_func(void *ptr, const int delay_seconds)
 {
     OBSliceEntry *slice;
+    OBEntry *ob;
 
     slice = (OBSliceEntry *)ptr;
     if (__sync_sub_and_fetch(&slice->ref_count, 1) == 0) {
@@ -241,7 +332,9 @@ static void slice_free_func(void *ptr, const int delay_seconds)
                 slice->ob->bkey.oid, slice->ob->bkey.offset, ctx);
                 */
 
+        ob = slice->ob;
         fast_mblock_free_object(&ctx->slice_allocator, slice);
+        ob_entry_release(ob);
     }
 }
 
@@ -263,6 +356,7 @@ static int init_ob_shared_ctx_array()
     if (ob_shared_ctx_array.contexts == NULL) {
         return ENOMEM;
     }
+    memset(ob_shared_ctx_array.contexts, 0, bytes);
 
     end = ob_shared_ctx_array.contexts + ob_shared_ctx_array.count;
     for (ctx=ob_shared_ctx_array.contexts; ctx<end; ctx++) {
@@ -274,9 +368,10 @@ static int init_ob_shared_ctx_array()
             return result;
         }
 
+        /* the entry is freed by the last slice without the shared lock */
         if ((result=fast_mblock_init_ex1(&ctx->ob_allocator,
                         "ob_entry", sizeof(OBEntry), 4 * 1024,
-                        0, NULL, NULL, false)) != 0)
+                        0, NULL, NULL, true)) != 0)
         {
             return result;
         }
@@ -339,7 +434,8 @@ void ob_index_destroy_htable(OBHashtable *htable)
 
             deleted = ob;
             ob = ob->next;
-            fast_mblock_free_object(&ctx->ob_allocator, deleted);
+            deleted->removed = true;
+            ob_entry_release(deleted);
         } while (ob != NULL);
 
         PTHREAD_MUTEX_UNLOCK(&ctx->lcp.lock);
@@ -356,12 +452,17 @@ int ob_index_init()
         return result;
     }
 
+    if ((result=ob_index_tier_init()) != 0) {
+        return result;
+    }
+
     return ob_index_init_htable_ex(&g_ob_hashtable, STORAGE_CFG.
             object_block.hashtable_capacity, true, true);
 }
 
 void ob_index_destroy()
 {
+    ob_index_tier_destroy();
 }
 
 static inline int do_delete_slice(OBHashtable *htable,
@@ -406,6 +507,7 @@ static inline OBSliceEntry *splice_dup(OBSharedContext *ctx,
     }
 
     slice->ob = src->ob;
+    ob_entry_hold(slice->ob);
     slice->type = src->type;
     slice->space = src->space;
     if (offset > src->ssize.offset) {
@@ -608,9 +710,24 @@ int ob_index_add_slice_ex(OBHashtable *htable, OBSliceEntry *slice,
             slice->ob->bkey.oid, slice->ob->bkey.offset);
             */
 
-    OB_INDEX_SET_HASHTABLE_CTX(htable, slice->ob->bkey);
+    OB_INDEX_SET_BUCKET_AND_CTX(htable, slice->ob->bkey);
     OB_INDEX_SHARED_CTX_LOCK(htable, ctx);
 
+    if (slice->ob->removed) {  //evicted or deleted after the slice allocated
+        OBEntry *ob;
+        if ((ob=get_ob_entry(htable, ctx, bucket,
+                        &slice->ob->bkey, true)) == NULL)
+        {
+            OB_INDEX_SHARED_CTX_UNLOCK(htable, ctx);
+            return ENOMEM;
+        }
+        ob_entry_hold(ob);
+        ob_entry_release(slice->ob);
+        slice->ob = ob;
+    } else {
+        slice->ob->last_access_time = g_current_time;
+    }
+
     CHECK_AND_WAIT_RECLAIM_DONE(ctx, slice->ob);
     result = add_slice(htable, ctx, slice->ob, slice, inc_alloc);
     if (result == 0) {
@@ -755,7 +872,7 @@ int ob_index_delete_slices_ex(OBHashtable *htable,
 
     OB_INDEX_SET_BUCKET_AND_CTX(htable, bs_key->block);
     OB_INDEX_SHARED_CTX_LOCK(htable, ctx);
-    ob = get_ob_entry(ctx, bucket, &bs_key->block, false);
+    ob = get_ob_entry(htable, ctx, bucket, &bs_key->block, false);
     if (ob == NULL) {
         *dec_alloc = 0;
         result = ENOENT;
@@ -785,7 +902,7 @@ int ob_index_delete_block_ex(OBHashtable *htable,
 
     *dec_alloc = 0;
     OB_INDEX_SHARED_CTX_LOCK(htable, ctx);
-    ob = get_ob_entry_ex(ctx, bucket, bkey, false, &previous);
+    ob = get_ob_entry_ex(htable, ctx, bucket, bkey, false, &previous);
     if (ob != NULL) {
         CHECK_AND_WAIT_RECLAIM_DONE(ctx, ob);
         uniq_skiplist_iterator(ob->slices, &it);
@@ -798,16 +915,10 @@ int ob_index_delete_block_ex(OBHashtable *htable,
         }
 
         uniq_skiplist_free(ob->slices);
-        if (previous == NULL) {
-            *bucket = ob->next;
-        } else {
-            previous->next = ob->next;
-        }
-
+        remove_ob_entry(bucket, previous, ob);
         if (sn != NULL) {
             *sn = __sync_add_and_fetch(&SLICE_BINLOG_SN, 1);
         }
-        fast_mblock_delay_free_object(&ctx->ob_allocator, ob, 3600);
         result = 0;
     } else {
         result = ENOENT;
@@ -1036,7 +1147,7 @@ int ob_index_get_slices_ex(OBHashtable *htable,
             */
 
     OB_INDEX_SHARED_CTX_LOCK(htable, ctx);
-    ob = get_ob_entry(ctx, bucket, &bs_key->block, false);
+    ob = get_ob_entry(htable, ctx, bucket, &bs_key->block, false);
     if (ob == NULL) {
         result = ENOENT;
     } else {
@@ -1050,3 +1161,661 @@ int ob_index_get_slices_ex(OBHashtable *htable,
     }
     return result;
 }
+
+/* the record body of the on-disk tier:
+ *   slice count (4 bytes) + slice entries (OB_INDEX_SLICE_RECORD_SIZE each)
+ * the slice entry:
+ *   type (1), read_offset (4), slice offset (4), slice length (4),
+ *   path index (4), trunk id (8), subdir (8), space offset (8),
+ *   space size (8)
+ */
+#define OB_INDEX_SLICE_RECORD_SIZE  (1 + 4 * 4 + 8 * 4)
+
+#define OB_INDEX_EVICT_BATCH_BLOCKS  (64 * 1024)
+
+typedef struct {
+    OBEntry *ob;   //held until the evicting done
+    int last_access_time;
+    FSBlockKey bkey;
+    int body_offset;
+    int body_len;
+} OBEvictEntry;
+
+typedef struct {
+    int count;
+    int alloc;
+    OBEvictEntry *entries;
+    BufferInfo bodies;
+    OBIndexTierRecordArray rarray;
+} OBEvictEntryArray;
+
+typedef struct {
+    int64_t bucket_index;   //the scan cursor
+    int block_count;
+    int evict_after_seconds;   //shortened when exceeds the memory limit
+    OBEvictEntryArray *arrays; //by tier store
+} OBEvictContext;
+
+static OBEvictContext evict_ctx = {0, 0, 0, NULL};
+
+static int decode_slices(OBSharedContext *ctx, OBEntry *ob,
+        const char *body, const int body_len)
+{
+    OBSliceEntry *slice;
+    const char *p;
+    int slice_count;
+    int path_index;
+    int result;
+    int i;
+
+    if (body_len < 4) {
+        return EINVAL;
+    }
+    slice_count = buff2int(body);
+    if (4 + slice_count * OB_INDEX_SLICE_RECORD_SIZE != body_len) {
+        return EINVAL;
+    }
+
+    p = body + 4;
+    for (i=0; i<slice_count; i++) {
+        path_index = buff2int(p + 13);
+        if (path_index < 0 || path_index > STORAGE_CFG.
+                max_store_path_index || PATHS_BY_INDEX_PPTR
+                [path_index] == NULL)
+        {
+            return EINVAL;
+        }
+
+        slice = (OBSliceEntry *)fast_mblock_alloc_object(
+                &ctx->slice_allocator);
+        if (slice == NULL) {
+            return ENOMEM;
+        }
+
+        slice->ob = ob;
+        ob_entry_hold(ob);
+        slice->type = *p;
+        slice->read_offset = buff2int(p + 1);
+        slice->ssize.offset = buff2int(p + 5);
+        slice->ssize.length = buff2int(p + 9);
+        slice->space.store = &PATHS_BY_INDEX_PPTR[path_index]->store;
+        slice->space.id_info.id = buff2long(p + 17);
+        slice->space.id_info.subdir = buff2long(p + 25);
+        slice->space.offset = buff2long(p + 33);
+        slice->space.size = buff2long(p + 41);
+        __sync_add_and_fetch(&slice->ref_count, 1);
+        if ((result=uniq_skiplist_insert(ob->slices, slice)) != 0) {
+            __sync_sub_and_fetch(&slice->ref_count, 1);
+            fast_mblock_free_object(&ctx->slice_allocator, slice);
+            ob_entry_release(ob);
+            return result;
+        }
+
+        p += OB_INDEX_SLICE_RECORD_SIZE;
+    }
+
+    return 0;
+}
+
+typedef struct {
+    OBSharedContext *ctx;
+    OBEntry *ob;   //the placeholder
+} OBTierLoadArgs;
+
+/* called with the store lock of the tier, the live bit of the record is
+ * cleared after this callback returns 0, so the slices are installed in
+ * the placeholder before the block leaving the tier */
+static int load_block_func(const char *body, const int body_len, void *args)
+{
+    OBTierLoadArgs *load_args;
+    OBSliceEntry *slice;
+    UniqSkiplistIterator it;
+    int result;
+
+    load_args = (OBTierLoadArgs *)args;
+    PTHREAD_MUTEX_LOCK(&load_args->ctx->lcp.lock);
+    if ((result=decode_slices(load_args->ctx, load_args->ob,
+                    body, body_len)) == 0)
+    {
+        uniq_skiplist_iterator(load_args->ob->slices, &it);
+        while ((slice=(OBSliceEntry *)uniq_skiplist_next(&it)) != NULL) {
+            storage_allocator_evict_slice(slice, false);
+        }
+    }
+    PTHREAD_MUTEX_UNLOCK(&load_args->ctx->lcp.lock);
+
+    return result;
+}
+
+/* caller MUST hold the shared lock, which is released during reading the
+ * on-disk tier. the placeholder entry makes the other accessors of the
+ * block wait until loaded, and it is kept as an empty block when
+ * create_flag is true and the block is not found in the tier */
+static OBEntry *load_from_tier(OBSharedContext *ctx, OBEntry **bucket,
+        const FSBlockKey *bkey, const bool create_flag, OBEntry **pprev)
+{
+    OBTierLoadArgs load_args;
+    BufferInfo buffer;
+    int result;
+
+    if ((load_args.ob=alloc_ob_entry(ctx, bkey)) == NULL) {
+        return NULL;
+    }
+    load_args.ctx = ctx;
+    load_args.ob->loading = true;
+    link_ob_entry(bucket, *pprev, load_args.ob);
+    PTHREAD_MUTEX_UNLOCK(&ctx->lcp.lock);
+
+    memset(&buffer, 0, sizeof(buffer));
+    result = ob_index_tier_take(bkey, &buffer,
+            load_block_func, &load_args);
+    if (buffer.buff != NULL) {
+        free(buffer.buff);
+    }
+
+    PTHREAD_MUTEX_LOCK(&ctx->lcp.lock);
+    load_args.ob->loading = false;
+    pthread_cond_broadcast(&ctx->lcp.cond);
+
+    find_ob_entry(bucket, bkey, pprev);
+    if (result == 0 || (result == ENOENT && create_flag)) {
+        return load_args.ob;
+    }
+
+    /* do NOT keep an empty block when the evicted one fails to load */
+    if (result != ENOENT) {
+        logError("file: "__FILE__", line: %d, "
+                "load block {oid: %"PRId64", offset: %"PRId64"} "
+                "from the on-disk tier fail, errno: %d, error info: %s, "
+                "the record is kept for the next access", __LINE__,
+                bkey->oid, bkey->offset, result, STRERROR(result));
+    }
+    uniq_skiplist_free(load_args.ob->slices);
+    remove_ob_entry(bucket, *pprev, load_args.ob);
+    return NULL;
+}
+
+static int encode_slices(OBEntry *ob, BufferInfo *buffer,
+        OBIndexTierTrunkArray *trunks, int *body_len)
+{
+    OBSliceEntry *slice;
+    UniqSkiplistIterator it;
+    char *start;
+    char *p;
+    int slice_count;
+    int result;
+
+    slice_count = 0;
+    uniq_skiplist_iterator(ob->slices, &it);
+    while (uniq_skiplist_next(&it) != NULL) {
+        slice_count++;
+    }
+    if (slice_count == 0) {
+        *body_len = 0;
+        return 0;
+    }
+
+    *body_len = 4 + slice_count * OB_INDEX_SLICE_RECORD_SIZE;
+    if (buffer->alloc_size - buffer->length < *body_len) {
+        char *buff;
+        int alloc_size;
+
+        alloc_size = buffer->alloc_size > 0 ?
+            buffer->alloc_size * 2 : 1024 * 1024;
+        while (alloc_size - buffer->length < *body_len) {
+            alloc_size *= 2;
+        }
+        if ((buff=(char *)fc_malloc(alloc_size)) == NULL) {
+            return ENOMEM;
+        }
+        if (buffer->buff != NULL) {
+            memcpy(buff, buffer->buff, buffer->length);
+            free(buffer->buff);
+        }
+        buffer->buff = buff;
+        buffer->alloc_size = alloc_size;
+    }
+
+    start = p = buffer->buff + buffer->length;
+    int2buff(slice_count, p);
+    p += 4;
+
+    uniq_skiplist_iterator(ob->slices, &it);
+    while ((slice=(OBSliceEntry *)uniq_skiplist_next(&it)) != NULL) {
+        *p = slice->type;
+        int2buff(slice->read_offset, p + 1);
+        int2buff(slice->ssize.offset, p + 5);
+        int2buff(slice->ssize.length, p + 9);
+        int2buff(slice->space.store->index, p + 13);
+        long2buff(slice->space.id_info.id, p + 17);
+        long2buff(slice->space.id_info.subdir, p + 25);
+        long2buff(slice->space.offset, p + 33);
+        long2buff(slice->space.size, p + 41);
+        p += OB_INDEX_SLICE_RECORD_SIZE;
+
+        if ((result=ob_index_tier_add_trunk(trunks, slice->space.store->
+                        index, slice->space.id_info.id)) != 0)
+        {
+            return result;
+        }
+    }
+
+    result = (p - start == *body_len) ? 0 : EINVAL;
+    if (result == 0) {
+        buffer->length += *body_len;
+    }
+    return result;
+}
+
+static int add_evict_entry(OBEvictEntryArray *array, OBEntry *ob)
+{
+    OBEvictEntry *entry;
+    int body_offset;
+    int body_len;
+    int result;
+
+    if (array->alloc <= array->count) {
+        OBEvictEntry *entries;
+        int alloc;
+
+        alloc = array->alloc > 0 ? array->alloc * 2 : 1024;
+        entries = (OBEvictEntry *)fc_malloc(sizeof(OBEvictEntry) * alloc);
+        if (entries == NULL) {
+            return ENOMEM;
+        }
+        if (array->entries != NULL) {
+            memcpy(entries, array->entries,
+                    sizeof(OBEvictEntry) * array->count);
+            free(array->entries);
+        }
+        array->entries = entries;
+        array->alloc = alloc;
+    }
+
+    body_offset = array->bodies.length;
+    if ((result=encode_slices(ob, &array->bodies,
+                    &array->rarray.trunks, &body_len)) != 0)
+    {
+        return result;
+    }
+    if (body_len == 0) {
+        return 0;
+    }
+
+    entry = array->entries + array->count++;
+    entry->ob = ob;
+    ob_entry_hold(ob);
+    entry->last_access_time = ob->last_access_time;
+    entry->bkey = ob->bkey;
+    entry->body_offset = body_offset;
+    entry->body_len = body_len;
+    return 0;
+}
+
+static int collect_cold_blocks()
+{
+    OBEntry **bucket;
+    OBEntry *ob;
+    OBSharedContext *ctx;
+    int64_t scanned;
+    int evict_before;
+    int result;
+
+    result = 0;
+    evict_before = g_current_time - evict_ctx.evict_after_seconds;
+    for (scanned=0; scanned < g_ob_hashtable.capacity &&
+            evict_ctx.block_count < OB_INDEX_EVICT_BATCH_BLOCKS &&
+            result == 0; scanned++)
+    {
+        if (evict_ctx.bucket_index >= g_ob_hashtable.capacity) {
+            evict_ctx.bucket_index = 0;
+        }
+        bucket = g_ob_hashtable.buckets + evict_ctx.bucket_index;
+        ctx = ob_shared_ctx_array.contexts + evict_ctx.bucket_index %
+            ob_shared_ctx_array.count;
+        evict_ctx.bucket_index++;
+
+        if (*bucket == NULL) {
+            continue;
+        }
+
+        PTHREAD_MUTEX_LOCK(&ctx->lcp.lock);
+        for (ob=*bucket; ob!=NULL; ob=ob->next) {
+            if (ob->loading || ob->reclaiming_count > 0 ||
+                    ob->last_access_time >= evict_before)
+            {
+                continue;
+            }
+
+            if ((result=add_evict_entry(evict_ctx.arrays +
+                            FS_BLOCK_HASH_CODE(ob->bkey) %
+                            g_ob_index_tier_stores.count, ob)) != 0)
+            {
+                break;
+            }
+            evict_ctx.block_count++;
+        }
+        PTHREAD_MUTEX_UNLOCK(&ctx->lcp.lock);
+    }
+
+    return result;
+}
+
+static int compare_evict_entry(const OBEvictEntry *e1,
+        const OBEvictEntry *e2)
+{
+    return ob_index_compare_block_key(&e1->bkey, &e2->bkey);
+}
+
+static int build_record_array(OBEvictEntryArray *array)
+{
+    OBEvictEntry *entry;
+    OBEvictEntry *end;
+    OBIndexTierRecord *record;
+
+    if (array->rarray.alloc < array->count) {
+        if (array->rarray.records != NULL) {
+            free(array->rarray.records);
+        }
+        array->rarray.alloc = array->alloc;
+        array->rarray.records = (OBIndexTierRecord *)fc_malloc(
+                sizeof(OBIndexTierRecord) * array->rarray.alloc);
+        if (array->rarray.records == NULL) {
+            array->rarray.alloc = 0;
+            return ENOMEM;
+        }
+    }
+
+    qsort(array->entries, array->count, sizeof(OBEvictEntry),
+            (int (*)(const void *, const void *))compare_evict_entry);
+
+    record = array->rarray.records;
+    end = array->entries + array->count;
+    for (entry=array->entries; entry<end; entry++, record++) {
+        record->bkey = entry->bkey;
+        record->body = array->bodies.buff + entry->body_offset;
+        record->body_len = entry->body_len;
+    }
+    array->rarray.count = array->count;
+    return 0;
+}
+
+static bool evict_one_block(OBEvictEntry *entry,
+        OBIndexTierSegment *segment, const int record_index)
+{
+    OBEntry *previous;
+    OBEntry *ob;
+    OBSliceEntry *slice;
+    UniqSkiplistIterator it;
+    bool evicted;
+    OB_INDEX_SET_BUCKET_AND_CTX(&g_ob_hashtable, entry->bkey);
+
+    evicted = false;
+    ob = entry->ob;
+    PTHREAD_MUTEX_LOCK(&ctx->lcp.lock);
+
+    /* the block is deleted or accessed after collected */
+    if (!ob->removed && ob->reclaiming_count == 0 &&
+            ob->last_access_time == entry->last_access_time)
+    {
+        previous = NULL;
+        if (*bucket != ob) {
+            previous = *bucket;
+            while (previous->next != ob) {
+                previous = previous->next;
+            }
+        }
+
+        ob_index_tier_set_live(segment, record_index);
+        uniq_skiplist_iterator(ob->slices, &it);
+        while ((slice=(OBSliceEntry *)uniq_skiplist_next(&it)) != NULL) {
+            storage_allocator_evict_slice(slice, true);
+        }
+
+        uniq_skiplist_free(ob->slices);
+        remove_ob_entry(bucket, previous, ob);
+        evicted = true;
+    }
+    PTHREAD_MUTEX_UNLOCK(&ctx->lcp.lock);
+
+    return evicted;
+}
+
+static int evict_blocks(OBIndexTierStore *store,
+        OBEvictEntryArray *array, int *evicted_count)
+{
+    OBIndexTierSegment *segment;
+    OBEvictEntry *entry;
+    OBEvictEntry *end;
+    int result;
+
+    if ((result=build_record_array(array)) != 0) {
+        return result;
+    }
+    if ((result=ob_index_tier_write_segment(store,
+                    &array->rarray, &segment)) != 0)
+    {
+        return result;
+    }
+
+    end = array->entries + array->count;
+    for (entry=array->entries; entry<end; entry++) {
+        if (evict_one_block(entry, segment, entry - array->entries)) {
+            (*evicted_count)++;
+        }
+    }
+
+    return 0;
+}
+
+static void release_evict_entries(OBEvictEntryArray *array)
+{
+    OBEvictEntry *entry;
+    OBEvictEntry *end;
+
+    end = array->entries + array->count;
+    for (entry=array->entries; entry<end; entry++) {
+        ob_entry_release(entry->ob);
+    }
+    array->count = 0;
+}
+
+static int64_t get_index_memory_usage()
+{
+    OBSharedContext *ctx;
+    OBSharedContext *end;
+    int64_t bytes;
+
+    bytes = 0;
+    end = ob_shared_ctx_array.contexts + ob_shared_ctx_array.count;
+    for (ctx=ob_shared_ctx_array.contexts; ctx<end; ctx++) {
+        bytes += (int64_t)ctx->ob_allocator.info.element_used_count *
+            ctx->ob_allocator.info.element_size;
+        bytes += (int64_t)ctx->slice_allocator.info.element_used_count *
+            ctx->slice_allocator.info.element_size;
+    }
+
+    return bytes;
+}
+
+/* halve the time before evicting when the memory exceeds the limit,
+ * and restore it step by step when the memory is low enough */
+static void adjust_evict_after_seconds()
+{
+    int64_t memory_limit;
+    int64_t used_bytes;
+    int max_seconds;
+    int min_seconds;
+
+    max_seconds = STORAGE_CFG.object_block.tier.evict_after_seconds;
+    memory_limit = STORAGE_CFG.object_block.tier.memory_limit;
+    if (memory_limit <= 0) {
+        evict_ctx.evict_after_seconds = max_seconds;
+        return;
+    }
+
+    min_seconds = FC_MIN(STORAGE_CFG.object_block.
+            tier.evict_interval, max_seconds);
+    used_bytes = get_index_memory_usage();
+    if (used_bytes > memory_limit) {
+        evict_ctx.evict_after_seconds = FC_MAX(evict_ctx.
+                evict_after_seconds / 2, min_seconds);
+    } else if (used_bytes < memory_limit * 8 / 10) {
+        evict_ctx.evict_after_seconds = FC_MIN(evict_ctx.
+                evict_after_seconds * 2, max_seconds);
+    }
+}
+
+static int evict_cold_blocks()
+{
+    OBEvictEntryArray *array;
+    int evicted_count;
+    int result;
+    int i;
+
+    if (!g_trunk_allocator_vars.data_load_done) {
+        return 0;
+    }
+
+    evicted_count = 0;
+    evict_ctx.block_count = 0;
+    adjust_evict_after_seconds();
+    result = collect_cold_blocks();
+    for (i=0; i<g_ob_index_tier_stores.count; i++) {
+        array = evict_ctx.arrays + i;
+        if (result == 0 && array->count > 0) {
+            result = evict_blocks(g_ob_index_tier_stores.stores + i,
+                    array, &evicted_count);
+        }
+        release_evict_entries(array);
+        array->bodies.length = 0;
+        array->rarray.trunks.count = 0;
+    }
+    ob_index_tier_compact_segments();
+
+    if (result != 0) {
+        logError("file: "__FILE__", line: %d, "
+                "evict cold blocks to the on-disk tier fail, "
+                "errno: %d, error info: %s", __LINE__,
+                result, STRERROR(result));
+    } else if (evicted_count > 0) {
+        logInfo("file: "__FILE__", line: %d, "
+                "evicted block count: %d, evict after seconds: %d, "
+                "ob index tier stat {evicted: %"PRId64", "
+                "faulted: %"PRId64", bloom negatives: %"PRId64", "
+                "disk lookups: %"PRId64", disk misses: %"PRId64", "
+                "compacted segments: %"PRId64"}", __LINE__, evicted_count,
+                evict_ctx.evict_after_seconds,
+                g_ob_index_tier_stat.evicted_blocks,
+                g_ob_index_tier_stat.faulted_blocks,
+                g_ob_index_tier_stat.bloom_negatives,
+                g_ob_index_tier_stat.disk_lookups,
+                g_ob_index_tier_stat.disk_misses,
+                g_ob_index_tier_stat.compacted_segments);
+    }
+
+    return result;
+}
+
+/* the segment writing and the compaction do disk IO, so run them in
+ * the dedicated thread instead of the shared schedule thread */
+static void *evict_thread_func(void *arg)
+{
+    int next_time;
+
+    next_time = g_current_time + STORAGE_CFG.object_block.tier.evict_interval;
+    while (SF_G_CONTINUE_FLAG) {
+        sleep(1);
+        if (g_current_time < next_time) {
+            continue;
+        }
+
+        evict_cold_blocks();
+        next_time = g_current_time + STORAGE_CFG.
+            object_block.tier.evict_interval;
+    }
+
+    return NULL;
+}
+
+int ob_index_start_evict_thread()
+{
+    pthread_t tid;
+    int bytes;
+
+    if (!OB_INDEX_TIER_ENABLED) {
+        return 0;
+    }
+
+    bytes = sizeof(OBEvictEntryArray) * g_ob_index_tier_stores.count;
+    evict_ctx.arrays = (OBEvictEntryArray *)fc_malloc(bytes);
+    if (evict_ctx.arrays == NULL) {
+        return ENOMEM;
+    }
+    memset(evict_ctx.arrays, 0, bytes);
+    evict_ctx.evict_after_seconds = STORAGE_CFG.
+        object_block.tier.evict_after_seconds;
+
+    return fc_create_thread(&tid, evict_thread_func,
+            NULL, SF_G_THREAD_STACK_SIZE);
+}
+
+static bool trunk_slice_filter(const OBIndexTierRecord *record, void *args)
+{
+    const FSTrunkSpaceInfo *space;
+    const char *p;
+    const char *end;
+
+    space = (const FSTrunkSpaceInfo *)args;
+    p = record->body + 4;
+    end = record->body + record->body_len;
+    while (p < end) {
+        if (buff2int(p + 13) == space->store->index &&
+                buff2long(p + 17) == space->id_info.id)
+        {
+            return true;
+        }
+        p += OB_INDEX_SLICE_RECORD_SIZE;
+    }
+
+    return false;
+}
+
+int ob_index_load_trunk_slices(FSStorePath *store,
+        const FSTrunkIdInfo *id_info)
+{
+    FSTrunkSpaceInfo space;
+    OBIndexTierTrunkKey trunk;
+    FSBlockKey *bkeys;
+    FSBlockKey *bkey;
+    FSBlockKey *end;
+    int count;
+    int result;
+
+    if (!OB_INDEX_TIER_ENABLED) {
+        return 0;
+    }
+
+    space.store = store;
+    space.id_info = *id_info;
+    trunk.path_index = store->index;
+    trunk.trunk_id = id_info->id;
+    if ((result=ob_index_tier_scan(&trunk, trunk_slice_filter,
+                    &space, &bkeys, &count)) != 0)
+    {
+        return result;
+    }
+
+    end = bkeys + count;
+    for (bkey=bkeys; bkey<end; bkey++) {
+        OB_INDEX_SET_BUCKET_AND_CTX(&g_ob_hashtable, *bkey);
+        PTHREAD_MUTEX_LOCK(&ctx->lcp.lock);
+        get_ob_entry(&g_ob_hashtable, ctx, bucket, bkey, false);
+        PTHREAD_MUTEX_UNLOCK(&ctx->lcp.lock);
+    }
+
+    if (bkeys != NULL) {
+        free(bkeys);
+    }
+    return 0;
+}
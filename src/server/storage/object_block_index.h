@@ -129,6 +129,13 @@ extern "C" {
     OBEntry *ob_index_reclaim_lock(const FSBlockKey *bkey);
     void ob_index_reclaim_unlock(OBEntry *ob);
 
+    /* evict the cold blocks to the on-disk tier periodically */
+    int ob_index_start_evict_thread();
+
+    /* load the evicted blocks which slices in the trunk */
+    int ob_index_load_trunk_slices(FSStorePath *store,
+            const FSTrunkIdInfo *id_info);
+
 #ifdef __cplusplus
 }
 #endif
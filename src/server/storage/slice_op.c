@@ -119,7 +119,8 @@ int fs_log_slice_write(FSSliceOpContext *op_ctx)
     {
         if ((result=slice_binlog_log_add_slice(slice_sn_pair->slice,
                         current_time, slice_sn_pair->sn, op_ctx->info.
-                        data_version, op_ctx->info.source)) != 0)
+                        data_version, op_ctx->info.source,
+                        op_ctx->info.write_binlog.batch)) != 0)
         {
             break;
         }
@@ -129,7 +130,8 @@ int fs_log_slice_write(FSSliceOpContext *op_ctx)
         if ((result=replica_binlog_log_write_slice(current_time,
                         op_ctx->info.data_group_id, op_ctx->info.
                         data_version, &op_ctx->info.bs_key,
-                        op_ctx->info.source)) != 0)
+                        op_ctx->info.source, op_ctx->info.
+                        write_binlog.batch)) != 0)
         {
             return result;
         }
@@ -219,24 +221,28 @@ static inline OBSliceEntry *alloc_init_slice(const FSBlockKey *bkey,
     return slice;
 }
 
+static inline FSAllocStream fs_slice_alloc_stream(const int source)
+{
+    switch (source) {
+        case BINLOG_SOURCE_RECLAIM:
+            return fs_alloc_stream_reclaim;
+        case BINLOG_SOURCE_REPLAY:
+            return fs_alloc_stream_recovery;
+        default:
+            return fs_alloc_stream_normal;
+    }
+}
+
 static int fs_slice_alloc(const FSBlockSliceKeyInfo *bs_key,
-        const OBSliceType slice_type, const bool reclaim_alloc,
+        const OBSliceType slice_type, const FSAllocStream stream,
         FSSliceSNPair *slice_sn_pairs, int *slice_count)
 {
     int result;
     FSTrunkSpaceInfo spaces[FS_MAX_SPLIT_COUNT_PER_SPACE_ALLOC];
 
-    if (reclaim_alloc) {
-        result = storage_allocator_reclaim_alloc(
-                FS_BLOCK_HASH_CODE(bs_key->block),
-                bs_key->slice.length, spaces, slice_count);
-    } else {
-        result = storage_allocator_normal_alloc(
-                FS_BLOCK_HASH_CODE(bs_key->block),
-                bs_key->slice.length, spaces, slice_count);
-    }
-
-    if (result != 0) {
+    if ((result=storage_allocator_alloc(&bs_key->block, bs_key->slice.
+                    length, spaces, slice_count, stream)) != 0)
+    {
         return result;
     }
 
@@ -296,7 +302,7 @@ int fs_slice_write(FSSliceOpContext *op_ctx)
 
     //TODO notify alloc fail
     if ((result=fs_slice_alloc(&op_ctx->info.bs_key, OB_SLICE_TYPE_FILE,
-                    op_ctx->info.source == BINLOG_SOURCE_RECLAIM,
+                    fs_slice_alloc_stream(op_ctx->info.source),
                     op_ctx->update.sarray.slice_sn_pairs,
                     &op_ctx->update.sarray.count)) != 0)
     {
@@ -463,7 +469,8 @@ int fs_slice_allocate(FSSliceOpContext *op_ctx)
         for (k=0; k<count; k++) {
             new_bskey.slice = ssizes[k];
             if ((result=fs_slice_alloc(&new_bskey, OB_SLICE_TYPE_ALLOC,
-                            false, op_ctx->update.sarray.slice_sn_pairs +
+                            fs_slice_alloc_stream(op_ctx->info.source),
+                            op_ctx->update.sarray.slice_sn_pairs +
                             op_ctx->update.sarray.count, &n)) != 0)
             {
                 break;
@@ -526,7 +533,8 @@ int fs_log_slice_allocate(FSSliceOpContext *op_ctx)
     {
         if ((result=slice_binlog_log_add_slice(slice_sn_pair->slice,
                         current_time, slice_sn_pair->sn, op_ctx->info.
-                        data_version, op_ctx->info.source)) != 0)
+                        data_version, op_ctx->info.source,
+                        op_ctx->info.write_binlog.batch)) != 0)
         {
             return result;
         }
@@ -538,7 +546,8 @@ int fs_log_slice_allocate(FSSliceOpContext *op_ctx)
         if ((result=replica_binlog_log_alloc_slice(current_time,
                         op_ctx->info.data_group_id, op_ctx->info.
                         data_version, &op_ctx->info.bs_key,
-                        op_ctx->info.source)) != 0)
+                        op_ctx->info.source, op_ctx->info.
+                        write_binlog.batch)) != 0)
         {
             return result;
         }
@@ -666,7 +675,8 @@ int fs_log_delete_slices(FSSliceOpContext *op_ctx)
     current_time = g_current_time;
     if ((result=slice_binlog_log_del_slice(&op_ctx->info.bs_key,
                     current_time, op_ctx->info.sn, op_ctx->info.
-                    data_version, op_ctx->info.source)) != 0)
+                    data_version, op_ctx->info.source,
+                    op_ctx->info.write_binlog.batch)) != 0)
     {
         return result;
     }
@@ -675,7 +685,7 @@ int fs_log_delete_slices(FSSliceOpContext *op_ctx)
         return replica_binlog_log_del_slice(current_time,
                 op_ctx->info.data_group_id, op_ctx->info.
                 data_version, &op_ctx->info.bs_key,
-                op_ctx->info.source);
+                op_ctx->info.source, op_ctx->info.write_binlog.batch);
     }
     return 0;
 }
@@ -704,7 +714,7 @@ int fs_log_delete_block(FSSliceOpContext *op_ctx)
     current_time = g_current_time;
     if ((result=slice_binlog_log_del_block(&op_ctx->info.bs_key.block,
                     current_time, op_ctx->info.sn, op_ctx->info.data_version,
-                    op_ctx->info.source)) != 0)
+                    op_ctx->info.source, op_ctx->info.write_binlog.batch)) != 0)
     {
         return result;
     }
@@ -712,7 +722,8 @@ int fs_log_delete_block(FSSliceOpContext *op_ctx)
     if (op_ctx->info.write_binlog.log_replica) {
         return replica_binlog_log_del_block(current_time,
                 op_ctx->info.data_group_id, op_ctx->info.data_version,
-                &op_ctx->info.bs_key.block, op_ctx->info.source);
+                &op_ctx->info.bs_key.block, op_ctx->info.source,
+                op_ctx->info.write_binlog.batch);
     }
 
     return 0;
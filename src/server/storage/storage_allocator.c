@@ -90,12 +90,19 @@ int storage_allocator_init()
     memset(g_allocator_mgr->allocator_ptr_array.allocators, 0, bytes);
     g_allocator_mgr->allocator_ptr_array.count = count;
 
+    bytes = count * count;
+    g_allocator_mgr->select_second = (volatile char *)fc_malloc(bytes);
+    if (g_allocator_mgr->select_second == NULL) {
+        return ENOMEM;
+    }
+    memset((void *)g_allocator_mgr->select_second, 0, bytes);
+
     if ((result=init_pthread_lock(&g_allocator_mgr->lock)) != 0) {
         return result;
     }
 
     if ((result=trunk_freelist_init(&g_allocator_mgr->
-                    reclaim_freelist)) != 0)
+                    reclaim_freelist, 1)) != 0)
     {
         return result;
     }
@@ -360,16 +367,199 @@ static int check_trunk_avail_func(void *args)
     return result;
 }
 
-static int setup_check_trunk_avail_schedule()
+static int calc_select_weight(FSTrunkAllocator *allocator)
 {
+    FSStoragePathInfo *path_info;
+    int64_t disk_avail;
+    int64_t avail;
+    int64_t used;
+    double free_ratio;
+    double load;
+
+    path_info = allocator->path_info;
+    storage_config_calc_path_avail_space(path_info);
+    disk_avail = path_info->space_stat.avail -
+        path_info->reserved_space.value;
+    if (disk_avail < 0) {
+        disk_avail = 0;
+    }
+    avail = __sync_add_and_fetch(&path_info->trunk_stat.avail, 0) +
+        disk_avail;
+    used = __sync_add_and_fetch(&path_info->trunk_stat.used, 0);
+    if (avail <= 0) {
+        return 0;
+    }
+    free_ratio = (double)avail / (double)(avail + used);
+
+    /* the latency in milliseconds and the queue depth as the load */
+    load = 1.00 + (double)__sync_add_and_fetch(&path_info->
+            io_stat.latency_us, 0) / 1000.00 +
+        (double)__sync_add_and_fetch(&path_info->
+                io_stat.queue_depth, 0) / 8.00;
+    return (int)(10000.00 * free_ratio / load) + 1;
+}
+
+/* the choice of the pair switches only when the other candidate is
+ * better by 10%, the choice is kept while the weights are close */
+static void update_select_choices()
+{
+    FSTrunkAllocator *first;
+    FSTrunkAllocator *second;
+    FSTrunkAllocator *end;
+    volatile char *select_second;
+    int64_t first_weight;
+    int64_t second_weight;
+
+    end = g_allocator_mgr->store_path.all.allocators +
+        g_allocator_mgr->store_path.all.count;
+    for (first=g_allocator_mgr->store_path.all.allocators;
+            first<end; first++)
+    {
+        for (second=g_allocator_mgr->store_path.all.allocators;
+                second<end; second++)
+        {
+            if (second == first) {
+                continue;
+            }
+
+            first_weight = first->select_weight;
+            second_weight = second->select_weight;
+            select_second = g_allocator_mgr->select_second +
+                first->path_info->store.index * g_allocator_mgr->
+                allocator_ptr_array.count + second->path_info->store.index;
+            if (*select_second) {
+                if (first_weight * 10 > second_weight * 11) {
+                    *select_second = 0;
+                }
+            } else if (second_weight * 10 > first_weight * 11) {
+                *select_second = 1;
+            }
+        }
+    }
+}
+
+static int calc_select_weights_func(void *args)
+{
+    FSTrunkAllocator *allocator;
+    FSTrunkAllocator *end;
+
+    end = g_allocator_mgr->store_path.all.allocators +
+        g_allocator_mgr->store_path.all.count;
+    for (allocator=g_allocator_mgr->store_path.all.allocators;
+            allocator<end; allocator++)
+    {
+        allocator->select_weight = calc_select_weight(allocator);
+    }
+
+    update_select_choices();
+    return 0;
+}
+
+static void log_stream_stats()
+{
+    const char *names[FS_ALLOC_STREAM_COUNT] = {
+        "normal", "reclaim", "recovery"};
+    FSAllocStreamStat *stat;
+    int64_t written_bytes;
+    int64_t migrated_bytes;
+    int stream;
+
+    for (stream=0; stream<FS_ALLOC_STREAM_COUNT; stream++) {
+        stat = g_allocator_mgr->stream_stats + stream;
+        written_bytes = __sync_add_and_fetch(&stat->written_bytes, 0);
+        migrated_bytes = __sync_add_and_fetch(&stat->migrated_bytes, 0);
+        if (written_bytes == stat->last_written_bytes &&
+                migrated_bytes == stat->last_migrated_bytes)
+        {
+            continue;
+        }
+
+        /* write amplification: the data written by the stream
+         * plus the copies made by reclaiming its trunks */
+        logInfo("file: "__FILE__", line: %d, "
+                "alloc stream: %s, written: %"PRId64" MB, "
+                "migrated by reclaim: %"PRId64" MB, "
+                "total written: %"PRId64" MB, total migrated: %"PRId64
+                " MB, write amplification: %.3f", __LINE__, names[stream],
+                (written_bytes - stat->last_written_bytes) / (1024 * 1024),
+                (migrated_bytes - stat->last_migrated_bytes) / (1024 * 1024),
+                written_bytes / (1024 * 1024), migrated_bytes / (1024 * 1024),
+                written_bytes > 0 ? (double)(written_bytes +
+                    migrated_bytes) / (double)written_bytes : 0.00);
+        stat->last_written_bytes = written_bytes;
+        stat->last_migrated_bytes = migrated_bytes;
+    }
+}
+
+static int log_alloc_stat_func(void *args)
+{
+    FSTrunkAllocator *allocator;
+    FSTrunkAllocator *end;
+    FSTrunkAllocLockStat *stat;
+    int64_t lock_waits;
+    int64_t lock_wait_us;
+
+    log_stream_stats();
+
+    end = g_allocator_mgr->store_path.all.allocators +
+        g_allocator_mgr->store_path.all.count;
+    for (allocator=g_allocator_mgr->store_path.all.allocators;
+            allocator<end; allocator++)
+    {
+        if (STORAGE_CFG.block_extent_size > 0) {
+            logInfo("file: "__FILE__", line: %d, "
+                    "path: %s, block extent reserves: %"PRId64", "
+                    "hits: %"PRId64", wasted bytes: %"PRId64, __LINE__,
+                    allocator->path_info->store.path.str,
+                    __sync_add_and_fetch(&allocator->freelist.
+                        extent_stat.reserves, 0),
+                    __sync_add_and_fetch(&allocator->freelist.
+                        extent_stat.hits, 0),
+                    __sync_add_and_fetch(&allocator->freelist.
+                        extent_stat.wasted_bytes, 0));
+        }
+
+        stat = &allocator->freelist.lock_stat;
+        lock_waits = __sync_add_and_fetch(&stat->lock_waits, 0);
+        lock_wait_us = __sync_add_and_fetch(&stat->lock_wait_us, 0);
+        if (lock_waits == stat->last_lock_waits) {
+            continue;
+        }
+
+        logInfo("file: "__FILE__", line: %d, "
+                "path: %s, alloc cursor lock waits: %"PRId64", "
+                "wait time: %"PRId64" us, total lock waits: %"PRId64", "
+                "total wait time: %"PRId64" ms", __LINE__,
+                allocator->path_info->store.path.str,
+                lock_waits - stat->last_lock_waits,
+                lock_wait_us - stat->last_lock_wait_us,
+                lock_waits, lock_wait_us / 1000);
+        stat->last_lock_waits = lock_waits;
+        stat->last_lock_wait_us = lock_wait_us;
+    }
+
+    return 0;
+}
+
+static int setup_allocator_schedules()
+{
+#define STORAGE_ALLOCATOR_SCHEDULE_COUNT  3
     ScheduleArray scheduleArray;
-    ScheduleEntry scheduleEntry;
+    ScheduleEntry scheduleEntries[STORAGE_ALLOCATOR_SCHEDULE_COUNT];
+
+    calc_select_weights_func(NULL);
 
-    INIT_SCHEDULE_ENTRY(scheduleEntry, sched_generate_next_id(),
+    INIT_SCHEDULE_ENTRY(scheduleEntries[0], sched_generate_next_id(),
            TIME_NONE, TIME_NONE, TIME_NONE, 10,
             check_trunk_avail_func, NULL);
-    scheduleArray.entries = &scheduleEntry;
-    scheduleArray.count = 1;
+    INIT_SCHEDULE_ENTRY(scheduleEntries[1], sched_generate_next_id(),
+           TIME_NONE, TIME_NONE, TIME_NONE, 60,
+            log_alloc_stat_func, NULL);
+    INIT_SCHEDULE_ENTRY(scheduleEntries[2], sched_generate_next_id(),
+           TIME_NONE, TIME_NONE, TIME_NONE, 5,
+            calc_select_weights_func, NULL);
+    scheduleArray.entries = scheduleEntries;
+    scheduleArray.count = STORAGE_ALLOCATOR_SCHEDULE_COUNT;
     return sched_add_entries(&scheduleArray);
 }
 
@@ -396,7 +586,11 @@ int storage_allocator_prealloc_trunk_freelists()
         return result;
     }
 
-    if ((result=setup_check_trunk_avail_schedule()) != 0) {
+    if ((result=setup_allocator_schedules()) != 0) {
+        return result;
+    }
+
+    if ((result=ob_index_start_evict_thread()) != 0) {
         return result;
     }
     wait_allocator_available();
@@ -38,11 +38,23 @@ typedef struct {
     volatile FSTrunkAllocatorPtrArray *avail;
 } FSStorageAllocatorContext;
 
+typedef struct {
+    volatile int64_t written_bytes;   //the space allocated by the stream
+    volatile int64_t migrated_bytes;  //moved out of its trunks by reclaim
+    int64_t last_written_bytes;       //for stat log
+    int64_t last_migrated_bytes;      //for stat log
+} FSAllocStreamStat;
+
 typedef struct {
     FSStorageAllocatorContext write_cache;
     FSStorageAllocatorContext store_path;
     FSTrunkFreelist reclaim_freelist;  //special purpose for reclaiming
+    FSAllocStreamStat stream_stats[FS_ALLOC_STREAM_COUNT];
     FSTrunkAllocatorPtrArray allocator_ptr_array; //by store path index
+
+    /* the choice of the candidate pair with the hysteresis, indexed by
+     * first path index * path count + second path index, 1 for second */
+    volatile char *select_second;
     struct fast_mblock_man aptr_array_allocator;
     pthread_mutex_t lock;
     int64_t current_trunk_id;
@@ -89,14 +101,48 @@ extern "C" {
                 allocators[path_index], id_info->id);
     }
 
+    /* power of two choices: the two candidates are derived from the block
+     * hash code, and the choice of the pair is kept until the weight of
+     * the other candidate is clearly larger, so the blocks of the pair
+     * do NOT flip between the paths while the weights are close */
+    static inline FSTrunkAllocator **storage_allocator_select(
+            FSTrunkAllocatorPtrArray *avail_array, const uint32_t blk_hc)
+    {
+        FSTrunkAllocator **first;
+        FSTrunkAllocator **second;
+        int index;
+
+        index = blk_hc % avail_array->count;
+        first = avail_array->allocators + index;
+        if (!STORAGE_CFG.weighted_path_select || avail_array->count == 1) {
+            return first;
+        }
+
+        index = (index + 1 + (blk_hc / avail_array->count) %
+                (avail_array->count - 1)) % avail_array->count;
+        second = avail_array->allocators + index;
+        if (g_allocator_mgr->select_second[(*first)->path_info->store.index *
+                g_allocator_mgr->allocator_ptr_array.count +
+                (*second)->path_info->store.index])
+        {
+            return second;
+        }
+        return first;
+    }
+
     static inline int storage_allocator_normal_alloc_ex(
-            const uint32_t blk_hc, const int size,
-            FSTrunkSpaceInfo *spaces, int *count, const bool is_normal)
+            const FSBlockKey *bkey, const int size,
+            FSTrunkSpaceInfo *spaces, int *count,
+            const FSAllocStream stream)
     {
         FSTrunkAllocatorPtrArray *avail_array;
         FSTrunkAllocator **allocator;
+        uint32_t blk_hc;
+        bool is_normal;
         int result;
 
+        is_normal = (stream != fs_alloc_stream_reclaim);
+        blk_hc = FS_BLOCK_HASH_CODE(*bkey);
         do {
             avail_array = (FSTrunkAllocatorPtrArray *)
                 g_allocator_mgr->store_path.avail;
@@ -105,35 +151,67 @@ extern "C" {
                 break;
             }
 
-            allocator = avail_array->allocators +
-                blk_hc % avail_array->count;
+            /* the cursor of the path is chosen by the quotient, the
+             * blocks of a path share the same remainder of the path
+             * count, which would leave the cursors unused */
+            allocator = storage_allocator_select(avail_array, blk_hc);
             result = trunk_freelist_alloc_space(*allocator,
-                    &(*allocator)->freelist, blk_hc, size,
-                    spaces, count, is_normal);
+                    &(*allocator)->freelist, bkey, blk_hc /
+                    avail_array->count, size, spaces, count, stream);
         } while ((result == ENOSPC || result == EAGAIN) && is_normal);
 
         return result;
     }
 
-    static inline int storage_allocator_reclaim_alloc(const uint32_t blk_hc,
+    static inline int storage_allocator_reclaim_alloc(const FSBlockKey *bkey,
             const int size, FSTrunkSpaceInfo *spaces, int *count)
     {
-        const bool is_normal = false;
         int result;
 
-        if ((result=storage_allocator_normal_alloc_ex(blk_hc,
-                        size, spaces, count, is_normal)) == 0)
+        if ((result=storage_allocator_normal_alloc_ex(bkey, size, spaces,
+                        count, fs_alloc_stream_reclaim)) == 0)
         {
             return result;
         }
 
         return trunk_freelist_alloc_space(NULL,
-                &g_allocator_mgr->reclaim_freelist, blk_hc,
-                size, spaces, count, is_normal);
+                &g_allocator_mgr->reclaim_freelist, bkey,
+                FS_BLOCK_HASH_CODE(*bkey), size, spaces,
+                count, fs_alloc_stream_reclaim);
+    }
+
+#define storage_allocator_normal_alloc(bkey, size, spaces, count) \
+    storage_allocator_normal_alloc_ex(bkey, size, spaces, \
+            count, fs_alloc_stream_normal)
+
+    static inline int storage_allocator_alloc(const FSBlockKey *bkey,
+            const int size, FSTrunkSpaceInfo *spaces, int *count,
+            const FSAllocStream stream)
+    {
+        int result;
+
+        if (stream == fs_alloc_stream_reclaim) {
+            result = storage_allocator_reclaim_alloc(bkey,
+                    size, spaces, count);
+        } else {
+            result = storage_allocator_normal_alloc_ex(bkey,
+                    size, spaces, count, stream);
+        }
+
+        if (result == 0) {
+            __sync_add_and_fetch(&g_allocator_mgr->stream_stats[stream].
+                    written_bytes, size);
+        }
+        return result;
     }
 
-#define storage_allocator_normal_alloc(blk_hc, size, spaces, count) \
-    storage_allocator_normal_alloc_ex(blk_hc, size, spaces, count, true)
+    /* the bytes of the trunk which filled by the stream are migrated */
+    static inline void storage_allocator_stream_migrated(
+            const FSTrunkFileInfo *trunk, const int64_t bytes)
+    {
+        __sync_add_and_fetch(&g_allocator_mgr->stream_stats[(int)trunk->
+                alloc.stream].migrated_bytes, bytes);
+    }
 
     static inline int storage_allocator_add_slice(OBSliceEntry *slice,
             const bool modify_used_space)
@@ -163,6 +241,14 @@ extern "C" {
         return trunk_allocator_delete_slice(allocator, slice);
     }
 
+    static inline int storage_allocator_evict_slice(OBSliceEntry *slice,
+            const bool evict)
+    {
+        return trunk_allocator_evict_slice(g_allocator_mgr->
+                allocator_ptr_array.allocators[slice->space.store->index],
+                slice, evict);
+    }
+
     int fs_move_allocator_ptr_array(FSTrunkAllocatorPtrArray **src_array,
             FSTrunkAllocatorPtrArray **dest_array, FSTrunkAllocator *allocator);
 
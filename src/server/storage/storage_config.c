@@ -270,8 +270,11 @@ static int load_global_items(FSStorageConfig *storage_cfg,
     int result;
     char *tf_size;
     char *discard_size;
+    char *extent_size;
+    char *memory_limit;
     int64_t trunk_file_size;
     int64_t discard_remain_space_size;
+    int64_t block_extent_size;
 
     storage_cfg->fd_cache_capacity_per_read_thread = iniGetIntValue(NULL,
             "fd_cache_capacity_per_read_thread", ini_ctx->context, 256);
@@ -301,6 +304,40 @@ static int load_global_items(FSStorageConfig *storage_cfg,
         storage_cfg->object_block.shared_locks_count = 163;
     }
 
+    storage_cfg->object_block.tier.enabled = iniGetBoolValue(NULL,
+            "object_block_tier_enabled", ini_ctx->context, false);
+    storage_cfg->object_block.tier.evict_after_seconds = iniGetIntValue(NULL,
+            "object_block_evict_after_seconds", ini_ctx->context, 86400);
+    if (storage_cfg->object_block.tier.evict_after_seconds <= 0) {
+        logWarning("file: "__FILE__", line: %d, "
+                "config file: %s, item \"object_block_evict_after_seconds\": "
+                "%d is invalid, set to default: %d",
+                __LINE__, ini_ctx->filename, storage_cfg->
+                object_block.tier.evict_after_seconds, 86400);
+        storage_cfg->object_block.tier.evict_after_seconds = 86400;
+    }
+
+    storage_cfg->object_block.tier.evict_interval = iniGetIntValue(NULL,
+            "object_block_evict_interval", ini_ctx->context, 300);
+    if (storage_cfg->object_block.tier.evict_interval <= 0) {
+        logWarning("file: "__FILE__", line: %d, "
+                "config file: %s, item \"object_block_evict_interval\": "
+                "%d is invalid, set to default: %d",
+                __LINE__, ini_ctx->filename, storage_cfg->
+                object_block.tier.evict_interval, 300);
+        storage_cfg->object_block.tier.evict_interval = 300;
+    }
+
+    memory_limit = iniGetStrValue(NULL, "object_block_tier_memory_limit",
+            ini_ctx->context);
+    if (memory_limit == NULL || *memory_limit == '\0') {
+        storage_cfg->object_block.tier.memory_limit = 0;
+    } else if ((result=parse_bytes(memory_limit, 1, &storage_cfg->
+                    object_block.tier.memory_limit)) != 0)
+    {
+        return result;
+    }
+
     storage_cfg->write_threads_per_path = iniGetIntValue(NULL,
             "write_threads_per_path", ini_ctx->context, 1);
     if (storage_cfg->write_threads_per_path <= 0) {
@@ -313,6 +350,21 @@ static int load_global_items(FSStorageConfig *storage_cfg,
         storage_cfg->read_threads_per_path = 1;
     }
 
+    storage_cfg->alloc_cursors_per_path = iniGetIntValue(NULL,
+            "alloc_cursors_per_path", ini_ctx->context, 4);
+    if (storage_cfg->alloc_cursors_per_path <= 0) {
+        storage_cfg->alloc_cursors_per_path = 1;
+    } else if (storage_cfg->alloc_cursors_per_path > 64) {
+        logWarning("file: "__FILE__", line: %d, "
+                "config file: %s, item \"alloc_cursors_per_path\": %d "
+                "is too large, set to %d", __LINE__, ini_ctx->filename,
+                storage_cfg->alloc_cursors_per_path, 64);
+        storage_cfg->alloc_cursors_per_path = 64;
+    }
+
+    storage_cfg->weighted_path_select = iniGetBoolValue(NULL,
+            "weighted_path_select", ini_ctx->context, true);
+
     if ((result=iniGetPercentValue(ini_ctx, "prealloc_space_per_path",
                     &storage_cfg->prealloc_space.ratio_per_path, 0.05)) != 0)
     {
@@ -404,6 +456,25 @@ static int load_global_items(FSStorageConfig *storage_cfg,
             FS_DISCARD_REMAIN_SPACE_MAX_SIZE;
     }
 
+    extent_size = iniGetStrValue(NULL, "block_extent_size",
+            ini_ctx->context);
+    if (extent_size == NULL || *extent_size == '\0') {
+        block_extent_size = FS_DEFAULT_BLOCK_EXTENT_SIZE;
+    } else if ((result=parse_bytes(extent_size, 1,
+                    &block_extent_size)) != 0) {
+        return result;
+    }
+
+    if (block_extent_size < 0) {
+        block_extent_size = 0;
+    } else if (block_extent_size > FS_FILE_BLOCK_SIZE) {
+        logWarning("file: "__FILE__", line: %d, "
+                "block_extent_size: %"PRId64" is too large, set to %d",
+                __LINE__, block_extent_size, FS_FILE_BLOCK_SIZE);
+        block_extent_size = FS_FILE_BLOCK_SIZE;
+    }
+    storage_cfg->block_extent_size = MEM_ALIGN(block_extent_size);
+
     if ((result=iniGetPercentValue(ini_ctx, "reserved_space_per_disk",
                     &storage_cfg->reserved_space_per_disk, 0.10)) != 0)
     {
@@ -643,9 +714,13 @@ void storage_config_to_log(FSStorageConfig *storage_cfg)
 {
     logInfo("storage config, write_threads_per_path: %d, "
             "read_threads_per_path: %d, "
+            "alloc_cursors_per_path: %d, "
+            "weighted_path_select: %d, "
             "fd_cache_capacity_per_read_thread: %d, "
             "object_block_hashtable_capacity: %"PRId64", "
             "object_block_shared_locks_count: %d, "
+            "object_block_tier: {enabled: %d, evict_after_seconds: %d, "
+            "evict_interval: %d, memory_limit: %"PRId64" MB}, "
             "prealloc_space: {ratio_per_path: %.2f%%, "
             "start_time: %02d:%02d, end_time: %02d:%02d }, "
             "trunk_prealloc_threads: %d, "
@@ -653,6 +728,7 @@ void storage_config_to_log(FSStorageConfig *storage_cfg)
             "trunk_file_size: %"PRId64" MB, "
             "max_trunk_files_per_subdir: %d, "
             "discard_remain_space_size: %d, "
+            "block_extent_size: %d KB, "
 #if 0
             / * "write_cache_to_hd: { on_usage: %.2f%%, start_time: %02d:%02d, "
             "end_time: %02d:%02d }, "  */
@@ -661,9 +737,15 @@ void storage_config_to_log(FSStorageConfig *storage_cfg)
             "never_reclaim_on_trunk_usage: %.2f%%",
             storage_cfg->write_threads_per_path,
             storage_cfg->read_threads_per_path,
+            storage_cfg->alloc_cursors_per_path,
+            storage_cfg->weighted_path_select,
             storage_cfg->fd_cache_capacity_per_read_thread,
             storage_cfg->object_block.hashtable_capacity,
             storage_cfg->object_block.shared_locks_count,
+            storage_cfg->object_block.tier.enabled,
+            storage_cfg->object_block.tier.evict_after_seconds,
+            storage_cfg->object_block.tier.evict_interval,
+            storage_cfg->object_block.tier.memory_limit / (1024 * 1024),
             storage_cfg->prealloc_space.ratio_per_path * 100.00,
             storage_cfg->prealloc_space.start_time.hour,
             storage_cfg->prealloc_space.start_time.minute,
@@ -674,6 +756,7 @@ void storage_config_to_log(FSStorageConfig *storage_cfg)
             storage_cfg->trunk_file_size / (1024 * 1024),
             storage_cfg->max_trunk_files_per_subdir,
             storage_cfg->discard_remain_space_size,
+            storage_cfg->block_extent_size / 1024,
             /*
             storage_cfg->write_cache_to_hd.on_usage * 100.00,
             storage_cfg->write_cache_to_hd.start_time.hour,
@@ -51,6 +51,11 @@ typedef struct {
     } space_stat;  //for disk space
 
     FSTrunkSpaceStat trunk_stat;  //for trunk space
+
+    struct {
+        volatile int queue_depth;     //the pending requests of IO threads
+        volatile int64_t latency_us;  //EWMA of the IO service time
+    } io_stat;  //for weighted path selection
 } FSStoragePathInfo;
 
 typedef struct {
@@ -77,15 +82,24 @@ typedef struct {
 
     int write_threads_per_path;
     int read_threads_per_path;
+    int alloc_cursors_per_path;  //concurrent allocation cursors
+    bool weighted_path_select;   //select the store path by weight
     double reserved_space_per_disk;
     int max_trunk_files_per_subdir;
     int64_t trunk_file_size;
     int discard_remain_space_size;
+    int block_extent_size;  //reserved extent size per block, 0 for disable
     int trunk_prealloc_threads;
     int fd_cache_capacity_per_read_thread;
     struct {
         int shared_locks_count;
         int64_t hashtable_capacity;
+        struct {
+            bool enabled;
+            int evict_after_seconds;  //evict the block not accessed in time
+            int evict_interval;       //the interval to check cold blocks
+            int64_t memory_limit;     //the memory of the index, 0 for no limit
+        } tier;  //the on-disk tier of the object block index
     } object_block;
     double reclaim_trunks_on_path_usage;
     double never_reclaim_on_trunk_usage;
@@ -67,6 +67,13 @@ typedef enum ob_slice_type {
     OB_SLICE_TYPE_ALLOC = 'A'  /* allocate slice (index and space allocate only) */
 } OBSliceType;
 
+/* the trunks are opened by stream to separate the hot and cold data */
+typedef enum {
+    fs_alloc_stream_normal,   //new writes from the clients
+    fs_alloc_stream_reclaim,  //the survivors migrated by trunk reclaim
+    fs_alloc_stream_recovery  //data recovery by binlog replay
+} FSAllocStream;
+
 typedef struct {
     UniqSkiplistFactory factory;
     struct fast_mblock_man ob_allocator;    //for ob_entry
@@ -76,7 +83,11 @@ typedef struct {
 
 typedef struct ob_entry {
     FSBlockKey bkey;
+    volatile int ref_count; //referred by the hashtable and the slices
     int reclaiming_count;
+    int last_access_time;  //for evicting to the on-disk tier
+    bool removed;  //removed from the hashtable by evicting or deleting
+    bool loading;  //the placeholder during loading from the on-disk tier
     UniqSkiplist *slices;  //the element is OBSliceEntry
     struct ob_entry *next; //for hashtable
 } OBEntry;
@@ -108,6 +119,7 @@ typedef struct ob_slice_ptr_array {
 
 struct fs_cluster_data_server_info;
 struct fs_data_thread_context;
+struct fs_replica_rpc_waiter;
 typedef struct fs_slice_op_context {
     fs_data_op_notify_func notify_func;  //for data thread
     fs_rw_done_callback_func rw_done_callback; //for caller (data or nio thread)
@@ -119,6 +131,7 @@ typedef struct fs_slice_op_context {
     struct {
         struct {
             bool log_replica;  //false for trunk reclaim
+            struct fs_binlog_write_batch *batch;  //NULL for push directly
         } write_binlog;
         short source;           //for binlog write
         int data_group_id;
@@ -129,6 +142,8 @@ typedef struct fs_slice_op_context {
         int body_len;
         char *body;
         char *buff;  //read or write buffer
+        struct fs_replica_rpc_waiter *chain_waiter;  //for chain replication
+        struct fs_replica_rpc_waiter *rpc_waiter;    //for the write quorum
     } info;
 
     struct {
@@ -151,6 +166,7 @@ typedef struct fs_trunk_file_info {
     volatile int status;
     struct {
         int count;  //slice count
+        int evicted_count;  //slice count in the on-disk tier
         volatile int64_t bytes;
         struct fc_list_head slice_head; //OBSliceEntry double link
     } used;
@@ -158,6 +174,7 @@ typedef struct fs_trunk_file_info {
     int64_t free_start;  //free space offset
 
     struct {
+        char stream;  //the allocation stream which filled this trunk
         struct fs_trunk_file_info *next;
     } alloc;  //for space allocate
 
@@ -112,7 +112,9 @@ int trunk_allocator_init_instance(FSTrunkAllocator *allocator,
 {
     int result;
 
-    if ((result=trunk_freelist_init(&allocator->freelist)) != 0) {
+    if ((result=trunk_freelist_init(&allocator->freelist,
+                    STORAGE_CFG.alloc_cursors_per_path)) != 0)
+    {
         return result;
     }
 
@@ -166,6 +168,7 @@ int trunk_allocator_add(FSTrunkAllocator *allocator,
     trunk_info->size = size;
     trunk_info->used.bytes = 0;
     trunk_info->used.count = 0;
+    trunk_info->used.evicted_count = 0;
     trunk_info->free_start = 0;
     PTHREAD_MUTEX_UNLOCK(&allocator->freelist.lcp.lock);
 
@@ -289,6 +292,40 @@ int trunk_allocator_delete_slice(FSTrunkAllocator *allocator,
     return result;
 }
 
+int trunk_allocator_evict_slice(FSTrunkAllocator *allocator,
+        OBSliceEntry *slice, const bool evict)
+{
+    int result;
+    FSTrunkFileInfo target;
+    FSTrunkFileInfo *trunk_info;
+
+    target.id_info.id = slice->space.id_info.id;
+    PTHREAD_MUTEX_LOCK(&allocator->trunks.lock);
+    if ((trunk_info=(FSTrunkFileInfo *)uniq_skiplist_find(
+                    allocator->trunks.by_id, &target)) == NULL)
+    {
+        logError("file: "__FILE__", line: %d, "
+                "store path index: %d, trunk id: %"PRId64" not exist",
+                __LINE__, allocator->path_info->store.index,
+                slice->space.id_info.id);
+        result = ENOENT;
+    } else {
+        /* keep the used bytes and count, only the slice entry
+         * is moved between memory and the on-disk tier */
+        if (evict) {
+            trunk_info->used.evicted_count++;
+            fc_list_del_init(&slice->dlink);
+        } else {
+            trunk_info->used.evicted_count--;
+            fc_list_add_tail(&slice->dlink, &trunk_info->used.slice_head);
+        }
+        result = 0;
+    }
+    PTHREAD_MUTEX_UNLOCK(&allocator->trunks.lock);
+
+    return result;
+}
+
 static bool can_add_to_freelist(FSTrunkFileInfo *trunk_info)
 {
     int64_t remain_size;
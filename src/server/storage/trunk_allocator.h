@@ -53,6 +53,7 @@ typedef struct {
 
 typedef struct fs_trunk_allocator {
     FSStoragePathInfo *path_info;
+    volatile int select_weight;  //refreshed periodically, bigger is better
     struct {
         UniqSkiplist *by_id;   //order by id
         UniqSkiplist *by_size; //order by used size and id
@@ -114,6 +115,11 @@ extern "C" {
     int trunk_allocator_delete_slice(FSTrunkAllocator *allocator,
             OBSliceEntry *slice);
 
+    /* evict the slice to or restore from the on-disk tier of
+     * the object block index */
+    int trunk_allocator_evict_slice(FSTrunkAllocator *allocator,
+            OBSliceEntry *slice, const bool evict);
+
     FSTrunkFreelistType trunk_allocator_add_to_freelist(
             FSTrunkAllocator *allocator, FSTrunkFileInfo *trunk_info);
 
@@ -24,17 +24,66 @@
 #include "storage_allocator.h"
 #include "trunk_freelist.h"
 
-int trunk_freelist_init(FSTrunkFreelist *freelist)
+static int init_cursor_array(FSTrunkAllocCursorArray *cursors,
+        const int cursor_count)
 {
     int result;
+    int bytes;
+    FSTrunkAllocCursor *cursor;
+    FSTrunkAllocCursor *end;
+
+    bytes = sizeof(FSTrunkAllocCursor) * cursor_count;
+    cursors->entries = (FSTrunkAllocCursor *)fc_malloc(bytes);
+    if (cursors->entries == NULL) {
+        return ENOMEM;
+    }
+    memset(cursors->entries, 0, bytes);
+
+    end = cursors->entries + cursor_count;
+    for (cursor=cursors->entries; cursor<end; cursor++) {
+        if ((result=init_pthread_lock(&cursor->lock)) != 0) {
+            return result;
+        }
+    }
+    cursors->count = cursor_count;
+    return 0;
+}
+
+int trunk_freelist_init(FSTrunkFreelist *freelist,
+        const int cursor_count)
+{
+    int result;
+    int stream;
+
     if ((result=init_pthread_lock_cond_pair(&freelist->lcp)) != 0) {
         return result;
     }
 
+    for (stream=0; stream<FS_ALLOC_STREAM_COUNT; stream++) {
+        if ((result=init_cursor_array(freelist->streams + stream,
+                        (stream == fs_alloc_stream_normal ?
+                         cursor_count : 1))) != 0)
+        {
+            return result;
+        }
+    }
+
     freelist->water_mark_trunks = 2;
     return 0;
 }
 
+#define TRUNK_CURSOR_LOCK(freelist, cursor) \
+    do { \
+        if (pthread_mutex_trylock(&(cursor)->lock) != 0) { \
+            int64_t start_time_us; \
+            start_time_us = get_current_time_us(); \
+            PTHREAD_MUTEX_LOCK(&(cursor)->lock);   \
+            __sync_add_and_fetch(&(freelist)->lock_stat.lock_waits, 1); \
+            __sync_add_and_fetch(&(freelist)->lock_stat.lock_wait_us, \
+                    get_current_time_us() - start_time_us); \
+        } \
+    } while (0)
+
 static inline void push_trunk_util_event_force(FSTrunkAllocator *allocator,
         FSTrunkFileInfo *trunk, const int event)
 {
@@ -108,28 +157,67 @@ void trunk_freelist_add(FSTrunkFreelist *freelist,
             trunk_stat.avail, avail_bytes);
 }
 
-static void trunk_freelist_remove(FSTrunkAllocator *allocator,
+static void trunk_freelist_pop_head(FSTrunkAllocator *allocator,
         FSTrunkFreelist *freelist)
 {
-    FSTrunkFileInfo *trunk_info;
-
-    trunk_info = freelist->head;
     freelist->head = freelist->head->alloc.next;
     if (freelist->head == NULL) {
         freelist->tail = NULL;
     }
     freelist->count--;
 
-    fs_set_trunk_status(trunk_info, FS_TRUNK_STATUS_REPUSH);
-    push_trunk_util_event_force(allocator, trunk_info,
-            FS_TRUNK_UTIL_EVENT_CREATE);
-    fs_set_trunk_status(trunk_info, FS_TRUNK_STATUS_NONE);
-
     if (freelist->count < freelist->water_mark_trunks) {
         trunk_maker_allocate_ex(allocator, true, false, NULL, NULL);
     }
 }
 
+/* give back the unused space of the extent */
+static void trunk_extent_retire(FSTrunkFreelist *freelist,
+        FSTrunkBlockExtent *extent)
+{
+    int64_t remain_bytes;
+
+    if (extent->trunk != NULL) {
+        remain_bytes = extent->end - extent->next;
+        if (remain_bytes > 0) {
+            if (extent->trunk->free_start == extent->end) {
+                /* the last allocation of the trunk, roll back */
+                extent->trunk->free_start = extent->next;
+                __sync_add_and_fetch(&extent->trunk->allocator->path_info->
+                        trunk_stat.avail, remain_bytes);
+            } else {
+                __sync_add_and_fetch(&freelist->extent_stat.
+                        wasted_bytes, remain_bytes);
+            }
+        }
+        extent->trunk = NULL;
+    }
+    extent->in_use = false;
+}
+
+static void trunk_cursor_clear_extents(FSTrunkFreelist *freelist,
+        FSTrunkAllocCursor *cursor)
+{
+    FSTrunkBlockExtent *extent;
+    FSTrunkBlockExtent *end;
+
+    end = cursor->extents + FS_TRUNK_CURSOR_EXTENT_COUNT;
+    for (extent=cursor->extents; extent<end; extent++) {
+        if (extent->trunk != NULL) {
+            trunk_extent_retire(freelist, extent);
+        }
+    }
+}
+
+/* the trunk is used up by the cursor */
+static void trunk_cursor_release(FSTrunkFileInfo *trunk_info)
+{
+    fs_set_trunk_status(trunk_info, FS_TRUNK_STATUS_REPUSH);
+    push_trunk_util_event_force(trunk_info->allocator, trunk_info,
+            FS_TRUNK_UTIL_EVENT_CREATE);
+    fs_set_trunk_status(trunk_info, FS_TRUNK_STATUS_NONE);
+}
+
 static int waiting_avail_trunk(struct fs_trunk_allocator *allocator,
         FSTrunkFreelist *freelist)
 {
@@ -166,31 +254,140 @@ static int waiting_avail_trunk(struct fs_trunk_allocator *allocator,
     return result;
 }
 
+static int trunk_cursor_next(FSTrunkAllocator *allocator,
+        FSTrunkFreelist *freelist, FSTrunkAllocCursor *cursor,
+        const FSAllocStream stream, const bool is_normal)
+{
+    int result;
+
+    PTHREAD_MUTEX_LOCK(&freelist->lcp.lock);
+    do {
+        if (freelist->head == NULL) {
+            if (!is_normal) {
+                result = EAGAIN;
+                break;
+            }
+
+            if ((result=waiting_avail_trunk(allocator, freelist)) != 0) {
+                break;
+            }
+
+            if (freelist->head == NULL) {
+                result = SF_G_CONTINUE_FLAG ? ENOSPC : EINTR;
+                break;
+            }
+        }
+
+        cursor->trunk = freelist->head;
+        cursor->trunk->alloc.stream = stream;
+        trunk_freelist_pop_head(cursor->trunk->allocator, freelist);
+        result = 0;
+    } while (0);
+
+    if (result == ENOSPC && is_normal) {
+        fs_remove_from_avail_aptr_array(&g_allocator_mgr->
+                store_path, allocator);
+    }
+    PTHREAD_MUTEX_UNLOCK(&freelist->lcp.lock);
+
+    return result;
+}
+
+/* the extent slot of the block, return true when the block
+ * writes sequentially, i.e. the block allocated from this slot last time */
+static inline bool trunk_extent_lookup(FSTrunkFreelist *freelist,
+        FSTrunkAllocCursorArray *cursors, FSTrunkAllocCursor *cursor,
+        const FSBlockKey *bkey, const uint32_t blk_hc,
+        FSTrunkBlockExtent **extent)
+{
+    *extent = cursor->extents + (blk_hc / cursors->count) %
+        FS_TRUNK_CURSOR_EXTENT_COUNT;
+    if ((*extent)->in_use && FS_BLOCK_KEY_EQUAL((*extent)->bkey, *bkey)) {
+        return true;
+    }
+
+    trunk_extent_retire(freelist, *extent);
+    (*extent)->in_use = true;
+    (*extent)->bkey = *bkey;
+    return false;
+}
+
 int trunk_freelist_alloc_space(struct fs_trunk_allocator
             *allocator, FSTrunkFreelist *freelist,
-        const uint32_t blk_hc, const int size,
-        FSTrunkSpaceInfo *spaces, int *count, const bool is_normal)
+        const FSBlockKey *bkey, const uint32_t blk_hc,
+        const int size, FSTrunkSpaceInfo *spaces, int *count,
+        const FSAllocStream stream)
 {
+    bool is_normal;
     int aligned_size;
     int result;
     int remain_bytes;
+    bool reserve;
     FSTrunkSpaceInfo *space_info;
     FSTrunkFileInfo *trunk_info;
+    FSTrunkAllocCursorArray *cursors;
+    FSTrunkAllocCursor *cursor;
+    FSTrunkBlockExtent *extent;
 
+    /* the reclaim stream never waits for the trunk creation */
+    is_normal = (stream != fs_alloc_stream_reclaim);
     aligned_size = MEM_ALIGN(size);
     space_info = spaces;
 
-    PTHREAD_MUTEX_LOCK(&freelist->lcp.lock);
+    /* the blocks of a cursor are spread over the data threads, the
+     * cursor lock is held for the short allocation only */
+    cursors = freelist->streams + stream;
+    cursor = cursors->entries + blk_hc % cursors->count;
+    TRUNK_CURSOR_LOCK(freelist, cursor);
     do {
-        if (freelist->head != NULL) {
-            trunk_info = freelist->head;
+        extent = NULL;
+        reserve = false;
+        if (is_normal && STORAGE_CFG.block_extent_size > 0 &&
+                aligned_size < STORAGE_CFG.block_extent_size)
+        {
+            if (trunk_extent_lookup(freelist, cursors,
+                        cursor, bkey, blk_hc, &extent))
+            {
+                if (extent->trunk != NULL && extent->end -
+                        extent->next >= aligned_size)
+                {
+                    space_info->store = &extent->trunk->
+                        allocator->path_info->store;
+                    space_info->id_info = extent->trunk->id_info;
+                    space_info->offset = extent->next;
+                    space_info->size = aligned_size;
+                    extent->next += aligned_size;
+                    __sync_add_and_fetch(&freelist->extent_stat.hits, 1);
+
+                    result = 0;
+                    *count = 1;
+                    break;
+                }
+
+                /* the second write of the block or the extent used up */
+                trunk_extent_retire(freelist, extent);
+                extent->in_use = true;
+                extent->bkey = *bkey;
+                reserve = true;
+            }
+        }
+
+        if (cursor->trunk != NULL) {
+            trunk_info = cursor->trunk;
             remain_bytes = FS_TRUNK_AVAIL_SPACE(trunk_info);
             if (remain_bytes < aligned_size) {
-                if (!is_normal && freelist->count <= 1) {
+                /* the trunk of the cursor is popped from the freelist,
+                 * so no trunk follows when the freelist is empty */
+                if (!is_normal && freelist->count == 0) {
                     result = EAGAIN;
                     break;
                 }
-                
+
+                trunk_cursor_clear_extents(freelist, cursor);
+                remain_bytes = FS_TRUNK_AVAIL_SPACE(trunk_info);
+            }
+
+            if (remain_bytes < aligned_size) {
                 if (remain_bytes <= 0) {
                     logInfo("allocator: %p, trunk_info: %p, "
                             "trunk size: %"PRId64", free start: %"PRId64
@@ -204,51 +401,61 @@ int trunk_freelist_alloc_space(struct fs_trunk_allocator
                 space_info++;
 
                 aligned_size -= remain_bytes;
-                trunk_freelist_remove(trunk_info->allocator, freelist);
+                cursor->trunk = NULL;
+                trunk_cursor_release(trunk_info);
+                reserve = false;
             }
         }
 
-        if (freelist->head == NULL) {
-            if (!is_normal) {
-                result = EAGAIN;
-                break;
-            }
-
-            if ((result=waiting_avail_trunk(allocator, freelist)) != 0) {
+        if (cursor->trunk == NULL) {
+            if ((result=trunk_cursor_next(allocator, freelist,
+                            cursor, stream, is_normal)) != 0)
+            {
                 break;
             }
         }
 
-        if (freelist->head == NULL) {
-            result = SF_G_CONTINUE_FLAG ? ENOSPC : EINTR;
-            break;
-        }
-
-        trunk_info = freelist->head;
+        trunk_info = cursor->trunk;
         if (aligned_size > FS_TRUNK_AVAIL_SPACE(trunk_info)) {
             result = EAGAIN;
             break;
         }
 
-        TRUNK_ALLOC_SPACE(trunk_info, space_info, aligned_size);
+        if (reserve && FS_TRUNK_AVAIL_SPACE(trunk_info) >=
+                2 * STORAGE_CFG.block_extent_size)
+        {
+            /* reserve the extent for the following writes of the block */
+            TRUNK_ALLOC_SPACE(trunk_info, space_info,
+                    STORAGE_CFG.block_extent_size);
+            space_info->size = aligned_size;
+            extent->trunk = trunk_info;
+            extent->next = space_info->offset + aligned_size;
+            extent->end = space_info->offset +
+                STORAGE_CFG.block_extent_size;
+            __sync_add_and_fetch(&freelist->extent_stat.reserves, 1);
+        } else {
+            TRUNK_ALLOC_SPACE(trunk_info, space_info, aligned_size);
+        }
         space_info++;
+
         if (FS_TRUNK_AVAIL_SPACE(trunk_info) <
                 STORAGE_CFG.discard_remain_space_size)
         {
-            trunk_freelist_remove(allocator, freelist);
-            __sync_sub_and_fetch(&allocator->path_info->
-                    trunk_stat.avail, FS_TRUNK_AVAIL_SPACE(trunk_info));
+            trunk_cursor_clear_extents(freelist, cursor);
+            if (FS_TRUNK_AVAIL_SPACE(trunk_info) <
+                    STORAGE_CFG.discard_remain_space_size)
+            {
+                cursor->trunk = NULL;
+                trunk_cursor_release(trunk_info);
+                __sync_sub_and_fetch(&trunk_info->allocator->path_info->
+                        trunk_stat.avail, FS_TRUNK_AVAIL_SPACE(trunk_info));
+            }
         }
 
         result = 0;
         *count = space_info - spaces;
     } while (0);
-
-    if (result == ENOSPC && is_normal) {
-        fs_remove_from_avail_aptr_array(&g_allocator_mgr->
-                store_path, allocator);
-    }
-    PTHREAD_MUTEX_UNLOCK(&freelist->lcp.lock);
+    PTHREAD_MUTEX_UNLOCK(&cursor->lock);
 
     return result;
 }
@@ -19,20 +19,60 @@
 
 #include "storage_types.h"
 
+#define FS_TRUNK_CURSOR_EXTENT_COUNT  16
+
 struct fs_trunk_allocator;
+
+/* the extent reserved for the sequential writes of one block */
+typedef struct {
+    bool in_use;
+    FSBlockKey bkey;
+    FSTrunkFileInfo *trunk;  //NULL for no reservation yet
+    int64_t next;  //the next offset to allocate
+    int64_t end;   //the end offset of the extent
+} FSTrunkBlockExtent;
+
+typedef struct {
+    FSTrunkFileInfo *trunk;  //the current trunk taken from the freelist
+    pthread_mutex_t lock;
+    FSTrunkBlockExtent extents[FS_TRUNK_CURSOR_EXTENT_COUNT];
+} FSTrunkAllocCursor;
+
+typedef struct {
+    int count;
+    FSTrunkAllocCursor *entries;
+} FSTrunkAllocCursorArray;
+
+typedef struct {
+    volatile int64_t lock_waits;    //contention count of the cursor lock
+    volatile int64_t lock_wait_us;  //wait time in microseconds
+    int64_t last_lock_waits;        //for stat log
+    int64_t last_lock_wait_us;      //for stat log
+} FSTrunkAllocLockStat;
+
 typedef struct {
     int count;
     int water_mark_trunks;
     FSTrunkFileInfo *head;  //allocate from head
     FSTrunkFileInfo *tail;  //push to tail
     pthread_lock_cond_pair_t lcp;  //for lock and notify
+    FSTrunkAllocCursorArray streams[FS_ALLOC_STREAM_COUNT]; //cursors by stream
+    FSTrunkAllocLockStat lock_stat;
+    struct {
+        volatile int64_t reserves;  //extent reserve count
+        volatile int64_t hits;      //allocate from the reserved extent
+        volatile int64_t wasted_bytes;  //the unused space of the extents
+    } extent_stat;
 } FSTrunkFreelist;
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-    int trunk_freelist_init(FSTrunkFreelist *freelist);
+    /* cursor_count: the cursor count of the normal stream,
+     * the other streams own one cursor */
+    int trunk_freelist_init(FSTrunkFreelist *freelist,
+            const int cursor_count);
 
     void trunk_freelist_keep_water_mark(struct fs_trunk_allocator
             *allocator);
@@ -40,10 +80,13 @@ extern "C" {
     void trunk_freelist_add(FSTrunkFreelist *freelist,
             FSTrunkFileInfo *trunk_info);
 
+    /* blk_hc: the block hash code without the part used by the
+     * store path selection, for choosing the cursor and the extent */
     int trunk_freelist_alloc_space(struct fs_trunk_allocator
             *allocator, FSTrunkFreelist *freelist,
-            const uint32_t blk_hc, const int size,
-            FSTrunkSpaceInfo *spaces, int *count, const bool is_normal);
+            const FSBlockKey *bkey, const uint32_t blk_hc,
+            const int size, FSTrunkSpaceInfo *spaces, int *count,
+            const FSAllocStream stream);
 
 #ifdef __cplusplus
 }
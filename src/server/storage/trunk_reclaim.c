@@ -48,6 +48,7 @@ int trunk_reclaim_init_ctx(TrunkReclaimContext *rctx)
     ob_index_init_slice_ptr_array(&rctx->op_ctx.slice_ptr_array);
     rctx->op_ctx.info.source = BINLOG_SOURCE_RECLAIM;
     rctx->op_ctx.info.write_binlog.log_replica = false;
+    rctx->op_ctx.info.write_binlog.batch = NULL;
     rctx->op_ctx.info.data_version = 0;
     rctx->op_ctx.info.myself = NULL;
     rctx->buffer_size = 256 * 1024;
@@ -374,6 +375,15 @@ int trunk_reclaim(FSTrunkAllocator *allocator, FSTrunkFileInfo *trunk,
         TrunkReclaimContext *rctx)
 {
     int result;
+    int64_t used_bytes;
+
+    if (trunk->used.evicted_count > 0) {
+        if ((result=ob_index_load_trunk_slices(&allocator->path_info->
+                        store, &trunk->id_info)) != 0)
+        {
+            return result;
+        }
+    }
 
     if ((result=convert_to_rs_array(allocator, trunk, &rctx->sarray)) != 0) {
         return result;
@@ -383,9 +393,11 @@ int trunk_reclaim(FSTrunkAllocator *allocator, FSTrunkFileInfo *trunk,
         return result;
     }
 
+    used_bytes = __sync_add_and_fetch(&trunk->used.bytes, 0);
     if ((result=migrate_blocks(rctx)) != 0) {
         return result;
     }
 
+    storage_allocator_stream_migrated(trunk, used_bytes);
     return 0;
 }
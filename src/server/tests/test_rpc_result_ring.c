@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2020 YuQing <384681@qq.com>
+ *
+ * This program is free software: you can use, redistribute, and/or modify
+ * it under the terms of the GNU Affero General Public License, version 3
+ * or later ("AGPL"), as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include "fastcommon/logger.h"
+#include "fastcommon/sched_thread.h"
+#include "sf/sf_global.h"
+#include "replication/rpc_result_ring.h"
+
+#define TEST_DATA_GROUP_ID     1
+#define TEST_RING_SIZE        16
+#define TEST_OVERFLOW_COUNT 3000
+
+static int add_versions(FSReplicaRPCResultContext *ctx,
+        const uint64_t start_version, const uint64_t end_version)
+{
+    uint64_t data_version;
+    int result;
+
+    for (data_version=start_version; data_version<=end_version;
+            data_version++)
+    {
+        if ((result=rpc_result_ring_add(ctx, TEST_DATA_GROUP_ID,
+                        data_version, NULL, get_current_time_us(),
+                        1024)) != 0)
+        {
+            printf("add data version: %"PRId64" fail, errno: %d\n",
+                    data_version, result);
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static int check_value(const char *caption,
+        const int64_t value, const int64_t expect)
+{
+    if (value != expect) {
+        printf("%s: %"PRId64" != expect: %"PRId64"\n",
+                caption, value, expect);
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+/* the contiguous versions are in the ring until the ring is full,
+ * the others are in the overflow queue whose hashtable expands */
+static int test_overflow(FSReplicaRPCResultContext *ctx)
+{
+    FSReplicaRPCResultInstance *instance;
+    uint64_t data_version;
+    uint64_t last_version;
+    int result;
+
+    instance = ctx->instances;
+    last_version = TEST_RING_SIZE - 1;
+    if ((result=add_versions(ctx, 1, last_version)) != 0) {
+        return result;
+    }
+    if ((result=check_value("ring overflows", ctx->overflows, 0)) != 0) {
+        return result;
+    }
+
+    /* the ring is full */
+    if ((result=add_versions(ctx, last_version + 1, last_version +
+                    TEST_OVERFLOW_COUNT)) != 0)
+    {
+        return result;
+    }
+    last_version += TEST_OVERFLOW_COUNT;
+    if ((result=check_value("queue overflows", ctx->overflows,
+                    TEST_OVERFLOW_COUNT)) != 0)
+    {
+        return result;
+    }
+    if ((result=check_value("queue count", instance->queue.count,
+                    TEST_OVERFLOW_COUNT)) != 0)
+    {
+        return result;
+    }
+
+    /* expanded from 1024 when the queue count reaches 2048 */
+    if ((result=check_value("htable capacity", instance->queue.
+                    htable.capacity, 2048)) != 0)
+    {
+        return result;
+    }
+    if ((result=check_value("waiting count", ctx->waiting_count,
+                    last_version)) != 0)
+    {
+        return result;
+    }
+
+    /* the responses arrive out of order */
+    for (data_version=last_version; data_version>=1; data_version--) {
+        if ((result=rpc_result_ring_remove(ctx, TEST_DATA_GROUP_ID,
+                        data_version)) != 0)
+        {
+            printf("remove data version: %"PRId64" fail, errno: %d\n",
+                    data_version, result);
+            return result;
+        }
+    }
+
+    if ((result=rpc_result_ring_remove(ctx, TEST_DATA_GROUP_ID, 1))
+            != ENOENT)
+    {
+        printf("remove the removed data version, errno: %d != "
+                "ENOENT: %d\n", result, ENOENT);
+        return EINVAL;
+    }
+
+    if ((result=check_value("waiting count", ctx->waiting_count, 0)) != 0) {
+        return result;
+    }
+    if ((result=check_value("queue count", instance->queue.count, 0)) != 0) {
+        return result;
+    }
+    if (instance->queue.head != NULL || instance->queue.tail != NULL) {
+        printf("the queue is NOT empty\n");
+        return EINVAL;
+    }
+    if (instance->ring.start != instance->ring.end) {
+        printf("the ring is NOT empty\n");
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+/* the version which is NOT the next of the ring end goes to the queue */
+static int test_gap(FSReplicaRPCResultContext *ctx)
+{
+    int64_t overflows;
+    int result;
+
+    overflows = ctx->overflows;
+    if ((result=add_versions(ctx, 10001, 10002)) != 0) {
+        return result;
+    }
+    if ((result=add_versions(ctx, 10005, 10005)) != 0) {
+        return result;
+    }
+    if ((result=check_value("gap overflows", ctx->overflows,
+                    overflows + 1)) != 0)
+    {
+        return result;
+    }
+
+    /* the ring start skips the removed entries */
+    if ((result=rpc_result_ring_remove(ctx, TEST_DATA_GROUP_ID,
+                    10002)) != 0)
+    {
+        return result;
+    }
+    if ((result=rpc_result_ring_remove(ctx, TEST_DATA_GROUP_ID,
+                    10001)) != 0)
+    {
+        return result;
+    }
+    if (ctx->instances->ring.start != ctx->instances->ring.end) {
+        printf("the ring is NOT empty after the removes\n");
+        return EINVAL;
+    }
+
+    if ((result=rpc_result_ring_remove(ctx, TEST_DATA_GROUP_ID,
+                    10005)) != 0)
+    {
+        return result;
+    }
+    return check_value("waiting count", ctx->waiting_count, 0);
+}
+
+/* the entry acked out of order is NOT done again
+ * by the timeout check or the clear all */
+static int test_acked_middle(FSReplicaRPCResultContext *ctx)
+{
+    int64_t timeouts;
+    int result;
+
+    timeouts = ctx->timeouts;
+    if ((result=add_versions(ctx, 20001, 20003)) != 0) {
+        return result;
+    }
+    if ((result=rpc_result_ring_remove(ctx, TEST_DATA_GROUP_ID,
+                    20002)) != 0)
+    {
+        return result;
+    }
+
+    g_current_time += SF_G_NETWORK_TIMEOUT + 1;
+    rpc_result_ring_clear_timeouts(ctx);
+    if ((result=check_value("timeout waiting count",
+                    ctx->waiting_count, 0)) != 0)
+    {
+        return result;
+    }
+    if ((result=check_value("timeout waiting bytes",
+                    ctx->waiting_bytes, 0)) != 0)
+    {
+        return result;
+    }
+    if ((result=check_value("timeouts", ctx->timeouts,
+                    timeouts + 2)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=add_versions(ctx, 30001, 30003)) != 0) {
+        return result;
+    }
+    if ((result=rpc_result_ring_remove(ctx, TEST_DATA_GROUP_ID,
+                    30002)) != 0)
+    {
+        return result;
+    }
+
+    rpc_result_ring_clear_all(ctx);
+    if ((result=check_value("clear all waiting count",
+                    ctx->waiting_count, 0)) != 0)
+    {
+        return result;
+    }
+    return check_value("clear all waiting bytes", ctx->waiting_bytes, 0);
+}
+
+int main(int argc, char *argv[])
+{
+    FSReplicaRPCResultContext ctx;
+    int result;
+
+    log_init();
+    g_current_time = time(NULL);
+    memset(&ctx, 0, sizeof(ctx));
+    if ((result=rpc_result_ring_init_ex(&ctx, TEST_DATA_GROUP_ID,
+                    1, TEST_RING_SIZE)) != 0)
+    {
+        return result;
+    }
+
+    if ((result=test_overflow(&ctx)) == 0 &&
+            (result=test_gap(&ctx)) == 0)
+    {
+        result = test_acked_middle(&ctx);
+    }
+
+    rpc_result_ring_clear_all(&ctx);
+    rpc_result_ring_destroy(&ctx);
+    if (result == 0) {
+        printf("test rpc result ring OK\n");
+    }
+    return result;
+}